@@ -1813,7 +1813,7 @@ aspath_key_make (void *p)
   if (!aspath->str)
     aspath_str_update (aspath);
   
-  key = jhash (aspath->str, strlen(aspath->str), 2334325);
+  key = jhash (aspath->str, strlen(aspath->str), jhash_seed ());
 
   return key;
 }
@@ -1848,6 +1848,7 @@ void
 aspath_init (void)
 {
   ashash = hash_create_size (32767, aspath_key_make, aspath_cmp);
+  hash_set_name (ashash, "BGP AS Path");
 }
 
 void
@@ -130,7 +130,7 @@ cluster_hash_key_make (void *p)
 {
   const struct cluster_list *cluster = p;
 
-  return jhash(cluster->list, cluster->length, 0);
+  return jhash(cluster->list, cluster->length, jhash_seed ());
 }
 
 static int
@@ -200,6 +200,7 @@ static void
 cluster_init (void)
 {
   cluster_hash = hash_create (cluster_hash_key_make, cluster_hash_cmp);
+  hash_set_name (cluster_hash, "BGP Cluster");
 }
 
 static void
@@ -259,7 +260,7 @@ transit_hash_key_make (void *p)
 {
   const struct transit * transit = p;
 
-  return jhash(transit->val, transit->length, 0);
+  return jhash(transit->val, transit->length, jhash_seed ());
 }
 
 static int
@@ -276,6 +277,7 @@ static void
 transit_init (void)
 {
   transit_hash = hash_create (transit_hash_key_make, transit_hash_cmp);
+  hash_set_name (transit_hash, "BGP Transit");
 }
 
 static void
@@ -343,7 +345,7 @@ unsigned int
 attrhash_key_make (void *p)
 {
   const struct attr * attr = (struct attr *) p;
-  uint32_t key = 0;
+  uint32_t key = jhash_seed ();
 #define MIX(val)	key = jhash_1word(val, key)
 
   MIX(attr->origin);
@@ -351,11 +353,6 @@ attrhash_key_make (void *p)
   MIX(attr->med);
   MIX(attr->local_pref);
 
-  key += attr->origin;
-  key += attr->nexthop.s_addr;
-  key += attr->med;
-  key += attr->local_pref;
-  
   if (attr->extra)
     {
       MIX(attr->extra->aggregator_as);
@@ -432,6 +429,7 @@ static void
 attrhash_init (void)
 {
   attrhash = hash_create (attrhash_key_make, attrhash_cmp);
+  hash_set_name (attrhash, "BGP Attributes");
 }
 
 static void
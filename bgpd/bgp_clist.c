@@ -23,6 +23,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "prefix.h"
 #include "memory.h"
+#include "routemap.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_community.h"
@@ -236,6 +237,8 @@ community_list_delete (struct community_list *list)
   struct community_list_list *clist;
   struct community_entry *entry, *next;
 
+  route_map_cache_flush ();
+
   for (entry = list->head; entry; entry = next)
     {
       next = entry->next;
@@ -268,6 +271,9 @@ static void
 community_list_entry_add (struct community_list *list,
                           struct community_entry *entry)
 {
+  /* Route-map match clauses may refer to the list. */
+  route_map_cache_flush ();
+
   entry->next = NULL;
   entry->prev = list->tail;
 
@@ -283,6 +289,8 @@ static void
 community_list_entry_delete (struct community_list *list,
                              struct community_entry *entry, int style)
 {
+  route_map_cache_flush ();
+
   if (entry->next)
     entry->next->prev = entry->prev;
   else
@@ -21,6 +21,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include <kroute.h>
 
 #include "hash.h"
+#include "jhash.h"
 #include "memory.h"
 
 #include "bgpd/bgp_community.h"
@@ -394,17 +395,7 @@ community_str (struct community *com)
 unsigned int
 community_hash_make (struct community *com)
 {
-  int c;
-  unsigned int key;
-  unsigned char *pnt;
-
-  key = 0;
-  pnt = (unsigned char *)com->val;
-  
-  for(c = 0; c < com->size * 4; c++)
-    key += pnt[c];
-      
-  return key;
+  return jhash2 (com->val, com->size, jhash_seed ());
 }
 
 int
@@ -636,6 +627,7 @@ community_init (void)
 {
   comhash = hash_create ((unsigned int (*) (void *))community_hash_make,
 			 (int (*) (const void *, const void *))community_cmp);
+  hash_set_name (comhash, "BGP Community");
 }
 
 void
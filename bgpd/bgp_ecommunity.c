@@ -21,6 +21,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include <kroute.h>
 
 #include "hash.h"
+#include "jhash.h"
 #include "memory.h"
 #include "prefix.h"
 #include "command.h"
@@ -233,17 +234,8 @@ unsigned int
 ecommunity_hash_make (void *arg)
 {
   const struct ecommunity *ecom = arg;
-  int c;
-  unsigned int key;
-  u_int8_t *pnt;
-
-  key = 0;
-  pnt = ecom->val;
-  
-  for (c = 0; c < ecom->size * ECOMMUNITY_SIZE; c++)
-    key += pnt[c];
 
-  return key;
+  return jhash (ecom->val, ecom->size * ECOMMUNITY_SIZE, jhash_seed ());
 }
 
 /* Compare two Extended Communities Attribute structure.  */
@@ -262,6 +254,7 @@ void
 ecommunity_init (void)
 {
   ecomhash = hash_create (ecommunity_hash_make, ecommunity_cmp);
+  hash_set_name (ecomhash, "BGP Extended Community");
 }
 
 void
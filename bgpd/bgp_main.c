@@ -42,7 +42,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_dump.h"
+#include "bgpd/bgp_table.h"
 #include "bgpd/bgp_route.h"
+#include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_nexthop.h"
 #include "bgpd/bgp_regex.h"
 #include "bgpd/bgp_clist.h"
@@ -337,6 +339,12 @@ main (int argc, char **argv)
   zlog_default = openzlog (progname, ZLOG_BGP,
 			   LOG_CONS|LOG_NDELAY|LOG_PID, LOG_DAEMON);
 
+  /* Pool the objects churned by table updates. */
+  memory_pool_enable (MTYPE_BGP_NODE, BGP_NODE_SIZE (AF_INET));
+  memory_pool_enable (MTYPE_BGP_NODE_IPV6, BGP_NODE_SIZE (AF_INET6));
+  memory_pool_enable (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  memory_pool_enable (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
+
   /* BGP master init. */
   bgp_master_init ();
 
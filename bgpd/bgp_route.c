@@ -1064,10 +1064,14 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_OUT); 
 
+      /* The attributes cacheable match rules look at are not changed
+	 above, so riattr stands for them. */
       if (ri->extra && ri->extra->suppress)
-	ret = route_map_apply (UNSUPPRESS_MAP (filter), p, RMAP_BGP, &info);
+	ret = route_map_apply_cached (UNSUPPRESS_MAP (filter), p, RMAP_BGP,
+				      &info, riattr);
       else
-	ret = route_map_apply (ROUTE_MAP_OUT (filter), p, RMAP_BGP, &info);
+	ret = route_map_apply_cached (ROUTE_MAP_OUT (filter), p, RMAP_BGP,
+				      &info, riattr);
 
       peer->rmap_type = 0;
       
@@ -6098,227 +6102,327 @@ enum bgp_show_type
   bgp_show_type_damp_neighbor
 };
 
-static int
-bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
-	  enum bgp_show_type type, void *output_arg)
+/* State of a "show ip bgp" table walk. */
+struct bgp_show_walk
 {
-  struct bgp_info *ri;
+  struct bgp_table *table;
+
+  /* Next node to show, locked. */
   struct bgp_node *rn;
-  int header = 1;
-  int display;
+
+  struct in_addr router_id;
+  enum bgp_show_type type;
+  void *output_arg;
+  int header;
   unsigned long output_count;
 
-  /* This is first entry point, so reset total line. */
-  output_count = 0;
+  /* Private copy of a by-value output_arg, so the walk can outlive the
+     command that started it. */
+  union
+  {
+    struct prefix p;
+    union sockunion su;
+  } arg;
+};
 
-  /* Start processing of routes. */
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn)) 
-    if (rn->info != NULL)
-      {
-	display = 0;
+/* Show the routes of one node, return how many were displayed. */
+static int
+bgp_show_node (struct vty *vty, struct bgp_show_walk *walk,
+	       struct bgp_node *rn)
+{
+  struct bgp_info *ri;
+  enum bgp_show_type type = walk->type;
+  void *output_arg = walk->output_arg;
+  int display = 0;
 
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (type == bgp_show_type_flap_statistics
-		|| type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix
-		|| type == bgp_show_type_flap_cidr_only
-		|| type == bgp_show_type_flap_regexp
-		|| type == bgp_show_type_flap_filter_list
-		|| type == bgp_show_type_flap_prefix_list
-		|| type == bgp_show_type_flap_prefix_longer
-		|| type == bgp_show_type_flap_route_map
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (!(ri->extra && ri->extra->damp_info))
-		  continue;
-	      }
-	    if (type == bgp_show_type_regexp
-		|| type == bgp_show_type_flap_regexp)
-	      {
-		regex_t *regex = output_arg;
-		    
-		if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_list
-		|| type == bgp_show_type_flap_prefix_list)
-	      {
-		struct prefix_list *plist = output_arg;
-		    
-		if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_filter_list
-		|| type == bgp_show_type_flap_filter_list)
-	      {
-		struct as_list *as_list = output_arg;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (type == bgp_show_type_flap_statistics
+	  || type == bgp_show_type_flap_address
+	  || type == bgp_show_type_flap_prefix
+	  || type == bgp_show_type_flap_cidr_only
+	  || type == bgp_show_type_flap_regexp
+	  || type == bgp_show_type_flap_filter_list
+	  || type == bgp_show_type_flap_prefix_list
+	  || type == bgp_show_type_flap_prefix_longer
+	  || type == bgp_show_type_flap_route_map
+	  || type == bgp_show_type_flap_neighbor
+	  || type == bgp_show_type_dampend_paths
+	  || type == bgp_show_type_damp_neighbor)
+	{
+	  if (!(ri->extra && ri->extra->damp_info))
+	    continue;
+	}
+      if (type == bgp_show_type_regexp
+	  || type == bgp_show_type_flap_regexp)
+	{
+	  regex_t *regex = output_arg;
 
-		if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_route_map
-		|| type == bgp_show_type_flap_route_map)
-	      {
-		struct route_map *rmap = output_arg;
-		struct bgp_info binfo;
-		struct attr dummy_attr = { 0 }; 
-		int ret;
-
-		bgp_attr_dup (&dummy_attr, ri->attr);
-		binfo.peer = ri->peer;
-		binfo.attr = &dummy_attr;
-
-		ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
-		
-		bgp_attr_extra_free (&dummy_attr);
-		
-		if (ret == RMAP_DENYMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_neighbor
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		union sockunion *su = output_arg;
+	  if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
+	    continue;
+	}
+      if (type == bgp_show_type_prefix_list
+	  || type == bgp_show_type_flap_prefix_list)
+	{
+	  struct prefix_list *plist = output_arg;
 
-		if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
-		  continue;
-	      }
-	    if (type == bgp_show_type_cidr_only
-		|| type == bgp_show_type_flap_cidr_only)
-	      {
-		u_int32_t destination;
-
-		destination = ntohl (rn->p.u.prefix4.s_addr);
-		if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
-		  continue;
-		if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
-		  continue;
-		if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_longer
-		|| type == bgp_show_type_flap_prefix_longer)
-	      {
-		struct prefix *p = output_arg;
+	  if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
+	    continue;
+	}
+      if (type == bgp_show_type_filter_list
+	  || type == bgp_show_type_flap_filter_list)
+	{
+	  struct as_list *as_list = output_arg;
 
-		if (! prefix_match (p, &rn->p))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_all)
-	      {
-		if (! ri->attr->community)
-		  continue;
-	      }
-	    if (type == bgp_show_type_community)
-	      {
-		struct community *com = output_arg;
+	  if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
+	    continue;
+	}
+      if (type == bgp_show_type_route_map
+	  || type == bgp_show_type_flap_route_map)
+	{
+	  struct route_map *rmap = output_arg;
+	  struct bgp_info binfo;
+	  struct attr dummy_attr = { 0 }; 
+	  int ret;
 
-		if (! ri->attr->community ||
-		    ! community_match (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_exact)
-	      {
-		struct community *com = output_arg;
+	  bgp_attr_dup (&dummy_attr, ri->attr);
+	  binfo.peer = ri->peer;
+	  binfo.attr = &dummy_attr;
 
-		if (! ri->attr->community ||
-		    ! community_cmp (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list)
-	      {
-		struct community_list *list = output_arg;
+	  ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
 
-		if (! community_list_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list_exact)
-	      {
-		struct community_list *list = output_arg;
+	  bgp_attr_extra_free (&dummy_attr);
 
-		if (! community_list_exact_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix)
-	      {
-		struct prefix *p = output_arg;
+	  if (ret == RMAP_DENYMATCH)
+	    continue;
+	}
+      if (type == bgp_show_type_neighbor
+	  || type == bgp_show_type_flap_neighbor
+	  || type == bgp_show_type_damp_neighbor)
+	{
+	  union sockunion *su = output_arg;
 
-		if (! prefix_match (&rn->p, p))
-		  continue;
+	  if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
+	    continue;
+	}
+      if (type == bgp_show_type_cidr_only
+	  || type == bgp_show_type_flap_cidr_only)
+	{
+	  u_int32_t destination;
 
-		if (type == bgp_show_type_flap_prefix)
-		  if (p->prefixlen != rn->p.prefixlen)
-		    continue;
-	      }
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
-		    || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
-		  continue;
-	      }
+	  destination = ntohl (rn->p.u.prefix4.s_addr);
+	  if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
+	    continue;
+	  if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
+	    continue;
+	  if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
+	    continue;
+	}
+      if (type == bgp_show_type_prefix_longer
+	  || type == bgp_show_type_flap_prefix_longer)
+	{
+	  struct prefix *p = output_arg;
 
-	    if (header)
-	      {
-		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (*router_id), VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		if (type == bgp_show_type_dampend_paths
-		    || type == bgp_show_type_damp_neighbor)
-		  vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
-		else if (type == bgp_show_type_flap_statistics
-			 || type == bgp_show_type_flap_address
-			 || type == bgp_show_type_flap_prefix
-			 || type == bgp_show_type_flap_cidr_only
-			 || type == bgp_show_type_flap_regexp
-			 || type == bgp_show_type_flap_filter_list
-			 || type == bgp_show_type_flap_prefix_list
-			 || type == bgp_show_type_flap_prefix_longer
-			 || type == bgp_show_type_flap_route_map
-			 || type == bgp_show_type_flap_neighbor)
-		  vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
-		else
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		header = 0;
-	      }
+	  if (! prefix_match (p, &rn->p))
+	    continue;
+	}
+      if (type == bgp_show_type_community_all)
+	{
+	  if (! ri->attr->community)
+	    continue;
+	}
+      if (type == bgp_show_type_community)
+	{
+	  struct community *com = output_arg;
 
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else if (type == bgp_show_type_flap_statistics
-		     || type == bgp_show_type_flap_address
-		     || type == bgp_show_type_flap_prefix
-		     || type == bgp_show_type_flap_cidr_only
-		     || type == bgp_show_type_flap_regexp
-		     || type == bgp_show_type_flap_filter_list
-		     || type == bgp_show_type_flap_prefix_list
-		     || type == bgp_show_type_flap_prefix_longer
-		     || type == bgp_show_type_flap_route_map
-		     || type == bgp_show_type_flap_neighbor)
-	      flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else
-	      route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    display++;
-	  }
-	if (display)
-	  output_count++;
-      }
+	  if (! ri->attr->community ||
+	      ! community_match (ri->attr->community, com))
+	    continue;
+	}
+      if (type == bgp_show_type_community_exact)
+	{
+	  struct community *com = output_arg;
+
+	  if (! ri->attr->community ||
+	      ! community_cmp (ri->attr->community, com))
+	    continue;
+	}
+      if (type == bgp_show_type_community_list)
+	{
+	  struct community_list *list = output_arg;
+
+	  if (! community_list_match (ri->attr->community, list))
+	    continue;
+	}
+      if (type == bgp_show_type_community_list_exact)
+	{
+	  struct community_list *list = output_arg;
+
+	  if (! community_list_exact_match (ri->attr->community, list))
+	    continue;
+	}
+      if (type == bgp_show_type_flap_address
+	  || type == bgp_show_type_flap_prefix)
+	{
+	  struct prefix *p = output_arg;
+
+	  if (! prefix_match (&rn->p, p))
+	    continue;
+
+	  if (type == bgp_show_type_flap_prefix)
+	    if (p->prefixlen != rn->p.prefixlen)
+	      continue;
+	}
+      if (type == bgp_show_type_dampend_paths
+	  || type == bgp_show_type_damp_neighbor)
+	{
+	  if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
+	      || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
+	    continue;
+	}
+
+      if (walk->header)
+	{
+	  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (walk->router_id), VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  if (type == bgp_show_type_dampend_paths
+	      || type == bgp_show_type_damp_neighbor)
+	    vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
+	  else if (type == bgp_show_type_flap_statistics
+		   || type == bgp_show_type_flap_address
+		   || type == bgp_show_type_flap_prefix
+		   || type == bgp_show_type_flap_cidr_only
+		   || type == bgp_show_type_flap_regexp
+		   || type == bgp_show_type_flap_filter_list
+		   || type == bgp_show_type_flap_prefix_list
+		   || type == bgp_show_type_flap_prefix_longer
+		   || type == bgp_show_type_flap_route_map
+		   || type == bgp_show_type_flap_neighbor)
+	    vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
+	  else
+	    vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+	  walk->header = 0;
+	}
+
+      if (type == bgp_show_type_dampend_paths
+	  || type == bgp_show_type_damp_neighbor)
+	damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      else if (type == bgp_show_type_flap_statistics
+	       || type == bgp_show_type_flap_address
+	       || type == bgp_show_type_flap_prefix
+	       || type == bgp_show_type_flap_cidr_only
+	       || type == bgp_show_type_flap_regexp
+	       || type == bgp_show_type_flap_filter_list
+	       || type == bgp_show_type_flap_prefix_list
+	       || type == bgp_show_type_flap_prefix_longer
+	       || type == bgp_show_type_flap_route_map
+	       || type == bgp_show_type_flap_neighbor)
+	flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      else
+	route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      display++;
+    }
+
+  return display;
+}
+
+static int
+bgp_show_walk_step (struct vty *vty, void *arg)
+{
+  struct bgp_show_walk *walk = arg;
+  int count;
+
+  for (count = 0; walk->rn && count < VTY_WALK_SLICE;
+       walk->rn = bgp_route_next (walk->rn), count++)
+    if (walk->rn->info != NULL && bgp_show_node (vty, walk, walk->rn))
+      walk->output_count++;
+
+  if (walk->rn)
+    return VTY_WALK_MORE;
 
   /* No route is displayed */
-  if (output_count == 0)
+  if (walk->output_count == 0)
     {
-      if (type == bgp_show_type_normal)
+      if (walk->type == bgp_show_type_normal)
 	vty_out (vty, "No BGP network exists%s", VTY_NEWLINE);
     }
   else
     vty_out (vty, "%sTotal number of prefixes %ld%s",
-	     VTY_NEWLINE, output_count, VTY_NEWLINE);
+	     VTY_NEWLINE, walk->output_count, VTY_NEWLINE);
+
+  return VTY_WALK_DONE;
+}
+
+static void
+bgp_show_walk_done (struct vty *vty, void *arg)
+{
+  struct bgp_show_walk *walk = arg;
+
+  if (walk->rn)
+    bgp_unlock_node (walk->rn);
+  bgp_table_unlock (walk->table);
+  XFREE (MTYPE_VTY_WALK, walk);
+}
+
+/* Take a copy of output_arg if it is a plain value.  Filters that refer
+   to other objects (regular expressions, communities, named lists and
+   route-maps) can change or go away between steps, so those walks are
+   not resumable. */
+static int
+bgp_show_walk_arg (struct bgp_show_walk *walk, void *output_arg)
+{
+  switch (walk->type)
+    {
+    case bgp_show_type_normal:
+    case bgp_show_type_cidr_only:
+    case bgp_show_type_community_all:
+    case bgp_show_type_flap_statistics:
+    case bgp_show_type_flap_cidr_only:
+    case bgp_show_type_dampend_paths:
+      walk->output_arg = NULL;
+      return 1;
+    case bgp_show_type_prefix_longer:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+    case bgp_show_type_flap_prefix_longer:
+      prefix_copy (&walk->arg.p, output_arg);
+      walk->output_arg = &walk->arg.p;
+      return 1;
+    case bgp_show_type_neighbor:
+    case bgp_show_type_flap_neighbor:
+    case bgp_show_type_damp_neighbor:
+      walk->arg.su = *(union sockunion *) output_arg;
+      walk->output_arg = &walk->arg.su;
+      return 1;
+    default:
+      walk->output_arg = output_arg;
+      return 0;
+    }
+}
 
+static int
+bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
+	  enum bgp_show_type type, void *output_arg)
+{
+  struct bgp_show_walk *walk;
+
+  walk = XCALLOC (MTYPE_VTY_WALK, sizeof (struct bgp_show_walk));
+  walk->table = table;
+  bgp_table_lock (table);
+  walk->rn = bgp_table_top (table);
+  walk->router_id = *router_id;
+  walk->type = type;
+  walk->header = 1;
+
+  if (bgp_show_walk_arg (walk, output_arg))
+    vty_walk (vty, bgp_show_walk_step, bgp_show_walk_done, walk);
+  else
+    {
+      while (bgp_show_walk_step (vty, walk) == VTY_WALK_MORE)
+	;
+      bgp_show_walk_done (vty, walk);
+    }
   return CMD_SUCCESS;
 }
 
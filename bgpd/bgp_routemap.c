@@ -241,7 +241,8 @@ struct route_map_rule_cmd route_match_ip_address_cmd =
   "ip address",
   route_match_ip_address,
   route_match_ip_address_compile,
-  route_match_ip_address_free
+  route_match_ip_address_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* `match ip next-hop IP_ADDRESS' */
@@ -391,7 +392,8 @@ struct route_map_rule_cmd route_match_ip_address_prefix_list_cmd =
   "ip address prefix-list",
   route_match_ip_address_prefix_list,
   route_match_ip_address_prefix_list_compile,
-  route_match_ip_address_prefix_list_free
+  route_match_ip_address_prefix_list_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* `match ip next-hop prefix-list PREFIX_LIST' */
@@ -688,7 +690,8 @@ struct route_map_rule_cmd route_match_community_cmd =
   "community",
   route_match_community,
   route_match_community_compile,
-  route_match_community_free
+  route_match_community_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* Match function for extcommunity match. */
@@ -737,7 +740,8 @@ struct route_map_rule_cmd route_match_ecommunity_cmd =
   "extcommunity",
   route_match_ecommunity,
   route_match_ecommunity_compile,
-  route_match_ecommunity_free
+  route_match_ecommunity_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* `match nlri` and `set nlri` are replaced by `address-family ipv4`
@@ -793,7 +797,8 @@ struct route_map_rule_cmd route_match_origin_cmd =
   "origin",
   route_match_origin,
   route_match_origin_compile,
-  route_match_origin_free
+  route_match_origin_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* match probability  { */
@@ -1856,7 +1861,8 @@ struct route_map_rule_cmd route_match_ipv6_address_cmd =
   "ipv6 address",
   route_match_ipv6_address,
   route_match_ipv6_address_compile,
-  route_match_ipv6_address_free
+  route_match_ipv6_address_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* `match ipv6 next-hop IP_ADDRESS' */
@@ -1958,7 +1964,8 @@ struct route_map_rule_cmd route_match_ipv6_address_prefix_list_cmd =
   "ipv6 address prefix-list",
   route_match_ipv6_address_prefix_list,
   route_match_ipv6_address_prefix_list_compile,
-  route_match_ipv6_address_prefix_list_free
+  route_match_ipv6_address_prefix_list_free,
+  RMAP_RULE_CACHEABLE
 };
 
 /* `set ipv6 nexthop global IP_ADDRESS' */
@@ -3837,6 +3844,22 @@ ALIAS (no_match_pathlimit_as,
        "Match Pathlimit ASN\n")
 
 
+/* Outbound route-map results are cached by interned attribute, which
+   is held while cached so its address is not reused. */
+static void *
+bgp_route_map_cache_ref (void *key)
+{
+  return bgp_attr_intern (key);
+}
+
+static void
+bgp_route_map_cache_unref (void *key)
+{
+  struct attr *attr = key;
+
+  bgp_attr_unintern (&attr);
+}
+
 /* Initialization of route map. */
 void
 bgp_route_map_init (void)
@@ -3845,6 +3868,8 @@ bgp_route_map_init (void)
   route_map_init_vty ();
   route_map_add_hook (bgp_route_map_update);
   route_map_delete_hook (bgp_route_map_update);
+  route_map_cache_key_hook (bgp_route_map_cache_ref,
+			    bgp_route_map_cache_unref);
 
   route_map_install_match (&route_match_peer_cmd);
   route_map_install_match (&route_match_ip_address_cmd);
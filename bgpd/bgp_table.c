@@ -73,9 +73,16 @@ bgp_table_finish (struct bgp_table **rt)
 }
 
 static struct bgp_node *
-bgp_node_create (void)
+bgp_node_create (u_char family)
 {
-  return XCALLOC (MTYPE_BGP_NODE, sizeof (struct bgp_node));
+  struct bgp_node *node;
+
+  if (family != AF_INET)
+    node = XCALLOC (MTYPE_BGP_NODE_IPV6, BGP_NODE_SIZE (family));
+  else
+    node = XCALLOC (MTYPE_BGP_NODE, BGP_NODE_SIZE (family));
+  node->p.family = family;
+  return node;
 }
 
 /* Allocate new route node with prefix set. */
@@ -84,7 +91,7 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 {
   struct bgp_node *node;
   
-  node = bgp_node_create ();
+  node = bgp_node_create (prefix->family);
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -96,7 +103,10 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 static void
 bgp_node_free (struct bgp_node *node)
 {
-  XFREE (MTYPE_BGP_NODE, node);
+  if (node->p.family != AF_INET)
+    XFREE (MTYPE_BGP_NODE_IPV6, node);
+  else
+    XFREE (MTYPE_BGP_NODE, node);
 }
 
 /* Free route table. */
@@ -336,9 +346,8 @@ bgp_node_get (struct bgp_table *const table, struct prefix *p)
     }
   else
     {
-      new = bgp_node_create ();
+      new = bgp_node_create (p->family);
       route_common (&node->p, p, &new->p);
-      new->p.family = p->family;
       new->table = table;
       set_link (new, node);
 
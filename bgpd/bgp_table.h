@@ -47,8 +47,6 @@ struct bgp_table
 
 struct bgp_node
 {
-  struct prefix p;
-
   struct bgp_table *table;
   struct bgp_node *parent;
   struct bgp_node *link[2];
@@ -67,8 +65,15 @@ struct bgp_node
 
   u_char flags;
 #define BGP_NODE_PROCESS_SCHEDULED	(1 << 0)
+
+  /* Must come last: nodes are allocated with only BGP_NODE_SIZE()
+     bytes for their family. */
+  struct prefix p;
 };
 
+#define BGP_NODE_SIZE(F) \
+  (offsetof (struct bgp_node, p) + PREFIX_FAMILY_SIZE (F))
+
 extern struct bgp_table *bgp_table_init (afi_t, safi_t);
 extern void bgp_table_lock (struct bgp_table *);
 extern void bgp_table_unlock (struct bgp_table *);
@@ -6736,8 +6736,15 @@ DEFUN (show_bgp_memory,
   count = mtype_stats_alloc (MTYPE_BGP_NODE);
   vty_out (vty, "%ld RIB nodes, using %s of memory%s", count,
            mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                         count * sizeof (struct bgp_node)),
+                         count * BGP_NODE_SIZE (AF_INET)),
            VTY_NEWLINE);
+
+  count = mtype_stats_alloc (MTYPE_BGP_NODE_IPV6);
+  if (count)
+    vty_out (vty, "%ld IPv6 RIB nodes, using %s of memory%s", count,
+             mtype_memstr (memstrbuf, sizeof (memstrbuf),
+                           count * BGP_NODE_SIZE (AF_INET6)),
+             VTY_NEWLINE);
   
   count = mtype_stats_alloc (MTYPE_BGP_ROUTE);
   vty_out (vty, "%ld BGP routes, using %s of memory%s", count,
@@ -6888,7 +6895,7 @@ bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
               ents = bgp_table_count (bgp->rib[afi][safi]);
               vty_out (vty, "RIB entries %ld, using %s of memory%s", ents,
                        mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                                     ents * sizeof (struct bgp_node)),
+                                     ents * BGP_NODE_SIZE (afi2family (afi))),
                        VTY_NEWLINE);
               
               /* Peer related usage */
@@ -35,6 +35,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "linklist.h"
 #include "workqueue.h"
+#include "metrics.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -3731,6 +3732,9 @@ peer_distribute_update (struct access_list *access)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  /* Route-map match clauses may refer to the list. */
+  route_map_cache_flush ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -3890,6 +3894,9 @@ peer_prefix_list_update (struct prefix_list *plist)
   safi_t safi;
   int direct;
 
+  /* Route-map match clauses may refer to the list. */
+  route_map_cache_flush ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -5341,6 +5348,105 @@ bgp_master_init (void)
 }
 
 
+/* Peer message counters by message type, for the metrics export. */
+static const struct
+{
+  const char *type;
+  size_t in;
+  size_t out;
+} bgp_metrics_messages[] =
+{
+  { "open",       offsetof (struct peer, open_in),
+                  offsetof (struct peer, open_out) },
+  { "update",     offsetof (struct peer, update_in),
+                  offsetof (struct peer, update_out) },
+  { "keepalive",  offsetof (struct peer, keepalive_in),
+                  offsetof (struct peer, keepalive_out) },
+  { "notify",     offsetof (struct peer, notify_in),
+                  offsetof (struct peer, notify_out) },
+  { "refresh",    offsetof (struct peer, refresh_in),
+                  offsetof (struct peer, refresh_out) },
+  { "capability", offsetof (struct peer, dynamic_cap_in),
+                  offsetof (struct peer, dynamic_cap_out) },
+};
+
+#define PEER_COUNTER(P, OFFSET) (*(u_int32_t *) ((char *) (P) + (OFFSET)))
+
+static void
+bgp_metrics_messages_family (struct metrics *m, int out)
+{
+  struct listnode *node, *pnode;
+  struct bgp *bgp;
+  struct peer *peer;
+  unsigned int i;
+
+  if (out)
+    metrics_family (m, "bgp_messages_sent_total", METRICS_COUNTER,
+		    "BGP messages sent by peer and type");
+  else
+    metrics_family (m, "bgp_messages_received_total", METRICS_COUNTER,
+		    "BGP messages received by peer and type");
+
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, pnode, peer))
+      for (i = 0; i < sizeof (bgp_metrics_messages)
+			/ sizeof (bgp_metrics_messages[0]); i++)
+	metrics_value (m, PEER_COUNTER (peer, out ? bgp_metrics_messages[i].out
+					: bgp_metrics_messages[i].in),
+		       "view", bgp->name ? bgp->name : "",
+		       "peer", peer->host,
+		       "type", bgp_metrics_messages[i].type, NULL);
+}
+
+static void
+bgp_metrics (struct metrics *m)
+{
+  struct listnode *node, *pnode;
+  struct bgp *bgp;
+  struct peer *peer;
+  afi_t afi;
+  safi_t safi;
+
+  bgp_metrics_messages_family (m, 0);
+  bgp_metrics_messages_family (m, 1);
+
+  metrics_family (m, "bgp_peer_established", METRICS_GAUGE,
+		  "1 if the session is Established");
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, pnode, peer))
+      metrics_value (m, peer->status == Established,
+		     "view", bgp->name ? bgp->name : "",
+		     "peer", peer->host, NULL);
+
+  metrics_family (m, "bgp_peer_established_total", METRICS_COUNTER,
+		  "Transitions to Established");
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, pnode, peer))
+      metrics_value (m, peer->established,
+		     "view", bgp->name ? bgp->name : "",
+		     "peer", peer->host, NULL);
+
+  metrics_family (m, "bgp_peer_dropped_total", METRICS_COUNTER,
+		  "Established sessions dropped");
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, pnode, peer))
+      metrics_value (m, peer->dropped,
+		     "view", bgp->name ? bgp->name : "",
+		     "peer", peer->host, NULL);
+
+  metrics_family (m, "bgp_peer_prefixes", METRICS_GAUGE,
+		  "Prefixes accepted from the peer by address family");
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    for (ALL_LIST_ELEMENTS_RO (bgp->peer, pnode, peer))
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+	for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	  if (peer->afc[afi][safi])
+	    metrics_value (m, peer->pcount[afi][safi],
+			   "view", bgp->name ? bgp->name : "",
+			   "peer", peer->host,
+			   "family", afi_safi_print (afi, safi), NULL);
+}
+
 void
 bgp_init (void)
 {
@@ -5358,6 +5464,7 @@ bgp_init (void)
   bgp_route_map_init ();
   bgp_scan_init ();
   bgp_mplsvpn_init ();
+  metrics_register ("bgp", bgp_metrics);
 
   /* Access list initialize. */
   access_list_init ();
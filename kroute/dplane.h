@@ -0,0 +1,69 @@
+/* Kroute dataplane: route changes programmed off the RIB's thread.
+ *
+ * This file is part of GNU Kroute.
+ *
+ * GNU Kroute is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Kroute is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Kroute; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _KROUTE_DPLANE_H
+#define _KROUTE_DPLANE_H
+
+#include "prefix.h"
+
+/* Largest kernel message a route change can be queued with.  Bigger
+   ones, such as very wide multipath routes, are sent directly. */
+#define DPLANE_MSG_SIZE		512
+
+/* Route changes the queue holds, queued and in flight. */
+#define DPLANE_QUEUE_SIZE	2048
+
+enum dplane_op
+{
+  DPLANE_OP_INSTALL,
+  DPLANE_OP_UNINSTALL,
+};
+
+/* A route change on its way to the kernel.  Everything but error is
+   filled in by the RIB's thread before it is queued, and only error is
+   written by the dataplane. */
+struct dplane_ctx
+{
+  enum dplane_op op;
+  struct prefix p;
+  struct timeval queued;
+  int error;			/* errno the kernel answered with, or 0 */
+  unsigned int len;
+  char msg[DPLANE_MSG_SIZE];	/* encoded by the provider */
+};
+
+/* What programs the changes: the kernel interface in use. */
+struct dplane_provider
+{
+  const char *name;
+
+  /* Program a run of changes, in order, setting each one's error.
+     May be called on the dataplane thread, so must not log, allocate
+     or touch the RIB. */
+  void (*write) (struct dplane_ctx **, unsigned int);
+};
+
+extern void dplane_init (void);
+extern void dplane_provider_set (const struct dplane_provider *);
+extern int dplane_enqueue (enum dplane_op, struct prefix *,
+			   const void *, unsigned int);
+extern void dplane_sync (void);
+
+#endif /* _KROUTE_DPLANE_H */
@@ -0,0 +1,536 @@
+/* Kroute dataplane: route changes programmed off the RIB's thread.
+ *
+ * This file is part of GNU Kroute.
+ *
+ * GNU Kroute is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Kroute is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Kroute; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <kroute.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "command.h"
+#include "log.h"
+#include "memory.h"
+#include "metrics.h"
+#include "network.h"
+#include "prefix.h"
+#include "privs.h"
+#include "table.h"
+#include "thread.h"
+#include "vty.h"
+
+#include "kroute/rib.h"
+#include "kroute/zserv.h"
+#include "kroute/debug.h"
+#include "kroute/dplane.h"
+
+extern struct kroute_t krouted;
+
+extern struct kroute_privs_t zserv_privs;
+
+/*
+ * rib_process() hands its kernel changes to the kernel interface, which
+ * encodes each one and queues it here instead of sending it.  A
+ * dataplane thread takes the changes off the queue in runs, programs
+ * them and publishes the results, and the master thread picks those up
+ * when the thread pokes it through a pipe.
+ *
+ * The queue is a ring with one producer and one consumer and no lock.
+ * Slots from reaped up to head are in use: the dataplane has taken
+ * those before taken, and is finished with those before done, whose
+ * results the master thread goes through before it reuses the slots.
+ * head and reaped are only moved by the master thread, taken and done
+ * only by the dataplane.
+ *
+ * The thread is started with the first change, by which time kroute has
+ * daemonized.  Without threads, or when it cannot be started, the
+ * master thread programs the queue itself from a timer.
+ */
+
+#ifdef __ATOMIC_ACQUIRE
+#define DPLANE_LOAD(V)		__atomic_load_n (&(V), __ATOMIC_ACQUIRE)
+#define DPLANE_STORE(V,X)	__atomic_store_n (&(V), (X), __ATOMIC_RELEASE)
+#define DPLANE_FENCE()		__atomic_thread_fence (__ATOMIC_SEQ_CST)
+#else
+#define DPLANE_LOAD(V)		({ __sync_synchronize (); (V); })
+#define DPLANE_STORE(V,X)	do { __sync_synchronize (); (V) = (X); } while (0)
+#define DPLANE_FENCE()		__sync_synchronize ()
+#endif
+
+/* Changes handed to the provider at once. */
+#define DPLANE_BATCH		256
+
+/* How long changes wait when the master thread sends them, in ms. */
+#define DPLANE_FLUSH_DELAY	1
+
+#define DPLANE_SLOT(I)		(&dplane.ring[(I) % DPLANE_QUEUE_SIZE])
+
+static struct
+{
+  const struct dplane_provider *provider;
+  struct dplane_ctx *ring;
+
+  unsigned long head;
+  unsigned long taken;
+  unsigned long done;
+  unsigned long reaped;
+
+  /* Kept by the master thread, bar batches. */
+  unsigned long completed;
+  unsigned long failed;
+  unsigned long direct;		/* too big to queue */
+  unsigned long full;		/* times the RIB waited for room */
+  unsigned long depth_max;
+  unsigned long long latency;	/* usec, queued to collected */
+  unsigned long latency_max;
+  unsigned long batches;
+
+  struct thread *t_flush;
+
+#ifdef HAVE_LIBPTHREAD
+  int running;			/* 1 thread up, -1 cannot be had */
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t wake;		/* changes queued */
+  pthread_cond_t progress;	/* done moved on */
+  int sleeping;
+
+  int fds[2];			/* the thread pokes the master here */
+  struct thread *t_read;
+#endif /* HAVE_LIBPTHREAD */
+} dplane;
+
+static const char *
+dplane_op_name (enum dplane_op op)
+{
+  return (op == DPLANE_OP_INSTALL) ? "install" : "uninstall";
+}
+
+static unsigned long
+dplane_usec_since (struct timeval *then, struct timeval *now)
+{
+  long usec = (now->tv_sec - then->tv_sec) * 1000000L
+	      + (now->tv_usec - then->tv_usec);
+
+  return (usec > 0) ? usec : 0;
+}
+
+/* Program what is queued up to head.  Runs on the dataplane thread, or
+   on the master thread when there is none. */
+static void
+dplane_run (unsigned long head)
+{
+  struct dplane_ctx *batch[DPLANE_BATCH];
+  unsigned long taken = dplane.taken;
+  unsigned int n;
+
+  while (taken != head)
+    {
+      for (n = 0; n < DPLANE_BATCH && taken + n != head; n++)
+	batch[n] = DPLANE_SLOT (taken + n);
+
+      taken += n;
+      DPLANE_STORE (dplane.taken, taken);
+      dplane.provider->write (batch, n);
+      DPLANE_STORE (dplane.batches, dplane.batches + 1);
+      DPLANE_STORE (dplane.done, taken);
+    }
+}
+
+/* The master thread programs the queue itself. */
+static void
+dplane_run_direct (void)
+{
+  THREAD_OFF (dplane.t_flush);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  dplane_run (dplane.head);
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+}
+
+/* A change is finished with.  A route the kernel refused is handed
+   back to the RIB, unless a later change for the prefix is queued. */
+static void
+dplane_complete (struct dplane_ctx *ctx)
+{
+  char buf[BUFSIZ];
+  unsigned long i;
+
+  if (! IS_KROUTE_DEBUG_KERNEL && ctx->error == 0)
+    return;
+
+  prefix2str (&ctx->p, buf, sizeof (buf));
+
+  if (ctx->error == 0
+      || (ctx->op == DPLANE_OP_INSTALL && ctx->error == EEXIST)
+      || (ctx->op == DPLANE_OP_UNINSTALL
+	  && (ctx->error == ESRCH || ctx->error == ENODEV)))
+    {
+      if (IS_KROUTE_DEBUG_KERNEL)
+	zlog_debug ("dplane: %s %s: %s", dplane_op_name (ctx->op), buf,
+		    ctx->error ? safe_strerror (ctx->error) : "done");
+      return;
+    }
+
+  dplane.failed++;
+  zlog_err ("dplane: %s %s failed: %s", dplane_op_name (ctx->op), buf,
+	    safe_strerror (ctx->error));
+
+  if (ctx->op != DPLANE_OP_INSTALL)
+    return;
+
+  for (i = dplane.reaped + 1; i != dplane.head; i++)
+    if (prefix_same (&DPLANE_SLOT (i)->p, &ctx->p))
+      return;
+
+  rib_fib_failed (&ctx->p);
+}
+
+/* Go through the results the dataplane has published. */
+static void
+dplane_reap (void)
+{
+  unsigned long done = DPLANE_LOAD (dplane.done);
+  struct dplane_ctx *ctx;
+  struct timeval now;
+  unsigned long latency;
+
+  if (dplane.reaped == done)
+    return;
+
+  bane_gettime (BANE_CLK_MONOTONIC, &now);
+  for (; dplane.reaped != done; dplane.reaped++)
+    {
+      ctx = DPLANE_SLOT (dplane.reaped);
+
+      latency = dplane_usec_since (&ctx->queued, &now);
+      dplane.latency += latency;
+      if (latency > dplane.latency_max)
+	dplane.latency_max = latency;
+      dplane.completed++;
+
+      dplane_complete (ctx);
+    }
+}
+
+static int
+dplane_flush (struct thread *thread)
+{
+  dplane.t_flush = NULL;
+  dplane_run_direct ();
+  dplane_reap ();
+  return 0;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+dplane_thread (void *arg)
+{
+  unsigned long head;
+  char c = 0;
+
+  pthread_mutex_lock (&dplane.mtx);
+  for (;;)
+    {
+      pthread_mutex_unlock (&dplane.mtx);
+      while ((head = DPLANE_LOAD (dplane.head)) != dplane.taken)
+	{
+	  dplane_run (head);
+	  while ((write (dplane.fds[1], &c, 1) < 0) && (errno == EINTR))
+	    ;
+	  pthread_mutex_lock (&dplane.mtx);
+	  pthread_cond_broadcast (&dplane.progress);
+	  pthread_mutex_unlock (&dplane.mtx);
+	}
+
+      /* Sleep, unless the master queued something after the check
+	 above without seeing us asleep. */
+      pthread_mutex_lock (&dplane.mtx);
+      DPLANE_STORE (dplane.sleeping, 1);
+      DPLANE_FENCE ();
+      if (DPLANE_LOAD (dplane.head) == dplane.taken)
+	pthread_cond_wait (&dplane.wake, &dplane.mtx);
+      DPLANE_STORE (dplane.sleeping, 0);
+    }
+
+  return NULL;
+}
+
+static int
+dplane_collect (struct thread *thread)
+{
+  char buf[64];
+
+  dplane.t_read = NULL;
+  while (read (dplane.fds[0], buf, sizeof (buf)) > 0)
+    ;
+  dplane_reap ();
+
+  dplane.t_read = thread_add_read (krouted.master, dplane_collect, NULL,
+				   dplane.fds[0]);
+  return 0;
+}
+
+static int
+dplane_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+#ifndef HAVE_LCAPS
+  /* Without capabilities kroute's privileges are its effective uid,
+     which is the whole process's: the master thread dropping them
+     would pull them from under the dataplane. */
+  if (geteuid () != 0)
+    return -1;
+#endif /* HAVE_LCAPS */
+
+  if (pipe (dplane.fds) < 0)
+    {
+      zlog_warn ("%s: pipe failed: %s", __func__, safe_strerror (errno));
+      return -1;
+    }
+  set_nonblocking (dplane.fds[0]);
+  set_nonblocking (dplane.fds[1]);
+
+  pthread_mutex_init (&dplane.mtx, NULL);
+  pthread_cond_init (&dplane.wake, NULL);
+  pthread_cond_init (&dplane.progress, NULL);
+
+  /* The thread keeps the capabilities it is created with, and signals
+     are for the master thread only. */
+  sigfillset (&all);
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  pthread_sigmask (SIG_BLOCK, &all, &old);
+  ret = pthread_create (&dplane.thread, NULL, dplane_thread, NULL);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (ret)
+    {
+      zlog_warn ("%s: can't start dataplane thread: %s", __func__,
+		 safe_strerror (ret));
+      close (dplane.fds[0]);
+      close (dplane.fds[1]);
+      return -1;
+    }
+
+  dplane.t_read = thread_add_read (krouted.master, dplane_collect, NULL,
+				   dplane.fds[0]);
+  return 0;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* Get the dataplane going on what was just queued. */
+static void
+dplane_kick (void)
+{
+#ifdef HAVE_LIBPTHREAD
+  if (dplane.running == 0)
+    dplane.running = dplane_start () ? -1 : 1;
+
+  if (dplane.running > 0)
+    {
+      DPLANE_FENCE ();
+      if (DPLANE_LOAD (dplane.sleeping))
+	{
+	  pthread_mutex_lock (&dplane.mtx);
+	  pthread_cond_signal (&dplane.wake);
+	  pthread_mutex_unlock (&dplane.mtx);
+	}
+      return;
+    }
+#endif /* HAVE_LIBPTHREAD */
+
+  if (! dplane.t_flush)
+    dplane.t_flush = thread_add_timer_msec (krouted.master, dplane_flush,
+					    NULL, DPLANE_FLUSH_DELAY);
+}
+
+/* Wait for the dataplane to be done with everything queued before
+   upto, and go through the results. */
+static void
+dplane_wait (unsigned long upto)
+{
+#ifdef HAVE_LIBPTHREAD
+  if (dplane.running > 0)
+    {
+      pthread_mutex_lock (&dplane.mtx);
+      while ((long) (upto - DPLANE_LOAD (dplane.done)) > 0)
+	{
+	  pthread_cond_signal (&dplane.wake);
+	  pthread_cond_wait (&dplane.progress, &dplane.mtx);
+	}
+      pthread_mutex_unlock (&dplane.mtx);
+    }
+  else
+#endif /* HAVE_LIBPTHREAD */
+  if ((long) (upto - dplane.done) > 0)
+    dplane_run_direct ();
+
+  dplane_reap ();
+}
+
+/* Queue a route change, encoded by the provider as msg.  Returns -1 if
+   it cannot be queued and the caller must send it itself. */
+int
+dplane_enqueue (enum dplane_op op, struct prefix *p, const void *msg,
+		unsigned int len)
+{
+  struct dplane_ctx *ctx;
+  unsigned long depth;
+
+  if (! dplane.provider)
+    return -1;
+  if (len > DPLANE_MSG_SIZE)
+    {
+      dplane.direct++;
+      return -1;
+    }
+
+  if (dplane.head - dplane.reaped >= DPLANE_QUEUE_SIZE)
+    {
+      dplane.full++;
+      dplane_wait (dplane.head - DPLANE_QUEUE_SIZE + 1);
+    }
+
+  ctx = DPLANE_SLOT (dplane.head);
+  ctx->op = op;
+  prefix_copy (&ctx->p, p);
+  ctx->error = 0;
+  ctx->len = len;
+  memcpy (ctx->msg, msg, len);
+  bane_gettime (BANE_CLK_MONOTONIC, &ctx->queued);
+
+  DPLANE_STORE (dplane.head, dplane.head + 1);
+
+  depth = dplane.head - dplane.reaped;
+  if (depth > dplane.depth_max)
+    dplane.depth_max = depth;
+
+  dplane_kick ();
+  return 0;
+}
+
+/* Wait for every queued change to be programmed.  The kernel interface
+   calls this before it uses the kernel for anything else, so requests
+   and replies stay in order with the route changes. */
+void
+dplane_sync (void)
+{
+  if (dplane.provider && dplane.head != dplane.reaped)
+    dplane_wait (dplane.head);
+}
+
+void
+dplane_provider_set (const struct dplane_provider *provider)
+{
+  if (! dplane.ring)
+    dplane.ring = XCALLOC (MTYPE_DPLANE_QUEUE,
+			   DPLANE_QUEUE_SIZE * sizeof (struct dplane_ctx));
+  dplane.provider = provider;
+}
+
+DEFUN (show_kroute_dataplane,
+       show_kroute_dataplane_cmd,
+       "show kroute dataplane",
+       SHOW_STR
+       "Kroute information\n"
+       "Dataplane route programming\n")
+{
+  unsigned long taken, done, batches;
+
+  if (! dplane.provider)
+    {
+      vty_out (vty, "No dataplane: routes are sent to the kernel "
+	       "as they change%s", VTY_NEWLINE);
+      return CMD_SUCCESS;
+    }
+
+  taken = DPLANE_LOAD (dplane.taken);
+  done = DPLANE_LOAD (dplane.done);
+  batches = DPLANE_LOAD (dplane.batches);
+
+  vty_out (vty, "Dataplane %s, programmed from %s%s", dplane.provider->name,
+#ifdef HAVE_LIBPTHREAD
+	   (dplane.running > 0) ? "its own thread" :
+#endif /* HAVE_LIBPTHREAD */
+	   "the main thread", VTY_NEWLINE);
+  vty_out (vty, "  Queue: %lu queued, %lu in flight, %lu to collect, "
+	   "%lu most, of %u%s",
+	   dplane.head - taken, taken - done, done - dplane.reaped,
+	   dplane.depth_max, DPLANE_QUEUE_SIZE, VTY_NEWLINE);
+  vty_out (vty, "  Changes: %lu done in %lu batches, %lu failed, "
+	   "%lu sent directly%s",
+	   dplane.completed, batches, dplane.failed, dplane.direct,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Queue full: %lu times%s", dplane.full, VTY_NEWLINE);
+  vty_out (vty, "  Latency (ms): %lu.%03lu average, %lu.%03lu max%s",
+	   dplane.completed ?
+	     (unsigned long) (dplane.latency / dplane.completed) / 1000 : 0,
+	   dplane.completed ?
+	     (unsigned long) (dplane.latency / dplane.completed) % 1000 : 0,
+	   dplane.latency_max / 1000, dplane.latency_max % 1000,
+	   VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
+static void
+dplane_metrics (struct metrics *m)
+{
+  unsigned long taken, done;
+
+  if (! dplane.provider)
+    return;
+
+  taken = DPLANE_LOAD (dplane.taken);
+  done = DPLANE_LOAD (dplane.done);
+
+  metrics_family (m, "dplane_queued", METRICS_GAUGE,
+		  "Route changes waiting for the dataplane");
+  metrics_value (m, dplane.head - taken, NULL);
+  metrics_family (m, "dplane_in_flight", METRICS_GAUGE,
+		  "Route changes the dataplane is programming");
+  metrics_value (m, taken - done, NULL);
+  metrics_family (m, "dplane_completed", METRICS_COUNTER,
+		  "Route changes programmed");
+  metrics_value (m, dplane.completed, NULL);
+  metrics_family (m, "dplane_failed", METRICS_COUNTER,
+		  "Route changes the kernel refused");
+  metrics_value (m, dplane.failed, NULL);
+  metrics_family (m, "dplane_latency_usec", METRICS_COUNTER,
+		  "Time route changes spent queued and in flight");
+  metrics_value (m, dplane.latency, NULL);
+}
+
+void
+dplane_init (void)
+{
+  install_element (VIEW_NODE, &show_kroute_dataplane_cmd);
+  install_element (ENABLE_NODE, &show_kroute_dataplane_cmd);
+  metrics_register ("dplane", dplane_metrics);
+
+  /* Changes queued on the way out, such as rib_close()'s, still have
+     to go. */
+  atexit (dplane_sync);
+}
@@ -34,6 +34,7 @@
 #include "workqueue.h"
 #include "prefix.h"
 #include "routemap.h"
+#include "metrics.h"
 
 #include "kroute/rib.h"
 #include "kroute/rt.h"
@@ -96,6 +97,9 @@ vrf_alloc (const char *name)
   vrf->stable[AFI_IP][SAFI_MULTICAST] = route_table_init ();
   vrf->stable[AFI_IP6][SAFI_MULTICAST] = route_table_init ();
 
+  /* Nexthop resolution and RPF checks do longest match lookups. */
+  route_table_index_enable (vrf->table[AFI_IP][SAFI_UNICAST]);
+  route_table_index_enable (vrf->table[AFI_IP][SAFI_MULTICAST]);
 
   return vrf;
 }
@@ -136,6 +140,35 @@ vrf_table (afi_t afi, safi_t safi, u_int32_t id)
   return vrf->table[afi][safi];
 }
 
+/* The ribs of each type in the default unicast tables. */
+static struct rib_type_link rib_types[AFI_MAX][KROUTE_ROUTE_MAX];
+
+/* Head of the list of ribs of a type in the default unicast table of an
+   address family, in no particular order.  The head is not a rib. */
+struct rib_type_link *
+rib_type_list (afi_t afi, int type)
+{
+  return &rib_types[afi][type];
+}
+
+/* Insert a link into a type list after another. */
+void
+rib_type_insert (struct rib_type_link *after, struct rib_type_link *link)
+{
+  link->prev = after;
+  link->next = after->next;
+  after->next->prev = link;
+  after->next = link;
+}
+
+void
+rib_type_remove (struct rib_type_link *link)
+{
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->next = link->prev = NULL;
+}
+
 /* Lookup static route table.  */
 struct route_table *
 vrf_static_table (afi_t afi, safi_t safi, u_int32_t id)
@@ -935,6 +968,33 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
     }
 }
 
+/* The kernel turned down a route installed for p.  The netlink writer
+   only learns this when the error comes back, so the entry is looked
+   up again rather than passed along with the change. */
+void
+rib_fib_failed (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+  struct nexthop *nexthop;
+
+  table = vrf_table (family2afi (p->family), SAFI_UNICAST, 0);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+  route_unlock_node (rn);
+
+  for (rib = rn->info; rib; rib = rib->next)
+    if (! RIB_SYSTEM_ROUTE (rib)
+	&& CHECK_FLAG (rib->flags, KROUTE_FLAG_SELECTED))
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
 /* Uninstall the route from kernel. */
 static int
 rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
@@ -1416,6 +1476,7 @@ static void
 rib_link (struct route_node *rn, struct rib *rib)
 {
   struct rib *head;
+  afi_t afi;
   char buf[INET6_ADDRSTRLEN];
   
   assert (rib && rn);
@@ -1441,6 +1502,15 @@ rib_link (struct route_node *rn, struct rib *rib)
     }
   rib->next = head;
   rn->info = rib;
+
+  afi = family2afi (rn->p.family);
+  if (rn->table == vrf_table (afi, SAFI_UNICAST, 0)
+      && rib->type < KROUTE_ROUTE_MAX)
+    {
+      rib->type_link.rn = rn;
+      rib_type_insert (rib_type_list (afi, rib->type), &rib->type_link);
+    }
+
   rib_queue_add (&krouted, rn);
 }
 
@@ -1498,6 +1568,9 @@ rib_unlink (struct route_node *rn, struct rib *rib)
         }
     }
 
+  if (rib->type_link.next)
+    rib_type_remove (&rib->type_link);
+
   /* free RIB and nexthops */
   for (nexthop = rib->nexthop; nexthop; nexthop = next)
     {
@@ -2980,11 +3053,38 @@ rib_close (void)
   rib_close_table (vrf_table (AFI_IP6, SAFI_UNICAST, 0));
 }
 
+static void
+rib_metrics (struct metrics *m)
+{
+  static const char *subq_names[MQ_SIZE] =
+    { "connected", "static", "igp", "bgp", "other" };
+  struct meta_queue *mq = krouted.mq;
+  int i;
+
+  if (!mq)
+    return;
+
+  metrics_family (m, "rib_queue_nodes", METRICS_GAUGE,
+		  "Route nodes waiting in the RIB meta queue");
+  for (i = 0; i < MQ_SIZE; i++)
+    metrics_value (m, listcount (mq->subq[i]),
+		   "subqueue", subq_names[i], NULL);
+}
+
 /* Routing information base initialize. */
 void
 rib_init (void)
 {
+  afi_t afi;
+  int type;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (type = 0; type < KROUTE_ROUTE_MAX; type++)
+      rib_types[afi][type].next = rib_types[afi][type].prev
+	= &rib_types[afi][type];
+
   rib_queue_init (&krouted);
+  metrics_register ("rib", rib_metrics);
   /* VRF initialization.  */
   vrf_init ();
 }
@@ -804,36 +804,83 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
     }
 }
 
-DEFUN (show_ip_route,
-       show_ip_route_cmd,
-       "show ip route",
-       SHOW_STR
-       IP_STR
-       "IP routing table\n")
+/* Cursor of "show ip route" and "show ipv6 route" over a whole table. */
+struct show_route_walk
 {
-  struct route_table *table;
+  /* Next node to show, locked. */
   struct route_node *rn;
-  struct rib *rib;
-  int first = 1;
+  afi_t afi;
+  int first;
+  void (*show) (struct vty *, struct route_node *, struct rib *);
+};
 
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
+static int
+show_route_walk_step (struct vty *vty, void *arg)
+{
+  struct show_route_walk *walk = arg;
+  struct rib *rib;
+  int count;
 
-  /* Show all IPv4 routes. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    for (rib = rn->info; rib; rib = rib->next)
+  for (count = 0; walk->rn && count < VTY_WALK_SLICE;
+       walk->rn = route_next (walk->rn), count++)
+    for (rib = walk->rn->info; rib; rib = rib->next)
       {
-	if (first)
+	if (walk->first)
 	  {
-	    vty_out (vty, SHOW_ROUTE_V4_HEADER);
-	    first = 0;
+#ifdef HAVE_IPV6
+	    if (walk->afi == AFI_IP6)
+	      vty_out (vty, SHOW_ROUTE_V6_HEADER);
+	    else
+#endif /* HAVE_IPV6 */
+	      vty_out (vty, SHOW_ROUTE_V4_HEADER);
+	    walk->first = 0;
 	  }
-	vty_show_ip_route (vty, rn, rib);
+	(*walk->show) (vty, walk->rn, rib);
       }
+  return walk->rn ? VTY_WALK_MORE : VTY_WALK_DONE;
+}
+
+static void
+show_route_walk_done (struct vty *vty, void *arg)
+{
+  struct show_route_walk *walk = arg;
+
+  if (walk->rn)
+    route_unlock_node (walk->rn);
+  XFREE (MTYPE_VTY_WALK, walk);
+}
+
+static int
+show_route_table (struct vty *vty, afi_t afi,
+		  void (*show) (struct vty *, struct route_node *,
+				struct rib *))
+{
+  struct route_table *table;
+  struct show_route_walk *walk;
+
+  table = vrf_table (afi, SAFI_UNICAST, 0);
+  if (! table)
+    return CMD_SUCCESS;
+
+  walk = XCALLOC (MTYPE_VTY_WALK, sizeof (struct show_route_walk));
+  walk->rn = route_top (table);
+  walk->afi = afi;
+  walk->first = 1;
+  walk->show = show;
+  vty_walk (vty, show_route_walk_step, show_route_walk_done, walk);
   return CMD_SUCCESS;
 }
 
+DEFUN (show_ip_route,
+       show_ip_route_cmd,
+       "show ip route",
+       SHOW_STR
+       IP_STR
+       "IP routing table\n")
+{
+  return show_route_table (vty, AFI_IP, vty_show_ip_route);
+}
+
 DEFUN (show_ip_route_prefix_longer,
        show_ip_route_prefix_longer_cmd,
        "show ip route A.B.C.D/M longer-prefixes",
@@ -1750,27 +1797,7 @@ DEFUN (show_ipv6_route,
        IP_STR
        "IPv6 routing table\n")
 {
-  struct route_table *table;
-  struct route_node *rn;
-  struct rib *rib;
-  int first = 1;
-
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (! table)
-    return CMD_SUCCESS;
-
-  /* Show all IPv6 route. */
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    for (rib = rn->info; rib; rib = rib->next)
-      {
-	if (first)
-	  {
-	    vty_out (vty, SHOW_ROUTE_V6_HEADER);
-	    first = 0;
-	  }
-	vty_show_ipv6_route (vty, rn, rib);
-      }
-  return CMD_SUCCESS;
+  return show_route_table (vty, AFI_IP6, vty_show_ipv6_route);
 }
 
 DEFUN (show_ipv6_route_prefix_longer,
@@ -39,6 +39,7 @@
 #include "kroute/router-id.h"
 #include "kroute/irdp.h"
 #include "kroute/rtadv.h"
+#include "kroute/dplane.h"
 
 /* Kroute instance */
 struct kroute_t krouted =
@@ -325,6 +326,7 @@ main (int argc, char **argv)
   kroute_debug_init ();
   router_id_init();
   kroute_vty_init ();
+  dplane_init ();
   access_list_init ();
   prefix_list_init ();
   rtadv_init ();
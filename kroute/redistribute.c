@@ -30,6 +30,8 @@
 #include "zclient.h"
 #include "linklist.h"
 #include "log.h"
+#include "buffer.h"
+#include "thread.h"
 
 #include "kroute/rib.h"
 #include "kroute/zserv.h"
@@ -137,35 +139,149 @@ kroute_redistribute_default (struct zserv *client)
 #endif /* HAVE_IPV6 */
 }
 
-/* Redistribute routes. */
+/* Routes a redistribution dump sends to a client in one pass, and the
+   output that may be queued to the client before the dump waits for it
+   to drain. */
+#define REDIST_DUMP_BATCH	1000
+#define REDIST_DUMP_BUFFER	(1024 * 1024)
+
+static int redistribute_dump (struct thread *);
+
 static void
-kroute_redistribute (struct zserv *client, int type)
+redistribute_dump_schedule (struct zserv *client)
 {
-  struct rib *newrib;
-  struct route_table *table;
-  struct route_node *rn;
+  client->redist_blocked = 0;
+  if (! client->t_redist)
+    client->t_redist = thread_add_background (krouted.master,
+					      redistribute_dump, client, 0);
+}
 
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      for (newrib = rn->info; newrib; newrib = newrib->next)
-	if (CHECK_FLAG (newrib->flags, KROUTE_FLAG_SELECTED) 
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && kroute_check_addr (&rn->p))
-	  zsend_route_multipath (KROUTE_IPV4_ROUTE_ADD, client, &rn->p, newrib);
-  
+/* Start the cursor on the first type and address family left to dump.
+   Returns 0 once there is nothing left. */
+static int
+redistribute_dump_next (struct zserv *client)
+{
+  int type;
+
+  for (type = 1; type < KROUTE_ROUTE_MAX; type++)
+    if (client->redist_dump[type])
+      {
+	client->redist_cursor_afi = AFI_IP;
+	client->redist_cursor_type = type;
+	rib_type_insert (rib_type_list (AFI_IP, type), &client->redist_cursor);
+	return 1;
+      }
+  return 0;
+}
+
+/* Send routes of the types a client has newly asked for, a batch at a
+   time.  The routes are found through the per type lists, with the
+   client's cursor stepping along a list so that changes made between
+   passes are neither missed nor sent twice by the dump; routes added
+   behind the cursor are sent by redistribute_add() as usual. */
+static int
+redistribute_dump (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct rib_type_link *cursor = &client->redist_cursor;
+  struct rib_type_link *head, *link;
+  struct rib *rib;
+  int sent = 0;
+
+  client->t_redist = NULL;
+
+  while (sent < REDIST_DUMP_BATCH)
+    {
+      if (client->t_suicide)
+	return 0;
+      if (buffer_pending (client->wb) > REDIST_DUMP_BUFFER)
+	{
+	  client->redist_blocked = 1;
+	  return 0;
+	}
+
+      if (! cursor->next && ! redistribute_dump_next (client))
+	return 0;
+
+      head = rib_type_list (client->redist_cursor_afi,
+			    client->redist_cursor_type);
+      link = cursor->next;
+      if (link == head)
+	{
+	  rib_type_remove (cursor);
 #ifdef HAVE_IPV6
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      for (newrib = rn->info; newrib; newrib = newrib->next)
-	if (CHECK_FLAG (newrib->flags, KROUTE_FLAG_SELECTED)
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && kroute_check_addr (&rn->p))
-	  zsend_route_multipath (KROUTE_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	  if (client->redist_cursor_afi == AFI_IP)
+	    {
+	      client->redist_cursor_afi = AFI_IP6;
+	      rib_type_insert (rib_type_list (AFI_IP6,
+					      client->redist_cursor_type),
+			       cursor);
+	      continue;
+	    }
 #endif /* HAVE_IPV6 */
+	  client->redist_dump[client->redist_cursor_type] = 0;
+	  continue;
+	}
+
+      rib_type_remove (cursor);
+      rib_type_insert (link, cursor);
+
+      /* Another client's cursor. */
+      if (! link->rn)
+	continue;
+
+      rib = (struct rib *) ((char *) link - offsetof (struct rib, type_link));
+      if (CHECK_FLAG (rib->flags, KROUTE_FLAG_SELECTED)
+	  && rib->distance != DISTANCE_INFINITY
+	  && kroute_check_addr (&link->rn->p))
+	{
+	  zsend_route_multipath (link->rn->p.family == AF_INET
+				 ? KROUTE_IPV4_ROUTE_ADD
+				 : KROUTE_IPV6_ROUTE_ADD,
+				 client, &link->rn->p, rib);
+	  sent++;
+	}
+    }
+
+  redistribute_dump_schedule (client);
+  return 0;
+}
+
+/* Called as a client's queued output drains, to carry on with a dump
+   that was waiting for it. */
+void
+redistribute_dump_resume (struct zserv *client)
+{
+  if (client->redist_blocked
+      && buffer_pending (client->wb) <= REDIST_DUMP_BUFFER / 2)
+    redistribute_dump_schedule (client);
+}
+
+/* Abandon whatever a client's dump has still to send. */
+void
+redistribute_dump_stop (struct zserv *client)
+{
+  memset (client->redist_dump, 0, sizeof (client->redist_dump));
+  if (client->redist_cursor.next)
+    rib_type_remove (&client->redist_cursor);
+  THREAD_OFF (client->t_redist);
+  client->redist_blocked = 0;
+}
+
+/* Send a route update to a client.  The message is encoded on first use
+   and then shared by every client it is sent to; a client that is
+   backed up queues a copy, as route messages are short (see
+   buffer_put_stream). */
+static void
+redistribute_send (int cmd, struct zserv *client, struct prefix *p,
+		   struct rib *rib, struct stream **s)
+{
+  if (*s == NULL)
+    {
+      *s = stream_new (KROUTE_MAX_PACKET_SIZ);
+      zserv_encode_route_multipath (cmd, *s, p, rib);
+    }
+  zsend_stream (client, *s);
 }
 
 void
@@ -173,31 +289,31 @@ redistribute_add (struct prefix *p, struct rib *rib)
 {
   struct listnode *node, *nnode;
   struct zserv *client;
+  struct stream *s = NULL;
+  int cmd;
+
+  if (p->family == AF_INET)
+    cmd = KROUTE_IPV4_ROUTE_ADD;
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    cmd = KROUTE_IPV6_ROUTE_ADD;
+#endif /* HAVE_IPV6 */
+  else
+    return;
 
   for (ALL_LIST_ELEMENTS (krouted.client_list, node, nnode, client))
     {
       if (is_default (p))
         {
           if (client->redist_default || client->redist[rib->type])
-            {
-              if (p->family == AF_INET)
-                zsend_route_multipath (KROUTE_IPV4_ROUTE_ADD, client, p, rib);
-#ifdef HAVE_IPV6
-              if (p->family == AF_INET6)
-                zsend_route_multipath (KROUTE_IPV6_ROUTE_ADD, client, p, rib);
-#endif /* HAVE_IPV6 */	  
-	    }
+            redistribute_send (cmd, client, p, rib, &s);
         }
       else if (client->redist[rib->type])
-        {
-          if (p->family == AF_INET)
-            zsend_route_multipath (KROUTE_IPV4_ROUTE_ADD, client, p, rib);
-#ifdef HAVE_IPV6
-          if (p->family == AF_INET6)
-            zsend_route_multipath (KROUTE_IPV6_ROUTE_ADD, client, p, rib);
-#endif /* HAVE_IPV6 */	  
-        }
+        redistribute_send (cmd, client, p, rib, &s);
     }
+
+  if (s)
+    stream_free (s);
 }
 
 void
@@ -205,37 +321,35 @@ redistribute_delete (struct prefix *p, struct rib *rib)
 {
   struct listnode *node, *nnode;
   struct zserv *client;
+  struct stream *s = NULL;
+  int cmd;
 
   /* Add DISTANCE_INFINITY check. */
   if (rib->distance == DISTANCE_INFINITY)
     return;
 
+  if (p->family == AF_INET)
+    cmd = KROUTE_IPV4_ROUTE_DELETE;
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    cmd = KROUTE_IPV6_ROUTE_DELETE;
+#endif /* HAVE_IPV6 */
+  else
+    return;
+
   for (ALL_LIST_ELEMENTS (krouted.client_list, node, nnode, client))
     {
       if (is_default (p))
 	{
 	  if (client->redist_default || client->redist[rib->type])
-	    {
-	      if (p->family == AF_INET)
-		zsend_route_multipath (KROUTE_IPV4_ROUTE_DELETE, client, p,
-				       rib);
-#ifdef HAVE_IPV6
-	      if (p->family == AF_INET6)
-		zsend_route_multipath (KROUTE_IPV6_ROUTE_DELETE, client, p,
-				       rib);
-#endif /* HAVE_IPV6 */
-	    }
+	    redistribute_send (cmd, client, p, rib, &s);
 	}
       else if (client->redist[rib->type])
-	{
-	  if (p->family == AF_INET)
-	    zsend_route_multipath (KROUTE_IPV4_ROUTE_DELETE, client, p, rib);
-#ifdef HAVE_IPV6
-	  if (p->family == AF_INET6)
-	    zsend_route_multipath (KROUTE_IPV6_ROUTE_DELETE, client, p, rib);
-#endif /* HAVE_IPV6 */
-	}
+	redistribute_send (cmd, client, p, rib, &s);
     }
+
+  if (s)
+    stream_free (s);
 }
 
 void
@@ -251,7 +365,9 @@ kroute_redistribute_add (int command, struct zserv *client, int length)
   if (! client->redist[type])
     {
       client->redist[type] = 1;
-      kroute_redistribute (client, type);
+      client->redist_dump[type] = 1;
+      if (! client->redist_blocked)
+	redistribute_dump_schedule (client);
     }
 }
 
@@ -266,6 +382,9 @@ kroute_redistribute_delete (int command, struct zserv *client, int length)
     return;
 
   client->redist[type] = 0;
+  client->redist_dump[type] = 0;
+  if (client->redist_cursor.next && client->redist_cursor_type == type)
+    rib_type_remove (&client->redist_cursor);
 }
 
 void
@@ -34,6 +34,8 @@ extern void kroute_redistribute_default_delete (int, struct zserv *, int);
 
 extern void redistribute_add (struct prefix *, struct rib *);
 extern void redistribute_delete (struct prefix *, struct rib *);
+extern void redistribute_dump_resume (struct zserv *);
+extern void redistribute_dump_stop (struct zserv *);
 
 extern void kroute_interface_up_update (struct interface *);
 extern void kroute_interface_down_update (struct interface *);
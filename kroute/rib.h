@@ -29,6 +29,16 @@
 
 /* Routing information base. */
 
+/* Membership of a per type list of ribs, which lets redistribution
+   find the routes of one type without walking the whole table.  Links
+   with no route node are place holders kept by walkers of the list. */
+struct rib_type_link
+{
+  struct rib_type_link *next;
+  struct rib_type_link *prev;
+  struct route_node *rn;
+};
+
 union g_addr {
   struct in_addr ipv4;
 #ifdef HAVE_IPV6
@@ -81,6 +91,9 @@ struct rib
   u_char nexthop_num;
   u_char nexthop_active_num;
   u_char nexthop_fib_num;
+
+  /* Per type list, see rib_type_list(). */
+  struct rib_type_link type_link;
 };
 
 /* meta-queue structure:
@@ -246,6 +259,9 @@ extern struct nexthop *nexthop_ipv6_add (struct rib *, struct in6_addr *);
 extern struct vrf *vrf_lookup (u_int32_t);
 extern struct route_table *vrf_table (afi_t afi, safi_t safi, u_int32_t id);
 extern struct route_table *vrf_static_table (afi_t afi, safi_t safi, u_int32_t id);
+extern struct rib_type_link *rib_type_list (afi_t, int);
+extern void rib_type_insert (struct rib_type_link *, struct rib_type_link *);
+extern void rib_type_remove (struct rib_type_link *);
 
 /* NOTE:
  * All rib_add_ipv[46]* functions will not just add prefix into RIB, but
@@ -269,6 +285,7 @@ extern void rib_update (void);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
 extern void rib_close (void);
+extern void rib_fib_failed (struct prefix *);
 extern void rib_init (void);
 extern unsigned long rib_score_proto (u_char proto);
 
@@ -20,6 +20,7 @@
  */
 
 #include <kroute.h>
+#include <poll.h>
 
 /* Hack for GNU libc version 2. */
 #ifndef MSG_TRUNC
@@ -42,6 +43,7 @@
 #include "kroute/redistribute.h"
 #include "kroute/interface.h"
 #include "kroute/debug.h"
+#include "kroute/dplane.h"
 
 #define NL_PKT_BUF_SIZE 4096
 
@@ -234,6 +236,11 @@ netlink_request (int family, int type, struct nlsock *nl)
       return -1;
     }
 
+  /* The reply is read straight off the socket, which the dataplane
+     must be done with. */
+  if (nl == &netlink_cmd)
+    dplane_sync ();
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -317,6 +324,15 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *),
       for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
            h = NLMSG_NEXT (h, status))
         {
+          /* Skip replies to earlier requests, such as the ACKs of route
+             changes the dataplane stopped waiting for. */
+          if (nl == &netlink_cmd && h->nlmsg_seq != (u_int32_t) nl->seq)
+            {
+              zlog_warn ("%s: skipping reply with seq=%u, expected seq=%u",
+                         nl->name, h->nlmsg_seq, (u_int32_t) nl->seq);
+              continue;
+            }
+
           /* Finish of reading. */
           if (h->nlmsg_type == NLMSG_DONE)
             return ret;
@@ -1315,6 +1331,9 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
   int save_errno;
 
+  if (nl == &netlink_cmd)
+    dplane_sync ();
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -1351,6 +1370,191 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   return netlink_parse_info (netlink_talk_filter, nl);
 }
 
+/* Route changes are not talked through one at a time: netlink_route_
+   multipath() queues them with the dataplane, which hands them back
+   here in runs.  A run is packed into buffers that go to the kernel in
+   a single sendmsg() each.  The kernel answers every message of a
+   sendmsg() before the call returns, so the ACKs are all read back
+   straight after, and how many messages a buffer may carry is bounded
+   by how many ACKs fit in the command socket's receive buffer. */
+#define NL_BATCH_BUF_SIZE	32768
+#define NL_BATCH_WINDOW		2048
+
+/* Receive buffer asked for on the command socket, and how much of it
+   each ACK is counted as taking. */
+#define NL_BATCH_RCVBUF		(4 * 1024 * 1024)
+#define NL_BATCH_ACK_SIZE	1024
+
+/* How long to wait for the ACKs of a buffer, in milliseconds. */
+#define NL_BATCH_TIMEOUT	2000
+
+/* Messages per buffer. */
+static unsigned int nl_batch_window = 1;
+
+/* Size the window to the command socket's receive buffer. */
+static void
+netlink_batch_init (void)
+{
+  int size = NL_BATCH_RCVBUF;
+  socklen_t len = sizeof (size);
+  int ret;
+
+  if (netlink_cmd.sock < 0)
+    return;
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  ret = setsockopt (netlink_cmd.sock, SOL_SOCKET, SO_RCVBUFFORCE,
+		    &size, sizeof (size));
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+  if (ret < 0)
+    setsockopt (netlink_cmd.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof (size));
+
+  if (getsockopt (netlink_cmd.sock, SOL_SOCKET, SO_RCVBUF, &size, &len) < 0)
+    size = 0;
+
+#if defined(SOL_NETLINK) && defined(NETLINK_CAP_ACK)
+  /* Errors need not echo back the whole route. */
+  {
+    int one = 1;
+    setsockopt (netlink_cmd.sock, SOL_NETLINK, NETLINK_CAP_ACK,
+		&one, sizeof (one));
+  }
+#endif
+
+  nl_batch_window = size / NL_BATCH_ACK_SIZE;
+  if (nl_batch_window > NL_BATCH_WINDOW)
+    nl_batch_window = NL_BATCH_WINDOW;
+  if (nl_batch_window < 1)
+    nl_batch_window = 1;
+
+  if (IS_KROUTE_DEBUG_KERNEL)
+    zlog_debug ("%s: receive buffer %d, %u route changes per send",
+		netlink_cmd.name, size, nl_batch_window);
+}
+
+/* Read back the ACKs for ctx[0..n), sent with sequence numbers from
+   seq on.  Changes whose ACK is lost, to an overrun or a kernel that
+   stopped answering, fail with the receive error or ETIMEDOUT; ACKs
+   that come in later are skipped by sequence number. */
+static void
+netlink_batch_acks (struct dplane_ctx **ctx, unsigned int n, u_int32_t seq)
+{
+  char buf[NL_PKT_BUF_SIZE];
+  struct iovec iov = { buf, sizeof buf };
+  struct sockaddr_nl snl;
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  struct pollfd pfd;
+  struct nlmsghdr *h;
+  struct nlmsgerr *err;
+  unsigned int acked = 0;
+  u_int32_t i;
+  int status;
+  int error = ETIMEDOUT;
+
+  pfd.fd = netlink_cmd.sock;
+  pfd.events = POLLIN;
+
+  /* -1 until acked. */
+  for (i = 0; i < n; i++)
+    ctx[i]->error = -1;
+
+  while (acked < n)
+    {
+      status = recvmsg (netlink_cmd.sock, &msg, MSG_DONTWAIT);
+      if (status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno != EWOULDBLOCK && errno != EAGAIN)
+	    error = errno;
+	  else if (poll (&pfd, 1, NL_BATCH_TIMEOUT) > 0)
+	    continue;
+	  break;
+	}
+      if (status == 0)
+	break;
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+	   h = NLMSG_NEXT (h, status))
+	{
+	  if (h->nlmsg_type != NLMSG_ERROR
+	      || h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	    continue;
+
+	  err = (struct nlmsgerr *) NLMSG_DATA (h);
+	  i = h->nlmsg_seq - seq;
+	  if (i >= n || ctx[i]->error != -1)
+	    continue;
+	  ctx[i]->error = -err->error;
+	  acked++;
+	}
+    }
+
+  for (i = 0; acked < n && i < n; i++)
+    if (ctx[i]->error == -1)
+      {
+	ctx[i]->error = error;
+	acked++;
+      }
+}
+
+/* The dataplane's provider write: send ctx[0..n) in as few buffers as
+   will hold them. */
+static void
+netlink_batch_write (struct dplane_ctx **ctx, unsigned int n)
+{
+  char buf[NL_BATCH_BUF_SIZE];
+  struct sockaddr_nl snl;
+  struct iovec iov;
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  struct nlmsghdr *h;
+  unsigned int first, i;
+  u_int32_t seq;
+  size_t len;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  for (first = 0; first < n; first = i)
+    {
+      len = 0;
+      seq = netlink_cmd.seq + 1;
+      for (i = first; i < n && i - first < nl_batch_window; i++)
+	{
+	  if (len + NLMSG_ALIGN (ctx[i]->len) > sizeof (buf))
+	    break;
+
+	  h = (struct nlmsghdr *) (buf + len);
+	  memcpy (h, ctx[i]->msg, ctx[i]->len);
+	  h->nlmsg_seq = ++netlink_cmd.seq;
+	  h->nlmsg_pid = netlink_cmd.snl.nl_pid;
+	  h->nlmsg_flags |= NLM_F_ACK;
+	  len += NLMSG_ALIGN (ctx[i]->len);
+	}
+
+      iov.iov_base = buf;
+      iov.iov_len = len;
+      if (sendmsg (netlink_cmd.sock, &msg, 0) < 0)
+	{
+	  int save_errno = errno;
+
+	  while (first < i)
+	    ctx[first++]->error = save_errno;
+	  continue;
+	}
+
+      netlink_batch_acks (ctx + first, i - first, seq);
+    }
+}
+
+static const struct dplane_provider netlink_dplane =
+{
+  "netlink",
+  netlink_batch_write,
+};
+
 /* Routing table change via netlink interface. */
 static int
 netlink_route (int cmd, int family, void *dest, int length, void *gate,
@@ -1848,7 +2052,11 @@ skip:
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
-  /* Talk to netlink socket. */
+  /* Queue it for the dataplane, or talk to netlink socket if it won't
+     fit. */
+  if (dplane_enqueue (cmd == RTM_NEWROUTE ? DPLANE_OP_INSTALL
+		      : DPLANE_OP_UNINSTALL, p, &req.n, req.n.nlmsg_len) == 0)
+    return 0;
   return netlink_talk (&req.n, &netlink_cmd);
 }
 
@@ -2006,6 +2214,9 @@ kernel_init (void)
 #endif /* HAVE_IPV6 */
   netlink_socket (&netlink, groups);
   netlink_socket (&netlink_cmd, 0);
+  netlink_batch_init ();
+  if (netlink_cmd.sock > 0)
+    dplane_provider_set (&netlink_dplane);
 
   /* Register kernel socket. */
   if (netlink.sock > 0)
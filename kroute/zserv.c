@@ -94,20 +94,19 @@ zserv_flush_data(struct thread *thread)
     case BUFFER_PENDING:
       client->t_write = thread_add_write(krouted.master, zserv_flush_data,
       					 client, client->sock);
+      redistribute_dump_resume (client);
       break;
     case BUFFER_EMPTY:
+      redistribute_dump_resume (client);
       break;
     }
   return 0;
 }
 
 static int
-kroute_server_send_message(struct zserv *client)
+kroute_server_send_status(struct zserv *client, buffer_status_t status)
 {
-  if (client->t_suicide)
-    return -1;
-  switch (buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
-		       stream_get_endp(client->obuf)))
+  switch (status)
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zserv client fd %d, closing",
@@ -121,6 +120,7 @@ kroute_server_send_message(struct zserv *client)
       return -1;
     case BUFFER_EMPTY:
       THREAD_OFF(client->t_write);
+      redistribute_dump_resume (client);
       break;
     case BUFFER_PENDING:
       THREAD_WRITE_ON(krouted.master, client->t_write,
@@ -130,6 +130,28 @@ kroute_server_send_message(struct zserv *client)
   return 0;
 }
 
+static int
+kroute_server_send_message(struct zserv *client)
+{
+  if (client->t_suicide)
+    return -1;
+  return kroute_server_send_status (client,
+	   buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
+			stream_get_endp(client->obuf)));
+}
+
+/* Send a message which may be sent to other clients as well.  Whatever
+   can not be written at once is queued by reference, so the stream must
+   not be modified afterwards. */
+int
+zsend_stream (struct zserv *client, struct stream *s)
+{
+  if (client->t_suicide)
+    return -1;
+  return kroute_server_send_status (client,
+	   buffer_write_stream(client->wb, client->sock, s));
+}
+
 static void
 zserv_create_header (struct stream *s, uint16_t cmd)
 {
@@ -348,18 +370,16 @@ zsend_interface_update (int cmd, struct zserv *client, struct interface *ifp)
  * zapi_ipv{4,6}_{add, delete} should be re-written to avoid code
  * duplication.
  */
-int
-zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
-                       struct rib *rib)
+void
+zserv_encode_route_multipath (int cmd, struct stream *s, struct prefix *p,
+                              struct rib *rib)
 {
   int psize;
-  struct stream *s;
   struct nexthop *nexthop;
   unsigned long nhnummark = 0, messmark = 0;
   int nhnum = 0;
   u_char zapi_flags = 0;
   
-  s = client->obuf;
   stream_reset (s);
   
   zserv_create_header (s, cmd);
@@ -457,7 +477,13 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   
   /* Write packet size. */
   stream_putw_at (s, 0, stream_get_endp (s));
+}
 
+int
+zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
+                       struct rib *rib)
+{
+  zserv_encode_route_multipath (cmd, client->obuf, p, rib);
   return kroute_server_send_message(client);
 }
 
@@ -712,90 +738,140 @@ zread_interface_delete (struct zserv *client, u_short length)
   return 0;
 }
 
-/* This function support multiple nexthop. */
-/* 
- * Parse the KROUTE_IPV4_ROUTE_ADD sent from client. Update rib and
- * add kernel route. 
- */
-static int
-zread_ipv4_add (struct zserv *client, u_short length)
+/* The part of an IPv4 route message after its prefix, which a bulk
+   message sends once for all its prefixes. */
+struct zread_route
 {
-  int i;
-  struct rib *rib;
-  struct prefix_ipv4 p;
-  u_char message;
-  struct in_addr nexthop;
   u_char nexthop_num;
-  u_char nexthop_type;
-  struct stream *s;
-  unsigned int ifindex;
-  u_char ifname_len;
-  safi_t safi;	
+  u_char nexthop_type[256];
+  struct in_addr nexthop[256];
+  unsigned int ifindex[256];
 
+  /* A delete goes by the last gateway and interface only. */
+  struct in_addr *gate;
+  unsigned int ifindex_last;
 
-  /* Get input stream.  */
-  s = client->ibuf;
-
-  /* Allocate new rib. */
-  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-  
-  /* Type, flags, message. */
-  rib->type = stream_getc (s);
-  rib->flags = stream_getc (s);
-  message = stream_getc (s); 
-  safi = stream_getw (s);
-  rib->uptime = time (NULL);
+  u_char distance;
+  u_int32_t metric;
+};
 
-  /* IPv4 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv4));
-  p.family = AF_INET;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+/* Parse the nexthops, distance and metric of a route message. */
+static void
+zread_ipv4_route (struct stream *s, u_char message, struct zread_route *route)
+{
+  int i, n;
+  u_char ifname_len;
 
-  /* Nexthop parse. */
+  route->nexthop_num = 0;
+  route->gate = NULL;
+  route->ifindex_last = 0;
   if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
     {
-      nexthop_num = stream_getc (s);
+      n = stream_getc (s);
 
-      for (i = 0; i < nexthop_num; i++)
+      for (i = 0; i < n; i++)
 	{
-	  nexthop_type = stream_getc (s);
+	  route->nexthop_type[route->nexthop_num] = stream_getc (s);
 
-	  switch (nexthop_type)
+	  switch (route->nexthop_type[route->nexthop_num])
 	    {
 	    case KROUTE_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      nexthop_ifindex_add (rib, ifindex);
+	      route->ifindex_last = stream_getl (s);
+	      route->ifindex[route->nexthop_num++] = route->ifindex_last;
 	      break;
 	    case KROUTE_NEXTHOP_IFNAME:
 	      ifname_len = stream_getc (s);
 	      stream_forward_getp (s, ifname_len);
 	      break;
 	    case KROUTE_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      nexthop_ipv4_add (rib, &nexthop, NULL);
+	      route->nexthop[route->nexthop_num].s_addr = stream_get_ipv4 (s);
+	      route->gate = &route->nexthop[route->nexthop_num++];
 	      break;
 	    case KROUTE_NEXTHOP_IPV6:
 	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
 	      break;
-            case KROUTE_NEXTHOP_BLACKHOLE:
-              nexthop_blackhole_add (rib);
-              break;
-            }
+	    case KROUTE_NEXTHOP_BLACKHOLE:
+	      route->nexthop_num++;
+	      break;
+	    }
 	}
     }
 
   /* Distance. */
+  route->distance = 0;
   if (CHECK_FLAG (message, ZAPI_MESSAGE_DISTANCE))
-    rib->distance = stream_getc (s);
+    route->distance = stream_getc (s);
 
   /* Metric. */
+  route->metric = 0;
   if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
-    rib->metric = stream_getl (s);
-    
-  /* Table */
-  rib->table=krouted.rtm_table_default;
-  rib_add_ipv4_multipath (&p, rib, safi);
+    route->metric = stream_getl (s);
+}
+
+/* Add prefix p with a parsed route's nexthops to the rib. */
+static void
+zread_ipv4_route_add (struct prefix_ipv4 *p, u_char type, u_char flags,
+		      safi_t safi, struct zread_route *route)
+{
+  struct rib *rib;
+  int i;
+
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = type;
+  rib->flags = flags;
+  rib->uptime = time (NULL);
+  rib->distance = route->distance;
+  rib->metric = route->metric;
+  rib->table = krouted.rtm_table_default;
+  for (i = 0; i < route->nexthop_num; i++)
+    switch (route->nexthop_type[i])
+      {
+      case KROUTE_NEXTHOP_IFINDEX:
+	nexthop_ifindex_add (rib, route->ifindex[i]);
+	break;
+      case KROUTE_NEXTHOP_IPV4:
+	nexthop_ipv4_add (rib, &route->nexthop[i], NULL);
+	break;
+      case KROUTE_NEXTHOP_BLACKHOLE:
+	nexthop_blackhole_add (rib);
+	break;
+      }
+  rib_add_ipv4_multipath (p, rib, safi);
+}
+
+/* This function support multiple nexthop. */
+/* 
+ * Parse the KROUTE_IPV4_ROUTE_ADD sent from client. Update rib and
+ * add kernel route. 
+ */
+static int
+zread_ipv4_add (struct zserv *client, u_short length)
+{
+  struct prefix_ipv4 p;
+  struct zread_route route;
+  u_char type, flags, message;
+  struct stream *s;
+  safi_t safi;	
+
+  /* Get input stream.  */
+  s = client->ibuf;
+
+  /* Type, flags, message. */
+  type = stream_getc (s);
+  flags = stream_getc (s);
+  message = stream_getc (s); 
+  safi = stream_getw (s);
+
+  /* IPv4 prefix. */
+  memset (&p, 0, sizeof (struct prefix_ipv4));
+  p.family = AF_INET;
+  p.prefixlen = stream_getc (s);
+  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+  /* Nexthop, distance, metric. */
+  zread_ipv4_route (s, message, &route);
+
+  zread_ipv4_route_add (&p, type, flags, safi, &route);
   return 0;
 }
 
@@ -803,20 +879,12 @@ zread_ipv4_add (struct zserv *client, u_short length)
 static int
 zread_ipv4_delete (struct zserv *client, u_short length)
 {
-  int i;
   struct stream *s;
   struct zapi_ipv4 api;
-  struct in_addr nexthop, *nexthop_p;
-  unsigned long ifindex;
   struct prefix_ipv4 p;
-  u_char nexthop_num;
-  u_char nexthop_type;
-  u_char ifname_len;
+  struct zread_route route;
   
   s = client->ibuf;
-  ifindex = 0;
-  nexthop.s_addr = 0;
-  nexthop_p = NULL;
 
   /* Type, flags, message. */
   api.type = stream_getc (s);
@@ -831,48 +899,60 @@ zread_ipv4_delete (struct zserv *client, u_short length)
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
   /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      nexthop_num = stream_getc (s);
+  zread_ipv4_route (s, api.message, &route);
+    
+  rib_delete_ipv4 (api.type, api.flags, &p, route.gate, route.ifindex_last,
+		   client->rtm_table, api.safi);
+  return 0;
+}
 
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop_type = stream_getc (s);
+/* Parse a KROUTE_IPV4_ROUTE_BULK_ADD or _DELETE: a run of prefixes
+   sharing the rest of a route message, see zapi_ipv4_route().  Each
+   prefix is added or deleted just as a message of its own would be. */
+static int
+zread_ipv4_bulk (struct zserv *client, int add)
+{
+  struct stream *s;
+  struct prefix_ipv4 p;
+  struct zread_route route;
+  u_char type, flags, message;
+  safi_t safi;
+  u_int16_t count;
 
-	  switch (nexthop_type)
-	    {
-	    case KROUTE_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      break;
-	    case KROUTE_NEXTHOP_IFNAME:
-	      ifname_len = stream_getc (s);
-	      stream_forward_getp (s, ifname_len);
-	      break;
-	    case KROUTE_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      nexthop_p = &nexthop;
-	      break;
-	    case KROUTE_NEXTHOP_IPV6:
-	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
-	      break;
-	    }
-	}
-    }
+  s = client->ibuf;
 
-  /* Distance. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
-  else
-    api.distance = 0;
+  type = stream_getc (s);
+  flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
 
-  /* Metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
-  else
-    api.metric = 0;
-    
-  rib_delete_ipv4 (api.type, api.flags, &p, nexthop_p, ifindex,
-		   client->rtm_table, api.safi);
+  zread_ipv4_route (s, message, &route);
+
+  count = stream_getw (s);
+
+  memset (&p, 0, sizeof (struct prefix_ipv4));
+  p.family = AF_INET;
+  while (count--)
+    {
+      if (STREAM_READABLE (s) < 1)
+	break;
+      p.prefixlen = stream_getc (s);
+      if (p.prefixlen > IPV4_MAX_BITLEN
+	  || STREAM_READABLE (s) < (size_t) PSIZE (p.prefixlen))
+	{
+	  zlog_warn ("%s: client %d sent a malformed prefix, giving up on "
+		     "the rest of the message", __func__, client->sock);
+	  break;
+	}
+      p.prefix.s_addr = 0;
+      stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+      if (add)
+	zread_ipv4_route_add (&p, type, flags, safi, &route);
+      else
+	rib_delete_ipv4 (type, flags, &p, route.gate, route.ifindex_last,
+			 client->rtm_table, safi);
+    }
   return 0;
 }
 
@@ -1068,14 +1148,35 @@ zread_router_id_delete (struct zserv *client, u_short length)
   return 0;
 }
 
+/* Answer a client's offer of protocol extensions with those we
+   support. */
+static int
+zsend_hello (struct zserv *client, u_char caps)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, KROUTE_HELLO);
+  stream_putc (s, caps);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return kroute_server_send_message(client);
+}
+
 /* Tie up route-type and client->sock */
 static void
-zread_hello (struct zserv *client)
+zread_hello (struct zserv *client, u_short length)
 {
   /* type of protocol (lib/kroute.h) */
   u_char proto;
   proto = stream_getc (client->ibuf);
 
+  /* Older clients offer no extensions, and must not be answered. */
+  if (length >= 2)
+    zsend_hello (client, stream_getc (client->ibuf) & ZAPI_CAP_BULK);
+
   /* accept only dynamic routing protocols */
   if ((proto < KROUTE_ROUTE_MAX)
   &&  (proto > KROUTE_ROUTE_STATIC))
@@ -1128,6 +1229,8 @@ kroute_client_close (struct zserv *client)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
+  if (client->rbuf)
+    stream_free (client->rbuf);
   if (client->wb)
     buffer_free(client->wb);
 
@@ -1138,6 +1241,7 @@ kroute_client_close (struct zserv *client)
     thread_cancel (client->t_write);
   if (client->t_suicide)
     thread_cancel (client->t_suicide);
+  redistribute_dump_stop (client);
 
   /* Free client structure. */
   listnode_delete (krouted.client_list, client);
@@ -1156,6 +1260,7 @@ kroute_client_create (int sock)
   client->sock = sock;
   client->ibuf = stream_new (KROUTE_MAX_PACKET_SIZ);
   client->obuf = stream_new (KROUTE_MAX_PACKET_SIZ);
+  client->rbuf = stream_new (KROUTE_READ_BUFSIZ);
   client->wb = buffer_new(0);
 
   /* Set table number. */
@@ -1168,106 +1273,14 @@ kroute_client_create (int sock)
   kroute_event (KROUTE_READ, sock, client);
 }
 
-/* Handler of kroute service request. */
-static int
-kroute_client_read (struct thread *thread)
+/* Handle the message in client->ibuf, its header already read. */
+static void
+kroute_client_dispatch (struct zserv *client, uint16_t command,
+			uint16_t length)
 {
-  int sock;
-  struct zserv *client;
-  size_t already;
-  uint16_t length, command;
-  uint8_t marker, version;
-
-  /* Get thread data.  Reset reading thread because I'm running. */
-  sock = THREAD_FD (thread);
-  client = THREAD_ARG (thread);
-  client->t_read = NULL;
-
-  if (client->t_suicide)
-    {
-      kroute_client_close(client);
-      return -1;
-    }
-
-  /* Read length and command (if we don't have it already). */
-  if ((already = stream_get_endp(client->ibuf)) < KROUTE_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     KROUTE_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_KROUTE_DEBUG_EVENT)
-	    zlog_debug ("connection closed socket [%d]", sock);
-	  kroute_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(KROUTE_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  kroute_event (KROUTE_READ, sock, client);
-	  return 0;
-	}
-      already = KROUTE_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(client->ibuf, 0);
-
-  /* Fetch header values */
-  length = stream_getw (client->ibuf);
-  marker = stream_getc (client->ibuf);
-  version = stream_getc (client->ibuf);
-  command = stream_getw (client->ibuf);
-
-  if (marker != KROUTE_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, sock, marker, version);
-      kroute_client_close (client);
-      return -1;
-    }
-  if (length < KROUTE_HEADER_SIZE) 
-    {
-      zlog_warn("%s: socket %d message length %u is less than header size %d",
-	        __func__, sock, length, KROUTE_HEADER_SIZE);
-      kroute_client_close (client);
-      return -1;
-    }
-  if (length > STREAM_SIZE(client->ibuf))
-    {
-      zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
-	        __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
-      kroute_client_close (client);
-      return -1;
-    }
-
-  /* Read rest of data. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_KROUTE_DEBUG_EVENT)
-	    zlog_debug ("connection closed [%d] when reading kroute data", sock);
-	  kroute_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(length-already))
-        {
-	  /* Try again later. */
-	  kroute_event (KROUTE_READ, sock, client);
-	  return 0;
-	}
-    }
-
-  length -= KROUTE_HEADER_SIZE;
-
   /* Debug packet information. */
   if (IS_KROUTE_DEBUG_EVENT)
-    zlog_debug ("kroute message comes from socket [%d]", sock);
+    zlog_debug ("kroute message comes from socket [%d]", client->sock);
 
   if (IS_KROUTE_DEBUG_PACKET && IS_KROUTE_DEBUG_RECV)
     zlog_debug ("kroute message received [%s] %d", 
@@ -1325,22 +1338,129 @@ kroute_client_read (struct thread *thread)
       zread_ipv4_import_lookup (client, length);
       break;
     case KROUTE_HELLO:
-      zread_hello (client);
+      zread_hello (client, length);
+      break;
+    case KROUTE_IPV4_ROUTE_BULK_ADD:
+      zread_ipv4_bulk (client, 1);
+      break;
+    case KROUTE_IPV4_ROUTE_BULK_DELETE:
+      zread_ipv4_bulk (client, 0);
       break;
     default:
       zlog_info ("Kroute received unknown command %d", command);
       break;
     }
+}
+
+/* Handler of kroute service request.  Reads as much as the client has
+   sent, then handles the complete messages among it, up to
+   KROUTE_READ_MSGS of them before letting other work run; the rest,
+   and any message not yet complete, wait in client->rbuf. */
+static int
+kroute_client_read (struct thread *thread)
+{
+  int sock;
+  struct zserv *client;
+  struct stream *rbuf;
+  size_t start;
+  uint16_t length, command;
+  uint8_t marker, version;
+  int count;
+
+  /* Get thread data.  Reset reading thread because I'm running. */
+  sock = THREAD_FD (thread);
+  client = THREAD_ARG (thread);
+  client->t_read = NULL;
 
   if (client->t_suicide)
     {
-      /* No need to wait for thread callback, just kill immediately. */
       kroute_client_close(client);
       return -1;
     }
 
-  stream_reset (client->ibuf);
-  kroute_event (KROUTE_READ, sock, client);
+  /* Read whatever there is room for.  The buffer is only full when
+     we were called back to handle messages already read. */
+  rbuf = client->rbuf;
+  if (STREAM_WRITEABLE (rbuf))
+    {
+      ssize_t nbyte;
+      if (((nbyte = stream_read_try (rbuf, sock,
+				     STREAM_WRITEABLE (rbuf))) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (IS_KROUTE_DEBUG_EVENT)
+	    zlog_debug ("connection closed socket [%d]", sock);
+	  kroute_client_close (client);
+	  return -1;
+	}
+    }
+
+  for (count = 0; count < KROUTE_READ_MSGS; count++)
+    {
+      if (STREAM_READABLE (rbuf) < KROUTE_HEADER_SIZE)
+	break;
+
+      /* Fetch header values */
+      start = stream_get_getp (rbuf);
+      length = stream_getw (rbuf);
+      marker = stream_getc (rbuf);
+      version = stream_getc (rbuf);
+      command = stream_getw (rbuf);
+
+      if (marker != KROUTE_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+		   __func__, sock, marker, version);
+	  kroute_client_close (client);
+	  return -1;
+	}
+      if (length < KROUTE_HEADER_SIZE) 
+	{
+	  zlog_warn("%s: socket %d message length %u is less than header size %d",
+		    __func__, sock, length, KROUTE_HEADER_SIZE);
+	  kroute_client_close (client);
+	  return -1;
+	}
+      if (length > STREAM_SIZE(client->ibuf))
+	{
+	  zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
+		    __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
+	  kroute_client_close (client);
+	  return -1;
+	}
+
+      /* The rest of it is still to come. */
+      if (STREAM_READABLE (rbuf) < (size_t) length - KROUTE_HEADER_SIZE)
+	{
+	  stream_set_getp (rbuf, start);
+	  break;
+	}
+
+      /* Handlers see the message alone, as if read by itself. */
+      stream_reset (client->ibuf);
+      stream_put (client->ibuf, STREAM_DATA (rbuf) + start, length);
+      stream_set_getp (client->ibuf, KROUTE_HEADER_SIZE);
+      stream_forward_getp (rbuf, length - KROUTE_HEADER_SIZE);
+
+      kroute_client_dispatch (client, command, length - KROUTE_HEADER_SIZE);
+
+      if (client->t_suicide)
+	{
+	  /* No need to wait for thread callback, just kill immediately. */
+	  kroute_client_close(client);
+	  return -1;
+	}
+    }
+
+  stream_pulldown (rbuf);
+
+  /* Out of turns with messages perhaps still waiting: come back for
+     them whether or not the client sends more. */
+  if (count == KROUTE_READ_MSGS)
+    client->t_read = thread_add_event (krouted.master, kroute_client_read,
+				       client, sock);
+  else
+    kroute_event (KROUTE_READ, sock, client);
   return 0;
 }
 
@@ -42,6 +42,9 @@ struct zserv
   struct stream *ibuf;
   struct stream *obuf;
 
+  /* Data read from the client, messages not yet handled. */
+  struct stream *rbuf;
+
   /* Buffer of data waiting to be written to client. */
   struct buffer *wb;
 
@@ -61,6 +64,17 @@ struct zserv
   /* Redistribute default route flag. */
   u_char redist_default;
 
+  /* Redistribution dump in progress: the types still to be sent, and
+     the place it has got to in the type list being walked. */
+  u_char redist_dump[KROUTE_ROUTE_MAX];
+  struct rib_type_link redist_cursor;
+  afi_t redist_cursor_afi;
+  int redist_cursor_type;
+  struct thread *t_redist;
+
+  /* The dump is waiting for queued output to drain. */
+  u_char redist_blocked;
+
   /* Interface information. */
   u_char ifinfo;
 
@@ -106,6 +120,9 @@ extern int zsend_interface_address (int, struct zserv *, struct interface *,
 extern int zsend_interface_update (int, struct zserv *, struct interface *);
 extern int zsend_route_multipath (int, struct zserv *, struct prefix *, 
                                   struct rib *);
+extern void zserv_encode_route_multipath (int, struct stream *,
+                                          struct prefix *, struct rib *);
+extern int zsend_stream (struct zserv *, struct stream *);
 extern int zsend_router_id_update(struct zserv *, struct prefix *);
 
 extern pid_t pid;
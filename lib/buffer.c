@@ -24,6 +24,7 @@
 
 #include "memory.h"
 #include "buffer.h"
+#include "stream.h"
 #include "log.h"
 #include "network.h"
 #include <stddef.h>
@@ -52,18 +53,29 @@ struct buffer_data
   /* Pointer to data not yet flushed. */
   size_t sp;
 
+  /* If set, the chunk holds no data of its own but refers to this
+     stream's data between sp and cp (see buffer_put_stream). */
+  struct stream *stream;
+
   /* Actual data stream (variable length). */
   unsigned char data[];  /* real dimension is buffer->size */
 };
 
 /* It should always be true that: 0 <= sp <= cp <= size */
 
+#define BUFFER_DATA_PTR(D) \
+  ((D)->stream ? STREAM_DATA((D)->stream) : (D)->data)
+
 /* Default buffer size (used if none specified).  It is rounded up to the
    next page boundery. */
 #define BUFFER_SIZE_DEFAULT		4096
 
 
-#define BUFFER_DATA_FREE(D) XFREE(MTYPE_BUFFER_DATA, (D))
+#define BUFFER_DATA_FREE(D) \
+  do { \
+    stream_free ((D)->stream); \
+    XFREE(MTYPE_BUFFER_DATA, (D)); \
+  } while (0)
 
 /* Make new buffer. */
 struct buffer *
@@ -113,7 +125,7 @@ buffer_getstr (struct buffer *b)
   p = s;
   for (data = b->head; data; data = data->next)
     {
-      memcpy(p, data->data + data->sp, data->cp - data->sp);
+      memcpy(p, BUFFER_DATA_PTR(data) + data->sp, data->cp - data->sp);
       p += data->cp - data->sp;
     }
   *p = '\0';
@@ -127,6 +139,17 @@ buffer_empty (struct buffer *b)
   return (b->head == NULL);
 }
 
+size_t
+buffer_pending (struct buffer *b)
+{
+  struct buffer_data *data;
+  size_t total = 0;
+
+  for (data = b->head; data; data = data->next)
+    total += data->cp - data->sp;
+  return total;
+}
+
 /* Clear and free all allocated data. */
 void
 buffer_reset (struct buffer *b)
@@ -150,6 +173,7 @@ buffer_add (struct buffer *b)
 
   d = XMALLOC(MTYPE_BUFFER_DATA, offsetof(struct buffer_data, data[b->size]));
   d->cp = d->sp = 0;
+  d->stream = NULL;
   d->next = NULL;
 
   if (b->tail)
@@ -174,7 +198,7 @@ buffer_put(struct buffer *b, const void *p, size_t size)
       size_t chunk;
 
       /* If there is no data buffer add it. */
-      if (data == NULL || data->cp == b->size)
+      if (data == NULL || data->stream || data->cp == b->size)
 	data = buffer_add (b);
 
       chunk = ((size <= (b->size - data->cp)) ? size : (b->size - data->cp));
@@ -185,6 +209,52 @@ buffer_put(struct buffer *b, const void *p, size_t size)
     }
 }
 
+/* Streams with less than this left to send are copied rather than
+   queued by reference: a reference holds the whole stream, however few
+   of its bytes are queued, and a run of small chunks makes for short
+   writes, as each writev takes at most MAX_CHUNKS of them. */
+#define BUFFER_STREAM_COPY_MAX	1024
+
+/* Queue the readable part of a stream past its first skip bytes. */
+static void
+buffer_put_stream_skip (struct buffer *b, struct stream *s, size_t skip)
+{
+  struct buffer_data *d;
+  size_t sp = stream_get_getp (s) + skip;
+  size_t cp = stream_get_endp (s);
+
+  if (sp >= cp)
+    return;
+
+  if (cp - sp < BUFFER_STREAM_COPY_MAX)
+    {
+      buffer_put (b, STREAM_DATA (s) + sp, cp - sp);
+      return;
+    }
+
+  d = XMALLOC(MTYPE_BUFFER_DATA, offsetof(struct buffer_data, data));
+  d->stream = stream_clone (s);
+  d->sp = sp;
+  d->cp = cp;
+  d->next = NULL;
+
+  if (b->tail)
+    b->tail->next = d;
+  else
+    b->head = d;
+  b->tail = d;
+}
+
+/* Queue the readable part of a stream without copying it.  The buffer
+   keeps a clone of the stream, so the same message can be queued on any
+   number of buffers while being encoded only once.  Short messages are
+   copied instead. */
+void
+buffer_put_stream (struct buffer *b, struct stream *s)
+{
+  buffer_put_stream_skip (b, s, 0);
+}
+
 /* Insert character into the buffer. */
 void
 buffer_putc (struct buffer *b, u_char c)
@@ -291,9 +361,9 @@ buffer_flush_window (struct buffer *b, int fd, int width, int height,
         {
 	  /* Calculate lines remaining and column position after displaying
 	     this character. */
-	  if (data->data[cp] == '\r')
+	  if (BUFFER_DATA_PTR(data)[cp] == '\r')
 	    column = 1;
-	  else if ((data->data[cp] == '\n') || (column == width))
+	  else if ((BUFFER_DATA_PTR(data)[cp] == '\n') || (column == width))
 	    {
 	      column = 1;
 	      height--;
@@ -302,7 +372,7 @@ buffer_flush_window (struct buffer *b, int fd, int width, int height,
 	    column++;
 	  cp++;
         }
-      iov[iov_index].iov_base = (char *)(data->data + data->sp);
+      iov[iov_index].iov_base = (char *)(BUFFER_DATA_PTR(data) + data->sp);
       iov[iov_index++].iov_len = cp-data->sp;
       data->sp = cp;
 
@@ -412,7 +482,7 @@ in one shot. */
   for (d = b->head; d && (iovcnt < MAX_CHUNKS) && (nbyte < MAX_FLUSH);
        d = d->next, iovcnt++)
     {
-      iov[iovcnt].iov_base = d->data+d->sp;
+      iov[iovcnt].iov_base = BUFFER_DATA_PTR(d)+d->sp;
       nbyte += (iov[iovcnt].iov_len = d->cp-d->sp);
     }
 
@@ -494,3 +564,31 @@ buffer_write(struct buffer *b, int fd, const void *p, size_t size)
   }
   return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
 }
+
+/* As buffer_write, but anything which cannot be written at once is
+   queued with buffer_put_stream, by reference unless short.  The
+   stream's getp is left alone. */
+buffer_status_t
+buffer_write_stream (struct buffer *b, int fd, struct stream *s)
+{
+  ssize_t nbytes;
+  size_t size = STREAM_READABLE (s);
+
+  if (b->head)
+    /* Buffer is not empty, so do not attempt to write the new data. */
+    nbytes = 0;
+  else if ((nbytes = write(fd, stream_pnt (s), size)) < 0)
+    {
+      if (ERRNO_IO_RETRY(errno))
+        nbytes = 0;
+      else
+        {
+	  zlog_warn("%s: write error on fd %d: %s",
+		    __func__, fd, safe_strerror(errno));
+	  return BUFFER_ERROR;
+	}
+    }
+  /* Queue any remaining data. */
+  buffer_put_stream_skip (b, s, nbytes);
+  return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
+}
@@ -23,6 +23,7 @@
 #ifndef _KROUTE_BUFFER_H
 #define _KROUTE_BUFFER_H
 
+struct stream;
 
 /* Create a new buffer.  Memory will be allocated in chunks of the given
    size.  If the argument is 0, the library will supply a reasonable
@@ -42,6 +43,11 @@ extern void buffer_put (struct buffer *, const void *, size_t);
 extern void buffer_putc (struct buffer *, u_char);
 /* Add a NUL-terminated string to the end of the buffer. */
 extern void buffer_putstr (struct buffer *, const char *);
+/* Add the readable part of a stream to the end of the buffer by reference,
+   without copying, unless it is short enough to copy.  The stream data
+   must not change afterwards (see stream_clone); the caller still frees
+   its own stream. */
+extern void buffer_put_stream (struct buffer *, struct stream *);
 
 /* Combine all accumulated (and unflushed) data inside the buffer into a
    single NUL-terminated string allocated using XMALLOC(MTYPE_TMP).  Note
@@ -52,6 +58,9 @@ char *buffer_getstr (struct buffer *);
 /* Returns 1 if there is no pending data in the buffer.  Otherwise returns 0. */
 int buffer_empty (struct buffer *);
 
+/* Returns the number of bytes waiting to be flushed. */
+extern size_t buffer_pending (struct buffer *);
+
 typedef enum
   {
     /* An I/O error occurred.  The buffer should be destroyed and the
@@ -73,6 +82,11 @@ typedef enum
 extern buffer_status_t buffer_write(struct buffer *, int fd,
 				    const void *, size_t);
 
+/* Like buffer_write for the readable part of a stream, but any remainder
+   is queued with buffer_put_stream. */
+extern buffer_status_t buffer_write_stream(struct buffer *, int fd,
+					   struct stream *);
+
 /* This function attempts to flush some (but perhaps not all) of 
    the queued data to the given file descriptor. */
 extern buffer_status_t buffer_flush_available(struct buffer *, int fd);
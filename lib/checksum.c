@@ -9,57 +9,333 @@
 #include <kroute.h>
 #include "checksum.h"
 
+/* SSE2 and AVX2 versions are built with per-function target attributes,
+   so they need no special compiler flags and are only called when the
+   CPU has the instructions. */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) \
+	|| __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CHECKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+/* Each implementation sums as much of the data as it can in whole
+   blocks, adds that to the accumulators and returns the number of
+   bytes it consumed.  The byte at a time code in in_cksum() and
+   fletcher_checksum() does the rest, and all of it for the reference
+   implementation. */
+struct checksum_ops
+{
+  const char *name;
+  int (*available) (void);
+  size_t (*in_sum) (const u_char *, size_t, u_int64_t *sum);
+  size_t (*fletcher_sum) (const u_char *, size_t,
+			  u_int64_t *c0, u_int64_t *c1);
+};
+
+static int
+checksum_always (void)
+{
+  return 1;
+}
+
+/* Portable version: 64 bit loads, each adding two 32 bit words to a 64
+   bit accumulator.  Modulo 0xffff a 32 bit word is the sum of its two
+   16 bit halves, whatever the byte order, so folding the total down to
+   16 bits gives the same checksum as adding 16 bit words. */
+static size_t
+in_sum_word64 (const u_char *p, size_t len, u_int64_t *sum)
+{
+  u_int64_t s = *sum;
+  u_int64_t w;
+  size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      memcpy (&w, p + i, sizeof (w));
+      s += (w & 0xffffffff) + (w >> 32);
+    }
+  *sum = s;
+  return i;
+}
+
+/* Fletcher over 8 bytes at a time: after a block of n bytes b[0..n-1],
+   c0 grows by their sum and c1 by n * c0 plus the sum of (n - i) * b[i]. */
+static size_t
+fletcher_sum_word64 (const u_char *p, size_t len,
+		     u_int64_t *c0, u_int64_t *c1)
+{
+  u_int64_t s0 = *c0, s1 = *c1;
+  size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      s1 += 8 * s0 + 8 * p[i] + 7 * p[i + 1] + 6 * p[i + 2] + 5 * p[i + 3]
+	    + 4 * p[i + 4] + 3 * p[i + 5] + 2 * p[i + 6] + p[i + 7];
+      s0 += p[i] + p[i + 1] + p[i + 2] + p[i + 3]
+	    + p[i + 4] + p[i + 5] + p[i + 6] + p[i + 7];
+    }
+  *c0 = s0;
+  *c1 = s1;
+  return i;
+}
+
+#ifdef CHECKSUM_X86
+static int
+checksum_sse2 (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("sse2");
+}
+
+static int
+checksum_avx2 (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+}
+
+/* 16 bytes at a time, the 32 bit words zero extended into 64 bit lanes. */
+__attribute__ ((target ("sse2")))
+static size_t
+in_sum_sse2 (const u_char *p, size_t len, u_int64_t *sum)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i acc = zero;
+  __m128i v;
+  u_int64_t lanes[2];
+  size_t i;
+
+  for (i = 0; i + 16 <= len; i += 16)
+    {
+      v = _mm_loadu_si128 ((const __m128i *) (p + i));
+      acc = _mm_add_epi64 (acc, _mm_unpacklo_epi32 (v, zero));
+      acc = _mm_add_epi64 (acc, _mm_unpackhi_epi32 (v, zero));
+    }
+  _mm_storeu_si128 ((__m128i *) lanes, acc);
+  *sum += lanes[0] + lanes[1];
+  return i;
+}
+
+/* Per 16 byte block the byte sum comes from psadbw and the weighted sum
+   (16 - i) * b[i] from pmaddwd.  vs accumulates byte sums, vps the byte
+   sums of all blocks before each one, which is what the n * c0 term
+   adds up to within the run. */
+__attribute__ ((target ("sse2")))
+static size_t
+fletcher_sum_sse2 (const u_char *p, size_t len,
+		   u_int64_t *c0, u_int64_t *c1)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i wlo = _mm_set_epi16 (9, 10, 11, 12, 13, 14, 15, 16);
+  const __m128i whi = _mm_set_epi16 (1, 2, 3, 4, 5, 6, 7, 8);
+  __m128i vs = zero, vps = zero, vw = zero;
+  __m128i v;
+  u_int64_t s[2], ps[2];
+  u_int32_t w[4];
+  size_t i;
+
+  for (i = 0; i + 16 <= len; i += 16)
+    {
+      v = _mm_loadu_si128 ((const __m128i *) (p + i));
+      vps = _mm_add_epi64 (vps, vs);
+      vs = _mm_add_epi64 (vs, _mm_sad_epu8 (v, zero));
+      vw = _mm_add_epi32 (vw,
+			  _mm_madd_epi16 (_mm_unpacklo_epi8 (v, zero), wlo));
+      vw = _mm_add_epi32 (vw,
+			  _mm_madd_epi16 (_mm_unpackhi_epi8 (v, zero), whi));
+    }
+  _mm_storeu_si128 ((__m128i *) s, vs);
+  _mm_storeu_si128 ((__m128i *) ps, vps);
+  _mm_storeu_si128 ((__m128i *) w, vw);
+
+  *c1 += i * *c0 + 16 * (ps[0] + ps[1])
+	 + (u_int64_t) w[0] + w[1] + w[2] + w[3];
+  *c0 += s[0] + s[1];
+  return i;
+}
+
+__attribute__ ((target ("avx2")))
+static size_t
+in_sum_avx2 (const u_char *p, size_t len, u_int64_t *sum)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  __m256i acc = zero;
+  __m256i v;
+  u_int64_t lanes[4];
+  size_t i;
+
+  for (i = 0; i + 32 <= len; i += 32)
+    {
+      v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+      acc = _mm256_add_epi64 (acc, _mm256_unpacklo_epi32 (v, zero));
+      acc = _mm256_add_epi64 (acc, _mm256_unpackhi_epi32 (v, zero));
+    }
+  _mm256_storeu_si256 ((__m256i *) lanes, acc);
+  *sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+/* As the SSE2 version over 32 byte blocks; pmaddubsw takes the byte
+   weights 32..1 directly. */
+__attribute__ ((target ("avx2")))
+static size_t
+fletcher_sum_avx2 (const u_char *p, size_t len,
+		   u_int64_t *c0, u_int64_t *c1)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i ones = _mm256_set1_epi16 (1);
+  const __m256i weights = _mm256_set_epi8 (1, 2, 3, 4, 5, 6, 7, 8,
+					   9, 10, 11, 12, 13, 14, 15, 16,
+					   17, 18, 19, 20, 21, 22, 23, 24,
+					   25, 26, 27, 28, 29, 30, 31, 32);
+  __m256i vs = zero, vps = zero, vw = zero;
+  __m256i v;
+  u_int64_t s[4], ps[4];
+  u_int32_t w[8];
+  size_t i;
+
+  for (i = 0; i + 32 <= len; i += 32)
+    {
+      v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+      vps = _mm256_add_epi64 (vps, vs);
+      vs = _mm256_add_epi64 (vs, _mm256_sad_epu8 (v, zero));
+      vw = _mm256_add_epi32 (vw,
+			     _mm256_madd_epi16 (_mm256_maddubs_epi16 (v, weights),
+						ones));
+    }
+  _mm256_storeu_si256 ((__m256i *) s, vs);
+  _mm256_storeu_si256 ((__m256i *) ps, vps);
+  _mm256_storeu_si256 ((__m256i *) w, vw);
+
+  *c1 += i * *c0 + 32 * (ps[0] + ps[1] + ps[2] + ps[3])
+	 + (u_int64_t) w[0] + w[1] + w[2] + w[3] + w[4] + w[5] + w[6] + w[7];
+  *c0 += s[0] + s[1] + s[2] + s[3];
+  return i;
+}
+#endif /* CHECKSUM_X86 */
+
+static const struct checksum_ops checksum_impls[CHECKSUM_IMPL_MAX] =
+{
+  [CHECKSUM_IMPL_REFERENCE] = { "reference", checksum_always, NULL, NULL },
+  [CHECKSUM_IMPL_WORD64] = { "word64", checksum_always,
+			     in_sum_word64, fletcher_sum_word64 },
+#ifdef CHECKSUM_X86
+  [CHECKSUM_IMPL_SSE2] = { "sse2", checksum_sse2,
+			   in_sum_sse2, fletcher_sum_sse2 },
+  [CHECKSUM_IMPL_AVX2] = { "avx2", checksum_avx2,
+			   in_sum_avx2, fletcher_sum_avx2 },
+#else
+  [CHECKSUM_IMPL_SSE2] = { "sse2", NULL, NULL, NULL },
+  [CHECKSUM_IMPL_AVX2] = { "avx2", NULL, NULL, NULL },
+#endif /* CHECKSUM_X86 */
+};
+
+/* Chosen on first use. */
+static const struct checksum_ops *checksum_ops;
+
+int
+checksum_impl_select (int impl)
+{
+  if (impl == CHECKSUM_IMPL_BEST)
+    {
+      for (impl = CHECKSUM_IMPL_MAX - 1; impl > 0; impl--)
+	if (checksum_impls[impl].available
+	    && (*checksum_impls[impl].available) ())
+	  break;
+    }
+  else if (impl < 0 || impl >= CHECKSUM_IMPL_MAX
+	   || ! checksum_impls[impl].available
+	   || ! (*checksum_impls[impl].available) ())
+    return -1;
+
+  checksum_ops = &checksum_impls[impl];
+  return impl;
+}
+
+const char *
+checksum_impl_name (int impl)
+{
+  if (impl < 0 || impl >= CHECKSUM_IMPL_MAX)
+    return "unknown";
+  return checksum_impls[impl].name;
+}
+
+static const struct checksum_ops *
+checksum_ops_get (void)
+{
+  if (! checksum_ops)
+    checksum_impl_select (CHECKSUM_IMPL_BEST);
+  return checksum_ops;
+}
+
 int			/* return checksum in low-order 16 bits */
 in_cksum(void *parg, int nbytes)
 {
-	u_short *ptr = parg;
-	register long		sum;		/* assumes long == 32 bits */
-	u_short			oddbyte;
+	const struct checksum_ops *ops = checksum_ops_get ();
+	u_char *p = parg;
+	u_int64_t		sum;
+	u_short			word;
+	size_t			done = 0;
 	register u_short	answer;		/* assumes u_short == 16 bits */
 
 	/*
-	 * Our algorithm is simple, using a 32-bit accumulator (sum),
+	 * Our algorithm is simple, using a 64-bit accumulator (sum),
 	 * we add sequential 16-bit words to it, and at the end, fold back
 	 * all the carry bits from the top 16 bits into the lower 16 bits.
+	 * The accelerated versions add the bulk of the data in larger
+	 * words first.
 	 */
 
 	sum = 0;
+	if (ops->in_sum && nbytes > 0)
+		done = (*ops->in_sum) (p, nbytes, &sum);
+	p += done;
+	nbytes -= done;
+
 	while (nbytes > 1)  {
-		sum += *ptr++;
+		memcpy (&word, p, sizeof (word));
+		sum += word;
+		p += 2;
 		nbytes -= 2;
 	}
 
 				/* mop up an odd byte, if necessary */
 	if (nbytes == 1) {
-		oddbyte = 0;		/* make sure top half is zero */
-		*((u_char *) &oddbyte) = *(u_char *)ptr;   /* one byte only */
-		sum += oddbyte;
+		word = 0;		/* make sure top half is zero */
+		*((u_char *) &word) = *p;   /* one byte only */
+		sum += word;
 	}
 
 	/*
 	 * Add back carry outs from top 16 bits to low 16 bits.
 	 */
 
-	sum  = (sum >> 16) + (sum & 0xffff);	/* add high-16 to low-16 */
-	sum += (sum >> 16);			/* add carry */
+	while (sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
 	answer = ~sum;		/* ones-complement, then truncate to 16 bits */
 	return(answer);
 }
 
 /* Fletcher Checksum -- Refer to RFC1008. */
-#define MODX                 4102   /* 5802 should be fine */
 
-/* To be consistent, offset is 0-based index, rather than the 1-based 
+/* Bytes summed between reductions modulo 255.  c1 grows with the square
+   of this and must not overflow its 64 bits. */
+#define FLETCHER_CHUNK       65536
+
+/* To be consistent, offset is 0-based index, rather than the 1-based
    index required in the specification ISO 8473, Annex C.1 */
 u_int16_t
 fletcher_checksum(u_char * buffer, const size_t len, const uint16_t offset)
 {
+  const struct checksum_ops *ops = checksum_ops_get ();
   u_int8_t *p;
-  int x, y, c0, c1;
+  int x, y;
+  u_int64_t c0, c1;
   u_int16_t checksum;
   u_int16_t *csum;
   size_t partial_len, i, left = len;
-  
+
   checksum = 0;
 
   assert (offset < len);
@@ -76,29 +352,32 @@ fletcher_checksum(u_char * buffer, const size_t len, const uint16_t offset)
 
   while (left != 0)
     {
-      partial_len = MIN(left, MODX);
+      partial_len = MIN(left, FLETCHER_CHUNK);
 
-      for (i = 0; i < partial_len; i++)
+      i = ops->fletcher_sum ? (*ops->fletcher_sum) (p, partial_len, &c0, &c1)
+			    : 0;
+      for (; i < partial_len; i++)
 	{
-	  c0 = c0 + *(p++);
+	  c0 = c0 + p[i];
 	  c1 += c0;
 	}
 
       c0 = c0 % 255;
       c1 = c1 % 255;
 
+      p += partial_len;
       left -= partial_len;
     }
-  
+
   /* The cast is important, to ensure the mod is taken as a signed value. */
   x = (int)((len - offset - 1) * c0 - c1) % 255;
 
   if (x <= 0)
     x += 255;
-  y = 510 - c0 - x;
-  if (y > 255)  
+  y = 510 - (int) c0 - x;
+  if (y > 255)
     y -= 255;
-  
+
   /*
    * Now we write this to the packet.
    * We could skip this step too, since the checksum returned would
@@ -1,2 +1,19 @@
 extern int in_cksum(void *, int);
 extern u_int16_t fletcher_checksum(u_char *, const size_t len, const uint16_t offset);
+
+/* Implementations of the checksums above.  The fastest one the CPU
+   supports is used unless another is selected, e.g. by a test. */
+enum checksum_impl
+{
+  CHECKSUM_IMPL_BEST = -1,
+  CHECKSUM_IMPL_REFERENCE,	/* 16 bit words, bytes */
+  CHECKSUM_IMPL_WORD64,		/* portable, 64 bit words */
+  CHECKSUM_IMPL_SSE2,
+  CHECKSUM_IMPL_AVX2,
+  CHECKSUM_IMPL_MAX,
+};
+
+/* Returns the implementation now in use, or -1 if impl is not
+   available on this CPU. */
+extern int checksum_impl_select (int impl);
+extern const char *checksum_impl_name (int impl);
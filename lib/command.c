@@ -30,6 +30,7 @@ Boston, MA 02111-1307, USA.  */
 #include "vty.h"
 #include "command.h"
 #include "workqueue.h"
+#include "hash.h"
 
 /* Command vector which includes some level of command lists. Normally
    each daemon maintains each own cmdvec. */
@@ -186,6 +187,64 @@ argv_concat (const char **argv, int argc, int shift)
   return str;
 }
 
+/* A node's commands compiled into a tree of their tokens.  Commands
+   with the same first n tokens share the path of trie nodes down to
+   depth n, so matching a line only looks at the branches its words
+   lead to rather than at every command of the node. */
+struct cmd_trie
+{
+  /* This token's alternatives, the descvec of the first command
+     installed through here.  NULL at the root. */
+  vector descvec;
+
+  /* Set if the token is a single plain keyword. */
+  const char *keyword;
+
+  /* Children for plain keywords, sorted by keyword, and the others:
+     variables, ranges, addresses and alternatives. */
+  vector keywords;
+  vector others;
+
+  /* Commands ending here. */
+  vector cmds;
+
+  /* Commands ending here or below, and the least cmdsize of them. */
+  unsigned int count;
+  unsigned int cmdsize_min;
+};
+
+static struct cmd_trie *
+cmd_trie_new (vector descvec)
+{
+  struct cmd_trie *trie;
+
+  trie = XCALLOC (MTYPE_CMD_TRIE, sizeof (struct cmd_trie));
+  trie->descvec = descvec;
+  return trie;
+}
+
+static void
+cmd_trie_free (struct cmd_trie *trie)
+{
+  unsigned int i;
+
+  if (trie->keywords)
+    {
+      for (i = 0; i < vector_active (trie->keywords); i++)
+	cmd_trie_free (vector_slot (trie->keywords, i));
+      vector_free (trie->keywords);
+    }
+  if (trie->others)
+    {
+      for (i = 0; i < vector_active (trie->others); i++)
+	cmd_trie_free (vector_slot (trie->others, i));
+      vector_free (trie->others);
+    }
+  if (trie->cmds)
+    vector_free (trie->cmds);
+  XFREE (MTYPE_CMD_TRIE, trie);
+}
+
 /* Install top node of command vector. */
 void
 install_node (struct cmd_node *node, 
@@ -194,6 +253,7 @@ install_node (struct cmd_node *node,
   vector_set_index (cmdvec, node->node, node);
   node->func = func;
   node->cmd_vector = vector_init (VECTOR_MIN_SIZE);
+  node->cmd_trie = cmd_trie_new (NULL);
 }
 
 /* Compare two command's string.  Used in sort_node (). */
@@ -467,6 +527,140 @@ cmd_cmdsize (vector strvec)
   return size;
 }
 
+/* The keyword if descvec is a single plain keyword, NULL otherwise. */
+static const char *
+cmd_descvec_keyword (vector descvec)
+{
+  struct desc *desc;
+
+  if (vector_active (descvec) != 1
+      || (desc = vector_slot (descvec, 0)) == NULL
+      || desc->cmd == NULL)
+    return NULL;
+
+  if (CMD_VARARG (desc->cmd) || CMD_OPTION (desc->cmd)
+      || CMD_VARIABLE (desc->cmd))
+    return NULL;
+
+  return desc->cmd;
+}
+
+static int
+cmd_descvec_same (vector a, vector b)
+{
+  unsigned int i;
+  struct desc *da, *db;
+
+  if (vector_active (a) != vector_active (b))
+    return 0;
+
+  for (i = 0; i < vector_active (a); i++)
+    {
+      da = vector_slot (a, i);
+      db = vector_slot (b, i);
+      if (da == NULL || db == NULL || da->cmd == NULL || db->cmd == NULL)
+	{
+	  if (da != db)
+	    return 0;
+	}
+      else if (strcmp (da->cmd, db->cmd) != 0)
+	return 0;
+    }
+  return 1;
+}
+
+/* Index of the first keyword child not sorting before str. */
+static unsigned int
+cmd_trie_keyword_find (vector keywords, const char *str)
+{
+  unsigned int low = 0, high = vector_active (keywords), mid;
+  struct cmd_trie *child;
+
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      child = vector_slot (keywords, mid);
+      if (strcmp (child->keyword, str) < 0)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  return low;
+}
+
+/* Find or make the child of trie for token descvec. */
+static struct cmd_trie *
+cmd_trie_child (struct cmd_trie *trie, vector descvec)
+{
+  struct cmd_trie *child;
+  const char *keyword;
+  unsigned int i;
+
+  if ((keyword = cmd_descvec_keyword (descvec)) != NULL)
+    {
+      if (trie->keywords == NULL)
+	trie->keywords = vector_init (VECTOR_MIN_SIZE);
+
+      i = cmd_trie_keyword_find (trie->keywords, keyword);
+      if (i < vector_active (trie->keywords))
+	{
+	  child = vector_slot (trie->keywords, i);
+	  if (strcmp (child->keyword, keyword) == 0)
+	    return child;
+	}
+
+      child = cmd_trie_new (descvec);
+      child->keyword = keyword;
+
+      vector_ensure (trie->keywords, vector_active (trie->keywords));
+      memmove (&trie->keywords->index[i + 1], &trie->keywords->index[i],
+	       (vector_active (trie->keywords) - i) * sizeof (void *));
+      vector_slot (trie->keywords, i) = child;
+      vector_active (trie->keywords)++;
+      return child;
+    }
+
+  if (trie->others == NULL)
+    trie->others = vector_init (VECTOR_MIN_SIZE);
+
+  for (i = 0; i < vector_active (trie->others); i++)
+    {
+      child = vector_slot (trie->others, i);
+      if (cmd_descvec_same (child->descvec, descvec))
+	return child;
+    }
+
+  child = cmd_trie_new (descvec);
+  vector_set_index (trie->others, vector_active (trie->others), child);
+  return child;
+}
+
+static void
+cmd_trie_account (struct cmd_trie *trie, struct cmd_element *cmd)
+{
+  if (trie->count == 0 || cmd->cmdsize < trie->cmdsize_min)
+    trie->cmdsize_min = cmd->cmdsize;
+  trie->count++;
+}
+
+static void
+cmd_trie_insert (struct cmd_trie *root, struct cmd_element *cmd)
+{
+  struct cmd_trie *trie = root;
+  unsigned int i;
+
+  cmd_trie_account (trie, cmd);
+  for (i = 0; i < vector_active (cmd->strvec); i++)
+    {
+      trie = cmd_trie_child (trie, vector_slot (cmd->strvec, i));
+      cmd_trie_account (trie, cmd);
+    }
+
+  if (trie->cmds == NULL)
+    trie->cmds = vector_init (VECTOR_MIN_SIZE);
+  vector_set_index (trie->cmds, vector_active (trie->cmds), cmd);
+}
+
 /* Return prompt character of specified node. */
 const char *
 cmd_prompt (enum node_type node)
@@ -502,6 +696,7 @@ install_element (enum node_type ntype, struct cmd_element *cmd)
     cmd->strvec = cmd_make_descvec (cmd->string, cmd->doc);
 
   cmd->cmdsize = cmd_cmdsize (cmd->strvec);
+  cmd_trie_insert (cnode->cmd_trie, cmd);
 }
 
 static const unsigned char itoa64[] =
@@ -607,6 +802,19 @@ config_write_host (struct vty *vty)
     vty_out (vty, "log timestamp precision %d%s",
 	     zlog_default->timestamp_precision, VTY_NEWLINE);
 
+  {
+    unsigned int size, queued;
+    unsigned long written, dropped;
+
+    if (zlog_async_stats (&size, &queued, &written, &dropped))
+      {
+	if (size == ZLOG_ASYNC_DEFAULT)
+	  vty_out (vty, "log async%s", VTY_NEWLINE);
+	else
+	  vty_out (vty, "log async %u%s", size, VTY_NEWLINE);
+      }
+  }
+
   if (host.advanced)
     vty_out (vty, "service advanced-vty%s", VTY_NEWLINE);
 
@@ -1130,131 +1338,102 @@ cmd_range_match (const char *range, const char *str)
   return 1;
 }
 
-/* Make completion match and return match type flag. */
+/* Best match of command against one token of a command string, the
+   alternatives in descvec; no_match if none matches.  Strict matching,
+   for configuration, takes keywords and addresses only in full. */
 static enum match_type
-cmd_filter_by_completion (char *command, vector v, unsigned int index)
+cmd_descvec_match (const char *command, vector descvec, int strict)
 {
-  unsigned int i;
+  unsigned int j;
   const char *str;
-  struct cmd_element *cmd_element;
-  enum match_type match_type;
-  vector descvec;
   struct desc *desc;
+  enum match_type match_type = no_match;
 
-  match_type = no_match;
-
-  /* If command and cmd_element string does not match set NULL to vector */
-  for (i = 0; i < vector_active (v); i++)
-    if ((cmd_element = vector_slot (v, i)) != NULL)
+  for (j = 0; j < vector_active (descvec); j++)
+    if ((desc = vector_slot (descvec, j)))
       {
-	if (index >= vector_active (cmd_element->strvec))
-	  vector_slot (v, i) = NULL;
-	else
-	  {
-	    unsigned int j;
-	    int matched = 0;
-
-	    descvec = vector_slot (cmd_element->strvec, index);
+	str = desc->cmd;
 
-	    for (j = 0; j < vector_active (descvec); j++)
-	      if ((desc = vector_slot (descvec, j)))
-		{
-		  str = desc->cmd;
-		  
-		  if (CMD_VARARG (str))
-		    {
-		      if (match_type < vararg_match)
-			match_type = vararg_match;
-		      matched++;
-		    }
-		  else if (CMD_RANGE (str))
-		    {
-		      if (cmd_range_match (str, command))
-			{
-			  if (match_type < range_match)
-			    match_type = range_match;
-
-			  matched++;
-			}
-		    }
+	if (CMD_VARARG (str))
+	  {
+	    if (match_type < vararg_match)
+	      match_type = vararg_match;
+	  }
+	else if (CMD_RANGE (str))
+	  {
+	    if (cmd_range_match (str, command))
+	      {
+		if (match_type < range_match)
+		  match_type = range_match;
+	      }
+	  }
 #ifdef HAVE_IPV6
-		  else if (CMD_IPV6 (str))
-		    {
-		      if (cmd_ipv6_match (command))
-			{
-			  if (match_type < ipv6_match)
-			    match_type = ipv6_match;
-
-			  matched++;
-			}
-		    }
-		  else if (CMD_IPV6_PREFIX (str))
-		    {
-		      if (cmd_ipv6_prefix_match (command))
-			{
-			  if (match_type < ipv6_prefix_match)
-			    match_type = ipv6_prefix_match;
-
-			  matched++;
-			}
-		    }
+	else if (CMD_IPV6 (str))
+	  {
+	    if (strict ? cmd_ipv6_match (command) == exact_match
+		       : cmd_ipv6_match (command) != no_match)
+	      {
+		if (match_type < ipv6_match)
+		  match_type = ipv6_match;
+	      }
+	  }
+	else if (CMD_IPV6_PREFIX (str))
+	  {
+	    if (strict ? cmd_ipv6_prefix_match (command) == exact_match
+		       : cmd_ipv6_prefix_match (command) != no_match)
+	      {
+		if (match_type < ipv6_prefix_match)
+		  match_type = ipv6_prefix_match;
+	      }
+	  }
 #endif /* HAVE_IPV6  */
-		  else if (CMD_IPV4 (str))
-		    {
-		      if (cmd_ipv4_match (command))
-			{
-			  if (match_type < ipv4_match)
-			    match_type = ipv4_match;
-
-			  matched++;
-			}
-		    }
-		  else if (CMD_IPV4_PREFIX (str))
-		    {
-		      if (cmd_ipv4_prefix_match (command))
-			{
-			  if (match_type < ipv4_prefix_match)
-			    match_type = ipv4_prefix_match;
-			  matched++;
-			}
-		    }
-		  else
-		    /* Check is this point's argument optional ? */
-		  if (CMD_OPTION (str) || CMD_VARIABLE (str))
-		    {
-		      if (match_type < extend_match)
-			match_type = extend_match;
-		      matched++;
-		    }
-		  else if (strncmp (command, str, strlen (command)) == 0)
-		    {
-		      if (strcmp (command, str) == 0)
-			match_type = exact_match;
-		      else
-			{
-			  if (match_type < partly_match)
-			    match_type = partly_match;
-			}
-		      matched++;
-		    }
-		}
-	    if (!matched)
-	      vector_slot (v, i) = NULL;
+	else if (CMD_IPV4 (str))
+	  {
+	    if (strict ? cmd_ipv4_match (command) == exact_match
+		       : cmd_ipv4_match (command) != no_match)
+	      {
+		if (match_type < ipv4_match)
+		  match_type = ipv4_match;
+	      }
+	  }
+	else if (CMD_IPV4_PREFIX (str))
+	  {
+	    if (strict ? cmd_ipv4_prefix_match (command) == exact_match
+		       : cmd_ipv4_prefix_match (command) != no_match)
+	      {
+		if (match_type < ipv4_prefix_match)
+		  match_type = ipv4_prefix_match;
+	      }
+	  }
+	else if (CMD_OPTION (str) || CMD_VARIABLE (str))
+	  {
+	    if (match_type < extend_match)
+	      match_type = extend_match;
+	  }
+	else if (strict)
+	  {
+	    if (strcmp (command, str) == 0)
+	      match_type = exact_match;
+	  }
+	else if (strncmp (command, str, strlen (command)) == 0)
+	  {
+	    if (strcmp (command, str) == 0)
+	      match_type = exact_match;
+	    else if (match_type < partly_match)
+	      match_type = partly_match;
 	  }
       }
   return match_type;
 }
 
-/* Filter vector by command character with index. */
+/* Filter vector of commands by the word at index, strictly or as
+   completion allows.  Returns the best match type of those left. */
 static enum match_type
-cmd_filter_by_string (char *command, vector v, unsigned int index)
+cmd_filter (char *command, vector v, unsigned int index, int strict)
 {
   unsigned int i;
-  const char *str;
   struct cmd_element *cmd_element;
-  enum match_type match_type;
-  vector descvec;
-  struct desc *desc;
+  enum match_type match_type, ret;
 
   match_type = no_match;
 
@@ -1268,89 +1447,111 @@ cmd_filter_by_string (char *command, vector v, unsigned int index)
 	  vector_slot (v, i) = NULL;
 	else
 	  {
-	    unsigned int j;
-	    int matched = 0;
+	    ret = cmd_descvec_match (command,
+				     vector_slot (cmd_element->strvec, index),
+				     strict);
+	    if (ret == no_match)
+	      vector_slot (v, i) = NULL;
+	    else if (match_type < ret)
+	      match_type = ret;
+	  }
+      }
+  return match_type;
+}
 
-	    descvec = vector_slot (cmd_element->strvec, index);
+/* Make completion match and return match type flag. */
+static enum match_type
+cmd_filter_by_completion (char *command, vector v, unsigned int index)
+{
+  return cmd_filter (command, v, index, 0);
+}
 
-	    for (j = 0; j < vector_active (descvec); j++)
-	      if ((desc = vector_slot (descvec, j)))
-		{
-		  str = desc->cmd;
+/* How the token descvec fares once the best match type of a word is
+   known.  Returns the number of its alternatives still matching, -1 if
+   the word is ambiguous or -2 if it is an incomplete prefix.  *matched
+   carries the keyword or range partly matched across calls. */
+static int
+cmd_descvec_ambiguous (const char *command, vector descvec,
+		       enum match_type type, const char **matched)
+{
+  unsigned int j;
+  const char *str;
+  struct desc *desc;
+  int match = 0;
 
-		  if (CMD_VARARG (str))
-		    {
-		      if (match_type < vararg_match)
-			match_type = vararg_match;
-		      matched++;
-		    }
-		  else if (CMD_RANGE (str))
-		    {
-		      if (cmd_range_match (str, command))
-			{
-			  if (match_type < range_match)
-			    match_type = range_match;
-			  matched++;
-			}
-		    }
+  for (j = 0; j < vector_active (descvec); j++)
+    if ((desc = vector_slot (descvec, j)))
+      {
+	enum match_type ret;
+
+	str = desc->cmd;
+
+	switch (type)
+	  {
+	  case exact_match:
+	    if (!(CMD_OPTION (str) || CMD_VARIABLE (str))
+		&& strcmp (command, str) == 0)
+	      match++;
+	    break;
+	  case partly_match:
+	    if (!(CMD_OPTION (str) || CMD_VARIABLE (str))
+		&& strncmp (command, str, strlen (command)) == 0)
+	      {
+		if (*matched && strcmp (*matched, str) != 0)
+		  return -1;	/* There is ambiguous match. */
+		else
+		  *matched = str;
+		match++;
+	      }
+	    break;
+	  case range_match:
+	    if (cmd_range_match (str, command))
+	      {
+		if (*matched && strcmp (*matched, str) != 0)
+		  return -1;
+		else
+		  *matched = str;
+		match++;
+	      }
+	    break;
 #ifdef HAVE_IPV6
-		  else if (CMD_IPV6 (str))
-		    {
-		      if (cmd_ipv6_match (command) == exact_match)
-			{
-			  if (match_type < ipv6_match)
-			    match_type = ipv6_match;
-			  matched++;
-			}
-		    }
-		  else if (CMD_IPV6_PREFIX (str))
-		    {
-		      if (cmd_ipv6_prefix_match (command) == exact_match)
-			{
-			  if (match_type < ipv6_prefix_match)
-			    match_type = ipv6_prefix_match;
-			  matched++;
-			}
-		    }
-#endif /* HAVE_IPV6  */
-		  else if (CMD_IPV4 (str))
-		    {
-		      if (cmd_ipv4_match (command) == exact_match)
-			{
-			  if (match_type < ipv4_match)
-			    match_type = ipv4_match;
-			  matched++;
-			}
-		    }
-		  else if (CMD_IPV4_PREFIX (str))
-		    {
-		      if (cmd_ipv4_prefix_match (command) == exact_match)
-			{
-			  if (match_type < ipv4_prefix_match)
-			    match_type = ipv4_prefix_match;
-			  matched++;
-			}
-		    }
-		  else if (CMD_OPTION (str) || CMD_VARIABLE (str))
-		    {
-		      if (match_type < extend_match)
-			match_type = extend_match;
-		      matched++;
-		    }
-		  else
-		    {
-		      if (strcmp (command, str) == 0)
-			{
-			  match_type = exact_match;
-			  matched++;
-			}
-		    }
-		}
-	    if (!matched)
-	      vector_slot (v, i) = NULL;
+	  case ipv6_match:
+	    if (CMD_IPV6 (str))
+	      match++;
+	    break;
+	  case ipv6_prefix_match:
+	    if ((ret = cmd_ipv6_prefix_match (command)) != no_match)
+	      {
+		if (ret == partly_match)
+		  return -2;	/* There is incomplete match. */
+
+		match++;
+	      }
+	    break;
+#endif /* HAVE_IPV6 */
+	  case ipv4_match:
+	    if (CMD_IPV4 (str))
+	      match++;
+	    break;
+	  case ipv4_prefix_match:
+	    if ((ret = cmd_ipv4_prefix_match (command)) != no_match)
+	      {
+		if (ret == partly_match)
+		  return -2;	/* There is incomplete match. */
+
+		match++;
+	      }
+	    break;
+	  case extend_match:
+	    if (CMD_OPTION (str) || CMD_VARIABLE (str))
+	      match++;
+	    break;
+	  case no_match:
+	  default:
+	    break;
 	  }
       }
-  return match_type;
+  return match;
 }
 
 /* Check ambiguous match */
@@ -1358,93 +1559,21 @@ static int
 is_cmd_ambiguous (char *command, vector v, int index, enum match_type type)
 {
   unsigned int i;
-  unsigned int j;
-  const char *str = NULL;
   struct cmd_element *cmd_element;
   const char *matched = NULL;
-  vector descvec;
-  struct desc *desc;
+  int ret;
 
   for (i = 0; i < vector_active (v); i++)
     if ((cmd_element = vector_slot (v, i)) != NULL)
       {
-	int match = 0;
-
-	descvec = vector_slot (cmd_element->strvec, index);
-
-	for (j = 0; j < vector_active (descvec); j++)
-	  if ((desc = vector_slot (descvec, j)))
-	    {
-	      enum match_type ret;
-	      
-	      str = desc->cmd;
-
-	      switch (type)
-		{
-		case exact_match:
-		  if (!(CMD_OPTION (str) || CMD_VARIABLE (str))
-		      && strcmp (command, str) == 0)
-		    match++;
-		  break;
-		case partly_match:
-		  if (!(CMD_OPTION (str) || CMD_VARIABLE (str))
-		      && strncmp (command, str, strlen (command)) == 0)
-		    {
-		      if (matched && strcmp (matched, str) != 0)
-			return 1;	/* There is ambiguous match. */
-		      else
-			matched = str;
-		      match++;
-		    }
-		  break;
-		case range_match:
-		  if (cmd_range_match (str, command))
-		    {
-		      if (matched && strcmp (matched, str) != 0)
-			return 1;
-		      else
-			matched = str;
-		      match++;
-		    }
-		  break;
-#ifdef HAVE_IPV6
-		case ipv6_match:
-		  if (CMD_IPV6 (str))
-		    match++;
-		  break;
-		case ipv6_prefix_match:
-		  if ((ret = cmd_ipv6_prefix_match (command)) != no_match)
-		    {
-		      if (ret == partly_match)
-			return 2;	/* There is incomplete match. */
-
-		      match++;
-		    }
-		  break;
-#endif /* HAVE_IPV6 */
-		case ipv4_match:
-		  if (CMD_IPV4 (str))
-		    match++;
-		  break;
-		case ipv4_prefix_match:
-		  if ((ret = cmd_ipv4_prefix_match (command)) != no_match)
-		    {
-		      if (ret == partly_match)
-			return 2;	/* There is incomplete match. */
-
-		      match++;
-		    }
-		  break;
-		case extend_match:
-		  if (CMD_OPTION (str) || CMD_VARIABLE (str))
-		    match++;
-		  break;
-		case no_match:
-		default:
-		  break;
-		}
-	    }
-	if (!match)
+	ret = cmd_descvec_ambiguous (command,
+				     vector_slot (cmd_element->strvec, index),
+				     type, &matched);
+	if (ret == -1)
+	  return 1;
+	if (ret == -2)
+	  return 2;
+	if (!ret)
 	  vector_slot (v, i) = NULL;
       }
   return 0;
@@ -1996,77 +2125,235 @@ node_parent ( enum node_type node )
       ret = CONFIG_NODE;
     }
 
-  return ret;
+  return ret;
+}
+
+/* Find the one command of the vector v that vline selects, filtering
+   a copy of v word by word. */
+static int
+cmd_vector_match (vector vline, vector v, int strict,
+		  struct cmd_element **matched)
+{
+  unsigned int i;
+  unsigned int index;
+  vector cmd_vector;
+  struct cmd_element *cmd_element;
+  unsigned int matched_count, incomplete_count;
+  enum match_type match = 0;
+  char *command;
+
+  /* Make copy of command elements. */
+  cmd_vector = vector_copy (v);
+
+  for (index = 0; index < vector_active (vline); index++)
+    if ((command = vector_slot (vline, index)))
+      {
+	int ret;
+
+	match = cmd_filter (command, cmd_vector, index, strict);
+
+	/* If command meets '.VARARG' then finish matching. */
+	if (match == vararg_match)
+	  break;
+        
+	ret = is_cmd_ambiguous (command, cmd_vector, index, match);
+
+	if (ret == 1)
+	  {
+	    vector_free (cmd_vector);
+	    return CMD_ERR_AMBIGUOUS;
+	  }
+	else if (ret == 2)
+	  {
+	    vector_free (cmd_vector);
+	    return CMD_ERR_NO_MATCH;
+	  }
+      }
+
+  /* Check matched count. */
+  *matched = NULL;
+  matched_count = 0;
+  incomplete_count = 0;
+
+  for (i = 0; i < vector_active (cmd_vector); i++)
+    if ((cmd_element = vector_slot (cmd_vector, i)))
+      {
+	if (match == vararg_match || index >= cmd_element->cmdsize)
+	  {
+	    *matched = cmd_element;
+	    matched_count++;
+	  }
+	else
+	  {
+	    incomplete_count++;
+	  }
+      }
+
+  /* Finish of using cmd_vector. */
+  vector_free (cmd_vector);
+
+  /* To execute command, matched_count must be 1. */
+  if (matched_count == 0)
+    {
+      if (incomplete_count)
+	return CMD_ERR_INCOMPLETE;
+      else
+	return CMD_ERR_NO_MATCH;
+    }
+
+  if (matched_count > 1)
+    return CMD_ERR_AMBIGUOUS;
+
+  return CMD_SUCCESS;
+}
+
+/* cmd_filter() over the children of trie: those the word matches are
+   added to v and *match raised to the best match type among them. */
+static void
+cmd_trie_filter (struct cmd_trie *trie, const char *command, int strict,
+		 vector v, enum match_type *match)
+{
+  struct cmd_trie *child;
+  enum match_type ret;
+  unsigned int i;
+
+  /* The keywords the word is a prefix of follow each other, from the
+     first one not sorting before the word. */
+  if (trie->keywords)
+    for (i = cmd_trie_keyword_find (trie->keywords, command);
+	 i < vector_active (trie->keywords); i++)
+      {
+	child = vector_slot (trie->keywords, i);
+	ret = cmd_descvec_match (command, child->descvec, strict);
+	if (ret == no_match)
+	  break;
+	vector_set_index (v, vector_active (v), child);
+	if (*match < ret)
+	  *match = ret;
+      }
+
+  if (trie->others)
+    for (i = 0; i < vector_active (trie->others); i++)
+      {
+	child = vector_slot (trie->others, i);
+	ret = cmd_descvec_match (command, child->descvec, strict);
+	if (ret == no_match)
+	  continue;
+	vector_set_index (v, vector_active (v), child);
+	if (*match < ret)
+	  *match = ret;
+      }
+}
+
+/* Count the commands at and below trie that index words complete, or
+   all of them after a vararg.  Stops once two have matched. */
+static void
+cmd_trie_count (struct cmd_trie *trie, unsigned int index, int vararg,
+		struct cmd_element **matched, unsigned int *matched_count,
+		unsigned int *incomplete_count)
+{
+  struct cmd_element *cmd_element;
+  unsigned int i;
+
+  if (*matched_count > 1)
+    return;
+
+  if (! vararg && trie->cmdsize_min > index)
+    {
+      *incomplete_count += trie->count;
+      return;
+    }
+
+  if (trie->cmds)
+    for (i = 0; i < vector_active (trie->cmds); i++)
+      {
+	cmd_element = vector_slot (trie->cmds, i);
+	if (vararg || index >= cmd_element->cmdsize)
+	  {
+	    *matched = cmd_element;
+	    (*matched_count)++;
+	  }
+	else
+	  (*incomplete_count)++;
+      }
+
+  if (trie->keywords)
+    for (i = 0; i < vector_active (trie->keywords); i++)
+      cmd_trie_count (vector_slot (trie->keywords, i), index, vararg,
+		      matched, matched_count, incomplete_count);
+  if (trie->others)
+    for (i = 0; i < vector_active (trie->others); i++)
+      cmd_trie_count (vector_slot (trie->others, i), index, vararg,
+		      matched, matched_count, incomplete_count);
 }
 
-/* Execute command by argument vline vector. */
+/* As cmd_vector_match(), following the words down the trie of a node
+   instead of filtering all its commands.  Commands sharing a trie node
+   share their tokens so far, so the filter and is_cmd_ambiguous()
+   steps keep or drop them together. */
 static int
-cmd_execute_command_real (vector vline, struct vty *vty,
-			  struct cmd_element **cmd)
+cmd_trie_match (struct cmd_trie *root, vector vline, int strict,
+		struct cmd_element **matched)
 {
-  unsigned int i;
-  unsigned int index;
-  vector cmd_vector;
-  struct cmd_element *cmd_element;
-  struct cmd_element *matched_element;
-  unsigned int matched_count, incomplete_count;
-  int argc;
-  const char *argv[CMD_ARGC_MAX];
-  enum match_type match = 0;
-  int varflag;
+  vector frontier, next;
+  struct cmd_trie *trie;
+  enum match_type match = no_match;
+  const char *ambiguous;
   char *command;
+  unsigned int index, i;
+  unsigned int matched_count, incomplete_count;
+  int ret = 0;
 
-  /* Make copy of command elements. */
-  cmd_vector = vector_copy (cmd_node_vector (cmdvec, vty->node));
+  frontier = vector_init (VECTOR_MIN_SIZE);
+  vector_set (frontier, root);
 
   for (index = 0; index < vector_active (vline); index++)
-    if ((command = vector_slot (vline, index)))
-      {
-	int ret;
-
-	match = cmd_filter_by_completion (command, cmd_vector, index);
+    {
+      command = vector_slot (vline, index);
+
+      next = vector_init (VECTOR_MIN_SIZE);
+      match = no_match;
+      for (i = 0; i < vector_active (frontier); i++)
+	cmd_trie_filter (vector_slot (frontier, i), command, strict,
+			 next, &match);
+      vector_free (frontier);
+      frontier = next;
+
+      /* If command meets '.VARARG' then finish matching. */
+      if (match == vararg_match)
+	break;
 
-	if (match == vararg_match)
-	  break;
-        
-	ret = is_cmd_ambiguous (command, cmd_vector, index, match);
+      next = vector_init (VECTOR_MIN_SIZE);
+      ambiguous = NULL;
+      for (i = 0; i < vector_active (frontier); i++)
+	{
+	  trie = vector_slot (frontier, i);
+	  ret = cmd_descvec_ambiguous (command, trie->descvec, match,
+				       &ambiguous);
+	  if (ret < 0)
+	    break;
+	  if (ret)
+	    vector_set_index (next, vector_active (next), trie);
+	}
+      vector_free (frontier);
+      frontier = next;
 
-	if (ret == 1)
-	  {
-	    vector_free (cmd_vector);
-	    return CMD_ERR_AMBIGUOUS;
-	  }
-	else if (ret == 2)
-	  {
-	    vector_free (cmd_vector);
-	    return CMD_ERR_NO_MATCH;
-	  }
-      }
+      if (ret < 0)
+	{
+	  vector_free (frontier);
+	  return ret == -1 ? CMD_ERR_AMBIGUOUS : CMD_ERR_NO_MATCH;
+	}
+    }
 
   /* Check matched count. */
-  matched_element = NULL;
+  *matched = NULL;
   matched_count = 0;
   incomplete_count = 0;
 
-  for (i = 0; i < vector_active (cmd_vector); i++)
-    if ((cmd_element = vector_slot (cmd_vector, i)))
-      {
-	if (match == vararg_match || index >= cmd_element->cmdsize)
-	  {
-	    matched_element = cmd_element;
-#if 0
-	    printf ("DEBUG: %s\n", cmd_element->string);
-#endif
-	    matched_count++;
-	  }
-	else
-	  {
-	    incomplete_count++;
-	  }
-      }
-
-  /* Finish of using cmd_vector. */
-  vector_free (cmd_vector);
+  for (i = 0; i < vector_active (frontier); i++)
+    cmd_trie_count (vector_slot (frontier, i), index, match == vararg_match,
+		    matched, &matched_count, &incomplete_count);
+  vector_free (frontier);
 
   /* To execute command, matched_count must be 1. */
   if (matched_count == 0)
@@ -2080,6 +2367,68 @@ cmd_execute_command_real (vector vline, struct vty *vty,
   if (matched_count > 1)
     return CMD_ERR_AMBIGUOUS;
 
+  return CMD_SUCCESS;
+}
+
+/* Find the one command of the vty's node that vline selects, strictly
+   as for configuration files or allowing abbreviations. */
+static int
+cmd_match_element (vector vline, struct vty *vty, int strict,
+		   struct cmd_element **matched)
+{
+  struct cmd_node *cnode = vector_slot (cmdvec, vty->node);
+  unsigned int i;
+
+  /* Only the vector walk knows to skip over empty words. */
+  for (i = 0; i < vector_active (vline); i++)
+    if (vector_slot (vline, i) == NULL)
+      return cmd_vector_match (vline, cnode->cmd_vector, strict, matched);
+
+  return cmd_trie_match (cnode->cmd_trie, vline, strict, matched);
+}
+
+/* Match vline in node both down the node's trie and by filtering its
+   command vector, for tests of the trie.  Returns 0 if the two agree on
+   the result and on the command matched, -1 if not. */
+int
+cmd_match_check (vector vline, enum node_type node, int strict)
+{
+  struct cmd_node *cnode = vector_slot (cmdvec, node);
+  struct cmd_element *by_vector, *by_trie;
+  unsigned int i;
+  int ret;
+
+  /* Only the vector walk takes lines with empty words. */
+  for (i = 0; i < vector_active (vline); i++)
+    if (vector_slot (vline, i) == NULL)
+      return 0;
+
+  ret = cmd_vector_match (vline, cnode->cmd_vector, strict, &by_vector);
+  if (ret != cmd_trie_match (cnode->cmd_trie, vline, strict, &by_trie))
+    return -1;
+
+  /* Which command is only defined when there is one. */
+  if (ret == CMD_SUCCESS && by_vector != by_trie)
+    return -1;
+  return 0;
+}
+
+/* Execute command by argument vline vector. */
+static int
+cmd_execute_command_real (vector vline, struct vty *vty,
+			  struct cmd_element **cmd)
+{
+  unsigned int i;
+  struct cmd_element *matched_element;
+  int argc;
+  const char *argv[CMD_ARGC_MAX];
+  int varflag;
+  int ret;
+
+  ret = cmd_match_element (vline, vty, 0, &matched_element);
+  if (ret != CMD_SUCCESS)
+    return ret;
+
   /* Argument treatment */
   varflag = 0;
   argc = 0;
@@ -2184,77 +2533,15 @@ cmd_execute_command_strict (vector vline, struct vty *vty,
 			    struct cmd_element **cmd)
 {
   unsigned int i;
-  unsigned int index;
-  vector cmd_vector;
-  struct cmd_element *cmd_element;
   struct cmd_element *matched_element;
-  unsigned int matched_count, incomplete_count;
   int argc;
   const char *argv[CMD_ARGC_MAX];
   int varflag;
-  enum match_type match = 0;
-  char *command;
-
-  /* Make copy of command element */
-  cmd_vector = vector_copy (cmd_node_vector (cmdvec, vty->node));
-
-  for (index = 0; index < vector_active (vline); index++)
-    if ((command = vector_slot (vline, index)))
-      {
-	int ret;
-	
-	match = cmd_filter_by_string (vector_slot (vline, index),
-				      cmd_vector, index);
-
-	/* If command meets '.VARARG' then finish matching. */
-	if (match == vararg_match)
-	  break;
-        
-	ret = is_cmd_ambiguous (command, cmd_vector, index, match);
-	if (ret == 1)
-	  {
-	    vector_free (cmd_vector);
-	    return CMD_ERR_AMBIGUOUS;
-	  }
-	if (ret == 2)
-	  {
-	    vector_free (cmd_vector);
-	    return CMD_ERR_NO_MATCH;
-	  }
-      }
-
-  /* Check matched count. */
-  matched_element = NULL;
-  matched_count = 0;
-  incomplete_count = 0;
-  for (i = 0; i < vector_active (cmd_vector); i++)
-    if (vector_slot (cmd_vector, i) != NULL)
-      {
-	cmd_element = vector_slot (cmd_vector, i);
-
-	if (match == vararg_match || index >= cmd_element->cmdsize)
-	  {
-	    matched_element = cmd_element;
-	    matched_count++;
-	  }
-	else
-	  incomplete_count++;
-      }
-
-  /* Finish of using cmd_vector. */
-  vector_free (cmd_vector);
-
-  /* To execute command, matched_count must be 1. */
-  if (matched_count == 0)
-    {
-      if (incomplete_count)
-	return CMD_ERR_INCOMPLETE;
-      else
-	return CMD_ERR_NO_MATCH;
-    }
+  int ret;
 
-  if (matched_count > 1)
-    return CMD_ERR_AMBIGUOUS;
+  ret = cmd_match_element (vline, vty, 1, &matched_element);
+  if (ret != CMD_SUCCESS)
+    return ret;
 
   /* Argument treatment */
   varflag = 0;
@@ -2297,9 +2584,148 @@ cmd_execute_command_strict (vector vline, struct vty *vty,
   return (*matched_element->func) (matched_element, vty, argc, argv);
 }
 
-/* Configration make from file. */
+/* What one module changed during a configuration batch. */
+struct cmd_batch
+{
+  /* struct cmd_batch_entry by name. */
+  struct hash *entries;
+
+  void (*flush) (const char *name, u_int32_t flags, void *arg);
+  void *arg;
+};
+
+struct cmd_batch_entry
+{
+  const char *name;		/* follows the entry */
+  u_int32_t flags;
+};
+
+/* All struct cmd_batch, flushed in the order they were made. */
+static vector cmd_batches;
+
+/* Nesting of open batches. */
+static int cmd_batch_depth;
+
+static unsigned int
+cmd_batch_entry_key (void *arg)
+{
+  struct cmd_batch_entry *entry = arg;
+
+  return string_hash_make (entry->name);
+}
+
+static int
+cmd_batch_entry_cmp (const void *a, const void *b)
+{
+  const struct cmd_batch_entry *ea = a;
+  const struct cmd_batch_entry *eb = b;
+
+  return strcmp (ea->name, eb->name) == 0;
+}
+
+static void *
+cmd_batch_entry_alloc (void *arg)
+{
+  struct cmd_batch_entry *lookup = arg;
+  struct cmd_batch_entry *entry;
+  size_t len = strlen (lookup->name) + 1;
+  char *name;
+
+  entry = XCALLOC (MTYPE_CMD_BATCH, sizeof (struct cmd_batch_entry) + len);
+  name = (char *) (entry + 1);
+  memcpy (name, lookup->name, len);
+  entry->name = name;
+  return entry;
+}
+
+static void
+cmd_batch_entry_free (void *arg)
+{
+  XFREE (MTYPE_CMD_BATCH, arg);
+}
+
+static void
+cmd_batch_entry_flush (struct hash_backet *backet, void *arg)
+{
+  struct cmd_batch *batch = arg;
+  struct cmd_batch_entry *entry = backet->data;
+
+  (*batch->flush) (entry->name, entry->flags, batch->arg);
+}
+
+static void
+cmd_batch_free (struct cmd_batch *batch)
+{
+  hash_clean (batch->entries, cmd_batch_entry_free);
+  hash_free (batch->entries);
+  XFREE (MTYPE_CMD_BATCH, batch);
+}
+
+/* Make the batch record of a module.  flush is called with each name
+   noted and the flags it was noted with, or'ed together. */
+struct cmd_batch *
+cmd_batch_new (void (*flush) (const char *name, u_int32_t flags, void *arg),
+	       void *arg)
+{
+  struct cmd_batch *batch;
+
+  batch = XCALLOC (MTYPE_CMD_BATCH, sizeof (struct cmd_batch));
+  batch->entries = hash_create_size (32, cmd_batch_entry_key,
+				     cmd_batch_entry_cmp);
+  batch->flush = flush;
+  batch->arg = arg;
+
+  if (cmd_batches == NULL)
+    cmd_batches = vector_init (VECTOR_MIN_SIZE);
+  vector_set (cmd_batches, batch);
+  return batch;
+}
+
+/* Note a change to name if a batch is open.  Returns 0, with nothing
+   noted, if the caller should run its hooks now. */
 int
-config_from_file (struct vty *vty, FILE *fp)
+cmd_batch_add (struct cmd_batch *batch, const char *name, u_int32_t flags)
+{
+  struct cmd_batch_entry lookup;
+  struct cmd_batch_entry *entry;
+
+  if (cmd_batch_depth == 0 || batch == NULL || name == NULL)
+    return 0;
+
+  lookup.name = name;
+  entry = hash_get (batch->entries, &lookup, cmd_batch_entry_alloc);
+  entry->flags |= flags;
+  return 1;
+}
+
+void
+cmd_batch_begin (void)
+{
+  cmd_batch_depth++;
+}
+
+void
+cmd_batch_end (void)
+{
+  struct cmd_batch *batch;
+  unsigned int i;
+
+  assert (cmd_batch_depth > 0);
+  if (--cmd_batch_depth > 0 || cmd_batches == NULL)
+    return;
+
+  /* The hooks run now, outside the batch, so can note nothing. */
+  for (i = 0; i < vector_active (cmd_batches); i++)
+    if ((batch = vector_slot (cmd_batches, i)) != NULL
+	&& batch->entries->count)
+      {
+	hash_iterate (batch->entries, cmd_batch_entry_flush, batch);
+	hash_clean (batch->entries, cmd_batch_entry_free);
+      }
+}
+
+static int
+config_from_file_lines (struct vty *vty, FILE *fp)
 {
   int ret;
   vector vline;
@@ -2331,6 +2757,19 @@ config_from_file (struct vty *vty, FILE *fp)
   return CMD_SUCCESS;
 }
 
+/* Configration make from file. */
+int
+config_from_file (struct vty *vty, FILE *fp)
+{
+  int ret;
+
+  cmd_batch_begin ();
+  ret = config_from_file_lines (vty, fp);
+  cmd_batch_end ();
+
+  return ret;
+}
+
 /* Configration from terminal */
 DEFUN (config_terminal,
        config_terminal_cmd,
@@ -3112,6 +3551,19 @@ DEFUN (show_logging,
   vty_out (vty, "Timestamp precision: %d%s",
 	   zl->timestamp_precision, VTY_NEWLINE);
 
+  {
+    unsigned int size, queued;
+    unsigned long written, dropped;
+
+    vty_out (vty, "Asynchronous logging: ");
+    if (zlog_async_stats (&size, &queued, &written, &dropped))
+      vty_out (vty, "ring of %u records, %u queued, %lu written, "
+	       "%lu dropped", size, queued, written, dropped);
+    else
+      vty_out (vty, "disabled");
+    vty_out (vty, "%s", VTY_NEWLINE);
+  }
+
   return CMD_SUCCESS;
 }
 
@@ -3466,6 +3918,43 @@ DEFUN (no_config_log_timestamp_precision,
   return CMD_SUCCESS;
 }
 
+DEFUN (config_log_async,
+       config_log_async_cmd,
+       "log async",
+       "Logging control\n"
+       "Write syslog, file and stdout logs from a separate thread\n")
+{
+  unsigned int records = 0;
+
+  if (argc == 1)
+    VTY_GET_INTEGER_RANGE ("Ring size", records, argv[0], 16, 65536);
+
+  if (!zlog_async_enable (records))
+    {
+      vty_out (vty, "%% Could not start asynchronous logging%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+  return CMD_SUCCESS;
+}
+
+ALIAS (config_log_async,
+       config_log_async_size_cmd,
+       "log async <16-65536>",
+       "Logging control\n"
+       "Write syslog, file and stdout logs from a separate thread\n"
+       "Number of log messages which may be queued\n")
+
+DEFUN (no_config_log_async,
+       no_config_log_async_cmd,
+       "no log async",
+       NO_STR
+       "Logging control\n"
+       "Write logs synchronously\n")
+{
+  zlog_async_disable ();
+  return CMD_SUCCESS;
+}
+
 DEFUN (banner_motd_file,
        banner_motd_file_cmd,
        "banner motd file [FILE]",
@@ -3639,6 +4128,9 @@ cmd_init (int terminal)
       install_element (CONFIG_NODE, &no_config_log_record_priority_cmd);
       install_element (CONFIG_NODE, &config_log_timestamp_precision_cmd);
       install_element (CONFIG_NODE, &no_config_log_timestamp_precision_cmd);
+      install_element (CONFIG_NODE, &config_log_async_cmd);
+      install_element (CONFIG_NODE, &config_log_async_size_cmd);
+      install_element (CONFIG_NODE, &no_config_log_async_cmd);
       install_element (CONFIG_NODE, &service_password_encrypt_cmd);
       install_element (CONFIG_NODE, &no_service_password_encrypt_cmd);
       install_element (CONFIG_NODE, &banner_motd_default_cmd);
@@ -3650,10 +4142,17 @@ cmd_init (int terminal)
       install_element (VIEW_NODE, &show_thread_cpu_cmd);
       install_element (ENABLE_NODE, &show_thread_cpu_cmd);
       install_element (RESTRICTED_NODE, &show_thread_cpu_cmd);
+      install_element (VIEW_NODE, &show_thread_cpu_latency_cmd);
+      install_element (ENABLE_NODE, &show_thread_cpu_latency_cmd);
+      install_element (RESTRICTED_NODE, &show_thread_cpu_latency_cmd);
+      install_element (VIEW_NODE, &show_thread_cpu_dump_cmd);
+      install_element (ENABLE_NODE, &show_thread_cpu_dump_cmd);
       
       install_element (ENABLE_NODE, &clear_thread_cpu_cmd);
       install_element (VIEW_NODE, &show_work_queues_cmd);
       install_element (ENABLE_NODE, &show_work_queues_cmd);
+      install_element (VIEW_NODE, &show_hash_stats_cmd);
+      install_element (ENABLE_NODE, &show_hash_stats_cmd);
     }
   srand(time(NULL));
 }
@@ -3701,12 +4200,22 @@ cmd_terminate ()
                 }
 
             vector_free (cmd_node_v);
+            cmd_trie_free (cmd_node->cmd_trie);
           }
 
       vector_free (cmdvec);
       cmdvec = NULL;
     }
 
+  if (cmd_batches)
+    {
+      for (i = 0; i < vector_active (cmd_batches); i++)
+	if (vector_slot (cmd_batches, i))
+	  cmd_batch_free (vector_slot (cmd_batches, i));
+      vector_free (cmd_batches);
+      cmd_batches = NULL;
+    }
+
   if (command_cr)
     XFREE(MTYPE_STRVEC, command_cr);
   if (desc_cr.str)
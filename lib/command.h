@@ -124,6 +124,9 @@ struct cmd_node
 
   /* Vector of this node's command list. */
   vector cmd_vector;	
+
+  /* The same commands as a tree of their tokens, for matching. */
+  struct cmd_trie *cmd_trie;
 };
 
 enum
@@ -333,6 +336,7 @@ extern void install_node (struct cmd_node *, int (*) (struct vty *));
 extern void install_default (enum node_type);
 extern void install_element (enum node_type, struct cmd_element *);
 extern void sort_node (void);
+extern int cmd_match_check (vector, enum node_type, int);
 
 /* Concatenates argv[shift] through argv[argc-1] into a single NUL-terminated
    string with a space between each element (allocated using
@@ -352,6 +356,21 @@ extern void config_replace_string (struct cmd_element *, char *, ...);
 extern void cmd_init (int);
 extern void cmd_terminate (void);
 
+/* Configuration batches.  While one is open, prefix lists, access
+   lists and route maps note the names of what changed, with flags of
+   their own, instead of running their hooks, and their flush function
+   runs once per name when the outermost batch ends.  config_from_file()
+   reads a whole file as one batch. */
+struct cmd_batch;
+extern void cmd_batch_begin (void);
+extern void cmd_batch_end (void);
+extern struct cmd_batch *cmd_batch_new (void (*flush) (const char *name,
+							u_int32_t flags,
+							void *arg),
+					void *arg);
+extern int cmd_batch_add (struct cmd_batch *, const char *name,
+			  u_int32_t flags);
+
 /* Export typical functions. */
 extern struct cmd_element config_end_cmd;
 extern struct cmd_element config_exit_cmd;
@@ -28,6 +28,11 @@
 #include "sockunion.h"
 #include "buffer.h"
 #include "log.h"
+#include "table.h"
+#include "linklist.h"
+
+/* Lists shorter than this are matched by walking the filters. */
+#define ACCESS_LIST_TRIE_MIN 16
 
 struct filter_cisco
 {
@@ -61,6 +66,9 @@ struct filter
   /* Cisco access-list */
   int cisco;
 
+  /* Position in the access_list, for its compiled form. */
+  int order;
+
   union
     {
       struct filter_cisco cfilter;
@@ -68,6 +76,23 @@ struct filter
     } u;
 };
 
+/* Compiled form of an access_list.  Filters whose address part is a
+   prefix hang off the nodes of a trie, each node keeping them in list
+   order, so only the filters covering the prefix looked up are tested.
+   Cisco filters with discontiguous wildcard bits are kept aside. */
+struct access_trie
+{
+  /* Kroute filters, matched against the prefix. */
+  struct route_table *prefix;
+
+  /* Cisco filters by address and wildcard, matched against the
+     address of the prefix. */
+  struct route_table *addr;
+
+  /* Cisco filters not expressible as a prefix. */
+  struct list *other;
+};
+
 /* List of access_list. */
 struct access_list_list
 {
@@ -89,8 +114,15 @@ struct access_master
 
   /* Hook function which is executed when access_list is deleted. */
   void (*delete_hook) (struct access_list *);
+
+  /* Lists changed during a configuration batch. */
+  struct cmd_batch *batch;
 };
 
+/* How an access list changed during a configuration batch. */
+#define ACCESS_LIST_BATCH_ADD		(1 << 0)
+#define ACCESS_LIST_BATCH_DELETE	(1 << 1)
+
 /* Static structure for IPv4 access_list's master. */
 static struct access_master access_master_ipv4 = 
 { 
@@ -224,6 +256,94 @@ access_list_free (struct access_list *access)
   XFREE (MTYPE_ACCESS_LIST, access);
 }
 
+static void
+access_trie_add (struct route_table *table, struct prefix *p,
+		 struct filter *filter)
+{
+  struct route_node *rn;
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = list_new ();
+  listnode_add (rn->info, filter);
+}
+
+static void
+access_trie_table_free (struct route_table *table)
+{
+  struct route_node *rn;
+
+  for (rn = route_top (table); rn; rn = route_next (rn))
+    if (rn->info)
+      {
+	list_delete (rn->info);
+	rn->info = NULL;
+	route_unlock_node (rn);
+      }
+  route_table_finish (table);
+}
+
+static void
+access_list_trie_build (struct access_list *access)
+{
+  struct access_trie *trie;
+  struct filter *filter;
+  struct filter_cisco *cfilter;
+  struct prefix p;
+  u_int32_t wildcard;
+  int order;
+
+  trie = XCALLOC (MTYPE_ACCESS_TRIE, sizeof (struct access_trie));
+  trie->prefix = route_table_init ();
+  trie->addr = route_table_init ();
+  trie->other = list_new ();
+
+  for (order = 0, filter = access->head; filter; filter = filter->next)
+    {
+      filter->order = order++;
+
+      if (! filter->cisco)
+	{
+	  access_trie_add (trie->prefix, &filter->u.zfilter.prefix, filter);
+	  continue;
+	}
+
+      /* Wildcard bits select a prefix when they are the low ones. */
+      cfilter = &filter->u.cfilter;
+      wildcard = ntohl (cfilter->addr_mask.s_addr);
+      if (wildcard & (wildcard + 1))
+	{
+	  listnode_add (trie->other, filter);
+	  continue;
+	}
+
+      memset (&p, 0, sizeof (struct prefix));
+      p.family = AF_INET;
+      p.u.prefix4 = cfilter->addr;
+      for (p.prefixlen = IPV4_MAX_BITLEN; wildcard; wildcard >>= 1)
+	p.prefixlen--;
+      access_trie_add (trie->addr, &p, filter);
+    }
+
+  access->trie = trie;
+}
+
+/* Drop the compiled form, to be rebuilt on the next lookup.  Must be
+   called before the filters change. */
+static void
+access_list_trie_reset (struct access_list *access)
+{
+  if (access->trie == NULL)
+    return;
+
+  access_trie_table_free (access->trie->prefix);
+  access_trie_table_free (access->trie->addr);
+  list_delete (access->trie->other);
+  XFREE (MTYPE_ACCESS_TRIE, access->trie);
+}
+
 /* Delete access_list from access_master and free it. */
 static void
 access_list_delete (struct access_list *access)
@@ -233,6 +353,8 @@ access_list_delete (struct access_list *access)
   struct access_list_list *list;
   struct access_master *master;
 
+  access_list_trie_reset (access);
+
   for (filter = access->head; filter; filter = next)
     {
       next = filter->next;
@@ -357,11 +479,26 @@ access_list_insert (afi_t afi, const char *name)
   return access;
 }
 
+static struct access_list *
+access_list_master_lookup (struct access_master *master, const char *name)
+{
+  struct access_list *access;
+
+  for (access = master->num.head; access; access = access->next)
+    if (strcmp (access->name, name) == 0)
+      return access;
+
+  for (access = master->str.head; access; access = access->next)
+    if (strcmp (access->name, name) == 0)
+      return access;
+
+  return NULL;
+}
+
 /* Lookup access_list from list of access_list by name. */
 struct access_list *
 access_list_lookup (afi_t afi, const char *name)
 {
-  struct access_list *access;
   struct access_master *master;
 
   if (name == NULL)
@@ -371,15 +508,39 @@ access_list_lookup (afi_t afi, const char *name)
   if (master == NULL)
     return NULL;
 
-  for (access = master->num.head; access; access = access->next)
-    if (strcmp (access->name, name) == 0)
-      return access;
+  return access_list_master_lookup (master, name);
+}
 
-  for (access = master->str.head; access; access = access->next)
-    if (strcmp (access->name, name) == 0)
-      return access;
+/* Replay the hooks held back for one access list.  A list that has
+   only lost entries still exists and goes to the delete hook, as
+   access_list_filter_delete() would have done; one removed outright is
+   represented by an empty list of the same name. */
+static void
+access_list_batch_flush (const char *name, u_int32_t flags, void *arg)
+{
+  struct access_master *master = arg;
+  struct access_list *access;
+  struct access_list gone;
 
-  return NULL;
+  access = access_list_master_lookup (master, name);
+  if (access == NULL)
+    {
+      if (master->delete_hook)
+	{
+	  memset (&gone, 0, sizeof (struct access_list));
+	  gone.name = XSTRDUP (MTYPE_ACCESS_LIST_STR, name);
+	  gone.master = master;
+	  (*master->delete_hook) (&gone);
+	  XFREE (MTYPE_ACCESS_LIST_STR, gone.name);
+	}
+    }
+  else if (flags & ACCESS_LIST_BATCH_ADD)
+    {
+      if (master->add_hook)
+	(*master->add_hook) (access);
+    }
+  else if (master->delete_hook)
+    (*master->delete_hook) (access);
 }
 
 /* Get access list from list of access_list.  If there isn't matched
@@ -395,18 +556,85 @@ access_list_get (afi_t afi, const char *name)
   return access;
 }
 
+static int
+filter_match (struct filter *filter, struct prefix *p)
+{
+  if (filter->cisco)
+    return filter_match_cisco (filter, p);
+  else
+    return filter_match_kroute (filter, p);
+}
+
+/* First filter in list order among those hanging off the path from
+   the longest node covering p to the root, if before match. */
+static struct filter *
+access_trie_match (struct route_table *table, struct prefix *p,
+		   struct prefix *key, struct filter *match)
+{
+  struct filter *filter;
+  struct listnode *node;
+  struct route_node *rn;
+
+  rn = route_node_match (table, key);
+  if (rn == NULL)
+    return match;
+  route_unlock_node (rn);
+
+  for (; rn; rn = rn->parent)
+    if (rn->info)
+      for (ALL_LIST_ELEMENTS_RO ((struct list *) rn->info, node, filter))
+	{
+	  if (match && filter->order >= match->order)
+	    break;
+	  if (filter_match (filter, p))
+	    {
+	      match = filter;
+	      break;
+	    }
+	}
+
+  return match;
+}
+
 /* Apply access list to object (which should be struct prefix *). */
 enum filter_type
 access_list_apply (struct access_list *access, void *object)
 {
   struct filter *filter;
+  struct filter *match;
+  struct listnode *node;
   struct prefix *p;
+  struct prefix host;
 
   p = (struct prefix *) object;
 
   if (access == NULL)
     return FILTER_DENY;
 
+  if (access->count >= ACCESS_LIST_TRIE_MIN)
+    {
+      if (access->trie == NULL)
+	access_list_trie_build (access);
+
+      /* Cisco filters only look at the IPv4 address bits. */
+      memset (&host, 0, sizeof (struct prefix));
+      host.family = AF_INET;
+      host.prefixlen = IPV4_MAX_BITLEN;
+      host.u.prefix4 = p->u.prefix4;
+
+      match = NULL;
+      for (ALL_LIST_ELEMENTS_RO (access->trie->other, node, filter))
+	if (filter_match (filter, p))
+	  {
+	    match = filter;
+	    break;
+	  }
+      match = access_trie_match (access->trie->addr, p, &host, match);
+      match = access_trie_match (access->trie->prefix, p, p, match);
+
+      return match ? match->type : FILTER_DENY;
+    }
+
   for (filter = access->head; filter; filter = filter->next)
     {
       if (filter->cisco)
@@ -448,6 +676,9 @@ access_list_delete_hook (void (*func) (struct access_list *access))
 static void
 access_list_filter_add (struct access_list *access, struct filter *filter)
 {
+  access_list_trie_reset (access);
+  access->count++;
+
   filter->next = NULL;
   filter->prev = access->tail;
 
@@ -458,7 +689,9 @@ access_list_filter_add (struct access_list *access, struct filter *filter)
   access->tail = filter;
 
   /* Run hook function. */
-  if (access->master->add_hook)
+  if (access->master->add_hook
+      && ! cmd_batch_add (access->master->batch, access->name,
+			  ACCESS_LIST_BATCH_ADD))
     (*access->master->add_hook) (access);
 }
 
@@ -478,9 +711,13 @@ static void
 access_list_filter_delete (struct access_list *access, struct filter *filter)
 {
   struct access_master *master;
+  int batched;
 
   master = access->master;
 
+  access_list_trie_reset (access);
+  access->count--;
+
   if (filter->next)
     filter->next->prev = filter->prev;
   else
@@ -493,12 +730,15 @@ access_list_filter_delete (struct access_list *access, struct filter *filter)
 
   filter_free (filter);
 
+  batched = cmd_batch_add (master->batch, access->name,
+			   ACCESS_LIST_BATCH_DELETE);
+
   /* If access_list becomes empty delete it from access_master. */
   if (access_list_empty (access))
     access_list_delete (access);
 
   /* Run hook function. */
-  if (master->delete_hook)
+  if (master->delete_hook && ! batched)
     (*master->delete_hook) (access);
 }
 
@@ -1338,7 +1578,9 @@ DEFUN (no_access_list_all,
   master = access->master;
 
   /* Run hook function. */
-  if (master->delete_hook)
+  if (master->delete_hook
+      && ! cmd_batch_add (master->batch, access->name,
+			  ACCESS_LIST_BATCH_DELETE))
     (*master->delete_hook) (access);
  
   /* Delete all filter from access-list. */
@@ -1509,7 +1751,9 @@ DEFUN (no_ipv6_access_list_all,
   master = access->master;
 
   /* Run hook function. */
-  if (master->delete_hook)
+  if (master->delete_hook
+      && ! cmd_batch_add (master->batch, access->name,
+			  ACCESS_LIST_BATCH_DELETE))
     (*master->delete_hook) (access);
 
   /* Delete all filter from access-list. */
@@ -1904,6 +2148,8 @@ static void
 access_list_init_ipv4 (void)
 {
   install_node (&access_node, config_write_access_ipv4);
+  access_master_ipv4.batch = cmd_batch_new (access_list_batch_flush,
+					    &access_master_ipv4);
 
   install_element (ENABLE_NODE, &show_ip_access_list_cmd);
   install_element (ENABLE_NODE, &show_ip_access_list_name_cmd);
@@ -1999,6 +2245,8 @@ static void
 access_list_init_ipv6 (void)
 {
   install_node (&access_ipv6_node, config_write_access_ipv6);
+  access_master_ipv6.batch = cmd_batch_new (access_list_batch_flush,
+					    &access_master_ipv6);
 
   install_element (ENABLE_NODE, &show_ipv6_access_list_cmd);
   install_element (ENABLE_NODE, &show_ipv6_access_list_name_cmd);
@@ -54,6 +54,10 @@ struct access_list
 
   struct filter *head;
   struct filter *tail;
+
+  /* Number of filters, and their compiled form once looked up. */
+  int count;
+  struct access_trie *trie;
 };
 
 /* Prototypes for access-list. */
@@ -23,6 +23,11 @@
 
 #include "hash.h"
 #include "memory.h"
+#include "linklist.h"
+#include "command.h"
+
+/* master list of named hash tables */
+static struct list *hashes;
 
 /* Allocate a new hash.  */
 struct hash *
@@ -31,10 +36,14 @@ hash_create_size (unsigned int size, unsigned int (*hash_key) (void *),
 {
   struct hash *hash;
 
-  hash = XMALLOC (MTYPE_HASH, sizeof (struct hash));
+  if (! hashes)
+    hashes = list_new ();
+
+  hash = XCALLOC (MTYPE_HASH, sizeof (struct hash));
   hash->index = XCALLOC (MTYPE_HASH_INDEX,
 			 sizeof (struct hash_backet *) * size);
   hash->size = size;
+  hash->min_size = size;
   hash->hash_key = hash_key;
   hash->hash_cmp = hash_cmp;
   hash->count = 0;
@@ -50,6 +59,17 @@ hash_create (unsigned int (*hash_key) (void *),
   return hash_create_size (HASHTABSIZE, hash_key, hash_cmp);
 }
 
+/* Name the hash and list it in "show hashtable". */
+void
+hash_set_name (struct hash *hash, const char *name)
+{
+  if (hash->name)
+    XFREE (MTYPE_HASH_NAME, hash->name);
+  else
+    listnode_add (hashes, hash);
+  hash->name = XSTRDUP (MTYPE_HASH_NAME, name);
+}
+
 /* Utility function for hash_get().  When this function is specified
    as alloc_func, return arugment as it is.  This function is used for
    intern already allocated value.  */
@@ -59,6 +79,80 @@ hash_alloc_intern (void *arg)
   return arg;
 }
 
+/* Move up to n buckets of the old table over to the new one, and
+   drop the old table once it is empty. */
+static void
+hash_rehash_step (struct hash *hash, unsigned int n)
+{
+  struct hash_backet *hb;
+  struct hash_backet *next;
+  unsigned int index;
+
+  while (hash->old_index && n--)
+    {
+      for (hb = hash->old_index[hash->rehash_pos]; hb; hb = next)
+	{
+	  next = hb->next;
+	  index = hb->key % hash->size;
+	  hb->next = hash->index[index];
+	  hash->index[index] = hb;
+	}
+      hash->old_index[hash->rehash_pos] = NULL;
+
+      if (++hash->rehash_pos == hash->old_size)
+	{
+	  XFREE (MTYPE_HASH_INDEX, hash->old_index);
+	  hash->old_size = 0;
+	  hash->rehash_pos = 0;
+	}
+    }
+}
+
+/* Start moving the hash to a table of new_size buckets.  The old
+   buckets are carried over a few at a time by hash_rehash_step(), so
+   no single insertion or release pays for the whole table. */
+static void
+hash_resize (struct hash *hash, unsigned int new_size)
+{
+  hash->old_index = hash->index;
+  hash->old_size = hash->size;
+  hash->rehash_pos = 0;
+
+  hash->index = XCALLOC (MTYPE_HASH_INDEX,
+			 sizeof (struct hash_backet *) * new_size);
+  hash->size = new_size;
+  hash->resizes++;
+}
+
+/* Keep the load factor in bounds.  Called after the hash count
+   changed. */
+static void
+hash_maintain (struct hash *hash)
+{
+  unsigned int new_size;
+
+  if (hash->iterating)
+    return;
+
+  if (hash->old_index)
+    {
+      hash_rehash_step (hash, HASH_REHASH_STEP);
+      return;
+    }
+
+  if (hash->count > (unsigned long) hash->size * HASH_GROW_THRESHOLD
+      && hash->size < UINT_MAX / 2)
+    hash_resize (hash, hash->size * 2);
+  else if (hash->size > hash->min_size
+	   && hash->count * HASH_SHRINK_THRESHOLD < hash->size)
+    {
+      new_size = hash->size / 2;
+      if (new_size < hash->min_size)
+	new_size = hash->min_size;
+      hash_resize (hash, new_size);
+    }
+}
+
 /* Lookup and return hash backet in hash.  If there is no
    corresponding hash backet and alloc_func is specified, create new
    hash backet.  */
@@ -77,6 +171,13 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
     if (backet->key == key && (*hash->hash_cmp) (backet->data, data))
       return backet->data;
 
+  /* Not yet moved over by a resize in progress? */
+  if (hash->old_index)
+    for (backet = hash->old_index[key % hash->old_size]; backet != NULL;
+	 backet = backet->next)
+      if (backet->key == key && (*hash->hash_cmp) (backet->data, data))
+	return backet->data;
+
   if (alloc_func)
     {
       newdata = (*alloc_func) (data);
@@ -89,6 +190,7 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
       backet->next = hash->index[index];
       hash->index[index] = backet;
       hash->count++;
+      hash_maintain (hash);
       return backet->data;
     }
   return NULL;
@@ -112,27 +214,22 @@ unsigned int string_hash_make (const char *str)
   return hash;
 }
 
-/* This function release registered value from specified hash.  When
-   release is successfully finished, return the data pointer in the
-   hash backet.  */
-void *
-hash_release (struct hash *hash, void *data)
+/* Unlink the backet matching data from the chain at head, and return
+   its data. */
+static void *
+hash_release_chain (struct hash *hash, struct hash_backet **head,
+		    unsigned int key, void *data)
 {
   void *ret;
-  unsigned int key;
-  unsigned int index;
   struct hash_backet *backet;
   struct hash_backet *pp;
 
-  key = (*hash->hash_key) (data);
-  index = key % hash->size;
-
-  for (backet = pp = hash->index[index]; backet; backet = backet->next)
+  for (backet = pp = *head; backet; backet = backet->next)
     {
       if (backet->key == key && (*hash->hash_cmp) (backet->data, data)) 
 	{
 	  if (backet == pp) 
-	    hash->index[index] = backet->next;
+	    *head = backet->next;
 	  else 
 	    pp->next = backet->next;
 
@@ -146,6 +243,26 @@ hash_release (struct hash *hash, void *data)
   return NULL;
 }
 
+/* This function release registered value from specified hash.  When
+   release is successfully finished, return the data pointer in the
+   hash backet.  */
+void *
+hash_release (struct hash *hash, void *data)
+{
+  void *ret;
+  unsigned int key;
+
+  key = (*hash->hash_key) (data);
+
+  ret = hash_release_chain (hash, &hash->index[key % hash->size], key, data);
+  if (ret == NULL && hash->old_index)
+    ret = hash_release_chain (hash, &hash->old_index[key % hash->old_size],
+			      key, data);
+  if (ret)
+    hash_maintain (hash);
+  return ret;
+}
+
 /* Iterator function for hash.  */
 void
 hash_iterate (struct hash *hash, 
@@ -155,6 +272,9 @@ hash_iterate (struct hash *hash,
   struct hash_backet *hb;
   struct hash_backet *hbnext;
 
+  /* Buckets must stay put while we walk them. */
+  hash->iterating++;
+
   for (i = 0; i < hash->size; i++)
     for (hb = hash->index[i]; hb; hb = hbnext)
       {
@@ -164,19 +284,29 @@ hash_iterate (struct hash *hash,
 	hbnext = hb->next;
 	(*func) (hb, arg);
       }
+
+  if (hash->old_index)
+    for (i = hash->rehash_pos; i < hash->old_size; i++)
+      for (hb = hash->old_index[i]; hb; hb = hbnext)
+	{
+	  hbnext = hb->next;
+	  (*func) (hb, arg);
+	}
+
+  hash->iterating--;
 }
 
-/* Clean up hash.  */
-void
-hash_clean (struct hash *hash, void (*free_func) (void *))
+static void
+hash_clean_index (struct hash *hash, struct hash_backet **index,
+		  unsigned int size, void (*free_func) (void *))
 {
   unsigned int i;
   struct hash_backet *hb;
   struct hash_backet *next;
 
-  for (i = 0; i < hash->size; i++)
+  for (i = 0; i < size; i++)
     {
-      for (hb = hash->index[i]; hb; hb = next)
+      for (hb = index[i]; hb; hb = next)
 	{
 	  next = hb->next;
 	      
@@ -186,7 +316,22 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 	  XFREE (MTYPE_HASH_BACKET, hb);
 	  hash->count--;
 	}
-      hash->index[i] = NULL;
+      index[i] = NULL;
+    }
+}
+
+/* Clean up hash.  */
+void
+hash_clean (struct hash *hash, void (*free_func) (void *))
+{
+  hash_clean_index (hash, hash->index, hash->size, free_func);
+
+  if (hash->old_index)
+    {
+      hash_clean_index (hash, hash->old_index, hash->old_size, free_func);
+      XFREE (MTYPE_HASH_INDEX, hash->old_index);
+      hash->old_size = 0;
+      hash->rehash_pos = 0;
     }
 }
 
@@ -195,6 +340,82 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 void
 hash_free (struct hash *hash)
 {
+  if (hash->name)
+    {
+      listnode_delete (hashes, hash);
+      XFREE (MTYPE_HASH_NAME, hash->name);
+    }
+  if (hash->old_index)
+    XFREE (MTYPE_HASH_INDEX, hash->old_index);
   XFREE (MTYPE_HASH_INDEX, hash->index);
   XFREE (MTYPE_HASH, hash);
 }
+
+/* Chain length histogram buckets: 0, 1, 2, 3, 4-7, 8-15, 16+ */
+#define HASH_HIST_SLOTS 7
+
+static void
+hash_stats_index (struct hash_backet **index, unsigned int size,
+		  unsigned long *hist, unsigned int *max_chain)
+{
+  unsigned int i, len, slot;
+  struct hash_backet *hb;
+
+  for (i = 0; i < size; i++)
+    {
+      for (len = 0, hb = index[i]; hb; hb = hb->next)
+	len++;
+
+      if (len > *max_chain)
+	*max_chain = len;
+
+      if (len < 4)
+	slot = len;
+      else if (len < 8)
+	slot = 4;
+      else if (len < 16)
+	slot = 5;
+      else
+	slot = 6;
+      hist[slot]++;
+    }
+}
+
+DEFUN (show_hash_stats,
+       show_hash_stats_cmd,
+       "show hashtable",
+       SHOW_STR
+       "Statistics about hash tables\n")
+{
+  struct listnode *node;
+  struct hash *hash;
+  unsigned long hist[HASH_HIST_SLOTS];
+  unsigned int max_chain;
+
+  vty_out (vty, "%-28s %9s %9s %5s %5s %7s %s%s",
+	   "Name", "Count", "Size", "Load", "Max", "Resizes", "State",
+	   VTY_NEWLINE);
+
+  if (! hashes)
+    return CMD_SUCCESS;
+
+  for (ALL_LIST_ELEMENTS_RO (hashes, node, hash))
+    {
+      memset (hist, 0, sizeof (hist));
+      max_chain = 0;
+      hash_stats_index (hash->index, hash->size, hist, &max_chain);
+      if (hash->old_index)
+	hash_stats_index (hash->old_index + hash->rehash_pos,
+			  hash->old_size - hash->rehash_pos, hist, &max_chain);
+
+      vty_out (vty, "%-28s %9lu %9u %5.2f %5u %7lu %s%s",
+	       hash->name, hash->count, hash->size,
+	       (double) hash->count / hash->size, max_chain, hash->resizes,
+	       hash->old_index ? "resizing" : "", VTY_NEWLINE);
+      vty_out (vty, "  chains 0:%lu 1:%lu 2:%lu 3:%lu 4-7:%lu 8-15:%lu 16+:%lu%s",
+	       hist[0], hist[1], hist[2], hist[3], hist[4], hist[5], hist[6],
+	       VTY_NEWLINE);
+    }
+
+  return CMD_SUCCESS;
+}
@@ -24,6 +24,16 @@ Boston, MA 02111-1307, USA.  */
 /* Default hash table size.  */ 
 #define HASHTABSIZE     1024
 
+/* Grow when the average chain is longer than this, shrink when the
+   table is this many times bigger than needed. */
+#define HASH_GROW_THRESHOLD    2
+#define HASH_SHRINK_THRESHOLD  8
+
+/* Old buckets moved to the new table per insertion or release while
+   a resize is in progress.  Must be at least HASH_SHRINK_THRESHOLD * 2
+   for a shrink to complete before the next one is due. */
+#define HASH_REHASH_STEP       32
+
 struct hash_backet
 {
   /* Linked list.  */
@@ -44,6 +54,18 @@ struct hash
   /* Hash table size. */
   unsigned int size;
 
+  /* Table being migrated from while a resize is in progress.  Buckets
+     below rehash_pos have already been moved to index. */
+  struct hash_backet **old_index;
+  unsigned int old_size;
+  unsigned int rehash_pos;
+
+  /* Never shrink below the size the table was created with. */
+  unsigned int min_size;
+
+  /* Resizing is held off while the table is being iterated. */
+  int iterating;
+
   /* Key make function. */
   unsigned int (*hash_key) (void *);
 
@@ -52,6 +74,12 @@ struct hash
 
   /* Backet alloc. */
   unsigned long count;
+
+  /* Number of resizes, for "show hashtable". */
+  unsigned long resizes;
+
+  /* Name for "show hashtable", see hash_set_name(). */
+  char *name;
 };
 
 extern struct hash *hash_create (unsigned int (*) (void *), 
@@ -70,6 +98,9 @@ extern void hash_iterate (struct hash *,
 extern void hash_clean (struct hash *, void (*) (void *));
 extern void hash_free (struct hash *);
 
+extern void hash_set_name (struct hash *, const char *);
+extern struct cmd_element show_hash_stats_cmd;
+
 extern unsigned int string_hash_make (const char *);
 
 #endif /* _KROUTE_HASH_H */
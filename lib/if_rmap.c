@@ -274,40 +274,50 @@ ALIAS (no_if_rmap,
        "Route map for output filtering\n"
        "Route map interface name\n")
 
+struct if_rmap_write_arg
+{
+  struct vty *vty;
+  int write;
+};
+
+static void
+if_rmap_write_iface (struct hash_backet *mp, void *arg)
+{
+  struct if_rmap_write_arg *w = arg;
+  struct vty *vty = w->vty;
+  struct if_rmap *if_rmap;
+
+  if_rmap = mp->data;
+
+  if (if_rmap->routemap[IF_RMAP_IN])
+    {
+      vty_out (vty, " route-map %s in %s%s", 
+	       if_rmap->routemap[IF_RMAP_IN],
+	       if_rmap->ifname,
+	       VTY_NEWLINE);
+      w->write++;
+    }
+
+  if (if_rmap->routemap[IF_RMAP_OUT])
+    {
+      vty_out (vty, " route-map %s out %s%s", 
+	       if_rmap->routemap[IF_RMAP_OUT],
+	       if_rmap->ifname,
+	       VTY_NEWLINE);
+      w->write++;
+    }
+}
+
 /* Configuration write function. */
 int
 config_write_if_rmap (struct vty *vty)
 {
-  unsigned int i;
-  struct hash_backet *mp;
-  int write = 0;
-
-  for (i = 0; i < ifrmaphash->size; i++)
-    for (mp = ifrmaphash->index[i]; mp; mp = mp->next)
-      {
-	struct if_rmap *if_rmap;
-
-	if_rmap = mp->data;
-
-	if (if_rmap->routemap[IF_RMAP_IN])
-	  {
-	    vty_out (vty, " route-map %s in %s%s", 
-		     if_rmap->routemap[IF_RMAP_IN],
-		     if_rmap->ifname,
-		     VTY_NEWLINE);
-	    write++;
-	  }
-
-	if (if_rmap->routemap[IF_RMAP_OUT])
-	  {
-	    vty_out (vty, " route-map %s out %s%s", 
-		     if_rmap->routemap[IF_RMAP_OUT],
-		     if_rmap->ifname,
-		     VTY_NEWLINE);
-	    write++;
-	  }
-      }
-  return write;
+  struct if_rmap_write_arg w;
+
+  w.vty = vty;
+  w.write = 0;
+  hash_iterate (ifrmaphash, if_rmap_write_iface, &w);
+  return w.write;
 }
 
 void
@@ -320,6 +330,7 @@ void
 if_rmap_init (int node)
 {
   ifrmaphash = hash_create (if_rmap_hash_make, if_rmap_hash_cmp);
+  hash_set_name (ifrmaphash, "Interface route-maps");
   if (node == RIPNG_NODE) {
     install_element (RIPNG_NODE, &if_ipv6_rmap_cmd);
     install_element (RIPNG_NODE, &no_if_ipv6_rmap_cmd);
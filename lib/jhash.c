@@ -168,3 +168,31 @@ jhash_1word (u_int32_t a, u_int32_t initval)
 {
   return jhash_3words (a, 0, 0, initval);
 }
+
+/* Random seed for the life of the process.  Tables keyed on data from
+ * the network start their hashes from it, so that a peer cannot work
+ * out offline a set of keys that all land in one chain.
+ */
+u_int32_t
+jhash_seed (void)
+{
+  static u_int32_t seed;
+  static int seeded;
+  struct timeval tv;
+  int fd;
+
+  if (seeded)
+    return seed;
+
+  fd = open ("/dev/urandom", O_RDONLY);
+  if (fd < 0 || read (fd, &seed, sizeof (seed)) != sizeof (seed))
+    {
+      gettimeofday (&tv, NULL);
+      seed = jhash_3words (tv.tv_sec, tv.tv_usec, getpid (), seed);
+    }
+  if (fd >= 0)
+    close (fd);
+
+  seeded = 1;
+  return seed;
+}
@@ -41,4 +41,9 @@ extern u_int32_t jhash_3words(u_int32_t a, u_int32_t b, u_int32_t c, u_int32_t i
 extern u_int32_t jhash_2words(u_int32_t a, u_int32_t b, u_int32_t initval);
 extern u_int32_t jhash_1word(u_int32_t a, u_int32_t initval);
 
+/* Per-process random initval for tables keyed on untrusted data.
+ * Fixed for the life of the process.
+ */
+extern u_int32_t jhash_seed(void);
+
 #endif /* _BANE_JHASH_H */
@@ -54,6 +54,9 @@ typedef int socklen_t;
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif /* HAVE_SYS_SELECT_H */
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/param.h>
@@ -418,7 +421,9 @@ struct in_pktinfo
 #define KROUTE_ROUTER_ID_DELETE            21
 #define KROUTE_ROUTER_ID_UPDATE            22
 #define KROUTE_HELLO                       23
-#define KROUTE_MESSAGE_MAX                 24
+#define KROUTE_IPV4_ROUTE_BULK_ADD         24
+#define KROUTE_IPV4_ROUTE_BULK_DELETE      25
+#define KROUTE_MESSAGE_MAX                 26
 
 /* Marker value used in new Zserv, in the byte location corresponding
  * the command value in the old zserv header. To allow old and new
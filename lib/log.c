@@ -34,6 +34,9 @@
 #ifdef HAVE_UCONTEXT_H
 #include <ucontext.h>
 #endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 static int logfile_fd = -1;	/* Used in signal handler. */
 
@@ -72,42 +75,42 @@ const char *zlog_priority[] =
 
 /* For time string format. */
 
-size_t
-bane_timestamp(int timestamp_precision, char *buf, size_t buflen)
+struct timestamp_cache
 {
-  static struct {
-    time_t last;
-    size_t len;
-    char buf[28];
-  } cache;
-  struct timeval clock;
-
-  /* would it be sufficient to use global 'recent_time' here?  I fear not... */
-  gettimeofday(&clock, NULL);
+  time_t last;
+  size_t len;
+  char buf[28];
+};
 
+/* Render the given time, caching the part up to seconds. */
+static size_t
+timestamp_render(struct timestamp_cache *cache, struct timeval *clock,
+		 int timestamp_precision, char *buf, size_t buflen)
+{
   /* first, we update the cache if the time has changed */
-  if (cache.last != clock.tv_sec)
+  if (cache->last != clock->tv_sec)
     {
-      struct tm *tm;
-      cache.last = clock.tv_sec;
-      tm = localtime(&cache.last);
-      cache.len = strftime(cache.buf, sizeof(cache.buf),
-      			   "%Y/%m/%d %H:%M:%S", tm);
+      struct tm tm;
+      cache->last = clock->tv_sec;
+      localtime_r(&cache->last, &tm);
+      cache->len = strftime(cache->buf, sizeof(cache->buf),
+      			    "%Y/%m/%d %H:%M:%S", &tm);
     }
   /* note: it's not worth caching the subsecond part, because
      chances are that back-to-back calls are not sufficiently close together
      for the clock not to have ticked forward */
 
-  if (buflen > cache.len)
+  if (buflen > cache->len)
     {
-      memcpy(buf, cache.buf, cache.len);
+      memcpy(buf, cache->buf, cache->len);
       if ((timestamp_precision > 0) &&
-	  (buflen > cache.len+1+timestamp_precision))
+	  (buflen > cache->len+1+timestamp_precision))
 	{
 	  /* should we worry about locale issues? */
 	  static const int divisor[] = {0, 100000, 10000, 1000, 100, 10, 1};
 	  int prec;
-	  char *p = buf+cache.len+1+(prec = timestamp_precision);
+	  long usec = clock->tv_usec;
+	  char *p = buf+cache->len+1+(prec = timestamp_precision);
 	  *p-- = '\0';
 	  while (prec > 6)
 	    /* this is unlikely to happen, but protect anyway */
@@ -115,24 +118,36 @@ bane_timestamp(int timestamp_precision, char *buf, size_t buflen)
 	      *p-- = '0';
 	      prec--;
 	    }
-	  clock.tv_usec /= divisor[prec];
+	  usec /= divisor[prec];
 	  do
 	    {
-	      *p-- = '0'+(clock.tv_usec % 10);
-	      clock.tv_usec /= 10;
+	      *p-- = '0'+(usec % 10);
+	      usec /= 10;
 	    }
 	  while (--prec > 0);
 	  *p = '.';
-	  return cache.len+1+timestamp_precision;
+	  return cache->len+1+timestamp_precision;
 	}
-      buf[cache.len] = '\0';
-      return cache.len;
+      buf[cache->len] = '\0';
+      return cache->len;
     }
   if (buflen > 0)
     buf[0] = '\0';
   return 0;
 }
 
+size_t
+bane_timestamp(int timestamp_precision, char *buf, size_t buflen)
+{
+  static struct timestamp_cache cache;
+  struct timeval clock;
+
+  /* would it be sufficient to use global 'recent_time' here?  I fear not... */
+  gettimeofday(&clock, NULL);
+
+  return timestamp_render(&cache, &clock, timestamp_precision, buf, buflen);
+}
+
 /* Utility routine for current time printing. */
 static void
 time_print(FILE *fp, struct timestamp_control *ctl)
@@ -145,6 +160,396 @@ time_print(FILE *fp, struct timestamp_control *ctl)
   fprintf(fp, "%s ", ctl->buf);
 }
   
+
+#ifdef HAVE_LIBPTHREAD
+/* Asynchronous logging.
+ *
+ * vzlog formats the message into a ring of fixed size records and a
+ * writer thread does the syslog, file and stdout output, so the caller
+ * never blocks in write().  Only the master thread logs, so the ring has
+ * one producer and one consumer and needs no lock: head is only moved by
+ * vzlog, tail only by the writer.  A full ring drops the message and the
+ * writer reports how many were lost.  Monitor vtys are still written
+ * from vzlog, as the vty code is not thread safe.
+ */
+#define ZLOG_ASYNC_MSGLEN 512
+
+/* head and tail are published with release/acquire ordering */
+#ifdef __ATOMIC_ACQUIRE
+#define ZLOG_ASYNC_LOAD(V)	__atomic_load_n (&(V), __ATOMIC_ACQUIRE)
+#define ZLOG_ASYNC_STORE(V,X)	__atomic_store_n (&(V), (X), __ATOMIC_RELEASE)
+#else
+#define ZLOG_ASYNC_LOAD(V)	({ __sync_synchronize (); (V); })
+#define ZLOG_ASYNC_STORE(V,X)	do { __sync_synchronize (); (V) = (X); } while (0)
+#endif
+
+struct zlog_record
+{
+  struct zlog *zl;
+  struct timeval tv;
+  int priority;
+  int dests;			/* ZLOG_DEST_* bits */
+  char msg[ZLOG_ASYNC_MSGLEN];
+};
+
+static struct
+{
+  struct zlog_record *ring;
+  unsigned int size;
+  unsigned long head;		/* next record vzlog fills */
+  unsigned long tail;		/* next record the writer outputs */
+  unsigned long dropped;
+  unsigned long reported;
+
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t wake;		/* writer has work or should stop */
+  pthread_cond_t drained;	/* writer caught up with head */
+  int sleeping;
+  int stop;
+
+  /* held by the writer while it uses the zlog FILE pointers */
+  pthread_mutex_t io;
+} zlog_async;
+
+#define ZLOG_IO_LOCK() \
+  do { if (zlog_async.ring) pthread_mutex_lock (&zlog_async.io); } while (0)
+#define ZLOG_IO_UNLOCK() \
+  do { if (zlog_async.ring) pthread_mutex_unlock (&zlog_async.io); } while (0)
+
+static void
+zlog_record_print (FILE *fp, struct zlog_record *rec, const char *ts)
+{
+  fprintf (fp, "%s ", ts);
+  if (rec->zl->record_priority)
+    fprintf (fp, "%s: ", zlog_priority[rec->priority]);
+  fprintf (fp, "%s: %s\n", zlog_proto_names[rec->zl->protocol], rec->msg);
+}
+
+static void
+zlog_record_write (struct zlog_record *rec, struct timestamp_cache *cache)
+{
+  char ts[40];
+
+  if (rec->dests & (1 << ZLOG_DEST_SYSLOG))
+    syslog (rec->priority|rec->zl->facility, "%s", rec->msg);
+
+  if (!(rec->dests & ((1 << ZLOG_DEST_FILE)|(1 << ZLOG_DEST_STDOUT))))
+    return;
+
+  timestamp_render (cache, &rec->tv, rec->zl->timestamp_precision,
+		    ts, sizeof (ts));
+  if ((rec->dests & (1 << ZLOG_DEST_FILE)) && rec->zl->fp)
+    zlog_record_print (rec->zl->fp, rec, ts);
+  if (rec->dests & (1 << ZLOG_DEST_STDOUT))
+    zlog_record_print (stdout, rec, ts);
+}
+
+static void *
+zlog_async_writer (void *arg)
+{
+  struct timestamp_cache cache;
+  struct zlog_record *rec;
+  struct timespec until;
+  struct timeval now;
+  unsigned long dropped;
+
+  memset (&cache, 0, sizeof (cache));
+
+  pthread_mutex_lock (&zlog_async.mtx);
+  for (;;)
+    {
+      pthread_mutex_unlock (&zlog_async.mtx);
+
+      /* write out everything queued, flushing stdio once per batch */
+      pthread_mutex_lock (&zlog_async.io);
+      while (zlog_async.tail != ZLOG_ASYNC_LOAD (zlog_async.head))
+	{
+	  rec = &zlog_async.ring[zlog_async.tail % zlog_async.size];
+	  zlog_record_write (rec, &cache);
+	  ZLOG_ASYNC_STORE (zlog_async.tail, zlog_async.tail + 1);
+	}
+      dropped = ZLOG_ASYNC_LOAD (zlog_async.dropped);
+      if (dropped != zlog_async.reported && zlog_default)
+	{
+	  unsigned long lost = dropped - zlog_async.reported;
+
+	  zlog_async.reported += lost;
+	  syslog (LOG_WARNING|zlog_default->facility,
+		  "%lu log messages dropped, ring full", lost);
+	  if (zlog_default->fp)
+	    fprintf (zlog_default->fp,
+		     "%lu log messages dropped, ring full\n", lost);
+	}
+      if (zlog_default && zlog_default->fp)
+	fflush (zlog_default->fp);
+      fflush (stdout);
+      pthread_mutex_unlock (&zlog_async.io);
+
+      pthread_mutex_lock (&zlog_async.mtx);
+      pthread_cond_broadcast (&zlog_async.drained);
+      if (zlog_async.tail != ZLOG_ASYNC_LOAD (zlog_async.head))
+	continue;
+      if (zlog_async.stop)
+	break;
+
+      /* a wakeup lost to the unlocked check in vzlog costs at most this */
+      gettimeofday (&now, NULL);
+      until.tv_sec = now.tv_sec;
+      until.tv_nsec = (now.tv_usec + 100000) * 1000;
+      if (until.tv_nsec >= 1000000000)
+	{
+	  until.tv_sec++;
+	  until.tv_nsec -= 1000000000;
+	}
+      ZLOG_ASYNC_STORE (zlog_async.sleeping, 1);
+      pthread_cond_timedwait (&zlog_async.wake, &zlog_async.mtx, &until);
+      ZLOG_ASYNC_STORE (zlog_async.sleeping, 0);
+    }
+  pthread_mutex_unlock (&zlog_async.mtx);
+
+  return NULL;
+}
+
+/* Wait for the writer to output everything queued so far. */
+void
+zlog_async_flush (void)
+{
+  unsigned long head = zlog_async.head;
+
+  if (!zlog_async.ring || zlog_async.stop)
+    return;
+
+  pthread_mutex_lock (&zlog_async.mtx);
+  while ((long) (head - ZLOG_ASYNC_LOAD (zlog_async.tail)) > 0)
+    {
+      pthread_cond_signal (&zlog_async.wake);
+      pthread_cond_wait (&zlog_async.drained, &zlog_async.mtx);
+    }
+  pthread_mutex_unlock (&zlog_async.mtx);
+}
+
+/* Queue a message for the writer.  Returns 0 if it must be written
+   synchronously instead. */
+static int
+zlog_async_put (struct zlog *zl, int priority, const char *format,
+		va_list args)
+{
+  struct zlog_record *rec;
+  va_list ac;
+  int dests = 0;
+  int len;
+
+  if (!zlog_async.ring || zlog_async.stop)
+    return 0;
+
+  if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
+    dests |= (1 << ZLOG_DEST_SYSLOG);
+  if ((priority <= zl->maxlvl[ZLOG_DEST_FILE]) && zl->fp)
+    dests |= (1 << ZLOG_DEST_FILE);
+  if (priority <= zl->maxlvl[ZLOG_DEST_STDOUT])
+    dests |= (1 << ZLOG_DEST_STDOUT);
+  if (!dests)
+    return 1;
+
+  if (zlog_async.head - ZLOG_ASYNC_LOAD (zlog_async.tail)
+      >= zlog_async.size)
+    {
+      ZLOG_ASYNC_STORE (zlog_async.dropped, zlog_async.dropped + 1);
+      return 1;
+    }
+
+  rec = &zlog_async.ring[zlog_async.head % zlog_async.size];
+  va_copy (ac, args);
+  len = vsnprintf (rec->msg, sizeof (rec->msg), format, ac);
+  va_end (ac);
+  if (len < 0 || len >= (int) sizeof (rec->msg))
+    {
+      /* too long for a record: write it directly, after what is queued */
+      zlog_async_flush ();
+      return 0;
+    }
+
+  rec->zl = zl;
+  rec->priority = priority;
+  rec->dests = dests;
+  gettimeofday (&rec->tv, NULL);
+
+  ZLOG_ASYNC_STORE (zlog_async.head, zlog_async.head + 1);
+
+  if (ZLOG_ASYNC_LOAD (zlog_async.sleeping))
+    {
+      pthread_mutex_lock (&zlog_async.mtx);
+      pthread_cond_signal (&zlog_async.wake);
+      pthread_mutex_unlock (&zlog_async.mtx);
+    }
+  return 1;
+}
+
+static int
+zlog_async_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+  /* signals are for the master thread only */
+  sigfillset (&all);
+  pthread_sigmask (SIG_BLOCK, &all, &old);
+  ret = pthread_create (&zlog_async.thread, NULL, zlog_async_writer, NULL);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  return ret;
+}
+
+/* Daemons fork after reading their configuration, which may well have
+   turned asynchronous logging on: keep the ring consistent over the
+   fork and give the child a writer of its own. */
+static void
+zlog_async_prefork (void)
+{
+  if (!zlog_async.ring)
+    return;
+  pthread_mutex_lock (&zlog_async.mtx);
+  pthread_mutex_lock (&zlog_async.io);
+}
+
+static void
+zlog_async_postfork_parent (void)
+{
+  if (!zlog_async.ring)
+    return;
+  pthread_mutex_unlock (&zlog_async.io);
+  pthread_mutex_unlock (&zlog_async.mtx);
+}
+
+static void
+zlog_async_postfork_child (void)
+{
+  if (!zlog_async.ring)
+    return;
+  /* the parent's writer may have been waiting on these */
+  pthread_mutex_init (&zlog_async.mtx, NULL);
+  pthread_mutex_init (&zlog_async.io, NULL);
+  pthread_cond_init (&zlog_async.wake, NULL);
+  pthread_cond_init (&zlog_async.drained, NULL);
+  zlog_async.sleeping = 0;
+  if (zlog_async.stop)
+    return;
+  if (zlog_async_start ())
+    zlog_async.stop = 1;	/* zlog_async_put will write synchronously */
+}
+
+int
+zlog_async_enable (unsigned int records)
+{
+  static int atfork;
+  int ret;
+
+  if (records == 0)
+    records = ZLOG_ASYNC_DEFAULT;
+
+  if (zlog_async.ring)
+    {
+      if (zlog_async.size == records)
+	return 1;
+      zlog_async_disable ();
+    }
+
+  zlog_async.ring = XCALLOC (MTYPE_ZLOG_RING,
+			     records * sizeof (struct zlog_record));
+  zlog_async.size = records;
+  zlog_async.head = zlog_async.tail = 0;
+  zlog_async.dropped = zlog_async.reported = 0;
+  zlog_async.stop = 0;
+  pthread_mutex_init (&zlog_async.mtx, NULL);
+  pthread_mutex_init (&zlog_async.io, NULL);
+  pthread_cond_init (&zlog_async.wake, NULL);
+  pthread_cond_init (&zlog_async.drained, NULL);
+
+  if (!atfork)
+    {
+      pthread_atfork (zlog_async_prefork, zlog_async_postfork_parent,
+		      zlog_async_postfork_child);
+      atfork = 1;
+    }
+
+  if ((ret = zlog_async_start ()))
+    {
+      zlog_async.stop = 1;
+      zlog_async_disable ();
+      zlog_warn ("Asynchronous logging not started: %s",
+		 safe_strerror (ret));
+      return 0;
+    }
+  return 1;
+}
+
+/* Write out everything queued, then go back to logging synchronously. */
+void
+zlog_async_disable (void)
+{
+  if (!zlog_async.ring)
+    return;
+
+  if (!zlog_async.stop)
+    {
+      pthread_mutex_lock (&zlog_async.mtx);
+      zlog_async.stop = 1;
+      pthread_cond_signal (&zlog_async.wake);
+      pthread_mutex_unlock (&zlog_async.mtx);
+      pthread_join (zlog_async.thread, NULL);
+    }
+
+  pthread_cond_destroy (&zlog_async.drained);
+  pthread_cond_destroy (&zlog_async.wake);
+  pthread_mutex_destroy (&zlog_async.io);
+  pthread_mutex_destroy (&zlog_async.mtx);
+  XFREE (MTYPE_ZLOG_RING, zlog_async.ring);
+  zlog_async.size = 0;
+}
+
+int
+zlog_async_stats (unsigned int *size, unsigned int *queued,
+		  unsigned long *written, unsigned long *dropped)
+{
+  if (!zlog_async.ring)
+    return 0;
+
+  *size = zlog_async.size;
+  *written = ZLOG_ASYNC_LOAD (zlog_async.tail);
+  *queued = zlog_async.head - *written;
+  *dropped = zlog_async.dropped;
+  return 1;
+}
+#else /* !HAVE_LIBPTHREAD */
+#define ZLOG_IO_LOCK()
+#define ZLOG_IO_UNLOCK()
+#define zlog_async_put(Z,P,F,A) 0
+
+int
+zlog_async_enable (unsigned int records)
+{
+  zlog_warn ("Asynchronous logging needs pthreads, logging synchronously");
+  return 0;
+}
+
+void
+zlog_async_disable (void)
+{
+}
+
+void
+zlog_async_flush (void)
+{
+}
+
+int
+zlog_async_stats (unsigned int *size, unsigned int *queued,
+		  unsigned long *written, unsigned long *dropped)
+{
+  return 0;
+}
+#endif /* HAVE_LIBPTHREAD */
 
 /* va_list version of zlog. */
 static void
@@ -172,6 +577,9 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
     }
   tsctl.precision = zl->timestamp_precision;
 
+  if (zlog_async_put (zl, priority, format, args))
+    goto monitor;
+
   /* Syslog output */
   if (priority <= zl->maxlvl[ZLOG_DEST_SYSLOG])
     {
@@ -211,6 +619,7 @@ vzlog (struct zlog *zl, int priority, const char *format, va_list args)
       fflush (stdout);
     }
 
+ monitor:
   /* Terminal monitor. */
   if (priority <= zl->maxlvl[ZLOG_DEST_MONITOR])
     vty_log ((zl->record_priority ? zlog_priority[priority] : NULL),
@@ -616,6 +1025,7 @@ _zlog_assert_failed (const char *assertion, const char *file,
   zlog(NULL, LOG_CRIT, "Assertion `%s' failed in file %s, line %u, function %s",
        assertion,file,line,(function ? function : "?"));
   zlog_backtrace(LOG_CRIT);
+  zlog_async_disable();
   abort();
 }
 
@@ -649,6 +1059,9 @@ openzlog (const char *progname, zlog_proto_t protocol,
 void
 closezlog (struct zlog *zl)
 {
+  /* queued records may still refer to zl */
+  zlog_async_disable ();
+
   closelog();
 
   if (zl->fp != NULL)
@@ -691,10 +1104,12 @@ zlog_set_file (struct zlog *zl, const char *filename, int log_level)
     return 0;
 
   /* Set flags. */
+  ZLOG_IO_LOCK ();
   zl->filename = strdup (filename);
   zl->maxlvl[ZLOG_DEST_FILE] = log_level;
   zl->fp = fp;
   logfile_fd = fileno(fp);
+  ZLOG_IO_UNLOCK ();
 
   return 1;
 }
@@ -706,6 +1121,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  ZLOG_IO_LOCK ();
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -715,6 +1131,7 @@ zlog_reset_file (struct zlog *zl)
   if (zl->filename)
     free (zl->filename);
   zl->filename = NULL;
+  ZLOG_IO_UNLOCK ();
 
   return 1;
 }
@@ -728,6 +1145,7 @@ zlog_rotate (struct zlog *zl)
   if (zl == NULL)
     zl = zlog_default;
 
+  ZLOG_IO_LOCK ();
   if (zl->fp)
     fclose (zl->fp);
   zl->fp = NULL;
@@ -746,6 +1164,7 @@ zlog_rotate (struct zlog *zl)
       umask(oldumask);
       if (zl->fp == NULL)
         {
+	  ZLOG_IO_UNLOCK ();
 	  zlog_err("Log rotate failed: cannot open file %s for append: %s",
 	  	   zl->filename, safe_strerror(save_errno));
 	  return -1;
@@ -753,6 +1172,7 @@ zlog_rotate (struct zlog *zl)
       logfile_fd = fileno(zl->fp);
       zl->maxlvl[ZLOG_DEST_FILE] = level;
     }
+  ZLOG_IO_UNLOCK ();
 
   return 1;
 }
@@ -845,6 +1265,8 @@ static const struct kroute_desc_table command_types[] = {
   DESC_ENTRY	(KROUTE_ROUTER_ID_DELETE),
   DESC_ENTRY	(KROUTE_ROUTER_ID_UPDATE),
   DESC_ENTRY	(KROUTE_HELLO),
+  DESC_ENTRY	(KROUTE_IPV4_ROUTE_BULK_ADD),
+  DESC_ENTRY	(KROUTE_IPV4_ROUTE_BULK_DELETE),
 };
 #undef DESC_ENTRY
 
@@ -147,6 +147,21 @@ extern int zlog_reset_file (struct zlog *zl);
 /* Rotate log. */
 extern int zlog_rotate (struct zlog *);
 
+/* Hand syslog, file and stdout output to a writer thread, through a ring
+   of the given number of records (0 for the default), so logging never
+   blocks the caller.  Messages are dropped, and counted, while the ring
+   is full.  Returns 0, and keeps logging synchronously, if the writer
+   can not be started. */
+#define ZLOG_ASYNC_DEFAULT 1024
+extern int zlog_async_enable (unsigned int records);
+/* Write out anything queued and log synchronously again. */
+extern void zlog_async_disable (void);
+/* Wait until everything logged so far has been written out. */
+extern void zlog_async_flush (void);
+/* Returns 0 if asynchronous logging is off. */
+extern int zlog_async_stats (unsigned int *size, unsigned int *queued,
+			     unsigned long *written, unsigned long *dropped);
+
 /* For hackey massage lookup and check */
 #define LOOKUP(x, y) mes_lookup(x, x ## _max, y, "(no item found)", #x)
 
@@ -25,14 +25,73 @@
 #if !defined(HAVE_STDLIB_H) || (defined(GNU_LINUX) && defined(HAVE_MALLINFO))
 #include <malloc.h>
 #endif /* !HAVE_STDLIB_H || HAVE_MALLINFO */
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif /* HAVE_LIBPTHREAD */
 
 #include "log.h"
 #include "memory.h"
+#include "thread.h"
+#include "linklist.h"
+#include "prefix.h"
+#include "table.h"
+#include "stream.h"
+#include "metrics.h"
 
 static void alloc_inc (int);
 static void alloc_dec (int);
 static void log_memstats(int log_priority);
+
+/* Fixed size object pools.  Objects of a pooled type are carved out
+   of MPOOL_SLAB_BYTES slabs, and freed objects are kept on a per type
+   free list for reuse instead of being returned to malloc.  Pooled
+   structures hold nothing needing more than 8 byte alignment, so they
+   are packed that tightly rather than at malloc's 16. */
+#define MPOOL_SLAB_BYTES	16384
+#define MPOOL_ALIGN		8
+#define MPOOL_OBJSIZE(P) \
+  (((P)->size + MPOOL_ALIGN - 1) & ~(MPOOL_ALIGN - 1))
+
+struct mpool
+{
+  size_t size;			/* object size, 0 if type is not pooled */
+  void *free;			/* free list, linked through the objects */
+  char *fresh;			/* unused tail of the newest slab */
+  char *fresh_end;
+  unsigned long nfree;
+  unsigned long slabs;
+  unsigned long hits;		/* allocations reusing a freed object */
+  unsigned long misses;		/* allocations carving a new object */
+};
+
+/* Hot library objects are pooled from the start.  Daemons add their
+   own types with memory_pool_enable(). */
+static struct mpool mpool[MTYPE_MAX] =
+{
+  [MTYPE_THREAD]	= { .size = sizeof (struct thread) },
+  [MTYPE_LINK_NODE]	= { .size = sizeof (struct listnode) },
+  [MTYPE_ROUTE_NODE]	= { .size = ROUTE_NODE_SIZE (AF_INET) },
+  [MTYPE_ROUTE_NODE_IPV6] = { .size = ROUTE_NODE_SIZE (AF_INET6) },
+  [MTYPE_STREAM]	= { .size = sizeof (struct stream) },
+};
 
+/* Once memory_threads_enable() has been called, threads besides the
+   master may allocate: the pools are then taken under mpool_mtx, and
+   the allocation counters are changed atomically.  Until then neither
+   costs anything. */
+#ifdef HAVE_LIBPTHREAD
+static int memory_threaded;
+static pthread_mutex_t mpool_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+#define MPOOL_LOCK() \
+  do { if (memory_threaded) pthread_mutex_lock (&mpool_mtx); } while (0)
+#define MPOOL_UNLOCK() \
+  do { if (memory_threaded) pthread_mutex_unlock (&mpool_mtx); } while (0)
+#else
+#define MPOOL_LOCK()
+#define MPOOL_UNLOCK()
+#endif /* HAVE_LIBPTHREAD */
+
 static const struct message mstr [] =
 {
   { MTYPE_THREAD, "thread" },
@@ -58,6 +117,60 @@ zerror (const char *fname, int type, size_t size)
   abort();
 }
 
+static void *
+mpool_alloc (int type, size_t size)
+{
+  struct mpool *p = &mpool[type];
+  size_t objsize = MPOOL_OBJSIZE (p);
+  size_t slab;
+  void *memory;
+
+  /* A pooled type must always be allocated at its registered size. */
+  if (size > p->size)
+    zerror ("mpool_alloc", type, size);
+
+  MPOOL_LOCK ();
+  if (p->free)
+    {
+      memory = p->free;
+      p->free = *(void **) memory;
+      p->nfree--;
+      p->hits++;
+      MPOOL_UNLOCK ();
+      return memory;
+    }
+
+  if (p->fresh == NULL || p->fresh + objsize > p->fresh_end)
+    {
+      slab = (objsize > MPOOL_SLAB_BYTES ? objsize : MPOOL_SLAB_BYTES);
+      if ((p->fresh = malloc (slab)) == NULL)
+	{
+	  MPOOL_UNLOCK ();
+	  zerror ("malloc", type, slab);
+	}
+      p->fresh_end = p->fresh + slab;
+      p->slabs++;
+    }
+
+  memory = p->fresh;
+  p->fresh += objsize;
+  p->misses++;
+  MPOOL_UNLOCK ();
+  return memory;
+}
+
+static void
+mpool_free (int type, void *ptr)
+{
+  struct mpool *p = &mpool[type];
+
+  MPOOL_LOCK ();
+  *(void **) ptr = p->free;
+  p->free = ptr;
+  p->nfree++;
+  MPOOL_UNLOCK ();
+}
+
 /*
  * Allocate memory of a given size, to be tracked by a given type.
  * Effects: Returns a pointer to usable memory.  If memory cannot
@@ -68,7 +181,10 @@ zmalloc (int type, size_t size)
 {
   void *memory;
 
-  memory = malloc (size);
+  if (mpool[type].size)
+    memory = mpool_alloc (type, size);
+  else
+    memory = malloc (size);
 
   if (memory == NULL)
     zerror ("malloc", type, size);
@@ -86,7 +202,13 @@ zcalloc (int type, size_t size)
 {
   void *memory;
 
-  memory = calloc (1, size);
+  if (mpool[type].size)
+    {
+      memory = mpool_alloc (type, size);
+      memset (memory, 0, size);
+    }
+  else
+    memory = calloc (1, size);
 
   if (memory == NULL)
     zerror ("calloc", type, size);
@@ -108,6 +230,16 @@ zrealloc (int type, void *ptr, size_t size)
 {
   void *memory;
 
+  /* Pooled objects can not grow past the pool's object size. */
+  if (mpool[type].size)
+    {
+      if (ptr == NULL)
+	return zmalloc (type, size);
+      if (size > mpool[type].size)
+	zerror ("realloc", type, size);
+      return ptr;
+    }
+
   memory = realloc (ptr, size);
   if (memory == NULL)
     zerror ("realloc", type, size);
@@ -129,7 +261,10 @@ zfree (int type, void *ptr)
   if (ptr != NULL)
     {
       alloc_dec (type);
-      free (ptr);
+      if (mpool[type].size)
+	mpool_free (type, ptr);
+      else
+	free (ptr);
     }
 }
 
@@ -144,6 +279,12 @@ zstrdup (int type, const char *str)
 {
   void *dup;
 
+  if (mpool[type].size)
+    {
+      dup = zmalloc (type, strlen (str) + 1);
+      return strcpy (dup, str);
+    }
+
   dup = strdup (str);
   if (dup == NULL)
     zerror ("strdup", type, strlen (str));
@@ -250,6 +391,13 @@ static struct
 static void
 alloc_inc (int type)
 {
+#ifdef HAVE_LIBPTHREAD
+  if (memory_threaded)
+    {
+      __sync_fetch_and_add (&mstat[type].alloc, 1);
+      return;
+    }
+#endif /* HAVE_LIBPTHREAD */
   mstat[type].alloc++;
 }
 
@@ -257,8 +405,53 @@ alloc_inc (int type)
 static void
 alloc_dec (int type)
 {
+#ifdef HAVE_LIBPTHREAD
+  if (memory_threaded)
+    {
+      __sync_fetch_and_sub (&mstat[type].alloc, 1);
+      return;
+    }
+#endif /* HAVE_LIBPTHREAD */
   mstat[type].alloc--;
 }
+
+/*
+ * Let threads besides the master allocate and free memory.  Must be
+ * called on the master thread, before it starts the first such thread.
+ * It can not be undone.
+ */
+void
+memory_threads_enable (void)
+{
+#ifdef HAVE_LIBPTHREAD
+  memory_threaded = 1;
+#endif /* HAVE_LIBPTHREAD */
+}
+
+/*
+ * Serve all further allocations of type from a fixed size object pool.
+ * Every allocation of the type must then be at most size bytes.  This
+ * has to be done before any object of the type is allocated, returns
+ * -1 if that is not the case.
+ */
+int
+memory_pool_enable (int type, size_t size)
+{
+  if (mpool[type].size == size)
+    return 0;
+
+  if (mstat[type].alloc != 0)
+    {
+      zlog_warn ("memory_pool_enable: %s already in use, not pooled",
+		 lookup (mstr, type));
+      return -1;
+    }
+
+  if (size < sizeof (void *))
+    size = sizeof (void *);
+  mpool[type].size = size;
+  return 0;
+}
 
 /* Looking up memory status from vty interface. */
 #include "vector.h"
@@ -281,6 +474,21 @@ log_memstats(int pri)
     }
 }
 
+void
+memory_metrics (struct metrics *m)
+{
+  struct mlist *ml;
+  struct memory_list *ms;
+
+  metrics_family (m, "memory_allocations", METRICS_GAUGE,
+		  "Allocations outstanding by memory type");
+  for (ml = mlists; ml->list; ml++)
+    for (ms = ml->list; ms->index >= 0; ms++)
+      if (ms->index && mstat[ms->index].alloc)
+	metrics_value (m, mstat[ms->index].alloc,
+		       "module", ml->name, "mtype", ms->format, NULL);
+}
+
 void
 log_memstats_stderr (const char *prefix)
 {
@@ -328,6 +536,27 @@ show_separator(struct vty *vty)
   vty_out (vty, "-----------------------------\r\n");
 }
 
+/* Pool hit rate, bytes held in slabs and the share of those not
+   holding live objects. */
+static void
+show_memory_pool (struct vty *vty, int type)
+{
+  struct mpool *p = &mpool[type];
+  unsigned long allocs = p->hits + p->misses;
+  unsigned long resident, used;
+  char buf[MTYPE_MEMSTR_LEN];
+
+  resident = p->slabs * MPOOL_SLAB_BYTES;
+  if (MPOOL_OBJSIZE (p) > MPOOL_SLAB_BYTES)
+    resident = p->slabs * MPOOL_OBJSIZE (p);
+  used = mstat[type].alloc * MPOOL_OBJSIZE (p);
+
+  vty_out (vty, "  pool %3lu%% hit %10s %3lu%% free",
+	   allocs ? p->hits * 100 / allocs : 0,
+	   mtype_memstr (buf, MTYPE_MEMSTR_LEN, resident),
+	   resident ? (resident - used) * 100 / resident : 0);
+}
+
 static int
 show_memory_vty (struct vty *vty, struct memory_list *list)
 {
@@ -345,7 +574,10 @@ show_memory_vty (struct vty *vty, struct memory_list *list)
       }
     else if (mstat[m->index].alloc)
       {
-	vty_out (vty, "%-30s: %10ld\r\n", m->format, mstat[m->index].alloc);
+	vty_out (vty, "%-30s: %10ld", m->format, mstat[m->index].alloc);
+	if (mpool[m->index].size)
+	  show_memory_pool (vty, m->index);
+	vty_out (vty, "\r\n");
 	needsep = 1;
       }
   return needsep;
@@ -640,3 +872,9 @@ mtype_stats_alloc (int type)
 {
   return mstat[type].alloc;
 }
+
+size_t
+mtype_stats_size (int type)
+{
+  return mpool[type].size;
+}
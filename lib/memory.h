@@ -83,11 +83,24 @@ extern void mtype_zfree (const char *file, int line, int type,
 extern char *mtype_zstrdup (const char *file, int line, int type,
 		            const char *str);
 extern void memory_init (void);
+extern int memory_pool_enable (int, size_t);
+
+/* The allocator, pooled types included, is for the master thread only
+   until this is called.  A daemon must call it before starting any
+   other thread that allocates or frees memory. */
+extern void memory_threads_enable (void);
 extern void log_memstats_stderr (const char *);
 
+struct metrics;
+extern void memory_metrics (struct metrics *);
+
 /* return number of allocations outstanding for the type */
 extern unsigned long mtype_stats_alloc (int);
 
+/* return the size objects of a pooled type are allocated at, 0 if the
+   type is not pooled */
+extern size_t mtype_stats_size (int);
+
 /* Human friendly string for given byte count */
 #define MTYPE_MEMSTR_LEN 20
 extern const char *mtype_memstr (char *, size_t, unsigned long);
@@ -22,9 +22,11 @@ struct memory_list memory_list_lib[] =
   { MTYPE_THREAD_MASTER,	"Thread master"			},
   { MTYPE_THREAD_STATS,		"Thread stats"			},
   { MTYPE_THREAD_FUNCNAME,	"Thread function name" 		},
+  { MTYPE_THREAD_POLL,		"Thread poll table"		},
   { MTYPE_VTY,			"VTY"				},
   { MTYPE_VTY_OUT_BUF,		"VTY output buffer"		},
   { MTYPE_VTY_HIST,		"VTY history"			},
+  { MTYPE_VTY_WALK,		"VTY walk cursor"		},
   { MTYPE_IF,			"Interface"			},
   { MTYPE_CONNECTED,		"Connected" 			},
   { MTYPE_CONNECTED_LABEL,	"Connected interface label"	},
@@ -39,13 +41,18 @@ struct memory_list memory_list_lib[] =
   { MTYPE_HASH,			"Hash"				},
   { MTYPE_HASH_BACKET,		"Hash Bucket"			},
   { MTYPE_HASH_INDEX,		"Hash Index"			},
+  { MTYPE_HASH_NAME,		"Hash name"			},
   { MTYPE_ROUTE_TABLE,		"Route table"			},
   { MTYPE_ROUTE_NODE,		"Route node"			},
+  { MTYPE_ROUTE_NODE_IPV6,	"Route node IPv6"		},
+  { MTYPE_ROUTE_INDEX,		"Route table index"		},
+  { MTYPE_ROUTE_DEFER,		"Route deferred free"		},
   { MTYPE_DISTRIBUTE,		"Distribute list"		},
   { MTYPE_DISTRIBUTE_IFNAME,	"Dist-list ifname"		},
   { MTYPE_ACCESS_LIST,		"Access List"			},
   { MTYPE_ACCESS_LIST_STR,	"Access List Str"		},
   { MTYPE_ACCESS_FILTER,	"Access Filter"			},
+  { MTYPE_ACCESS_TRIE,		"Access List Trie"		},
   { MTYPE_PREFIX_LIST,		"Prefix List"			},
   { MTYPE_PREFIX_LIST_ENTRY,	"Prefix List Entry"		},
   { MTYPE_PREFIX_LIST_STR,	"Prefix List Str"		},
@@ -55,7 +62,10 @@ struct memory_list memory_list_lib[] =
   { MTYPE_ROUTE_MAP_RULE,	"Route map rule"		},
   { MTYPE_ROUTE_MAP_RULE_STR,	"Route map rule str"		},
   { MTYPE_ROUTE_MAP_COMPILED,	"Route map compiled"		},
+  { MTYPE_ROUTE_MAP_CACHE,	"Route map cache"		},
   { MTYPE_DESC,			"Command desc"			},
+  { MTYPE_CMD_TRIE,		"Command trie"			},
+  { MTYPE_CMD_BATCH,		"Command batch"			},
   { MTYPE_KEY,			"Key"				},
   { MTYPE_KEYCHAIN,		"Key chain"			},
   { MTYPE_IF_RMAP,		"Interface route map"		},
@@ -63,13 +73,16 @@ struct memory_list memory_list_lib[] =
   { MTYPE_SOCKUNION,		"Socket union"			},
   { MTYPE_PRIVS,		"Privilege information"		},
   { MTYPE_ZLOG,			"Logging"			},
+  { MTYPE_ZLOG_RING,		"Logging ring"			},
   { MTYPE_ZCLIENT,		"Zclient"			},
   { MTYPE_WORK_QUEUE,		"Work queue"			},
   { MTYPE_WORK_QUEUE_ITEM,	"Work queue item"		},
   { MTYPE_WORK_QUEUE_NAME,	"Work queue name string"	},
+  { MTYPE_WORK_QUEUE_POOL,	"Work queue worker pool"	},
   { MTYPE_PQUEUE,		"Priority queue"		},
   { MTYPE_PQUEUE_DATA,		"Priority queue data"		},
   { MTYPE_HOST,			"Host config"			},
+  { MTYPE_METRICS,		"Metrics export"		},
   { -1, NULL },
 };
 
@@ -83,6 +96,7 @@ struct memory_list memory_list_kroute[] =
   { MTYPE_RIB_QUEUE,		"RIB process work queue"	},
   { MTYPE_STATIC_IPV4,		"Static IPv4 route"		},
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
+  { MTYPE_DPLANE_QUEUE,		"Dataplane route change queue"	},
   { -1, NULL },
 };
 
@@ -104,6 +118,7 @@ struct memory_list memory_list_bgp[] =
   { 0, NULL },
   { MTYPE_BGP_TABLE,		"BGP table"			},
   { MTYPE_BGP_NODE,		"BGP node"			},
+  { MTYPE_BGP_NODE_IPV6,	"BGP node IPv6"			},
   { MTYPE_BGP_ROUTE,		"BGP route"			},
   { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
   { MTYPE_BGP_CONN,		"BGP connected"			},
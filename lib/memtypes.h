@@ -16,9 +16,11 @@ enum
   MTYPE_THREAD_MASTER,
   MTYPE_THREAD_STATS,
   MTYPE_THREAD_FUNCNAME,
+  MTYPE_THREAD_POLL,
   MTYPE_VTY,
   MTYPE_VTY_OUT_BUF,
   MTYPE_VTY_HIST,
+  MTYPE_VTY_WALK,
   MTYPE_IF,
   MTYPE_CONNECTED,
   MTYPE_CONNECTED_LABEL,
@@ -33,13 +35,18 @@ enum
   MTYPE_HASH,
   MTYPE_HASH_BACKET,
   MTYPE_HASH_INDEX,
+  MTYPE_HASH_NAME,
   MTYPE_ROUTE_TABLE,
   MTYPE_ROUTE_NODE,
+  MTYPE_ROUTE_NODE_IPV6,
+  MTYPE_ROUTE_INDEX,
+  MTYPE_ROUTE_DEFER,
   MTYPE_DISTRIBUTE,
   MTYPE_DISTRIBUTE_IFNAME,
   MTYPE_ACCESS_LIST,
   MTYPE_ACCESS_LIST_STR,
   MTYPE_ACCESS_FILTER,
+  MTYPE_ACCESS_TRIE,
   MTYPE_PREFIX_LIST,
   MTYPE_PREFIX_LIST_ENTRY,
   MTYPE_PREFIX_LIST_STR,
@@ -49,7 +56,10 @@ enum
   MTYPE_ROUTE_MAP_RULE,
   MTYPE_ROUTE_MAP_RULE_STR,
   MTYPE_ROUTE_MAP_COMPILED,
+  MTYPE_ROUTE_MAP_CACHE,
   MTYPE_DESC,
+  MTYPE_CMD_TRIE,
+  MTYPE_CMD_BATCH,
   MTYPE_KEY,
   MTYPE_KEYCHAIN,
   MTYPE_IF_RMAP,
@@ -57,13 +67,16 @@ enum
   MTYPE_SOCKUNION,
   MTYPE_PRIVS,
   MTYPE_ZLOG,
+  MTYPE_ZLOG_RING,
   MTYPE_ZCLIENT,
   MTYPE_WORK_QUEUE,
   MTYPE_WORK_QUEUE_ITEM,
   MTYPE_WORK_QUEUE_NAME,
+  MTYPE_WORK_QUEUE_POOL,
   MTYPE_PQUEUE,
   MTYPE_PQUEUE_DATA,
   MTYPE_HOST,
+  MTYPE_METRICS,
   MTYPE_RTADV_PREFIX,
   MTYPE_VRF,
   MTYPE_VRF_NAME,
@@ -72,6 +85,7 @@ enum
   MTYPE_RIB_QUEUE,
   MTYPE_STATIC_IPV4,
   MTYPE_STATIC_IPV6,
+  MTYPE_DPLANE_QUEUE,
   MTYPE_BGP,
   MTYPE_BGP_LISTENER,
   MTYPE_BGP_PEER,
@@ -87,6 +101,7 @@ enum
   MTYPE_AS_STR,
   MTYPE_BGP_TABLE,
   MTYPE_BGP_NODE,
+  MTYPE_BGP_NODE_IPV6,
   MTYPE_BGP_ROUTE,
   MTYPE_BGP_ROUTE_EXTRA,
   MTYPE_BGP_CONN,
@@ -0,0 +1,550 @@
+/* Metrics export over a UNIX domain socket.
+ *
+ * This file is part of GNU Kroute.
+ *
+ * GNU Kroute is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Kroute is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Kroute; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <kroute.h>
+#include <sys/un.h>
+
+#include "thread.h"
+#include "buffer.h"
+#include "linklist.h"
+#include "memory.h"
+#include "log.h"
+#include "network.h"
+#include "privs.h"
+#include "workqueue.h"
+#include "metrics.h"
+
+/* Longest request we read before answering anyway. */
+#define METRICS_REQUEST_MAX   1024
+
+/* Seconds a client has to send its request and read the answer. */
+#define METRICS_TIMEOUT       10
+
+struct metrics
+{
+  struct buffer *buf;
+  enum metrics_format format;
+  const char *name;		/* current family */
+  int families;			/* families rendered so far */
+  int values;			/* samples in the current family */
+};
+
+struct metrics_collector
+{
+  char *name;
+  metrics_collect_t collect;
+};
+
+struct metrics_client
+{
+  int fd;
+  int http;
+  char request[METRICS_REQUEST_MAX + 1];
+  int reqlen;
+  struct buffer *obuf;
+  struct thread *t_read;
+  struct thread *t_write;
+  struct thread *t_timeout;
+};
+
+static struct thread_master *metrics_master;
+static struct list *metrics_collectors;
+static struct list *metrics_clients;
+static int metrics_sock = -1;
+static struct thread *metrics_t_accept;
+static char *metrics_path;
+
+/* Append str with the quoting a label value or JSON string needs. */
+static void
+metrics_put_escaped (struct metrics *m, const char *str)
+{
+  char hex[8];
+
+  for (; *str; str++)
+    switch (*str)
+      {
+      case '\\':
+	buffer_putstr (m->buf, "\\\\");
+	break;
+      case '"':
+	buffer_putstr (m->buf, "\\\"");
+	break;
+      case '\n':
+	buffer_putstr (m->buf, "\\n");
+	break;
+      default:
+	if (m->format == METRICS_JSON && (u_char) *str < 0x20)
+	  {
+	    snprintf (hex, sizeof (hex), "\\u%04x", (u_char) *str);
+	    buffer_putstr (m->buf, hex);
+	  }
+	else
+	  buffer_putc (m->buf, *str);
+      }
+}
+
+void
+metrics_family (struct metrics *m, const char *name, enum metrics_type type,
+		const char *help)
+{
+  const char *typestr = (type == METRICS_COUNTER) ? "counter" : "gauge";
+
+  m->name = name;
+  m->values = 0;
+
+  if (m->format == METRICS_JSON)
+    {
+      buffer_putstr (m->buf, m->families ? "]},\n\"kroute_" : "\"kroute_");
+      buffer_putstr (m->buf, name);
+      buffer_putstr (m->buf, "\":{\"type\":\"");
+      buffer_putstr (m->buf, typestr);
+      buffer_putstr (m->buf, "\",\"help\":\"");
+      metrics_put_escaped (m, help);
+      buffer_putstr (m->buf, "\",\"samples\":[");
+    }
+  else
+    {
+      buffer_putstr (m->buf, "# HELP kroute_");
+      buffer_putstr (m->buf, name);
+      buffer_putc (m->buf, ' ');
+      buffer_putstr (m->buf, help);
+      buffer_putstr (m->buf, "\n# TYPE kroute_");
+      buffer_putstr (m->buf, name);
+      buffer_putc (m->buf, ' ');
+      buffer_putstr (m->buf, typestr);
+      buffer_putc (m->buf, '\n');
+    }
+  m->families++;
+}
+
+void
+metrics_value (struct metrics *m, unsigned long long value, ...)
+{
+  const char *label, *lvalue;
+  char num[24];
+  va_list args;
+  int n = 0;
+
+  assert (m->name);
+
+  if (m->format == METRICS_JSON)
+    buffer_putstr (m->buf, m->values ? ",{\"labels\":{" : "{\"labels\":{");
+  else
+    {
+      buffer_putstr (m->buf, "kroute_");
+      buffer_putstr (m->buf, m->name);
+    }
+
+  va_start (args, value);
+  while ((label = va_arg (args, const char *)) != NULL)
+    {
+      lvalue = va_arg (args, const char *);
+      if (m->format == METRICS_JSON)
+	{
+	  buffer_putstr (m->buf, n ? ",\"" : "\"");
+	  buffer_putstr (m->buf, label);
+	  buffer_putstr (m->buf, "\":\"");
+	}
+      else
+	{
+	  buffer_putc (m->buf, n ? ',' : '{');
+	  buffer_putstr (m->buf, label);
+	  buffer_putstr (m->buf, "=\"");
+	}
+      metrics_put_escaped (m, lvalue ? lvalue : "");
+      buffer_putc (m->buf, '"');
+      n++;
+    }
+  va_end (args);
+
+  snprintf (num, sizeof (num), "%llu", value);
+  if (m->format == METRICS_JSON)
+    {
+      buffer_putstr (m->buf, "},\"value\":");
+      buffer_putstr (m->buf, num);
+      buffer_putc (m->buf, '}');
+    }
+  else
+    {
+      if (n)
+	buffer_putc (m->buf, '}');
+      buffer_putc (m->buf, ' ');
+      buffer_putstr (m->buf, num);
+      buffer_putc (m->buf, '\n');
+    }
+  m->values++;
+}
+
+void
+metrics_render (struct buffer *buf, enum metrics_format format)
+{
+  struct metrics_collector *mc;
+  struct listnode *node;
+  struct metrics m;
+
+  memset (&m, 0, sizeof (m));
+  m.buf = buf;
+  m.format = format;
+
+  if (format == METRICS_JSON)
+    buffer_putc (buf, '{');
+  for (ALL_LIST_ELEMENTS_RO (metrics_collectors, node, mc))
+    (*mc->collect) (&m);
+  if (format == METRICS_JSON)
+    buffer_putstr (buf, m.families ? "]}}\n" : "}\n");
+}
+
+static struct metrics_collector *
+metrics_lookup (const char *name)
+{
+  struct metrics_collector *mc;
+  struct listnode *node;
+
+  for (ALL_LIST_ELEMENTS_RO (metrics_collectors, node, mc))
+    if (strcmp (mc->name, name) == 0)
+      return mc;
+  return NULL;
+}
+
+void
+metrics_register (const char *name, metrics_collect_t collect)
+{
+  struct metrics_collector *mc;
+
+  /* daemons may register before vty_init () */
+  if (!metrics_collectors)
+    metrics_collectors = list_new ();
+
+  if ((mc = metrics_lookup (name)) == NULL)
+    {
+      mc = XCALLOC (MTYPE_METRICS, sizeof (struct metrics_collector));
+      mc->name = XSTRDUP (MTYPE_METRICS, name);
+      listnode_add (metrics_collectors, mc);
+    }
+  mc->collect = collect;
+}
+
+void
+metrics_unregister (const char *name)
+{
+  struct metrics_collector *mc;
+
+  if (!metrics_collectors || (mc = metrics_lookup (name)) == NULL)
+    return;
+  listnode_delete (metrics_collectors, mc);
+  XFREE (MTYPE_METRICS, mc->name);
+  XFREE (MTYPE_METRICS, mc);
+}
+
+static void
+metrics_client_close (struct metrics_client *client)
+{
+  THREAD_OFF (client->t_read);
+  THREAD_OFF (client->t_write);
+  THREAD_OFF (client->t_timeout);
+  close (client->fd);
+  buffer_free (client->obuf);
+  listnode_delete (metrics_clients, client);
+  XFREE (MTYPE_METRICS, client);
+}
+
+static int
+metrics_client_timeout (struct thread *thread)
+{
+  struct metrics_client *client = THREAD_ARG (thread);
+
+  client->t_timeout = NULL;
+  metrics_client_close (client);
+  return 0;
+}
+
+static int
+metrics_client_write (struct thread *thread)
+{
+  struct metrics_client *client = THREAD_ARG (thread);
+
+  client->t_write = NULL;
+  switch (buffer_flush_available (client->obuf, client->fd))
+    {
+    case BUFFER_PENDING:
+      client->t_write = thread_add_write (metrics_master,
+					  metrics_client_write, client,
+					  client->fd);
+      break;
+    case BUFFER_ERROR:
+      zlog_warn ("metrics: write to client failed: %s",
+		 safe_strerror (errno));
+      /* fall through */
+    case BUFFER_EMPTY:
+      metrics_client_close (client);
+      break;
+    }
+  return 0;
+}
+
+/* Render the answer to the request read so far and start writing it. */
+static void
+metrics_client_answer (struct metrics_client *client)
+{
+  enum metrics_format format = METRICS_PROMETHEUS;
+  char *req = client->request;
+  char *end;
+
+  if (client->http)
+    {
+      /* "GET /path HTTP/1.x": only the path matters */
+      req += 4;
+      if ((end = strpbrk (req, " ?\r\n")) != NULL)
+	*end = '\0';
+      if (strlen (req) >= 5 && strcmp (req + strlen (req) - 5, ".json") == 0)
+	format = METRICS_JSON;
+    }
+  else
+    {
+      if ((end = strpbrk (req, "\r\n")) != NULL)
+	*end = '\0';
+      if (strcmp (req, "json") == 0)
+	format = METRICS_JSON;
+    }
+
+  if (client->http)
+    {
+      buffer_putstr (client->obuf, "HTTP/1.0 200 OK\r\nContent-Type: ");
+      buffer_putstr (client->obuf, format == METRICS_JSON
+		     ? "application/json"
+		     : "text/plain; version=0.0.4");
+      buffer_putstr (client->obuf, "\r\nConnection: close\r\n\r\n");
+    }
+  metrics_render (client->obuf, format);
+
+  client->t_write = thread_add_write (metrics_master, metrics_client_write,
+				      client, client->fd);
+}
+
+static int
+metrics_client_read (struct thread *thread)
+{
+  struct metrics_client *client = THREAD_ARG (thread);
+  int nbytes;
+
+  client->t_read = NULL;
+
+  nbytes = read (client->fd, client->request + client->reqlen,
+		 METRICS_REQUEST_MAX - client->reqlen);
+  if (nbytes < 0)
+    {
+      if (ERRNO_IO_RETRY (errno))
+	{
+	  client->t_read = thread_add_read (metrics_master,
+					    metrics_client_read, client,
+					    client->fd);
+	  return 0;
+	}
+      metrics_client_close (client);
+      return 0;
+    }
+  client->reqlen += nbytes;
+  client->request[client->reqlen] = '\0';
+
+  if (client->reqlen >= 4 && strncmp (client->request, "GET ", 4) == 0)
+    client->http = 1;
+
+  /* Answer once the request is complete: a line, or for HTTP the
+     headers too, so nothing is left unread when the socket closes.
+     End of file or a full buffer answer whatever was sent. */
+  if (nbytes > 0 && client->reqlen < METRICS_REQUEST_MAX
+      && (client->http
+	  ? !(strstr (client->request, "\r\n\r\n")
+	      || strstr (client->request, "\n\n"))
+	  : !strchr (client->request, '\n')))
+    {
+      client->t_read = thread_add_read (metrics_master, metrics_client_read,
+					client, client->fd);
+      return 0;
+    }
+
+  metrics_client_answer (client);
+  return 0;
+}
+
+static int
+metrics_accept (struct thread *thread)
+{
+  struct metrics_client *client;
+  int accept_sock = THREAD_FD (thread);
+  int sock;
+
+  metrics_t_accept = thread_add_read (metrics_master, metrics_accept, NULL,
+				      accept_sock);
+
+  sock = accept (accept_sock, NULL, NULL);
+  if (sock < 0)
+    {
+      zlog_warn ("metrics: can't accept: %s", safe_strerror (errno));
+      return -1;
+    }
+  if (set_nonblocking (sock) < 0)
+    {
+      zlog_warn ("metrics: could not set socket %d to non-blocking, %s",
+		 sock, safe_strerror (errno));
+      close (sock);
+      return -1;
+    }
+
+  client = XCALLOC (MTYPE_METRICS, sizeof (struct metrics_client));
+  client->fd = sock;
+  client->obuf = buffer_new (0);
+  listnode_add (metrics_clients, client);
+
+  client->t_read = thread_add_read (metrics_master, metrics_client_read,
+				    client, sock);
+  client->t_timeout = thread_add_timer (metrics_master,
+					metrics_client_timeout, client,
+					METRICS_TIMEOUT);
+  return 0;
+}
+
+static void
+metrics_serv_close (void)
+{
+  THREAD_OFF (metrics_t_accept);
+  if (metrics_sock >= 0)
+    {
+      close (metrics_sock);
+      metrics_sock = -1;
+    }
+  if (metrics_path)
+    {
+      unlink (metrics_path);
+      XFREE (MTYPE_METRICS, metrics_path);
+    }
+}
+
+/* Listen on the metrics socket belonging to the vtysh socket vty_path. */
+void
+metrics_serv_un (const char *vty_path)
+{
+  struct sockaddr_un serv;
+  struct zprivs_ids_t ids;
+  mode_t old_mask;
+  size_t len;
+  int sock;
+
+  if (!vty_path || !metrics_master)
+    return;
+
+  metrics_serv_close ();
+
+  len = strlen (vty_path);
+  if (len > 4 && strcmp (vty_path + len - 4, ".vty") == 0)
+    len -= 4;
+  metrics_path = XMALLOC (MTYPE_METRICS, len + sizeof (".metrics"));
+  memcpy (metrics_path, vty_path, len);
+  strcpy (metrics_path + len, ".metrics");
+
+  memset (&serv, 0, sizeof (serv));
+  serv.sun_family = AF_UNIX;
+  if (strlen (metrics_path) >= sizeof (serv.sun_path))
+    {
+      zlog_err ("metrics: socket path %s too long", metrics_path);
+      XFREE (MTYPE_METRICS, metrics_path);
+      return;
+    }
+  strcpy (serv.sun_path, metrics_path);
+#ifdef HAVE_STRUCT_SOCKADDR_UN_SUN_LEN
+  len = serv.sun_len = SUN_LEN(&serv);
+#else
+  len = sizeof (serv.sun_family) + strlen (serv.sun_path);
+#endif /* HAVE_STRUCT_SOCKADDR_UN_SUN_LEN */
+
+  unlink (metrics_path);
+  old_mask = umask (0007);
+
+  sock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    {
+      zlog_err ("metrics: cannot create unix stream socket: %s",
+		safe_strerror (errno));
+      umask (old_mask);
+      XFREE (MTYPE_METRICS, metrics_path);
+      return;
+    }
+  if (bind (sock, (struct sockaddr *) &serv, len) < 0
+      || listen (sock, 5) < 0)
+    {
+      zlog_err ("metrics: cannot listen on %s: %s", metrics_path,
+		safe_strerror (errno));
+      umask (old_mask);
+      close (sock);
+      XFREE (MTYPE_METRICS, metrics_path);
+      return;
+    }
+  umask (old_mask);
+
+  zprivs_get_ids (&ids);
+  if (ids.gid_vty > 0 && chown (metrics_path, -1, ids.gid_vty))
+    zlog_err ("metrics: could not chown socket, %s", safe_strerror (errno));
+
+  metrics_sock = sock;
+  metrics_t_accept = thread_add_read (metrics_master, metrics_accept, NULL,
+				      sock);
+}
+
+void
+metrics_init (struct thread_master *master)
+{
+  metrics_master = master;
+  metrics_clients = list_new ();
+
+  metrics_register ("memory", memory_metrics);
+  metrics_register ("thread", thread_metrics);
+  metrics_register ("work_queue", work_queue_metrics);
+}
+
+void
+metrics_terminate (void)
+{
+  struct metrics_collector *mc;
+  struct metrics_client *client;
+
+  metrics_serv_close ();
+
+  if (metrics_clients)
+    {
+      while (listcount (metrics_clients))
+	{
+	  client = listgetdata (listhead (metrics_clients));
+	  metrics_client_close (client);
+	}
+      list_delete (metrics_clients);
+      metrics_clients = NULL;
+    }
+
+  if (!metrics_collectors)
+    return;
+
+  while (listcount (metrics_collectors))
+    {
+      mc = listgetdata (listhead (metrics_collectors));
+      metrics_unregister (mc->name);
+    }
+  list_delete (metrics_collectors);
+  metrics_collectors = NULL;
+}
@@ -0,0 +1,75 @@
+/* Metrics export over a UNIX domain socket.
+ *
+ * This file is part of GNU Kroute.
+ *
+ * GNU Kroute is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Kroute is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Kroute; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _KROUTE_METRICS_H
+#define _KROUTE_METRICS_H
+
+/* Every daemon listens on a UNIX socket next to its vtysh socket, with
+ * the ".vty" suffix replaced by ".metrics".  A client connects and
+ * sends one request line:
+ *
+ *   ""  or "prometheus"       Prometheus text exposition format
+ *   "json"                    a JSON object keyed by metric name
+ *   "GET /metrics HTTP/1.x"   the same over HTTP, JSON if the path
+ *                             ends in ".json" (curl --unix-socket)
+ *
+ * and gets a snapshot of the registered counters, after which the
+ * daemon closes the connection.  Requests are served from the thread
+ * master with non-blocking writes, like the vty.
+ */
+
+enum metrics_type
+{
+  METRICS_COUNTER,
+  METRICS_GAUGE,
+};
+
+enum metrics_format
+{
+  METRICS_PROMETHEUS,
+  METRICS_JSON,
+};
+
+struct buffer;
+struct metrics;
+
+/* A collector appends its families and samples to m. */
+typedef void (*metrics_collect_t) (struct metrics *m);
+
+/* Start a metric family.  name should be a valid Prometheus name, it
+   is prefixed with "kroute_". */
+extern void metrics_family (struct metrics *m, const char *name,
+			    enum metrics_type type, const char *help);
+
+/* Add a sample to the current family.  The value is followed by a
+   NULL terminated list of label name and label value pairs. */
+extern void metrics_value (struct metrics *m, unsigned long long value, ...);
+
+extern void metrics_register (const char *name, metrics_collect_t collect);
+extern void metrics_unregister (const char *name);
+
+/* Render every registered collector into buf. */
+extern void metrics_render (struct buffer *buf, enum metrics_format format);
+
+extern void metrics_serv_un (const char *vty_path);
+extern void metrics_init (struct thread_master *);
+extern void metrics_terminate (void);
+
+#endif /* _KROUTE_METRICS_H */
@@ -29,6 +29,11 @@
 #include "buffer.h"
 #include "stream.h"
 #include "log.h"
+#include "table.h"
+#include "linklist.h"
+
+/* Lists shorter than this are matched by walking the entries. */
+#define PREFIX_LIST_TRIE_MIN 16
 
 /* Each prefix-list's entry. */
 struct prefix_list_entry
@@ -46,6 +51,9 @@ struct prefix_list_entry
   unsigned long refcnt;
   unsigned long hitcnt;
 
+  /* Matches through the trie not yet accounted in refcnt. */
+  unsigned long hits;
+
   struct prefix_list_entry *next;
   struct prefix_list_entry *prev;
 };
@@ -77,8 +85,15 @@ struct prefix_master
 
   /* Hook function which is executed when prefix_list is deleted. */
   void (*delete_hook) (struct prefix_list *);
+
+  /* Lists changed during a configuration batch. */
+  struct cmd_batch *batch;
 };
 
+/* How a prefix list changed during a configuration batch. */
+#define PREFIX_LIST_BATCH_ADD		(1 << 0)
+#define PREFIX_LIST_BATCH_DELETE	(1 << 1)
+
 /* Static structure of IPv4 prefix_list's master. */
 static struct prefix_master prefix_master_ipv4 = 
 { 
@@ -125,11 +140,26 @@ prefix_master_get (afi_t afi)
   return NULL;
 }
 
+static struct prefix_list *
+prefix_list_master_lookup (struct prefix_master *master, const char *name)
+{
+  struct prefix_list *plist;
+
+  for (plist = master->num.head; plist; plist = plist->next)
+    if (strcmp (plist->name, name) == 0)
+      return plist;
+
+  for (plist = master->str.head; plist; plist = plist->next)
+    if (strcmp (plist->name, name) == 0)
+      return plist;
+
+  return NULL;
+}
+
 /* Lookup prefix_list from list of prefix_list by name. */
 struct prefix_list *
 prefix_list_lookup (afi_t afi, const char *name)
 {
-  struct prefix_list *plist;
   struct prefix_master *master;
 
   if (name == NULL)
@@ -139,15 +169,7 @@ prefix_list_lookup (afi_t afi, const char *name)
   if (master == NULL)
     return NULL;
 
-  for (plist = master->num.head; plist; plist = plist->next)
-    if (strcmp (plist->name, name) == 0)
-      return plist;
-
-  for (plist = master->str.head; plist; plist = plist->next)
-    if (strcmp (plist->name, name) == 0)
-      return plist;
-
-  return NULL;
+  return prefix_list_master_lookup (master, name);
 }
 
 static struct prefix_list *
@@ -284,6 +306,68 @@ prefix_list_get (afi_t afi, const char *name)
   return plist;
 }
 
+/* A trie lookup does not visit the entries before the one matching,
+   so their refcnt is brought up to date here: every lookup which hit
+   an entry at or after this one, or missed, would have tested it. */
+static void
+prefix_list_refcnt_update (struct prefix_list *plist)
+{
+  struct prefix_list_entry *pentry;
+  unsigned long later;
+
+  later = plist->misscnt;
+  for (pentry = plist->tail; pentry; pentry = pentry->prev)
+    {
+      later += pentry->hits;
+      pentry->refcnt += later;
+      pentry->hits = 0;
+    }
+  plist->misscnt = 0;
+}
+
+static void
+prefix_list_trie_build (struct prefix_list *plist)
+{
+  struct prefix_list_entry *pentry;
+  struct route_node *rn;
+
+  plist->trie = route_table_init ();
+
+  /* Entries are visited by sequence, so each node's list is too. */
+  for (pentry = plist->head; pentry; pentry = pentry->next)
+    {
+      rn = route_node_get (plist->trie, &pentry->prefix);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	rn->info = list_new ();
+      listnode_add (rn->info, pentry);
+    }
+}
+
+/* Drop the trie, to be rebuilt on the next lookup.  Must be called
+   before the entries change. */
+static void
+prefix_list_trie_reset (struct prefix_list *plist)
+{
+  struct route_node *rn;
+
+  prefix_list_refcnt_update (plist);
+
+  if (plist->trie == NULL)
+    return;
+
+  for (rn = route_top (plist->trie); rn; rn = route_next (rn))
+    if (rn->info)
+      {
+	list_delete (rn->info);
+	rn->info = NULL;
+	route_unlock_node (rn);
+      }
+  route_table_finish (plist->trie);
+  plist->trie = NULL;
+}
+
 /* Delete prefix-list from prefix_list_master and free it. */
 static void
 prefix_list_delete (struct prefix_list *plist)
@@ -292,6 +376,9 @@ prefix_list_delete (struct prefix_list *plist)
   struct prefix_master *master;
   struct prefix_list_entry *pentry;
   struct prefix_list_entry *next;
+  int batched;
+
+  prefix_list_trie_reset (plist);
 
   /* If prefix-list contain prefix_list_entry free all of it. */
   for (pentry = plist->head; pentry; pentry = next)
@@ -325,12 +412,15 @@ prefix_list_delete (struct prefix_list *plist)
      cleared. */
   master->recent = NULL;
 
+  batched = cmd_batch_add (master->batch, plist->name,
+			   PREFIX_LIST_BATCH_DELETE);
+
   if (plist->name)
     XFREE (MTYPE_PREFIX_LIST_STR, plist->name);
   
   prefix_list_free (plist);
   
-  if (master->delete_hook)
+  if (master->delete_hook && ! batched)
     (*master->delete_hook) (NULL);
 }
 
@@ -354,6 +444,36 @@ prefix_list_entry_make (struct prefix *prefix, enum prefix_list_type type,
   return pentry;
 }
 
+/* End of a configuration batch: the hooks run once for each list
+   changed, with a stand-in carrying the name of one since deleted. */
+static void
+prefix_list_batch_flush (const char *name, u_int32_t flags, void *arg)
+{
+  struct prefix_master *master = arg;
+  struct prefix_list *plist;
+  struct prefix_list gone;
+
+  plist = prefix_list_master_lookup (master, name);
+  if (plist == NULL)
+    {
+      if (master->delete_hook)
+	{
+	  memset (&gone, 0, sizeof (struct prefix_list));
+	  gone.name = XSTRDUP (MTYPE_PREFIX_LIST_STR, name);
+	  gone.master = master;
+	  (*master->delete_hook) (&gone);
+	  XFREE (MTYPE_PREFIX_LIST_STR, gone.name);
+	}
+    }
+  else if (flags & PREFIX_LIST_BATCH_ADD)
+    {
+      if (master->add_hook)
+	(*master->add_hook) (plist);
+    }
+  else if (master->delete_hook)
+    (*master->delete_hook) (plist);
+}
+
 /* Add hook function. */
 void
 prefix_list_add_hook (void (*func) (struct prefix_list *plist))
@@ -437,6 +557,9 @@ prefix_list_entry_delete (struct prefix_list *plist,
 {
   if (plist == NULL || pentry == NULL)
     return;
+
+  prefix_list_trie_reset (plist);
+
   if (pentry->prev)
     pentry->prev->next = pentry->next;
   else
@@ -452,7 +575,9 @@ prefix_list_entry_delete (struct prefix_list *plist,
 
   if (update_list)
     {
-      if (plist->master->delete_hook)
+      if (plist->master->delete_hook
+	  && ! cmd_batch_add (plist->master->batch, plist->name,
+			      PREFIX_LIST_BATCH_DELETE))
 	(*plist->master->delete_hook) (plist);
 
       if (plist->head == NULL && plist->tail == NULL && plist->desc == NULL)
@@ -469,6 +594,8 @@ prefix_list_entry_add (struct prefix_list *plist,
   struct prefix_list_entry *replace;
   struct prefix_list_entry *point;
 
+  prefix_list_trie_reset (plist);
+
   /* Automatic asignment of seq no. */
   if (pentry->seq == -1)
     pentry->seq = prefix_new_seq_get (plist);
@@ -511,7 +638,9 @@ prefix_list_entry_add (struct prefix_list *plist,
   plist->count++;
 
   /* Run hook function. */
-  if (plist->master->add_hook)
+  if (plist->master->add_hook
+      && ! cmd_batch_add (plist->master->batch, plist->name,
+			  PREFIX_LIST_BATCH_ADD))
     (*plist->master->add_hook) (plist);
 
   plist->master->recent = plist;
@@ -560,6 +689,39 @@ prefix_list_entry_match (struct prefix_list_entry *pentry, struct prefix *p)
   return 1;
 }
 
+/* First entry by sequence matching p.  Only entries whose prefix
+   covers p can match, and those sit on the path from the longest one
+   up to the root of the trie. */
+static struct prefix_list_entry *
+prefix_list_trie_match (struct prefix_list *plist, struct prefix *p)
+{
+  struct prefix_list_entry *pentry;
+  struct prefix_list_entry *match;
+  struct listnode *node;
+  struct route_node *rn;
+
+  rn = route_node_match (plist->trie, p);
+  if (rn == NULL)
+    return NULL;
+  route_unlock_node (rn);
+
+  match = NULL;
+  for (; rn; rn = rn->parent)
+    if (rn->info)
+      for (ALL_LIST_ELEMENTS_RO ((struct list *) rn->info, node, pentry))
+	{
+	  if (match && pentry->seq >= match->seq)
+	    break;
+	  if (prefix_list_entry_match (pentry, p))
+	    {
+	      match = pentry;
+	      break;
+	    }
+	}
+
+  return match;
+}
+
 enum prefix_list_type
 prefix_list_apply (struct prefix_list *plist, void *object)
 {
@@ -574,16 +736,32 @@ prefix_list_apply (struct prefix_list *plist, void *object)
   if (plist->count == 0)
     return PREFIX_PERMIT;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  if (plist->count < PREFIX_LIST_TRIE_MIN)
     {
-      pentry->refcnt++;
-      if (prefix_list_entry_match (pentry, p))
+      for (pentry = plist->head; pentry; pentry = pentry->next)
 	{
-	  pentry->hitcnt++;
-	  return pentry->type;
+	  pentry->refcnt++;
+	  if (prefix_list_entry_match (pentry, p))
+	    {
+	      pentry->hitcnt++;
+	      return pentry->type;
+	    }
 	}
+      return PREFIX_DENY;
     }
 
+  if (plist->trie == NULL)
+    prefix_list_trie_build (plist);
+
+  pentry = prefix_list_trie_match (plist, p);
+  if (pentry)
+    {
+      pentry->hits++;
+      pentry->hitcnt++;
+      return pentry->type;
+    }
+
+  plist->misscnt++;
   return PREFIX_DENY;
 }
 
@@ -955,6 +1133,8 @@ vty_show_prefix_entry (struct vty *vty, afi_t afi, struct prefix_list *plist,
 
   if (dtype != summary_display)
     {
+      prefix_list_refcnt_update (plist);
+
       for (pentry = plist->head; pentry; pentry = pentry->next)
 	{
 	  if (dtype == sequential_display && pentry->seq != seqnum)
@@ -1061,6 +1241,8 @@ vty_show_prefix_list_prefix (struct vty *vty, afi_t afi, const char *name,
       return CMD_WARNING;
     }
 
+  prefix_list_refcnt_update (plist);
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     {
       match = 0;
@@ -2672,6 +2854,8 @@ static void
 prefix_list_init_ipv4 (void)
 {
   install_node (&prefix_node, config_write_prefix_ipv4);
+  prefix_master_ipv4.batch = cmd_batch_new (prefix_list_batch_flush,
+					    &prefix_master_ipv4);
 
   install_element (CONFIG_NODE, &ip_prefix_list_cmd);
   install_element (CONFIG_NODE, &ip_prefix_list_ge_cmd);
@@ -2781,6 +2965,8 @@ static void
 prefix_list_init_ipv6 (void)
 {
   install_node (&prefix_ipv6_node, config_write_prefix_ipv6);
+  prefix_master_ipv6.batch = cmd_batch_new (prefix_list_batch_flush,
+					    &prefix_master_ipv6);
 
   install_element (CONFIG_NODE, &ipv6_prefix_list_cmd);
   install_element (CONFIG_NODE, &ipv6_prefix_list_ge_cmd);
@@ -52,6 +52,12 @@ struct prefix_list
   struct prefix_list_entry *head;
   struct prefix_list_entry *tail;
 
+  /* Entries indexed by prefix, built on first use after a change. */
+  struct route_table *trie;
+
+  /* Lookups matching no entry since the refcnt were last updated. */
+  unsigned long misscnt;
+
   struct prefix_list *next;
   struct prefix_list *prev;
 };
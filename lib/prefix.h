@@ -128,6 +128,14 @@ struct prefix_rd
 /* Prefix's family member. */
 #define PREFIX_FAMILY(p)  ((p)->family)
 
+/* Bytes of a struct prefix which a prefix of family F uses.  An IPv4
+   prefix fits in the size of a struct prefix_ipv4, so a structure
+   ending in a struct prefix may be allocated that much shorter, as
+   long as it is only copied with prefix_copy().  Other families, IPv6
+   and the OSPF LSDB keys (struct prefix_ls) among them, need it all. */
+#define PREFIX_FAMILY_SIZE(F) \
+  ((F) == AF_INET ? sizeof (struct prefix_ipv4) : sizeof (struct prefix))
+
 /* Prototypes. */
 extern int afi2family (afi_t);
 extern afi_t family2afi (int);
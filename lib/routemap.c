@@ -28,6 +28,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "vty.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* Vector for route match rules. */
 static vector route_match_vec;
@@ -61,11 +63,46 @@ struct route_map_list
   void (*add_hook) (const char *);
   void (*delete_hook) (const char *);
   void (*event_hook) (route_map_event_t, const char *); 
+
+  /* Hooks held back while configuration is read in a batch. */
+  struct cmd_batch *batch;
 };
 
 /* Master list of route map. */
 static struct route_map_list route_map_master = { NULL, NULL, NULL, NULL };
 
+/* Changes to a route map noted in the batch.  Events take one bit each
+   from ROUTE_MAP_BATCH_EVENT up. */
+#define ROUTE_MAP_BATCH_ADD       (1 << 0)
+#define ROUTE_MAP_BATCH_DELETE    (1 << 1)
+#define ROUTE_MAP_BATCH_EVENT     2
+
+/* Execute event hook, unless a configuration batch holds it back. */
+static void
+route_map_notify (route_map_event_t event, const char *name)
+{
+  if (route_map_master.event_hook
+      && ! cmd_batch_add (route_map_master.batch, name,
+			  1 << (ROUTE_MAP_BATCH_EVENT + event)))
+    (*route_map_master.event_hook) (event, name);
+}
+
+/* Remembered outcome of the match clauses of a route map. */
+struct route_map_cache
+{
+  struct prefix prefix;
+  void *key;
+
+  /* First index whose match clauses all matched, or if not matched
+     the first one with uncacheable rules.  NULL if neither. */
+  struct route_map_index *index;
+  int matched;
+};
+
+/* Keep the keys of cache entries alive, see route_map_cache_key_hook(). */
+static void *(*route_map_cache_ref) (void *);
+static void (*route_map_cache_unref) (void *);
+
 static void
 route_map_rule_delete (struct route_map_rule_list *,
 		       struct route_map_rule *);
@@ -104,12 +141,87 @@ route_map_add (const char *name)
   list->tail = map;
 
   /* Execute hook. */
-  if (route_map_master.add_hook)
+  if (route_map_master.add_hook
+      && ! cmd_batch_add (route_map_master.batch, name, ROUTE_MAP_BATCH_ADD))
     (*route_map_master.add_hook) (name);
 
   return map;
 }
 
+static unsigned int
+route_map_cache_hash_key (void *arg)
+{
+  struct route_map_cache *cache = arg;
+  uintptr_t key = (uintptr_t) cache->key;
+
+  return jhash (&cache->prefix.u.prefix, PSIZE (cache->prefix.prefixlen),
+		jhash_3words ((u_int32_t) key, (u_int32_t) (key >> 16 >> 16),
+			      cache->prefix.prefixlen << 16
+			      | cache->prefix.family, jhash_seed ()));
+}
+
+static int
+route_map_cache_hash_cmp (const void *arg1, const void *arg2)
+{
+  const struct route_map_cache *cache1 = arg1;
+  const struct route_map_cache *cache2 = arg2;
+
+  return cache1->key == cache2->key
+	 && prefix_same (&cache1->prefix, &cache2->prefix);
+}
+
+static void *
+route_map_cache_alloc (void *arg)
+{
+  struct route_map_cache *cache;
+
+  cache = XMALLOC (MTYPE_ROUTE_MAP_CACHE, sizeof (struct route_map_cache));
+  *cache = *(struct route_map_cache *) arg;
+  if (route_map_cache_ref)
+    cache->key = (*route_map_cache_ref) (cache->key);
+  return cache;
+}
+
+static void
+route_map_cache_free (void *arg)
+{
+  struct route_map_cache *cache = arg;
+
+  if (route_map_cache_unref)
+    (*route_map_cache_unref) (cache->key);
+  XFREE (MTYPE_ROUTE_MAP_CACHE, cache);
+}
+
+/* Forget the map's cached results, on any change to its match
+   clauses. */
+static void
+route_map_cache_clean (struct route_map *map)
+{
+  if (map->cache)
+    hash_clean (map->cache, route_map_cache_free);
+}
+
+/* Forget all cached results.  To be called when anything a cacheable
+   match rule looks up, such as an access-list, changes. */
+void
+route_map_cache_flush (void)
+{
+  struct route_map *map;
+
+  for (map = route_map_master.head; map; map = map->next)
+    route_map_cache_clean (map);
+}
+
+/* Set the functions taking and dropping a reference on cache keys, so
+   that a key cannot be freed and its address reused for another
+   object while cached. */
+void
+route_map_cache_key_hook (void *(*ref) (void *), void (*unref) (void *))
+{
+  route_map_cache_ref = ref;
+  route_map_cache_unref = unref;
+}
+
 /* Route map delete from list. */
 static void
 route_map_delete (struct route_map *map)
@@ -121,6 +233,12 @@ route_map_delete (struct route_map *map)
   while ((index = map->head) != NULL)
     route_map_index_delete (index, 0);
 
+  if (map->cache)
+    {
+      hash_clean (map->cache, route_map_cache_free);
+      hash_free (map->cache);
+    }
+
   name = map->name;
 
   list = &route_map_master;
@@ -138,7 +256,9 @@ route_map_delete (struct route_map *map)
   XFREE (MTYPE_ROUTE_MAP, map);
 
   /* Execute deletion hook. */
-  if (route_map_master.delete_hook)
+  if (route_map_master.delete_hook
+      && ! cmd_batch_add (route_map_master.batch, name,
+			  ROUTE_MAP_BATCH_DELETE))
     (*route_map_master.delete_hook) (name);
 
   if (name)
@@ -246,6 +366,11 @@ vty_show_route_map_entry (struct vty *vty, struct route_map *map)
       else if (index->exitpolicy == RMAP_EXIT)
         vty_out (vty, "    Exit routemap%s", VTY_NEWLINE);
     }
+
+  if (map->cache)
+    vty_out (vty, "route-map %s cache: %lu entries, %lu hits, %lu misses%s",
+	     map->name, map->cache->count, map->cache_hits,
+	     map->cache_misses, VTY_NEWLINE);
 }
 
 static int
@@ -295,6 +420,8 @@ route_map_index_delete (struct route_map_index *index, int notify)
 {
   struct route_map_rule *rule;
 
+  route_map_cache_clean (index->map);
+
   /* Free route match. */
   while ((rule = index->match_list.head) != NULL)
     route_map_rule_delete (&index->match_list, rule);
@@ -319,9 +446,8 @@ route_map_index_delete (struct route_map_index *index, int notify)
     XFREE (MTYPE_ROUTE_MAP_NAME, index->nextrm);
 
     /* Execute event hook. */
-  if (route_map_master.event_hook && notify)
-    (*route_map_master.event_hook) (RMAP_EVENT_INDEX_DELETED,
-				    index->map->name);
+  if (notify)
+    route_map_notify (RMAP_EVENT_INDEX_DELETED, index->map->name);
 
   XFREE (MTYPE_ROUTE_MAP_INDEX, index);
 }
@@ -348,6 +474,8 @@ route_map_index_add (struct route_map *map, enum route_map_type type,
   struct route_map_index *index;
   struct route_map_index *point;
 
+  route_map_cache_clean (map);
+
   /* Allocate new route map inex. */
   index = route_map_index_new ();
   index->map = map;
@@ -385,9 +513,7 @@ route_map_index_add (struct route_map *map, enum route_map_type type,
     }
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (RMAP_EVENT_INDEX_ADDED,
-				    map->name);
+  route_map_notify (RMAP_EVENT_INDEX_ADDED, map->name);
 
   return index;
 }
@@ -547,6 +673,8 @@ route_map_add_match (struct route_map_index *index, const char *match_name,
   else
     compile = NULL;
 
+  route_map_cache_clean (index->map);
+
   /* If argument is completely same ignore it. */
   for (rule = index->match_list.head; rule; rule = next)
     {
@@ -571,11 +699,10 @@ route_map_add_match (struct route_map_index *index, const char *match_name,
   route_map_rule_add (&index->match_list, rule);
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (replaced ?
-				    RMAP_EVENT_MATCH_REPLACED:
-				    RMAP_EVENT_MATCH_ADDED,
-				    index->map->name);
+  route_map_notify (replaced ?
+		    RMAP_EVENT_MATCH_REPLACED:
+		    RMAP_EVENT_MATCH_ADDED,
+		    index->map->name);
 
   return 0;
 }
@@ -596,11 +723,10 @@ route_map_delete_match (struct route_map_index *index, const char *match_name,
     if (rule->cmd == cmd && 
 	(rulecmp (rule->rule_str, match_arg) == 0 || match_arg == NULL))
       {
+	route_map_cache_clean (index->map);
 	route_map_rule_delete (&index->match_list, rule);
 	/* Execute event hook. */
-	if (route_map_master.event_hook)
-	  (*route_map_master.event_hook) (RMAP_EVENT_MATCH_DELETED,
-					  index->map->name);
+	route_map_notify (RMAP_EVENT_MATCH_DELETED, index->map->name);
 	return 0;
       }
   /* Can't find matched rule. */
@@ -658,11 +784,10 @@ route_map_add_set (struct route_map_index *index, const char *set_name,
   route_map_rule_add (&index->set_list, rule);
 
   /* Execute event hook. */
-  if (route_map_master.event_hook)
-    (*route_map_master.event_hook) (replaced ?
-				    RMAP_EVENT_SET_REPLACED:
-				    RMAP_EVENT_SET_ADDED,
-				    index->map->name);
+  route_map_notify (replaced ?
+		    RMAP_EVENT_SET_REPLACED:
+		    RMAP_EVENT_SET_ADDED,
+		    index->map->name);
   return 0;
 }
 
@@ -684,9 +809,7 @@ route_map_delete_set (struct route_map_index *index, const char *set_name,
       {
         route_map_rule_delete (&index->set_list, rule);
 	/* Execute event hook. */
-	if (route_map_master.event_hook)
-	  (*route_map_master.event_hook) (RMAP_EVENT_SET_DELETED,
-					  index->map->name);
+	route_map_notify (RMAP_EVENT_SET_DELETED, index->map->name);
         return 0;
       }
   /* Can't find matched rule. */
@@ -769,10 +892,24 @@ route_map_apply_match (struct route_map_rule_list *match_list,
   return ret;
 }
 
-/* Apply route map to the object. */
-route_map_result_t
-route_map_apply (struct route_map *map, struct prefix *prefix,
-                 route_map_object_t type, void *object)
+/* Whether all match clauses of the index may be cached. */
+static int
+route_map_index_cacheable (struct route_map_index *index)
+{
+  struct route_map_rule *match;
+
+  for (match = index->match_list.head; match; match = match->next)
+    if (! CHECK_FLAG (match->cmd->flags, RMAP_RULE_CACHEABLE))
+      return 0;
+  return 1;
+}
+
+/* Apply route map to the object, starting at index start if not
+   NULL, whose match clauses are known to match if matched is set. */
+static route_map_result_t
+route_map_apply_index (struct route_map *map, struct route_map_index *start,
+                       int matched, struct prefix *prefix,
+                       route_map_object_t type, void *object)
 {
   static int recursion = 0;
   int ret = 0;
@@ -791,10 +928,13 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   if (map == NULL)
     return RMAP_DENYMATCH;
 
-  for (index = map->head; index; index = index->next)
+  for (index = start ? start : map->head; index; index = index->next)
     {
       /* Apply this index. */
-      ret = route_map_apply_match (&index->match_list, prefix, type, object);
+      if (index == start && matched)
+        ret = RMAP_MATCH;
+      else
+        ret = route_map_apply_match (&index->match_list, prefix, type, object);
 
       /* Now we apply the matrix from above */
       if (ret == RMAP_NOMATCH)
@@ -864,6 +1004,73 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+/* Apply route map to the object. */
+route_map_result_t
+route_map_apply (struct route_map *map, struct prefix *prefix,
+                 route_map_object_t type, void *object)
+{
+  return route_map_apply_index (map, NULL, 0, prefix, type, object);
+}
+
+/* Apply route map to the object, remembering which index the match
+   clauses select for the prefix and key.  The caller guarantees that
+   rules flagged RMAP_RULE_CACHEABLE give the same result for objects
+   passed with the same key.  Only the leading indexes made of such
+   rules are cached; set clauses always run. */
+route_map_result_t
+route_map_apply_cached (struct route_map *map, struct prefix *prefix,
+                        route_map_object_t type, void *object, void *key)
+{
+  struct route_map_cache lookup;
+  struct route_map_cache *cache;
+  struct route_map_index *index;
+  int ret;
+
+  if (map == NULL)
+    return RMAP_DENYMATCH;
+
+  if (map->cache == NULL)
+    map->cache = hash_create (route_map_cache_hash_key,
+                              route_map_cache_hash_cmp);
+
+  memset (&lookup, 0, sizeof (struct route_map_cache));
+  prefix_copy (&lookup.prefix, prefix);
+  lookup.key = key;
+
+  cache = hash_lookup (map->cache, &lookup);
+  if (cache)
+    map->cache_hits++;
+  else
+    {
+      map->cache_misses++;
+
+      /* Find the first index matching, as route_map_apply_index()
+         would, up to the first one with uncacheable rules. */
+      for (index = map->head; index; index = index->next)
+        {
+          if (! route_map_index_cacheable (index))
+            break;
+          ret = route_map_apply_match (&index->match_list, prefix,
+                                       type, object);
+          if (ret == RMAP_MATCH)
+            {
+              lookup.matched = 1;
+              break;
+            }
+        }
+      lookup.index = index;
+
+      if (map->cache->count >= RMAP_CACHE_MAX)
+        hash_clean (map->cache, route_map_cache_free);
+      cache = hash_get (map->cache, &lookup, route_map_cache_alloc);
+    }
+
+  if (cache->index == NULL)
+    return RMAP_DENYMATCH;
+  return route_map_apply_index (map, cache->index, cache->matched,
+                                prefix, type, object);
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
@@ -882,12 +1089,43 @@ route_map_event_hook (void (*func) (route_map_event_t, const char *))
   route_map_master.event_hook = func;
 }
 
+/* Run the hooks a configuration batch held back for one route map.
+   Hooks only look at the map's name, so a map that is gone gets just
+   its deletion hook, and one event stands for every change to a map
+   that is still there. */
+static void
+route_map_batch_flush (const char *name, u_int32_t flags,
+		       void *arg __attribute__ ((unused)))
+{
+  int event;
+
+  if (route_map_lookup_by_name (name) == NULL)
+    {
+      if (flags & ROUTE_MAP_BATCH_DELETE && route_map_master.delete_hook)
+	(*route_map_master.delete_hook) (name);
+      return;
+    }
+
+  if (flags & ROUTE_MAP_BATCH_ADD && route_map_master.add_hook)
+    (*route_map_master.add_hook) (name);
+
+  for (event = RMAP_EVENT_SET_ADDED; event <= RMAP_EVENT_INDEX_DELETED; event++)
+    if (flags & (1 << (ROUTE_MAP_BATCH_EVENT + event)))
+      {
+	if (route_map_master.event_hook)
+	  (*route_map_master.event_hook) (event, name);
+	break;
+      }
+}
+
 void
 route_map_init (void)
 {
   /* Make vector for match and set. */
   route_match_vec = vector_init (1);
   route_set_vec = vector_init (1);
+
+  route_map_master.batch = cmd_batch_new (route_map_batch_flush, NULL);
 }
 
 void
@@ -87,8 +87,18 @@ struct route_map_rule_cmd
 
   /* Free allocated value by func_compile (). */
   void (*func_free)(void *);
+
+  /* RMAP_RULE_* flags. */
+  int flags;
 };
 
+/* Match rule result depends only on the prefix and on the key passed
+   to route_map_apply_cached(), so it may be remembered. */
+#define RMAP_RULE_CACHEABLE     (1 << 0)
+
+/* Entries kept per route map by route_map_apply_cached(). */
+#define RMAP_CACHE_MAX          65536
+
 /* Route map apply error. */
 enum
 {
@@ -146,6 +156,12 @@ struct route_map
   struct route_map_index *head;
   struct route_map_index *tail;
 
+  /* First matching index by prefix and key, see
+     route_map_apply_cached(). */
+  struct hash *cache;
+  unsigned long cache_hits;
+  unsigned long cache_misses;
+
   /* Make linked list. */
   struct route_map *next;
   struct route_map *prev;
@@ -191,6 +207,15 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+extern route_map_result_t route_map_apply_cached (struct route_map *map,
+                                                  struct prefix *,
+                                                  route_map_object_t object_type,
+                                                  void *object,
+                                                  void *key);
+extern void route_map_cache_key_hook (void * (*ref) (void *),
+                                      void (*unref) (void *));
+extern void route_map_cache_flush (void);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
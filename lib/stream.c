@@ -111,15 +111,30 @@ stream_new (size_t size)
     }
   
   s->size = size;
+  s->refcnt = 1;
   return s;
 }
 
-/* Free it now. */
+/* Free it now, or once the last clone sharing its data is freed. */
 void
 stream_free (struct stream *s)
 {
   if (!s)
     return;
+
+  if (s->owner)
+    {
+      struct stream *owner = s->owner;
+
+      XFREE (MTYPE_STREAM, s);
+      s = owner;
+    }
+
+  if (s->refcnt > 1)
+    {
+      s->refcnt--;
+      return;
+    }
   
   XFREE (MTYPE_STREAM_DATA, s->data);
   XFREE (MTYPE_STREAM, s);
@@ -131,6 +146,7 @@ stream_copy (struct stream *new, struct stream *src)
   STREAM_VERIFY_SANE (src);
   
   assert (new != NULL);
+  assert (!STREAM_SHARED (new));
   assert (STREAM_SIZE(new) >= src->endp);
 
   new->endp = src->endp;
@@ -154,11 +170,37 @@ stream_dup (struct stream *s)
   return (stream_copy (new, s));
 }
 
+/* Make a read-only stream sharing the data of the given one, with its
+ * own getp and endp.  Neither stream may be written to, or resized,
+ * while the other is still allocated.
+ */
+struct stream *
+stream_clone (struct stream *s)
+{
+  struct stream *new;
+  struct stream *owner;
+
+  STREAM_VERIFY_SANE (s);
+
+  owner = s->owner ? s->owner : s;
+
+  new = XCALLOC (MTYPE_STREAM, sizeof (struct stream));
+  new->owner = owner;
+  new->data = s->data;
+  new->size = s->size;
+  new->getp = s->getp;
+  new->endp = s->endp;
+  owner->refcnt++;
+
+  return new;
+}
+
 size_t
 stream_resize (struct stream *s, size_t newsize)
 {
   u_char *newdata;
   STREAM_VERIFY_SANE (s);
+  assert (!STREAM_SHARED (s));
   
   newdata = XREALLOC (MTYPE_STREAM_DATA, s->data, newsize);
   
@@ -479,6 +521,7 @@ stream_put (struct stream *s, const void *src, size_t size)
   CHECK_SIZE(s, size);
   
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < size)
     {
@@ -499,6 +542,7 @@ int
 stream_putc (struct stream *s, u_char c)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < sizeof(u_char))
     {
@@ -515,6 +559,7 @@ int
 stream_putw (struct stream *s, u_int16_t w)
 {
   STREAM_VERIFY_SANE (s);
+  assert (!STREAM_SHARED (s));
 
   if (STREAM_WRITEABLE (s) < sizeof (u_int16_t))
     {
@@ -533,6 +578,7 @@ int
 stream_putl (struct stream *s, u_int32_t l)
 {
   STREAM_VERIFY_SANE (s);
+  assert (!STREAM_SHARED (s));
 
   if (STREAM_WRITEABLE (s) < sizeof (u_int32_t))
     {
@@ -553,6 +599,7 @@ int
 stream_putq (struct stream *s, uint64_t q)
 {
   STREAM_VERIFY_SANE (s);
+  assert (!STREAM_SHARED (s));
 
   if (STREAM_WRITEABLE (s) < sizeof (uint64_t))
     {
@@ -576,6 +623,7 @@ int
 stream_putc_at (struct stream *s, size_t putp, u_char c)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (!PUT_AT_VALID (s, putp + sizeof (u_char)))
     {
@@ -592,6 +640,7 @@ int
 stream_putw_at (struct stream *s, size_t putp, u_int16_t w)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (!PUT_AT_VALID (s, putp + sizeof (u_int16_t)))
     {
@@ -609,6 +658,7 @@ int
 stream_putl_at (struct stream *s, size_t putp, u_int32_t l)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (!PUT_AT_VALID (s, putp + sizeof (u_int32_t)))
     {
@@ -627,6 +677,7 @@ int
 stream_putq_at (struct stream *s, size_t putp, uint64_t q)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (!PUT_AT_VALID (s, putp + sizeof (uint64_t)))
     {
@@ -650,6 +701,7 @@ int
 stream_put_ipv4 (struct stream *s, u_int32_t l)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < sizeof (u_int32_t))
     {
@@ -667,6 +719,7 @@ int
 stream_put_in_addr (struct stream *s, struct in_addr *addr)
 {
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < sizeof (u_int32_t))
     {
@@ -687,6 +740,7 @@ stream_put_prefix (struct stream *s, struct prefix *p)
   size_t psize;
   
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   psize = PSIZE (p->prefixlen);
   
@@ -710,6 +764,7 @@ stream_read (struct stream *s, int fd, size_t size)
   int nbytes;
 
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < size)
     {
@@ -733,6 +788,7 @@ stream_read_unblock (struct stream *s, int fd, size_t size)
   int val;
   
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < size)
     {
@@ -757,6 +813,7 @@ stream_read_try(struct stream *s, int fd, size_t size)
   ssize_t nbytes;
 
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE(s) < size)
     {
@@ -788,6 +845,7 @@ stream_recvfrom (struct stream *s, int fd, size_t size, int flags,
   ssize_t nbytes;
 
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE(s) < size)
     {
@@ -823,6 +881,7 @@ stream_recvmsg (struct stream *s, int fd, struct msghdr *msgh, int flags,
   struct iovec *iov;
   
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   assert (msgh->msg_iovlen > 0);  
   
   if (STREAM_WRITEABLE (s) < size)
@@ -853,6 +912,7 @@ stream_write (struct stream *s, const void *ptr, size_t size)
   CHECK_SIZE(s, size);
 
   STREAM_VERIFY_SANE(s);
+  assert (!STREAM_SHARED (s));
   
   if (STREAM_WRITEABLE (s) < size)
     {
@@ -896,6 +956,22 @@ stream_reset (struct stream *s)
   s->getp = s->endp = 0;
 }
 
+/* Move the data not yet read to the start of the stream, to make room
+   after it for more. */
+void
+stream_pulldown (struct stream *s)
+{
+  size_t len;
+
+  STREAM_VERIFY_SANE (s);
+  assert (!STREAM_SHARED (s));
+
+  len = STREAM_READABLE (s);
+  memmove (s->data, s->data + s->getp, len);
+  s->getp = 0;
+  s->endp = len;
+}
+
 /* Write stream contens to the file discriptor. */
 int
 stream_flush (struct stream *s, int fd)
@@ -104,6 +104,12 @@ struct stream
   size_t endp;		/* last valid data position */
   size_t size;		/* size of data segment */
   unsigned char *data; /* data pointer */
+
+  /* Streams made by stream_clone share the data of their owner, which
+   * stays allocated until the owner and every clone have been freed.
+   */
+  struct stream *owner;	/* stream owning data, NULL if this one does */
+  unsigned int refcnt;	/* owner plus outstanding clones */
 };
 
 /* First in first out queue structure. */
@@ -127,6 +133,9 @@ struct stream_fifo
 #define STREAM_DATA(S)  ((S)->data)
 #define STREAM_REMAIN(S) STREAM_WRITEABLE((S))
 
+  /* data is shared with other streams and must not be written to */
+#define STREAM_SHARED(S) ((S)->owner || (S)->refcnt > 1)
+
 /* Stream prototypes. 
  * For stream_{put,get}S, the S suffix mean:
  *
@@ -139,6 +148,7 @@ extern struct stream *stream_new (size_t);
 extern void stream_free (struct stream *);
 extern struct stream * stream_copy (struct stream *, struct stream *src);
 extern struct stream *stream_dup (struct stream *);
+extern struct stream *stream_clone (struct stream *);
 extern size_t stream_resize (struct stream *, size_t);
 extern size_t stream_get_getp (struct stream *);
 extern size_t stream_get_endp (struct stream *);
@@ -205,6 +215,7 @@ extern size_t stream_write (struct stream *, const void *, size_t);
 
 /* reset the stream. See Note above */
 extern void stream_reset (struct stream *);
+extern void stream_pulldown (struct stream *);
 extern int stream_flush (struct stream *, int);
 extern int stream_empty (struct stream *); /* is the stream empty? */
 
@@ -26,10 +26,416 @@
 #include "table.h"
 #include "memory.h"
 #include "sockunion.h"
+#include "thread.h"
+#include "network.h"
+#include "log.h"
+#if defined(__linux__) && defined(HAVE_LIBPTHREAD)
+#include <sys/syscall.h>
+#endif
 
 void route_node_delete (struct route_node *);
 void route_table_free (struct route_table *);
+
+/* IPv4 longest match index.  A 16-8-8 stride trie whose slots hold the
+   deepest node of the tree covering the addresses the slot spans, so
+   a lookup is at most three array loads instead of one pointer chase
+   per bit.  A slot may instead point to the next level, tagged in the
+   low bit. */
+#define ROUTE_INDEX_ROOT_BITS	16
+#define ROUTE_INDEX_LEVEL_BITS	8
+
+#define ROUTE_INDEX_IS_LEVEL(V)	((uintptr_t) (V) & 1)
+#define ROUTE_INDEX_LEVEL(V)	((struct route_index_level *) ((uintptr_t) (V) & ~(uintptr_t) 1))
+#define ROUTE_INDEX_TAG(L)	((void *) ((uintptr_t) (L) | 1))
+
+struct route_index_level
+{
+  void *slot[1 << ROUTE_INDEX_LEVEL_BITS];
+};
+
+struct route_index
+{
+  void *slot[1 << ROUTE_INDEX_ROOT_BITS];
+};
 
+/* Readers on other threads, by epochs.  The master thread is the only
+   writer.  It links a node into the tree only once the node is
+   complete, with release stores, so a reader following links with
+   acquire loads sees whole nodes.  What it unlinks goes on the
+   deferred list tagged with the current epoch, and the epoch moves
+   on.  A reader announces the epoch it started reading in, and an
+   entry is freed once every reader still reading started after it.
+   Readers take a slot of a fixed array, as the allocator may only be
+   used by the master thread.  Entries readers still hold are retried
+   from a timer on the master thread.
+
+   A walk of a table that keeps changing may never see it stay still,
+   so a reader can instead ask the master for a copy of the table as it
+   was at one instant, see route_read_snapshot().  The master makes it
+   before its next change to the table, or when woken through a pipe. */
+#ifdef __ATOMIC_ACQUIRE
+#define ROUTE_LOAD(V)		__atomic_load_n (&(V), __ATOMIC_ACQUIRE)
+#define ROUTE_STORE(V,X)	__atomic_store_n (&(V), (X), __ATOMIC_RELEASE)
+#define ROUTE_FENCE()		__atomic_thread_fence (__ATOMIC_SEQ_CST)
+#define ROUTE_BARRIER()		__atomic_signal_fence (__ATOMIC_SEQ_CST)
+#else
+#define ROUTE_LOAD(V)		({ __sync_synchronize (); (V); })
+#define ROUTE_STORE(V,X)	do { __sync_synchronize (); (V) = (X); } while (0)
+#define ROUTE_FENCE()		__sync_synchronize ()
+#define ROUTE_BARRIER()		__asm__ __volatile__ ("" : : : "memory")
+#endif
+
+#define ROUTE_READERS_MAX	64
+
+/* msec between retries of what readers still hold. */
+#define ROUTE_RECLAIM_DELAY	10
+
+/* usec a reader sleeps between looks at its snapshot request. */
+#define ROUTE_SNAP_POLL		100
+
+/* States of a reader's snapshot request. */
+#define ROUTE_SNAP_NONE		0
+#define ROUTE_SNAP_WANTED	1	/* of snap_want, by the reader */
+#define ROUTE_SNAP_READY	2	/* in snap, by the master */
+#define ROUTE_SNAP_DONE		3	/* for the master to free */
+
+/* membarrier(2) commands. */
+#define ROUTE_MEMBARRIER_QUERY	0
+#define ROUTE_MEMBARRIER_GLOBAL	1
+
+struct route_reader
+{
+  /* Epoch the reader started reading in, 0 while not reading. */
+  unsigned long epoch;
+  int used;
+  int depth;
+
+  /* Snapshot request, see ROUTE_SNAP_*. */
+  int snap_state;
+  struct route_table *snap_want;
+  struct route_table *snap;
+};
+
+struct route_defer
+{
+  struct route_defer *next;
+  unsigned long epoch;
+  void (*func) (void *);
+  void *arg;
+};
+
+static struct route_reader route_readers[ROUTE_READERS_MAX];
+static int route_readers_used;
+static unsigned long route_epoch = 1;
+
+/* Oldest first. */
+static struct route_defer *route_deferred;
+static struct route_defer **route_deferred_tail = &route_deferred;
+static struct thread_master *route_master;
+static struct thread *route_t_reclaim;
+
+/* Readers wake the master through this.  Requests not yet served are
+   counted, for a quick look before every change. */
+static int route_wake[2] = { -1, -1 };
+static int route_snap_pending;
+
+static long
+route_membarrier (int cmd)
+{
+#if defined(__linux__) && defined(__NR_membarrier)
+  return syscall (__NR_membarrier, cmd, 0);
+#else
+  return -1;
+#endif
+}
+
+/* Whether the master may look for readers without a fence of its own.
+   It may if a thread taking a reader slot can make every other thread
+   execute a barrier, so that either the master sees the slot taken or
+   the new reader sees everything the master unlinked before looking.
+   Master thread. */
+static int
+route_fence_needed (void)
+{
+  static int needed = -1;
+  long cmds;
+
+  if (needed < 0)
+    {
+      cmds = route_membarrier (ROUTE_MEMBARRIER_QUERY);
+      needed = (cmds < 0 || ! (cmds & ROUTE_MEMBARRIER_GLOBAL));
+    }
+  return needed;
+}
+
+/* Take a reader slot, NULL if all are in use.  Any thread. */
+struct route_reader *
+route_reader_get (void)
+{
+  int i;
+
+  for (i = 0; i < ROUTE_READERS_MAX; i++)
+    if (__sync_bool_compare_and_swap (&route_readers[i].used, 0, 1))
+      {
+	__sync_fetch_and_add (&route_readers_used, 1);
+	/* Pairs with route_fence_needed(); without membarrier the
+	   master fences instead. */
+	route_membarrier (ROUTE_MEMBARRIER_GLOBAL);
+	return &route_readers[i];
+      }
+  return NULL;
+}
+
+void
+route_reader_put (struct route_reader *reader)
+{
+  assert (reader->depth == 0);
+  assert (reader->snap_state == ROUTE_SNAP_NONE
+	  || reader->snap_state == ROUTE_SNAP_DONE);
+  __sync_fetch_and_sub (&route_readers_used, 1);
+  ROUTE_STORE (reader->used, 0);
+}
+
+/* Nests.  The fence orders the announcement before any load from a
+   table, against the master's unlinking stores and its reader scan. */
+void
+route_read_lock (struct route_reader *reader)
+{
+  if (reader->depth++ > 0)
+    return;
+  ROUTE_STORE (reader->epoch, ROUTE_LOAD (route_epoch));
+  ROUTE_FENCE ();
+}
+
+void
+route_read_unlock (struct route_reader *reader)
+{
+  assert (reader->depth > 0);
+  if (--reader->depth == 0)
+    {
+      /* The snapshot's info is only safe while still locked. */
+      assert (reader->snap_state != ROUTE_SNAP_READY);
+      ROUTE_STORE (reader->epoch, 0);
+    }
+}
+
+static int
+route_reclaim_timer (struct thread *thread)
+{
+  route_t_reclaim = NULL;
+  route_reclaim ();
+  return 0;
+}
+
+/* Run the deferred calls of epochs no reader is still in, and retry
+   the rest later. */
+void
+route_reclaim (void)
+{
+  unsigned long oldest = ULONG_MAX;
+  unsigned long epoch;
+  struct route_defer *defer;
+  int i;
+
+  if (route_deferred == NULL)
+    return;
+
+  ROUTE_FENCE ();
+  for (i = 0; i < ROUTE_READERS_MAX; i++)
+    if (ROUTE_LOAD (route_readers[i].used)
+	&& (epoch = ROUTE_LOAD (route_readers[i].epoch)) != 0
+	&& epoch < oldest)
+      oldest = epoch;
+
+  while ((defer = route_deferred) != NULL && defer->epoch < oldest)
+    {
+      route_deferred = defer->next;
+      if (route_deferred == NULL)
+	route_deferred_tail = &route_deferred;
+      (*defer->func) (defer->arg);
+      XFREE (MTYPE_ROUTE_DEFER, defer);
+    }
+
+  if (route_deferred && route_master && ! route_t_reclaim)
+    route_t_reclaim = thread_add_timer_msec (route_master, route_reclaim_timer,
+					     NULL, ROUTE_RECLAIM_DELAY);
+}
+
+/* Free at once when no thread has a reader slot, which is the usual
+   case and then costs no fence. */
+void
+route_defer_free (void (*func) (void *), void *arg)
+{
+  struct route_defer *defer;
+
+  if (route_fence_needed ())
+    ROUTE_FENCE ();
+  else
+    ROUTE_BARRIER ();
+  if (ROUTE_LOAD (route_readers_used) == 0 && route_deferred == NULL)
+    {
+      (*func) (arg);
+      return;
+    }
+
+  defer = XMALLOC (MTYPE_ROUTE_DEFER, sizeof (struct route_defer));
+  defer->next = NULL;
+  defer->epoch = route_epoch;
+  defer->func = func;
+  defer->arg = arg;
+  *route_deferred_tail = defer;
+  route_deferred_tail = &defer->next;
+  ROUTE_STORE (route_epoch, route_epoch + 1);
+
+  route_reclaim ();
+}
+
+/* Odd while the master is changing the shape of the table. */
+unsigned long
+route_read_version (const struct route_table *table)
+{
+  return ROUTE_LOAD (table->version);
+}
+
+/* Copy the nodes of table holding info, with their info, into a new
+   table nothing else changes. */
+static struct route_table *
+route_table_copy (struct route_table *table)
+{
+  struct route_table *copy;
+  struct route_node *node, *new;
+
+  copy = route_table_init ();
+  for (node = table->top; node; node = route_read_next (node))
+    if (node->info)
+      {
+	new = route_node_get (copy, &node->p);
+	new->info = node->info;
+      }
+  return copy;
+}
+
+/* Make the snapshots asked of table, or of any table if NULL, and free
+   those readers are done with. */
+static void
+route_snapshot_serve (struct route_table *table)
+{
+  static int serving;
+  struct route_reader *reader;
+  int i;
+
+  /* Making a copy changes the copy. */
+  if (serving)
+    return;
+  serving = 1;
+
+  for (i = 0; i < ROUTE_READERS_MAX; i++)
+    {
+      reader = &route_readers[i];
+      switch (ROUTE_LOAD (reader->snap_state))
+	{
+	case ROUTE_SNAP_WANTED:
+	  if (table && reader->snap_want != table)
+	    break;
+	  reader->snap = route_table_copy (reader->snap_want);
+	  __sync_fetch_and_sub (&route_snap_pending, 1);
+	  ROUTE_STORE (reader->snap_state, ROUTE_SNAP_READY);
+	  break;
+	case ROUTE_SNAP_DONE:
+	  route_table_finish (reader->snap);
+	  reader->snap = NULL;
+	  ROUTE_STORE (reader->snap_state, ROUTE_SNAP_NONE);
+	  break;
+	}
+    }
+
+  serving = 0;
+}
+
+/* A snapshot asked for is made while the table is still as it was. */
+static void
+route_table_change (struct route_table *table)
+{
+  if (! (table->version & 1) && ROUTE_LOAD (route_snap_pending))
+    route_snapshot_serve (table);
+  ROUTE_STORE (table->version, table->version + 1);
+}
+
+static int
+route_read_wakeup (struct thread *thread)
+{
+  char buf[64];
+
+  while (read (route_wake[0], buf, sizeof (buf)) > 0)
+    ;
+  thread_add_read (route_master, route_read_wakeup, NULL, route_wake[0]);
+
+  route_snapshot_serve (NULL);
+  return 0;
+}
+
+static void
+route_read_wake (void)
+{
+  char c = 0;
+
+  while ((write (route_wake[1], &c, 1) < 0) && (errno == EINTR))
+    ;
+}
+
+/* Serve readers from the given master thread: retry deferred frees
+   readers held up, and make the snapshots they ask for. */
+void
+route_read_init (struct thread_master *m)
+{
+  route_master = m;
+
+  if (route_wake[0] < 0)
+    {
+      if (pipe (route_wake) < 0)
+	{
+	  zlog_warn ("%s: pipe failed: %s", __func__, safe_strerror (errno));
+	  route_wake[0] = route_wake[1] = -1;
+	  return;
+	}
+      set_nonblocking (route_wake[0]);
+      set_nonblocking (route_wake[1]);
+    }
+  thread_add_read (route_master, route_read_wakeup, NULL, route_wake[0]);
+}
+
+/* Ask the master for a copy of table as it was at one instant, and
+   wait for it.  The copy holds the nodes of table with info, and the
+   same info, so it is only good until the reader unlocks. */
+struct route_table *
+route_read_snapshot (struct route_reader *reader, struct route_table *table)
+{
+  assert (reader->depth > 0);
+  assert (route_wake[1] >= 0);
+
+  /* The master may not have freed the last one yet. */
+  while (ROUTE_LOAD (reader->snap_state) != ROUTE_SNAP_NONE)
+    usleep (ROUTE_SNAP_POLL);
+
+  reader->snap_want = table;
+  ROUTE_STORE (reader->snap_state, ROUTE_SNAP_WANTED);
+  __sync_fetch_and_add (&route_snap_pending, 1);
+  route_read_wake ();
+
+  while (ROUTE_LOAD (reader->snap_state) != ROUTE_SNAP_READY)
+    usleep (ROUTE_SNAP_POLL);
+  return reader->snap;
+}
+
+/* Hand the snapshot back to the master to free. */
+void
+route_read_snapshot_done (struct route_reader *reader)
+{
+  assert (ROUTE_LOAD (reader->snap_state) == ROUTE_SNAP_READY);
+  ROUTE_STORE (reader->snap_state, ROUTE_SNAP_DONE);
+  route_read_wake ();
+}
+
 struct route_table *
 route_table_init (void)
 {
@@ -39,18 +445,33 @@ route_table_init (void)
   return rt;
 }
 
+static void
+route_table_free_deferred (void *arg)
+{
+  route_table_free (arg);
+}
+
+/* The caller has made the table unreachable; readers already in it
+   may finish their walk. */
 void
 route_table_finish (struct route_table *rt)
 {
-  route_table_free (rt);
+  route_defer_free (route_table_free_deferred, rt);
 }
 
 /* Allocate new route node. */
 static struct route_node *
-route_node_new (void)
+route_node_new (u_char family)
 {
   struct route_node *node;
-  node = XCALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+
+  /* IPv6 and any other family with more than an IPv4 address, such as
+     the OSPF LSDB keys, get a whole struct prefix. */
+  if (family != AF_INET)
+    node = XCALLOC (MTYPE_ROUTE_NODE_IPV6, ROUTE_NODE_SIZE (family));
+  else
+    node = XCALLOC (MTYPE_ROUTE_NODE, ROUTE_NODE_SIZE (family));
+  node->p.family = family;
   return node;
 }
 
@@ -60,7 +481,7 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 {
   struct route_node *node;
   
-  node = route_node_new ();
+  node = route_node_new (prefix->family);
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -72,7 +493,207 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 static void
 route_node_free (struct route_node *node)
 {
-  XFREE (MTYPE_ROUTE_NODE, node);
+  if (node->p.family != AF_INET)
+    XFREE (MTYPE_ROUTE_NODE_IPV6, node);
+  else
+    XFREE (MTYPE_ROUTE_NODE, node);
+}
+
+static void
+route_node_free_deferred (void *arg)
+{
+  route_node_free (arg);
+}
+
+static void
+route_index_level_free (void *arg)
+{
+  XFREE (MTYPE_ROUTE_INDEX, arg);
+}
+
+/* Every address below slot not covered by a longer prefix is now
+   covered by node. */
+static void
+route_index_set (void **slot, struct route_node *node)
+{
+  struct route_node *cur;
+  int i;
+
+  if (ROUTE_INDEX_IS_LEVEL (*slot))
+    {
+      struct route_index_level *level = ROUTE_INDEX_LEVEL (*slot);
+
+      for (i = 0; i < (1 << ROUTE_INDEX_LEVEL_BITS); i++)
+	route_index_set (&level->slot[i], node);
+      return;
+    }
+
+  cur = *slot;
+  if (cur == NULL || cur->p.prefixlen < node->p.prefixlen)
+    ROUTE_STORE (*slot, node);
+}
+
+/* Addresses covered by node fall back to its parent, which is the
+   next shorter prefix covering them. */
+static void
+route_index_unset (void **slot, struct route_node *node,
+		   struct route_node *parent)
+{
+  int i;
+
+  if (ROUTE_INDEX_IS_LEVEL (*slot))
+    {
+      struct route_index_level *level = ROUTE_INDEX_LEVEL (*slot);
+
+      for (i = 0; i < (1 << ROUTE_INDEX_LEVEL_BITS); i++)
+	route_index_unset (&level->slot[i], node, parent);
+      return;
+    }
+
+  if (*slot == node)
+    ROUTE_STORE (*slot, parent);
+}
+
+/* Replace a level whose slots all hold the same node by that node. */
+static void
+route_index_collapse (void **slot)
+{
+  struct route_index_level *level = ROUTE_INDEX_LEVEL (*slot);
+  void *first = level->slot[0];
+  int i;
+
+  if (ROUTE_INDEX_IS_LEVEL (first))
+    return;
+  for (i = 1; i < (1 << ROUTE_INDEX_LEVEL_BITS); i++)
+    if (level->slot[i] != first)
+      return;
+
+  ROUTE_STORE (*slot, first);
+  route_defer_free (route_index_level_free, level);
+}
+
+/* Add (parent unused) or remove node in the index level made of
+   slots, which is indexed by the stride bits of the address following
+   the first depth bits. */
+static void
+route_index_update (void **slots, int depth, int stride,
+		    struct route_node *node, struct route_node *parent,
+		    int add)
+{
+  u_int32_t addr = ntohl (node->p.u.prefix4.s_addr);
+  int end = depth + stride;
+  unsigned int index, count, i;
+  struct route_index_level *level;
+
+  index = (addr >> (IPV4_MAX_BITLEN - end)) & ((1 << stride) - 1);
+
+  /* The prefix ends within this level, expand it over its slots. */
+  if (node->p.prefixlen <= end)
+    {
+      count = 1 << (end - node->p.prefixlen);
+      index &= ~(count - 1);
+      for (i = index; i < index + count; i++)
+	if (add)
+	  route_index_set (&slots[i], node);
+	else
+	  route_index_unset (&slots[i], node, parent);
+      return;
+    }
+
+  if (! ROUTE_INDEX_IS_LEVEL (slots[index]))
+    {
+      if (! add)
+	return;
+
+      level = XMALLOC (MTYPE_ROUTE_INDEX, sizeof (struct route_index_level));
+      for (i = 0; i < (1 << ROUTE_INDEX_LEVEL_BITS); i++)
+	level->slot[i] = slots[index];
+      ROUTE_STORE (slots[index], ROUTE_INDEX_TAG (level));
+    }
+
+  level = ROUTE_INDEX_LEVEL (slots[index]);
+  route_index_update (level->slot, end, ROUTE_INDEX_LEVEL_BITS,
+		      node, parent, add);
+  if (! add)
+    route_index_collapse (&slots[index]);
+}
+
+static void
+route_index_add (struct route_table *table, struct route_node *node)
+{
+  if (table->index && node->p.family == AF_INET)
+    route_index_update (table->index->slot, 0, ROUTE_INDEX_ROOT_BITS,
+			node, NULL, 1);
+}
+
+static void
+route_index_delete (struct route_table *table, struct route_node *node,
+		    struct route_node *parent)
+{
+  if (table->index && node->p.family == AF_INET)
+    route_index_update (table->index->slot, 0, ROUTE_INDEX_ROOT_BITS,
+			node, parent, 0);
+}
+
+/* Deepest node of the table covering addr. */
+static struct route_node *
+route_index_lookup (const struct route_index *index,
+		    const struct in_addr *addr)
+{
+  u_int32_t a = ntohl (addr->s_addr);
+  void *v;
+
+  v = ROUTE_LOAD (index->slot[a >> (IPV4_MAX_BITLEN - ROUTE_INDEX_ROOT_BITS)]);
+  if (ROUTE_INDEX_IS_LEVEL (v))
+    {
+      v = ROUTE_LOAD (ROUTE_INDEX_LEVEL (v)->slot[(a >> ROUTE_INDEX_LEVEL_BITS)
+						  & 0xff]);
+      if (ROUTE_INDEX_IS_LEVEL (v))
+	v = ROUTE_LOAD (ROUTE_INDEX_LEVEL (v)->slot[a & 0xff]);
+    }
+  return v;
+}
+
+static void
+route_index_add_tree (struct route_index *index, struct route_node *node)
+{
+  if (node == NULL)
+    return;
+  if (node->p.family == AF_INET)
+    route_index_update (index->slot, 0, ROUTE_INDEX_ROOT_BITS, node, NULL, 1);
+  route_index_add_tree (index, node->l_left);
+  route_index_add_tree (index, node->l_right);
+}
+
+/* Maintain an IPv4 longest match index for the table, for tables
+   which see many more match lookups than updates.  Costs 512KiB plus
+   2KiB for every /16 and /24 holding longer prefixes. */
+void
+route_table_index_enable (struct route_table *table)
+{
+  struct route_index *index;
+
+  if (table->index)
+    return;
+
+  index = XCALLOC (MTYPE_ROUTE_INDEX, sizeof (struct route_index));
+  route_index_add_tree (index, table->top);
+  ROUTE_STORE (table->index, index);
+}
+
+static void
+route_index_free (void *slot)
+{
+  struct route_index_level *level;
+  int i;
+
+  if (! ROUTE_INDEX_IS_LEVEL (slot))
+    return;
+
+  level = ROUTE_INDEX_LEVEL (slot);
+  for (i = 0; i < (1 << ROUTE_INDEX_LEVEL_BITS); i++)
+    route_index_free (level->slot[i]);
+  XFREE (MTYPE_ROUTE_INDEX, level);
 }
 
 /* Free route table. */
@@ -119,6 +740,15 @@ route_table_free (struct route_table *rt)
 	  break;
 	}
     }
+
+  if (rt->index)
+    {
+      int i;
+
+      for (i = 0; i < (1 << ROUTE_INDEX_ROOT_BITS); i++)
+	route_index_free (rt->index->slot[i]);
+      XFREE (MTYPE_ROUTE_INDEX, rt->index);
+    }
  
   XFREE (MTYPE_ROUTE_TABLE, rt);
   return;
@@ -165,13 +795,14 @@ route_common (struct prefix *n, struct prefix *p, struct prefix *new)
     }
 }
 
+/* Hang new below node.  new is complete before a reader can reach it. */
 static void
 set_link (struct route_node *node, struct route_node *new)
 {
   unsigned int bit = prefix_bit (&new->p.u.prefix, node->p.prefixlen);
 
-  node->link[bit] = new;
   new->parent = node;
+  ROUTE_STORE (node->link[bit], new);
 }
 
 /* Lock node. */
@@ -192,15 +823,28 @@ route_unlock_node (struct route_node *node)
     route_node_delete (node);
 }
 
-/* Find matched prefix. */
-struct route_node *
-route_node_match (const struct route_table *table, const struct prefix *p)
+/* Find matched prefix, without locking it. */
+static struct route_node *
+route_node_match_nolock (const struct route_table *table,
+			 const struct prefix *p)
 {
+  struct route_index *index;
   struct route_node *node;
   struct route_node *matched;
 
+  /* The index yields the deepest node covering the address, the match
+     is the first of it and its parents which is short enough and in
+     use. */
+  if ((index = ROUTE_LOAD (table->index)) != NULL && p->family == AF_INET)
+    {
+      node = route_index_lookup (index, &p->u.prefix4);
+      while (node && (node->p.prefixlen > p->prefixlen || ! node->info))
+	node = ROUTE_LOAD (node->parent);
+      return node;
+    }
+
   matched = NULL;
-  node = table->top;
+  node = ROUTE_LOAD (table->top);
 
   /* Walk down tree.  If there is matched route then store it to
      matched. */
@@ -213,9 +857,21 @@ route_node_match (const struct route_table *table, const struct prefix *p)
       if (node->p.prefixlen == p->prefixlen)
         break;
       
-      node = node->link[prefix_bit(&p->u.prefix, node->p.prefixlen)];
+      node = ROUTE_LOAD (node->link[prefix_bit(&p->u.prefix,
+					       node->p.prefixlen)]);
     }
 
+  return matched;
+}
+
+/* Find matched prefix. */
+struct route_node *
+route_node_match (const struct route_table *table, const struct prefix *p)
+{
+  struct route_node *matched;
+
+  matched = route_node_match_nolock (table, p);
+
   /* If matched route found, return it. */
   if (matched)
     return route_lock_node (matched);
@@ -293,34 +949,41 @@ route_node_get (struct route_table *table, struct prefix *p)
       node = node->link[prefix_bit(&p->u.prefix, node->p.prefixlen)];
     }
 
+  route_table_change (table);
   if (node == NULL)
     {
       new = route_node_set (table, p);
       if (match)
 	set_link (match, new);
       else
-	table->top = new;
+	ROUTE_STORE (table->top, new);
+      route_index_add (table, new);
     }
   else
     {
-      new = route_node_new ();
+      /* A reader climbing from node skips the new glue node until it
+	 is in place above it. */
+      new = route_node_new (p->family);
       route_common (&node->p, p, &new->p);
-      new->p.family = p->family;
       new->table = table;
-      set_link (new, node);
+      new->link[prefix_bit (&node->p.u.prefix, new->p.prefixlen)] = node;
 
       if (match)
 	set_link (match, new);
       else
-	table->top = new;
+	ROUTE_STORE (table->top, new);
+      ROUTE_STORE (node->parent, new);
+      route_index_add (table, new);
 
       if (new->p.prefixlen != p->prefixlen)
 	{
 	  match = new;
 	  new = route_node_set (table, p);
 	  set_link (match, new);
+	  route_index_add (table, new);
 	}
     }
+  route_table_change (table);
   route_lock_node (new);
   
   return new;
@@ -346,20 +1009,24 @@ route_node_delete (struct route_node *node)
 
   parent = node->parent;
 
+  /* node itself is left as it is, for readers still on it. */
+  route_table_change (node->table);
   if (child)
-    child->parent = parent;
+    ROUTE_STORE (child->parent, parent);
 
   if (parent)
     {
       if (parent->l_left == node)
-	parent->l_left = child;
+	ROUTE_STORE (parent->l_left, child);
       else
-	parent->l_right = child;
+	ROUTE_STORE (parent->l_right, child);
     }
   else
-    node->table->top = child;
+    ROUTE_STORE (node->table->top, child);
 
-  route_node_free (node);
+  route_index_delete (node->table, node, parent);
+  route_table_change (node->table);
+  route_defer_free (route_node_free_deferred, node);
 
   /* If parent node is stub then delete it also. */
   if (parent && parent->lock == 0)
@@ -461,3 +1128,41 @@ route_next_until (struct route_node *node, struct route_node *limit)
   route_unlock_node (start);
   return NULL;
 }
+
+/* Reader walk, in the order of route_top() and route_next() but taking
+   no locks, for use between route_read_lock() and route_read_unlock().
+   A node may have been taken out of the table since the reader got to
+   it, so which side of its parent it is on comes from its prefix rather
+   than from the parent's links. */
+struct route_node *
+route_read_top (const struct route_table *table)
+{
+  return ROUTE_LOAD (table->top);
+}
+
+struct route_node *
+route_read_next (struct route_node *node)
+{
+  struct route_node *next;
+  struct route_node *parent;
+
+  if ((next = ROUTE_LOAD (node->l_left)) != NULL)
+    return next;
+  if ((next = ROUTE_LOAD (node->l_right)) != NULL)
+    return next;
+
+  while ((parent = ROUTE_LOAD (node->parent)) != NULL)
+    {
+      if (prefix_bit (&node->p.u.prefix, parent->p.prefixlen) == 0
+	  && (next = ROUTE_LOAD (parent->l_right)) != NULL)
+	return next;
+      node = parent;
+    }
+  return NULL;
+}
+
+struct route_node *
+route_read_match (const struct route_table *table, const struct prefix *p)
+{
+  return route_node_match_nolock (table, p);
+}
@@ -27,14 +27,18 @@
 struct route_table
 {
   struct route_node *top;
+
+  /* Optional IPv4 longest match index, see route_table_index_enable(). */
+  struct route_index *index;
+
+  /* Bumped before and after each change to the shape of the tree, so
+     odd while one is under way.  See route_read_version(). */
+  unsigned long version;
 };
 
 /* Each routing entry. */
 struct route_node
 {
-  /* Actual prefix of this radix. */
-  struct prefix p;
-
   /* Tree link. */
   struct route_table *table;
   struct route_node *parent;
@@ -50,11 +54,19 @@ struct route_node
 
   /* Aggregation. */
   void *aggregate;
+
+  /* Actual prefix of this radix.  Must come last: nodes are allocated
+     with only ROUTE_NODE_SIZE() bytes for their family. */
+  struct prefix p;
 };
 
+#define ROUTE_NODE_SIZE(F) \
+  (offsetof (struct route_node, p) + PREFIX_FAMILY_SIZE (F))
+
 /* Prototypes. */
 extern struct route_table *route_table_init (void);
 extern void route_table_finish (struct route_table *);
+extern void route_table_index_enable (struct route_table *);
 extern void route_unlock_node (struct route_node *node);
 extern void route_node_delete (struct route_node *node);
 extern struct route_node *route_top (struct route_table *);
@@ -75,4 +87,39 @@ extern struct route_node *route_node_match_ipv6 (const struct route_table *,
 						 const struct in6_addr *);
 #endif /* HAVE_IPV6 */
 
+/* Readers on other threads.  Between route_read_lock() and
+   route_read_unlock() a reader may walk and match in any table without
+   taking node locks, while the master thread goes on changing it:
+   nodes and index levels taken out of a table are only freed once no
+   reader can still be on them.  The info of a node is the daemon's to
+   keep alive the same way, with route_defer_free().  A reader that
+   needs the tree as it was at one instant compares route_read_version()
+   before and after its walk.  If a few tries do not find it still, it
+   walks a snapshot instead: route_read_snapshot() has the master copy
+   the table, which costs the master a walk of it, and the copy goes
+   back with route_read_snapshot_done() before the reader unlocks.
+   Readers need the master to have called route_read_init(). */
+struct route_reader;
+struct thread_master;
+
+extern struct route_reader *route_reader_get (void);
+extern void route_reader_put (struct route_reader *);
+extern void route_read_lock (struct route_reader *);
+extern void route_read_unlock (struct route_reader *);
+extern unsigned long route_read_version (const struct route_table *);
+extern struct route_node *route_read_top (const struct route_table *);
+extern struct route_node *route_read_next (struct route_node *);
+extern struct route_node *route_read_match (const struct route_table *,
+					    const struct prefix *);
+extern struct route_table *route_read_snapshot (struct route_reader *,
+						struct route_table *);
+extern void route_read_snapshot_done (struct route_reader *);
+extern void route_read_init (struct thread_master *);
+
+/* Master thread: call func (arg) once no reader can be using what
+   was unlinked before the call, and run the calls now due.  Calls
+   readers hold up are retried from a timer on master. */
+extern void route_defer_free (void (*func) (void *), void *arg);
+extern void route_reclaim (void);
+
 #endif /* _KROUTE_TABLE_H */
@@ -28,7 +28,10 @@
 #include "log.h"
 #include "hash.h"
 #include "command.h"
+#include "metrics.h"
 #include "sigevent.h"
+#include "pqueue.h"
+#include "linklist.h"
 
 /* Recent absolute time of day */
 struct timeval recent_time;
@@ -40,6 +43,29 @@ static struct timeval relative_time_base;
 static unsigned short timers_inited;
 
 static struct hash *cpu_record = NULL;
+
+/* The slowest thread calls seen, in no particular order.  A call only
+   displaces an entry once it is slower than thread_slow_min, the
+   fastest entry kept, so the common case costs one comparison. */
+static struct thread_slow
+{
+  struct cpu_thread_history *hist;
+  unsigned long real;
+  unsigned long cpu;
+  struct timeval when;		/* wall clock time the call returned */
+} thread_slow[THREAD_SLOW_MAX];
+static unsigned long thread_slow_min;
+
+/* Event loop lag: how late timers were run after their sands. */
+static struct
+{
+  unsigned long buckets[THREAD_HIST_BUCKETS];
+  struct time_stats lag;
+  unsigned long calls;
+} thread_lag;
+
+/* All live thread masters, for reporting timer queue statistics. */
+static struct list *thread_masters = NULL;
 
 /* Struct timeval's tv_usec one second value.  */
 #define TIMER_SECOND_MICRO 1000000L
@@ -323,6 +349,85 @@ cpu_record_print(struct vty *vty, thread_type filter)
     vty_out_cpu_thread_history(vty, &tmp);
 }
 
+/* Depth of a binary heap holding size nodes. */
+static int
+thread_timer_depth (struct pqueue *queue)
+{
+  int depth = 0;
+  int size;
+
+  for (size = queue->size; size > 0; size >>= 1)
+    depth++;
+  return depth;
+}
+
+static void
+thread_timer_print (struct vty *vty)
+{
+  struct listnode *node;
+  struct thread_master *m;
+  int i = 0;
+
+  vty_out (vty, "%sTimer queues:%s", VTY_NEWLINE, VTY_NEWLINE);
+  vty_out (vty, "%6s %9s %6s %11s %6s%s",
+           "Master", "Timers", "Depth", "Background", "Depth", VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (thread_masters, node, m))
+    vty_out (vty, "%6d %9d %6d %11d %6d%s", i++,
+             m->timer->size, thread_timer_depth (m->timer),
+             m->background->size, thread_timer_depth (m->background),
+             VTY_NEWLINE);
+}
+
+/* Parse a "rwtexb" style thread type filter. */
+static int
+thread_filter_parse (struct vty *vty, const char *str, thread_type *filter)
+{
+  int i = 0;
+
+  *filter = 0;
+  while (str[i] != '\0')
+    {
+      switch ( str[i] )
+	{
+	case 'r':
+	case 'R':
+	  *filter |= (1 << THREAD_READ);
+	  break;
+	case 'w':
+	case 'W':
+	  *filter |= (1 << THREAD_WRITE);
+	  break;
+	case 't':
+	case 'T':
+	  *filter |= (1 << THREAD_TIMER);
+	  break;
+	case 'e':
+	case 'E':
+	  *filter |= (1 << THREAD_EVENT);
+	  break;
+	case 'x':
+	case 'X':
+	  *filter |= (1 << THREAD_EXECUTE);
+	  break;
+	case 'b':
+	case 'B':
+	  *filter |= (1 << THREAD_BACKGROUND);
+	  break;
+	default:
+	  break;
+	}
+      ++i;
+    }
+  if (*filter == 0)
+    {
+      vty_out(vty, "Invalid filter \"%s\" specified,"
+	      " must contain at least one of 'RWTEXB'%s",
+	      str, VTY_NEWLINE);
+      return 0;
+    }
+  return 1;
+}
+
 DEFUN(show_thread_cpu,
       show_thread_cpu_cmd,
       "show thread cpu [FILTER]",
@@ -331,58 +436,316 @@ DEFUN(show_thread_cpu,
       "Thread CPU usage\n"
       "Display filter (rwtexb)\n")
 {
-  int i = 0;
   thread_type filter = (thread_type) -1U;
 
-  if (argc > 0)
+  if (argc > 0 && !thread_filter_parse (vty, argv[0], &filter))
+    return CMD_WARNING;
+
+  cpu_record_print(vty, filter);
+  if (filter & ((1 << THREAD_TIMER) | (1 << THREAD_BACKGROUND)))
+    thread_timer_print(vty);
+  return CMD_SUCCESS;
+}
+
+static int
+thread_hist_bucket (unsigned long usec)
+{
+  int n = 0;
+
+  while ((usec >>= 1) && n < THREAD_HIST_BUCKETS - 1)
+    n++;
+  return n;
+}
+
+/* Estimate a percentile, in permille, from a histogram: the upper
+   bound of the bucket it falls in, capped at the largest value seen. */
+static unsigned long
+thread_hist_percentile (const unsigned long *buckets, unsigned long count,
+			unsigned long max, unsigned int permille)
+{
+  unsigned long want, seen = 0;
+  int n;
+
+  if (count == 0)
+    return 0;
+
+  want = (count * permille + 999) / 1000;
+  for (n = 0; n < THREAD_HIST_BUCKETS - 1; n++)
     {
-      filter = 0;
-      while (argv[0][i] != '\0')
-	{
-	  switch ( argv[0][i] )
-	    {
-	    case 'r':
-	    case 'R':
-	      filter |= (1 << THREAD_READ);
-	      break;
-	    case 'w':
-	    case 'W':
-	      filter |= (1 << THREAD_WRITE);
-	      break;
-	    case 't':
-	    case 'T':
-	      filter |= (1 << THREAD_TIMER);
-	      break;
-	    case 'e':
-	    case 'E':
-	      filter |= (1 << THREAD_EVENT);
-	      break;
-	    case 'x':
-	    case 'X':
-	      filter |= (1 << THREAD_EXECUTE);
-	      break;
-	    case 'b':
-	    case 'B':
-	      filter |= (1 << THREAD_BACKGROUND);
-	      break;
-	    default:
-	      break;
-	    }
-	  ++i;
-	}
-      if (filter == 0)
-	{
-	  vty_out(vty, "Invalid filter \"%s\" specified,"
-                  " must contain at least one of 'RWTEXB'%s",
-		  argv[0], VTY_NEWLINE);
-	  return CMD_WARNING;
-	}
+      seen += buckets[n];
+      if (seen >= want)
+	break;
     }
+  if (n == THREAD_HIST_BUCKETS - 1 || (2UL << n) - 1 > max)
+    return max;
+  return (2UL << n) - 1;
+}
 
-  cpu_record_print(vty, filter);
+static void
+thread_types_str (thread_type types, char *buf)
+{
+  int i = 0;
+
+  buf[i++] = types & (1 << THREAD_READ) ? 'R':' ';
+  buf[i++] = types & (1 << THREAD_WRITE) ? 'W':' ';
+  buf[i++] = types & (1 << THREAD_TIMER) ? 'T':' ';
+  buf[i++] = types & (1 << THREAD_EVENT) ? 'E':' ';
+  buf[i++] = types & (1 << THREAD_EXECUTE) ? 'X':' ';
+  buf[i++] = types & (1 << THREAD_BACKGROUND) ? 'B':' ';
+  buf[i] = '\0';
+}
+
+static void
+cpu_latency_hash_print (struct hash_backet *bucket, void *args[])
+{
+  struct vty *vty = args[0];
+  thread_type *filter = args[1];
+  struct cpu_thread_history *a = bucket->data;
+  char types[8];
+
+  if (!(a->types & *filter))
+    return;
+
+  thread_types_str (a->types, types);
+  vty_out (vty, "%9u %8lu %8lu %8lu %9lu",
+	   a->total_calls,
+	   thread_hist_percentile (a->buckets, a->total_calls, a->real.max, 500),
+	   thread_hist_percentile (a->buckets, a->total_calls, a->real.max, 990),
+	   thread_hist_percentile (a->buckets, a->total_calls, a->real.max, 999),
+	   a->real.max);
+  if (a->lag_calls)
+    vty_out (vty, " %8lu %9lu", a->lag.total / a->lag_calls, a->lag.max);
+  else
+    vty_out (vty, " %8s %9s", "-", "-");
+  vty_out (vty, "  %s %s%s", types, a->funcname, VTY_NEWLINE);
+}
+
+static void
+thread_slow_print (struct vty *vty, thread_type filter)
+{
+  struct thread_slow *order[THREAD_SLOW_MAX];
+  int i, j, count = 0;
+
+  /* insertion sort, slowest first */
+  for (i = 0; i < THREAD_SLOW_MAX; i++)
+    {
+      struct thread_slow *slow = &thread_slow[i];
+
+      if (!slow->hist || !(slow->hist->types & filter))
+	continue;
+      for (j = count++; j > 0 && order[j - 1]->real < slow->real; j--)
+	order[j] = order[j - 1];
+      order[j] = slow;
+    }
+  if (count == 0)
+    return;
+
+  vty_out (vty, "%sSlowest calls:%s", VTY_NEWLINE, VTY_NEWLINE);
+  vty_out (vty, "%-19s %9s %9s  Thread%s",
+	   "Finished", "Real uSec", "CPU uSec", VTY_NEWLINE);
+  for (i = 0; i < count; i++)
+    {
+      char buf[20];
+      time_t when = order[i]->when.tv_sec;
+      struct tm tm;
+
+      strftime (buf, sizeof (buf), "%Y/%m/%d %H:%M:%S",
+		localtime_r (&when, &tm));
+      vty_out (vty, "%-19s %9lu %9lu  %s%s", buf, order[i]->real,
+	       order[i]->cpu, order[i]->hist->funcname, VTY_NEWLINE);
+    }
+}
+
+static void
+thread_lag_print (struct vty *vty)
+{
+  if (thread_lag.calls == 0)
+    return;
+
+  vty_out (vty, "%sTimer dispatch lag (uSecs):%s", VTY_NEWLINE, VTY_NEWLINE);
+  vty_out (vty, "%9s %8s %8s %8s %8s %9s%s",
+	   "Timers", "Avg", "p50", "p99", "p999", "Max", VTY_NEWLINE);
+  vty_out (vty, "%9lu %8lu %8lu %8lu %8lu %9lu%s",
+	   thread_lag.calls, thread_lag.lag.total / thread_lag.calls,
+	   thread_hist_percentile (thread_lag.buckets, thread_lag.calls,
+				   thread_lag.lag.max, 500),
+	   thread_hist_percentile (thread_lag.buckets, thread_lag.calls,
+				   thread_lag.lag.max, 990),
+	   thread_hist_percentile (thread_lag.buckets, thread_lag.calls,
+				   thread_lag.lag.max, 999),
+	   thread_lag.lag.max, VTY_NEWLINE);
+}
+
+DEFUN(show_thread_cpu_latency,
+      show_thread_cpu_latency_cmd,
+      "show thread cpu latency [FILTER]",
+      SHOW_STR
+      "Thread information\n"
+      "Thread CPU usage\n"
+      "Latency distribution of thread calls\n"
+      "Display filter (rwtexb)\n")
+{
+  thread_type filter = (thread_type) -1U;
+  void *args[2] = {vty, &filter};
+
+  if (argc > 0 && !thread_filter_parse (vty, argv[0], &filter))
+    return CMD_WARNING;
+
+  vty_out (vty, "%10s%-35s %s%s",
+	   "", "Real (wall-clock) uSecs:", "Timer lag uSecs:", VTY_NEWLINE);
+  vty_out (vty, "%9s %8s %8s %8s %9s %8s %9s  Type   Thread%s",
+	   "Invoked", "p50", "p99", "p999", "Max", "Avg", "Max", VTY_NEWLINE);
+  hash_iterate (cpu_record,
+		(void (*) (struct hash_backet *, void *)) cpu_latency_hash_print,
+		args);
+  thread_slow_print (vty, filter);
+  if (filter & ((1 << THREAD_TIMER) | (1 << THREAD_BACKGROUND)))
+    thread_lag_print (vty);
   return CMD_SUCCESS;
 }
 
+static void
+thread_buckets_dump (struct vty *vty, const unsigned long *buckets)
+{
+  int n;
+
+  for (n = 0; n < THREAD_HIST_BUCKETS; n++)
+    vty_out (vty, "%s%lu", n ? "," : " hist=", buckets[n]);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+static void
+cpu_dump_hash_print (struct hash_backet *bucket, struct vty *vty)
+{
+  struct cpu_thread_history *a = bucket->data;
+  char types[8];
+  int i, j;
+
+  thread_types_str (a->types, types);
+  for (i = j = 0; types[i]; i++)
+    if (types[i] != ' ')
+      types[j++] = types[i];
+  types[j] = '\0';
+
+  vty_out (vty, "thread name=%s types=%s calls=%u real_total=%lu real_max=%lu",
+	   a->funcname, types, a->total_calls, a->real.total, a->real.max);
+#ifdef HAVE_RUSAGE
+  vty_out (vty, " cpu_total=%lu cpu_max=%lu", a->cpu.total, a->cpu.max);
+#endif
+  vty_out (vty, " lag_calls=%u lag_total=%lu lag_max=%lu",
+	   a->lag_calls, a->lag.total, a->lag.max);
+  thread_buckets_dump (vty, a->buckets);
+}
+
+/* One record per line, space separated key=value pairs; hist lists the
+   THREAD_HIST_BUCKETS log2 bucket counts, smallest first. */
+DEFUN(show_thread_cpu_dump,
+      show_thread_cpu_dump_cmd,
+      "show thread cpu dump",
+      SHOW_STR
+      "Thread information\n"
+      "Thread CPU usage\n"
+      "Machine readable statistics and latency histograms\n")
+{
+  int i;
+
+  vty_out (vty, "buckets=%d%s", THREAD_HIST_BUCKETS, VTY_NEWLINE);
+  hash_iterate (cpu_record,
+		(void (*) (struct hash_backet *, void *)) cpu_dump_hash_print,
+		vty);
+  vty_out (vty, "lag calls=%lu total=%lu max=%lu",
+	   thread_lag.calls, thread_lag.lag.total, thread_lag.lag.max);
+  thread_buckets_dump (vty, thread_lag.buckets);
+  for (i = 0; i < THREAD_SLOW_MAX; i++)
+    if (thread_slow[i].hist)
+      vty_out (vty, "slow name=%s real=%lu cpu=%lu time=%ld.%06ld%s",
+	       thread_slow[i].hist->funcname, thread_slow[i].real,
+	       thread_slow[i].cpu, (long) thread_slow[i].when.tv_sec,
+	       (long) thread_slow[i].when.tv_usec, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
+struct thread_metrics_arg
+{
+  struct metrics *m;
+  int field;
+};
+
+static void
+thread_metrics_hash (struct hash_backet *bucket, struct thread_metrics_arg *arg)
+{
+  struct cpu_thread_history *a = bucket->data;
+  unsigned long long value = 0;
+
+  switch (arg->field)
+    {
+    case 0:
+      value = a->total_calls;
+      break;
+    case 1:
+      value = a->real.total;
+      break;
+    case 2:
+      value = a->real.max;
+      break;
+#ifdef HAVE_RUSAGE
+    case 3:
+      value = a->cpu.total;
+      break;
+#endif
+    }
+  metrics_value (arg->m, value, "thread", a->funcname, NULL);
+}
+
+void
+thread_metrics (struct metrics *m)
+{
+  static const struct
+  {
+    const char *name;
+    enum metrics_type type;
+    const char *help;
+  } fields[] =
+  {
+    { "thread_calls_total", METRICS_COUNTER, "Thread function calls" },
+    { "thread_real_microseconds_total", METRICS_COUNTER,
+      "Wall clock time spent in thread functions" },
+    { "thread_real_max_microseconds", METRICS_GAUGE,
+      "Longest wall clock time of one call" },
+#ifdef HAVE_RUSAGE
+    { "thread_cpu_microseconds_total", METRICS_COUNTER,
+      "CPU time spent in thread functions" },
+#endif
+  };
+  struct thread_metrics_arg arg;
+  struct listnode *node;
+  struct thread_master *tm;
+
+  arg.m = m;
+  for (arg.field = 0; arg.field < (int) (sizeof (fields) / sizeof (fields[0])); arg.field++)
+    {
+      metrics_family (m, fields[arg.field].name, fields[arg.field].type,
+		      fields[arg.field].help);
+      hash_iterate (cpu_record,
+		    (void (*) (struct hash_backet *, void *)) thread_metrics_hash,
+		    &arg);
+    }
+
+  metrics_family (m, "thread_timer_lag_microseconds_total", METRICS_COUNTER,
+		  "Time timers were run after they were due");
+  metrics_value (m, thread_lag.lag.total, NULL);
+  metrics_family (m, "thread_timer_lag_max_microseconds", METRICS_GAUGE,
+		  "Longest time a timer was run after it was due");
+  metrics_value (m, thread_lag.lag.max, NULL);
+
+  metrics_family (m, "thread_timers", METRICS_GAUGE, "Timers scheduled");
+  for (ALL_LIST_ELEMENTS_RO (thread_masters, node, tm))
+    {
+      metrics_value (m, tm->timer->size, "queue", "timer", NULL);
+      metrics_value (m, tm->background->size, "queue", "background", NULL);
+    }
+}
+
 static void
 cpu_record_hash_clear (struct hash_backet *bucket, 
 		      void *args)
@@ -401,6 +764,15 @@ static void
 cpu_record_clear (thread_type filter)
 {
   thread_type *tmp = &filter;
+  int i;
+
+  for (i = 0; i < THREAD_SLOW_MAX; i++)
+    if (thread_slow[i].hist && (thread_slow[i].hist->types & filter))
+      memset (&thread_slow[i], 0, sizeof (thread_slow[i]));
+  thread_slow_min = 0;
+  if (filter & ((1 << THREAD_TIMER) | (1 << THREAD_BACKGROUND)))
+    memset (&thread_lag, 0, sizeof (thread_lag));
+
   hash_iterate (cpu_record,
 	        (void (*) (struct hash_backet*,void*)) cpu_record_hash_clear,
 	        tmp);
@@ -414,53 +786,10 @@ DEFUN(clear_thread_cpu,
       "Thread CPU usage\n"
       "Display filter (rwtexb)\n")
 {
-  int i = 0;
   thread_type filter = (thread_type) -1U;
 
-  if (argc > 0)
-    {
-      filter = 0;
-      while (argv[0][i] != '\0')
-	{
-	  switch ( argv[0][i] )
-	    {
-	    case 'r':
-	    case 'R':
-	      filter |= (1 << THREAD_READ);
-	      break;
-	    case 'w':
-	    case 'W':
-	      filter |= (1 << THREAD_WRITE);
-	      break;
-	    case 't':
-	    case 'T':
-	      filter |= (1 << THREAD_TIMER);
-	      break;
-	    case 'e':
-	    case 'E':
-	      filter |= (1 << THREAD_EVENT);
-	      break;
-	    case 'x':
-	    case 'X':
-	      filter |= (1 << THREAD_EXECUTE);
-	      break;
-	    case 'b':
-	    case 'B':
-	      filter |= (1 << THREAD_BACKGROUND);
-	      break;
-	    default:
-	      break;
-	    }
-	  ++i;
-	}
-      if (filter == 0)
-	{
-	  vty_out(vty, "Invalid filter \"%s\" specified,"
-                  " must contain at least one of 'RWTEXB'%s",
-		  argv[0], VTY_NEWLINE);
-	  return CMD_WARNING;
-	}
-    }
+  if (argc > 0 && !thread_filter_parse (vty, argv[0], &filter))
+    return CMD_WARNING;
 
   cpu_record_clear (filter);
   return CMD_SUCCESS;
@@ -474,6 +803,13 @@ thread_list_debug (struct thread_list *list)
 	  list->count, list->head, list->tail);
 }
 
+static void
+thread_queue_debug (struct pqueue *queue)
+{
+  printf ("size [%d] depth [%d] array size [%d]\n",
+	  queue->size, thread_timer_depth (queue), queue->array_size);
+}
+
 /* Debug print for thread_master. */
 static void  __attribute__ ((unused))
 thread_master_debug (struct thread_master *m)
@@ -483,29 +819,84 @@ thread_master_debug (struct thread_master *m)
   thread_list_debug (&m->read);
   printf ("writelist : ");
   thread_list_debug (&m->write);
-  printf ("timerlist : ");
-  thread_list_debug (&m->timer);
+  printf ("timerqueue : ");
+  thread_queue_debug (m->timer);
   printf ("eventlist : ");
   thread_list_debug (&m->event);
   printf ("unuselist : ");
   thread_list_debug (&m->unuse);
-  printf ("bgndlist : ");
-  thread_list_debug (&m->background);
+  printf ("bgndqueue : ");
+  thread_queue_debug (m->background);
   printf ("total alloc: [%ld]\n", m->alloc);
   printf ("-----------\n");
 }
 
+/* Timer queue ordering, earliest sands first. */
+static int
+thread_timer_cmp (void *a, void *b)
+{
+  struct thread *thread_a = a;
+  struct thread *thread_b = b;
+  long cmp;
+
+  cmp = timeval_cmp (thread_a->u.sands, thread_b->u.sands);
+  if (cmp < 0)
+    return -1;
+  if (cmp > 0)
+    return 1;
+  return 0;
+}
+
+/* Track a timer's position in its queue, so it can be cancelled. */
+static void
+thread_timer_update (void *node, int actual_position)
+{
+  struct thread *thread = node;
+
+  thread->index = actual_position;
+}
+
 /* Allocate new thread master.  */
 struct thread_master *
 thread_master_create ()
 {
+  struct thread_master *m;
+
   if (cpu_record == NULL) 
-    cpu_record 
-      = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
-                          (int (*) (const void *, const void *))cpu_record_hash_cmp);
+    {
+      cpu_record 
+        = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
+                            (int (*) (const void *, const void *))cpu_record_hash_cmp);
+      hash_set_name (cpu_record, "Thread CPU history");
+    }
     
-  return (struct thread_master *) XCALLOC (MTYPE_THREAD_MASTER,
-					   sizeof (struct thread_master));
+  if (thread_masters == NULL)
+    thread_masters = list_new ();
+
+  m = (struct thread_master *) XCALLOC (MTYPE_THREAD_MASTER,
+					sizeof (struct thread_master));
+
+  m->timer = pqueue_create ();
+  m->timer->cmp = thread_timer_cmp;
+  m->timer->update = thread_timer_update;
+  m->background = pqueue_create ();
+  m->background->cmp = thread_timer_cmp;
+  m->background->update = thread_timer_update;
+#ifdef HAVE_EPOLL
+  /* The size argument is only a hint, the kernel grows the set itself. */
+  if ((m->epoll_fd = epoll_create (THREAD_EPOLL_EVENTS)) < 0)
+    {
+      zlog_err ("epoll_create() error: %s", safe_strerror (errno));
+      exit (1);
+    }
+  fcntl (m->epoll_fd, F_SETFD, FD_CLOEXEC);
+  m->events = XCALLOC (MTYPE_THREAD_POLL,
+                       THREAD_EPOLL_EVENTS * sizeof (struct epoll_event));
+#endif /* HAVE_EPOLL */
+
+  listnode_add (thread_masters, m);
+
+  return m;
 }
 
 /* Add a new thread to the list.  */
@@ -522,22 +913,6 @@ thread_list_add (struct thread_list *list, struct thread *thread)
   list->count++;
 }
 
-/* Add a new thread just before the point.  */
-static void
-thread_list_add_before (struct thread_list *list, 
-			struct thread *point, 
-			struct thread *thread)
-{
-  thread->next = point;
-  thread->prev = point->prev;
-  if (point->prev)
-    point->prev->next = thread;
-  else
-    list->head = thread;
-  point->prev = thread;
-  list->count++;
-}
-
 /* Delete a thread from the list. */
 static struct thread *
 thread_list_delete (struct thread_list *list, struct thread *thread)
@@ -585,22 +960,58 @@ thread_list_free (struct thread_master *m, struct thread_list *list)
     }
 }
 
+/* Free all threads in a timer queue, and the queue itself. */
+static void
+thread_queue_free (struct thread_master *m, struct pqueue *queue)
+{
+  int i;
+
+  for (i = 0; i < queue->size; i++)
+    {
+      struct thread *t = queue->array[i];
+
+      if (t->funcname)
+        XFREE (MTYPE_THREAD_FUNCNAME, t->funcname);
+      XFREE (MTYPE_THREAD, t);
+      m->alloc--;
+    }
+  pqueue_delete (queue);
+}
+
 /* Stop thread scheduler. */
 void
 thread_master_free (struct thread_master *m)
 {
   thread_list_free (m, &m->read);
   thread_list_free (m, &m->write);
-  thread_list_free (m, &m->timer);
+  thread_queue_free (m, m->timer);
   thread_list_free (m, &m->event);
   thread_list_free (m, &m->ready);
   thread_list_free (m, &m->unuse);
-  thread_list_free (m, &m->background);
+  thread_queue_free (m, m->background);
+
+#ifdef HAVE_EPOLL
+  close (m->epoll_fd);
+  XFREE (MTYPE_THREAD_POLL, m->events);
+  if (m->fd_read)
+    XFREE (MTYPE_THREAD_POLL, m->fd_read);
+  if (m->fd_write)
+    XFREE (MTYPE_THREAD_POLL, m->fd_write);
+#endif /* HAVE_EPOLL */
   
+  listnode_delete (thread_masters, m);
   XFREE (MTYPE_THREAD_MASTER, m);
 
+  if (thread_masters->count == 0)
+    {
+      list_delete (thread_masters);
+      thread_masters = NULL;
+    }
+
   if (cpu_record)
     {
+      memset (thread_slow, 0, sizeof (thread_slow));
+      thread_slow_min = 0;
       hash_clean (cpu_record, cpu_record_hash_free);
       hash_free (cpu_record);
       cpu_record = NULL;
@@ -683,6 +1094,7 @@ thread_get (struct thread_master *m, u_char type,
   thread->type = type;
   thread->add_type = type;
   thread->master = m;
+  thread->index = -1;
   thread->func = func;
   thread->arg = arg;
   
@@ -691,6 +1103,154 @@ thread_get (struct thread_master *m, u_char type,
   return thread;
 }
 
+#ifdef HAVE_EPOLL
+/* Make sure the fd indexed thread tables can hold fd. */
+static void
+thread_fd_table_grow (struct thread_master *m, int fd)
+{
+  int size;
+
+  if (fd < m->fd_size)
+    return;
+
+  size = m->fd_size ? m->fd_size : 64;
+  while (size <= fd)
+    size *= 2;
+
+  m->fd_read = XREALLOC (MTYPE_THREAD_POLL, m->fd_read,
+                         size * sizeof (struct thread *));
+  m->fd_write = XREALLOC (MTYPE_THREAD_POLL, m->fd_write,
+                          size * sizeof (struct thread *));
+  memset (m->fd_read + m->fd_size, 0,
+          (size - m->fd_size) * sizeof (struct thread *));
+  memset (m->fd_write + m->fd_size, 0,
+          (size - m->fd_size) * sizeof (struct thread *));
+  m->fd_size = size;
+}
+
+/* Bring the epoll interest set for fd in line with the read and write
+   threads currently waiting on it.  Threads are one-shot, so this is
+   called whenever one is added, cancelled or made ready. */
+static int
+thread_epoll_update (struct thread_master *m, int fd, int registered)
+{
+  struct epoll_event ev;
+  int op;
+  int ret;
+
+  memset (&ev, 0, sizeof (struct epoll_event));
+  ev.data.fd = fd;
+  if (m->fd_read[fd])
+    ev.events |= EPOLLIN;
+  if (m->fd_write[fd])
+    ev.events |= EPOLLOUT;
+
+  if (! ev.events)
+    op = EPOLL_CTL_DEL;
+  else
+    op = registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  ret = epoll_ctl (m->epoll_fd, op, fd, &ev);
+  if (ret < 0)
+    {
+      /* A descriptor closed while registered silently leaves the set,
+         and its number may since have been reused. */
+      if (op == EPOLL_CTL_DEL)
+        ret = 0;
+      else if (op == EPOLL_CTL_MOD && errno == ENOENT)
+        ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+      else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+        ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+  return ret;
+}
+
+static int
+thread_fd_isset (struct thread_master *m, int fd, thread_type type)
+{
+  if (fd >= m->fd_size)
+    return 0;
+  return (type == THREAD_READ ? m->fd_read[fd] : m->fd_write[fd]) != NULL;
+}
+
+static void
+thread_fd_set (struct thread_master *m, struct thread *thread)
+{
+  int fd = THREAD_FD (thread);
+  int registered;
+
+  thread_fd_table_grow (m, fd);
+  registered = (m->fd_read[fd] || m->fd_write[fd]);
+
+  if (thread->type == THREAD_READ)
+    m->fd_read[fd] = thread;
+  else
+    m->fd_write[fd] = thread;
+
+  if (thread_epoll_update (m, fd, registered) == 0)
+    {
+      thread_list_add (thread->type == THREAD_READ ? &m->read : &m->write,
+                       thread);
+      return;
+    }
+
+  /* epoll refuses descriptors which are always ready, e.g. regular
+     files.  select() reports those as ready at once, so do the same. */
+  if (errno != EPERM)
+    zlog_warn ("epoll_ctl() error on fd %d: %s", fd, safe_strerror (errno));
+  if (thread->type == THREAD_READ)
+    m->fd_read[fd] = NULL;
+  else
+    m->fd_write[fd] = NULL;
+  thread->type = THREAD_READY;
+  thread_list_add (&m->ready, thread);
+}
+
+static void
+thread_fd_clr (struct thread_master *m, struct thread *thread)
+{
+  int fd = THREAD_FD (thread);
+
+  assert (thread_fd_isset (m, fd, thread->type));
+  if (thread->type == THREAD_READ)
+    m->fd_read[fd] = NULL;
+  else
+    m->fd_write[fd] = NULL;
+  thread_epoll_update (m, fd, 1);
+}
+#else
+static int
+thread_fd_isset (struct thread_master *m, int fd, thread_type type)
+{
+  return FD_ISSET (fd, type == THREAD_READ ? &m->readfd : &m->writefd);
+}
+
+static void
+thread_fd_set (struct thread_master *m, struct thread *thread)
+{
+  if (thread->type == THREAD_READ)
+    {
+      FD_SET (THREAD_FD (thread), &m->readfd);
+      thread_list_add (&m->read, thread);
+    }
+  else
+    {
+      FD_SET (THREAD_FD (thread), &m->writefd);
+      thread_list_add (&m->write, thread);
+    }
+}
+
+static void
+thread_fd_clr (struct thread_master *m, struct thread *thread)
+{
+  fd_set *fdset;
+
+  fdset = (thread->type == THREAD_READ ? &m->readfd : &m->writefd);
+  assert (FD_ISSET (THREAD_FD (thread), fdset));
+  FD_CLR (THREAD_FD (thread), fdset);
+}
+#endif /* HAVE_EPOLL */
+
 /* Add new read thread. */
 struct thread *
 funcname_thread_add_read (struct thread_master *m, 
@@ -700,16 +1260,15 @@ funcname_thread_add_read (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->readfd))
+  if (thread_fd_isset (m, fd, THREAD_READ))
     {
       zlog (NULL, LOG_WARNING, "There is already read fd [%d]", fd);
       return NULL;
     }
 
   thread = thread_get (m, THREAD_READ, func, arg, funcname);
-  FD_SET (fd, &m->readfd);
   thread->u.fd = fd;
-  thread_list_add (&m->read, thread);
+  thread_fd_set (m, thread);
 
   return thread;
 }
@@ -723,16 +1282,15 @@ funcname_thread_add_write (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->writefd))
+  if (thread_fd_isset (m, fd, THREAD_WRITE))
     {
       zlog (NULL, LOG_WARNING, "There is already write fd [%d]", fd);
       return NULL;
     }
 
   thread = thread_get (m, THREAD_WRITE, func, arg, funcname);
-  FD_SET (fd, &m->writefd);
   thread->u.fd = fd;
-  thread_list_add (&m->write, thread);
+  thread_fd_set (m, thread);
 
   return thread;
 }
@@ -746,16 +1304,15 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
                                   const char* funcname)
 {
   struct thread *thread;
-  struct thread_list *list;
+  struct pqueue *queue;
   struct timeval alarm_time;
-  struct thread *tt;
 
   assert (m != NULL);
 
   assert (type == THREAD_TIMER || type == THREAD_BACKGROUND);
   assert (time_relative);
   
-  list = ((type == THREAD_TIMER) ? &m->timer : &m->background);
+  queue = ((type == THREAD_TIMER) ? m->timer : m->background);
   thread = thread_get (m, type, func, arg, funcname);
 
   /* Do we need jitter here? */
@@ -764,15 +1321,7 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   alarm_time.tv_usec = relative_time.tv_usec + time_relative->tv_usec;
   thread->u.sands = timeval_adjust(alarm_time);
 
-  /* Sort by timeval. */
-  for (tt = list->head; tt; tt = tt->next)
-    if (timeval_cmp (thread->u.sands, tt->u.sands) <= 0)
-      break;
-
-  if (tt)
-    thread_list_add_before (list, tt, thread);
-  else
-    thread_list_add (list, thread);
+  pqueue_enqueue (thread, queue);
 
   return thread;
 }
@@ -858,22 +1407,21 @@ funcname_thread_add_event (struct thread_master *m,
 void
 thread_cancel (struct thread *thread)
 {
-  struct thread_list *list;
+  struct thread_list *list = NULL;
+  struct pqueue *queue = NULL;
   
   switch (thread->type)
     {
     case THREAD_READ:
-      assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
-      FD_CLR (thread->u.fd, &thread->master->readfd);
+      thread_fd_clr (thread->master, thread);
       list = &thread->master->read;
       break;
     case THREAD_WRITE:
-      assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
-      FD_CLR (thread->u.fd, &thread->master->writefd);
+      thread_fd_clr (thread->master, thread);
       list = &thread->master->write;
       break;
     case THREAD_TIMER:
-      list = &thread->master->timer;
+      queue = thread->master->timer;
       break;
     case THREAD_EVENT:
       list = &thread->master->event;
@@ -882,13 +1430,21 @@ thread_cancel (struct thread *thread)
       list = &thread->master->ready;
       break;
     case THREAD_BACKGROUND:
-      list = &thread->master->background;
+      queue = thread->master->background;
       break;
     default:
       return;
       break;
     }
-  thread_list_delete (list, thread);
+
+  if (queue)
+    {
+      assert (thread->index >= 0 && thread == queue->array[thread->index]);
+      pqueue_remove_at (thread->index, queue);
+      thread->index = -1;
+    }
+  else
+    thread_list_delete (list, thread);
   thread->type = THREAD_UNUSED;
   thread_add_unuse (thread->master, thread);
 }
@@ -920,11 +1476,12 @@ thread_cancel_event (struct thread_master *m, void *arg)
 }
 
 static struct timeval *
-thread_timer_wait (struct thread_list *tlist, struct timeval *timer_val)
+thread_timer_wait (struct pqueue *queue, struct timeval *timer_val)
 {
-  if (!thread_empty (tlist))
+  if (queue->size)
     {
-      *timer_val = timeval_subtract (tlist->head->u.sands, relative_time);
+      struct thread *next_timer = queue->array[0];
+      *timer_val = timeval_subtract (next_timer->u.sands, relative_time);
       return timer_val;
     }
   return NULL;
@@ -941,6 +1498,50 @@ thread_run (struct thread_master *m, struct thread *thread,
   return fetch;
 }
 
+#ifdef HAVE_EPOLL
+/* Move the threads waiting on descriptors reported by epoll_wait() to
+   the ready list.  Unlike select() this is proportional to the number
+   of ready descriptors, not to the number being watched. */
+static int
+thread_process_epoll (struct thread_master *m, int num)
+{
+  struct thread *thread;
+  int i, fd;
+  uint32_t events;
+  int ready = 0;
+
+  for (i = 0; i < num; i++)
+    {
+      fd = m->events[i].data.fd;
+      events = m->events[i].events;
+
+      if (fd >= m->fd_size)
+        continue;
+
+      /* As with select(), errors and hangups wake up both directions. */
+      if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          && (thread = m->fd_read[fd]) != NULL)
+        {
+          m->fd_read[fd] = NULL;
+          thread_list_delete (&m->read, thread);
+          thread_list_add (&m->ready, thread);
+          thread->type = THREAD_READY;
+          ready++;
+        }
+      if ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+          && (thread = m->fd_write[fd]) != NULL)
+        {
+          m->fd_write[fd] = NULL;
+          thread_list_delete (&m->write, thread);
+          thread_list_add (&m->ready, thread);
+          thread->type = THREAD_READY;
+          ready++;
+        }
+      thread_epoll_update (m, fd, 1);
+    }
+  return ready;
+}
+#else
 static int
 thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
 {
@@ -966,21 +1567,22 @@ thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
     }
   return ready;
 }
+#endif /* HAVE_EPOLL */
 
 /* Add all timers that have popped to the ready list. */
 static unsigned int
-thread_timer_process (struct thread_list *list, struct timeval *timenow)
+thread_timer_process (struct pqueue *queue, struct timeval *timenow)
 {
   struct thread *thread;
-  struct thread *next;
   unsigned int ready = 0;
   
-  for (thread = list->head; thread; thread = next)
+  while (queue->size)
     {
-      next = thread->next;
+      thread = queue->array[0];
       if (timeval_cmp (*timenow, thread->u.sands) < 0)
         return ready;
-      thread_list_delete (list, thread);
+      pqueue_dequeue (queue);
+      thread->index = -1;
       thread->type = THREAD_READY;
       thread_list_add (&thread->master->ready, thread);
       ready++;
@@ -1013,9 +1615,13 @@ struct thread *
 thread_fetch (struct thread_master *m, struct thread *fetch)
 {
   struct thread *thread;
+#ifdef HAVE_EPOLL
+  int timeout;
+#else
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
+#endif /* HAVE_EPOLL */
   struct timeval timer_val = { .tv_sec = 0, .tv_usec = 0 };
   struct timeval timer_val_bg;
   struct timeval *timer_wait = &timer_val;
@@ -1042,31 +1648,48 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
       /* Normal event are the next highest priority.  */
       thread_process (&m->event);
       
+#ifndef HAVE_EPOLL
       /* Structure copy.  */
       readfd = m->readfd;
       writefd = m->writefd;
       exceptfd = m->exceptfd;
+#endif /* !HAVE_EPOLL */
       
       /* Calculate select wait timer if nothing else to do */
       if (m->ready.count == 0)
         {
           bane_get_relative (NULL);
-          timer_wait = thread_timer_wait (&m->timer, &timer_val);
-          timer_wait_bg = thread_timer_wait (&m->background, &timer_val_bg);
+          timer_wait = thread_timer_wait (m->timer, &timer_val);
+          timer_wait_bg = thread_timer_wait (m->background, &timer_val_bg);
           
           if (timer_wait_bg &&
               (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_bg) > 0)))
             timer_wait = timer_wait_bg;
         }
       
+#ifdef HAVE_EPOLL
+      /* Round up, so that we do not spin on a timer less than 1ms away. */
+      if (timer_wait)
+        timeout = timer_wait->tv_sec * 1000
+                  + (timer_wait->tv_usec + 999) / 1000;
+      else
+        timeout = -1;
+
+      num = epoll_wait (m->epoll_fd, m->events, THREAD_EPOLL_EVENTS, timeout);
+#else
       num = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+#endif /* HAVE_EPOLL */
       
       /* Signals should get quick treatment */
       if (num < 0)
         {
           if (errno == EINTR)
             continue; /* signal received - process it */
+#ifdef HAVE_EPOLL
+          zlog_warn ("epoll_wait() error: %s", safe_strerror (errno));
+#else
           zlog_warn ("select() error: %s", safe_strerror (errno));
+#endif /* HAVE_EPOLL */
             return NULL;
         }
 
@@ -1074,15 +1697,19 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
          priority than I/O threads, so let's push them onto the ready
 	 list in front of the I/O threads. */
       bane_get_relative (NULL);
-      thread_timer_process (&m->timer, &relative_time);
+      thread_timer_process (m->timer, &relative_time);
       
       /* Got IO, process it */
       if (num > 0)
         {
+#ifdef HAVE_EPOLL
+          thread_process_epoll (m, num);
+#else
           /* Normal priority read thead. */
           thread_process_fd (&m->read, &readfd, &m->readfd);
           /* Write thead. */
           thread_process_fd (&m->write, &writefd, &m->writefd);
+#endif /* HAVE_EPOLL */
         }
 
 #if 0
@@ -1095,7 +1722,7 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
 #endif
 
       /* Background timer/events, lowest priority */
-      thread_timer_process (&m->background, &relative_time);
+      thread_timer_process (m->background, &relative_time);
       
       if ((thread = thread_trim_head (&m->ready)) != NULL)
         return thread_run (m, thread, fetch);
@@ -1150,6 +1777,52 @@ thread_getrusage (RUSAGE_T *r)
 #endif /* HAVE_CLOCK_MONOTONIC */
 }
 
+/* Remember the call if it is among the THREAD_SLOW_MAX slowest. */
+static void
+thread_slow_record (struct cpu_thread_history *hist, unsigned long realtime,
+		    unsigned long cputime)
+{
+  struct thread_slow *slow = &thread_slow[0];
+  int i;
+
+  for (i = 1; i < THREAD_SLOW_MAX; i++)
+    if (thread_slow[i].real < slow->real)
+      slow = &thread_slow[i];
+
+  slow->hist = hist;
+  slow->real = realtime;
+  slow->cpu = cputime;
+  slow->when = recent_time;
+
+  thread_slow_min = realtime;
+  for (i = 0; i < THREAD_SLOW_MAX; i++)
+    if (thread_slow[i].real < thread_slow_min)
+      thread_slow_min = thread_slow[i].real;
+}
+
+/* Account how long after its sands a timer got to run. */
+static void
+thread_lag_record (struct thread *thread)
+{
+  unsigned long lag = 0;
+  int n;
+
+  if (timeval_cmp (thread->ru.real, thread->u.sands) > 0)
+    lag = timeval_elapsed (thread->ru.real, thread->u.sands);
+
+  thread->hist->lag.total += lag;
+  if (thread->hist->lag.max < lag)
+    thread->hist->lag.max = lag;
+  thread->hist->lag_calls++;
+
+  n = thread_hist_bucket (lag);
+  thread_lag.buckets[n]++;
+  thread_lag.lag.total += lag;
+  if (thread_lag.lag.max < lag)
+    thread_lag.lag.max = lag;
+  thread_lag.calls++;
+}
+
 /* We check thread consumed time. If the system has getrusage, we'll
    use that to get in-depth stats on the performance of the thread in addition
    to wall clock time stats from gettimeofday. */
@@ -1178,6 +1851,10 @@ thread_call (struct thread *thread)
 
   GETRUSAGE (&thread->ru);
 
+  if (thread->add_type == THREAD_TIMER
+      || thread->add_type == THREAD_BACKGROUND)
+    thread_lag_record (thread);
+
   (*thread->func) (thread);
 
   GETRUSAGE (&ru);
@@ -1194,6 +1871,9 @@ thread_call (struct thread *thread)
 
   ++(thread->hist->total_calls);
   thread->hist->types |= (1 << thread->add_type);
+  thread->hist->buckets[thread_hist_bucket (realtime)]++;
+  if (realtime > thread_slow_min)
+    thread_slow_record (thread->hist, realtime, cputime);
 
 #ifdef CONSUMED_TIME_CHECK
   if (realtime > CONSUMED_TIME_CHECK)
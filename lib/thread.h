@@ -49,14 +49,22 @@ struct thread_master
 {
   struct thread_list read;
   struct thread_list write;
-  struct thread_list timer;
+  struct pqueue *timer;
   struct thread_list event;
   struct thread_list ready;
   struct thread_list unuse;
-  struct thread_list background;
+  struct pqueue *background;
+#ifdef HAVE_EPOLL
+  int epoll_fd;
+  struct epoll_event *events;	/* epoll_wait() result buffer */
+  struct thread **fd_read;	/* read thread indexed by fd */
+  struct thread **fd_write;	/* write thread indexed by fd */
+  int fd_size;
+#else
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
+#endif /* HAVE_EPOLL */
   unsigned long alloc;
 };
 
@@ -70,6 +78,7 @@ struct thread
   struct thread *next;		/* next pointer of the thread */   
   struct thread *prev;		/* previous pointer of the thread */
   struct thread_master *master;	/* pointer to the struct thread_master. */
+  int index;			/* position in timer queue, -1 if none */
   int (*func) (struct thread *); /* event function */
   void *arg;			/* event argument */
   union {
@@ -82,6 +91,13 @@ struct thread
   char* funcname;
 };
 
+/* Latency histogram buckets: bucket n counts calls which took
+   [2^n, 2^(n+1)) uSecs, the last bucket everything slower. */
+#define THREAD_HIST_BUCKETS   24
+
+/* Number of slowest thread calls kept for "show thread cpu latency". */
+#define THREAD_SLOW_MAX       16
+
 struct cpu_thread_history 
 {
   int (*func)(struct thread *);
@@ -95,6 +111,9 @@ struct cpu_thread_history
   struct time_stats cpu;
 #endif
   thread_type types;
+  unsigned long buckets[THREAD_HIST_BUCKETS]; /* calls by log2 real uSecs */
+  struct time_stats lag;	/* timers: dispatch time - sands */
+  unsigned int lag_calls;
 };
 
 /* Clocks supported by Bane */
@@ -114,6 +133,9 @@ enum bane_clkid {
 #define THREAD_UNUSED         6
 #define THREAD_EXECUTE        7
 
+/* Max number of ready descriptors returned by one epoll_wait(). */
+#define THREAD_EPOLL_EVENTS   256
+
 /* Thread yield time.  */
 #define THREAD_YIELD_TIME_SLOT     10 * 1000L /* 10ms */
 
@@ -206,8 +228,13 @@ extern int thread_should_yield (struct thread *);
 /* Internal libkroute exports */
 extern void thread_getrusage (RUSAGE_T *);
 extern struct cmd_element show_thread_cpu_cmd;
+extern struct cmd_element show_thread_cpu_latency_cmd;
+extern struct cmd_element show_thread_cpu_dump_cmd;
 extern struct cmd_element clear_thread_cpu_cmd;
 
+struct metrics;
+extern void thread_metrics (struct metrics *);
+
 /* replacements for the system gettimeofday(), clock_gettime() and
  * time() functions, providing support for non-decrementing clock on
  * all systems, and fully monotonic on /some/ systems.
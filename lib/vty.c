@@ -36,6 +36,7 @@
 #include "vty.h"
 #include "privs.h"
 #include "network.h"
+#include "metrics.h"
 
 #include <arpa/telnet.h>
 
@@ -46,6 +47,7 @@ enum event
   VTY_READ,
   VTY_WRITE,
   VTY_TIMEOUT_RESET,
+  VTY_WALK,
 #ifdef VTYSH
   VTYSH_SERV,
   VTYSH_READ,
@@ -54,6 +56,7 @@ enum event
 };
 
 static void vty_event (enum event, int, struct vty *);
+static void vty_walk_stop (struct vty *);
 
 /* Extern host structure from command.c */
 extern struct host host;
@@ -1290,7 +1293,8 @@ vty_execute (struct vty *vty)
   vty->cp = vty->length = 0;
   vty_clear_buf (vty);
 
-  if (vty->status != VTY_CLOSE )
+  /* A walk gives the prompt once its output is complete. */
+  if (vty->status != VTY_CLOSE && ! vty->walk_step)
     vty_prompt (vty);
 
   return ret;
@@ -1400,6 +1404,15 @@ vty_read (struct thread *thread)
 	}
 	        
 
+      /* Only an interrupt is accepted while a walk is producing output;
+	 other keys just let the next window through. */
+      if (vty->walk_step)
+	{
+	  if (buf[i] == CONTROL('C') || buf[i] == 'q' || buf[i] == 'Q')
+	    vty_walk_stop (vty);
+	  continue;
+	}
+
       if (vty->status == VTY_MORE)
 	{
 	  switch (buf[i])
@@ -1595,6 +1608,7 @@ vty_flush (struct thread *thread)
 	  vty->status = VTY_NORMAL;
 	  if (vty->lines == 0)
 	    vty_event (VTY_READ, vty_sock, vty);
+	  vty_event (VTY_WALK, vty_sock, vty);
 	}
       break;
     case BUFFER_PENDING:
@@ -1602,6 +1616,7 @@ vty_flush (struct thread *thread)
       vty->status = VTY_MORE;
       if (vty->lines == 0)
 	vty_event (VTY_WRITE, vty_sock, vty);
+      vty_event (VTY_WALK, vty_sock, vty);
       break;
     }
 
@@ -2046,6 +2061,7 @@ vtysh_flush(struct vty *vty)
     {
     case BUFFER_PENDING:
       vty_event(VTYSH_WRITE, vty->fd, vty);
+      vty_event(VTY_WALK, vty->fd, vty);
       break;
     case BUFFER_ERROR:
       vty->monitor = 0; /* disable monitoring to avoid infinite recursion */
@@ -2055,6 +2071,7 @@ vtysh_flush(struct vty *vty)
       return -1;
       break;
     case BUFFER_EMPTY:
+      vty_event(VTY_WALK, vty->fd, vty);
       break;
     }
   return 0;
@@ -2117,6 +2134,14 @@ vtysh_read (struct thread *thread)
 	  printf ("vtysh node: %d\n", vty->node);
 #endif /* VTYSH_DEBUG */
 
+	  /* The result follows the walk's output.  vtysh waits for it
+	     before sending anything else, so reading stops until then. */
+	  if (vty->walk_step)
+	    {
+	      vty->walk_ret = ret;
+	      return 0;
+	    }
+
 	  header[3] = ret;
 	  buffer_put(vty->obuf, header, 4);
 
@@ -2143,6 +2168,101 @@ vtysh_write (struct thread *thread)
 
 #endif /* VTYSH */
 
+/* Release the walk's cursor. */
+static void
+vty_walk_finish (struct vty *vty)
+{
+  vty_walk_done_t done = vty->walk_done;
+  void *arg = vty->walk_arg;
+
+  THREAD_OFF (vty->t_walk);
+  vty->walk_step = NULL;
+  vty->walk_done = NULL;
+  vty->walk_arg = NULL;
+  if (done)
+    (*done) (vty, arg);
+}
+
+/* The command's output is complete: give the prompt, or the result to
+   vtysh, and go back to reading commands. */
+static void
+vty_walk_complete (struct vty *vty)
+{
+  vty_walk_finish (vty);
+#ifdef VTYSH
+  if (vty->type == VTY_SHELL_SERV)
+    {
+      u_char header[4] = {0, 0, 0, 0};
+
+      header[3] = vty->walk_ret;
+      buffer_put (vty->obuf, header, 4);
+      vty_event (VTYSH_READ, vty->fd, vty);
+      return;
+    }
+#endif /* VTYSH */
+  vty_prompt (vty);
+}
+
+/* Interrupted by the user: drop what is not written yet. */
+static void
+vty_walk_stop (struct vty *vty)
+{
+  vty_walk_finish (vty);
+  vty_buffer_reset (vty);
+}
+
+static int
+vty_walk_run (struct thread *thread)
+{
+  struct vty *vty = THREAD_ARG (thread);
+
+  vty->t_walk = NULL;
+
+  if ((*vty->walk_step) (vty, vty->walk_arg) == VTY_WALK_DONE)
+    vty_walk_complete (vty);
+
+#ifdef VTYSH
+  if (vty->type == VTY_SHELL_SERV)
+    {
+      if (! vty->t_write && vtysh_flush (vty) < 0)
+	return 0;
+    }
+  else
+#endif /* VTYSH */
+  if (vty->status != VTY_MORE)	/* else the next window waits for a key */
+    vty_event (VTY_WRITE, vty->fd, vty);
+
+  /* Otherwise the flush that drains the backlog resumes the walk. */
+  vty_event (VTY_WALK, vty->fd, vty);
+  return 0;
+}
+
+void
+vty_walk (struct vty *vty, vty_walk_step_t step, vty_walk_done_t done,
+	  void *arg)
+{
+  int resumable;
+
+  resumable = (vty->type == VTY_SHELL_SERV
+	       || (vty->type == VTY_TERM && vtyvec
+		   && vector_lookup (vtyvec, vty->fd) == vty));
+
+  if (! resumable || vty->walk_step)
+    {
+      while ((*step) (vty, arg) == VTY_WALK_MORE)
+	;
+      if (done)
+	(*done) (vty, arg);
+      return;
+    }
+
+  vty->walk_step = step;
+  vty->walk_done = done;
+  vty->walk_arg = arg;
+  vty->walk_ret = CMD_SUCCESS;
+  vty_event (VTY_WALK, vty->fd, vty);
+}
+
 /* Determine address family to bind. */
 void
 vty_serv_sock (const char *addr, unsigned short port, const char *path)
@@ -2166,6 +2286,8 @@ vty_serv_sock (const char *addr, unsigned short port, const char *path)
 #ifdef VTYSH
   vty_serv_un (path);
 #endif /* VTYSH */
+
+  metrics_serv_un (path);
 }
 
 /* Close vty interface.  Warning: call this only from functions that
@@ -2177,6 +2299,9 @@ vty_close (struct vty *vty)
 {
   int i;
 
+  if (vty->walk_step)
+    vty_walk_finish (vty);
+
   /* Cancel threads.*/
   if (vty->t_read)
     thread_cancel (vty->t_read);
@@ -2549,6 +2674,11 @@ vty_event (enum event event, int sock, struct vty *vty)
       if (! vty->t_write)
 	vty->t_write = thread_add_write (master, vty_flush, vty, sock);
       break;
+    case VTY_WALK:
+      if (vty->walk_step && ! vty->t_walk
+	  && buffer_pending (vty->obuf) < VTY_WALK_BACKLOG)
+	vty->t_walk = thread_add_background (master, vty_walk_run, vty, 0);
+      break;
     case VTY_TIMEOUT_RESET:
       if (vty->t_timeout)
 	{
@@ -2975,6 +3105,8 @@ vty_init (struct thread_master *master_thread)
   /* Initilize server thread vector. */
   Vvty_serv_thread = vector_init (VECTOR_MIN_SIZE);
 
+  metrics_init (master_thread);
+
   /* Install bgp top node. */
   install_node (&vty_node, vty_config_write);
 
@@ -3020,4 +3152,6 @@ vty_terminate (void)
       vector_free (vtyvec);
       vector_free (Vvty_serv_thread);
     }
+
+  metrics_terminate ();
 }
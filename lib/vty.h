@@ -27,6 +27,12 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define VTY_BUFSIZ 512
 #define VTY_MAXHIST 20
 
+struct vty;
+
+/* Incremental output, see vty_walk. */
+typedef int (*vty_walk_step_t) (struct vty *, void *);
+typedef void (*vty_walk_done_t) (struct vty *, void *);
+
 /* VTY struct. */
 struct vty 
 {
@@ -118,6 +124,14 @@ struct vty
   /* Timeout seconds and thread. */
   unsigned long v_timeout;
   struct thread *t_timeout;
+
+  /* Incremental output in progress, and the return code of the
+     command that started it. */
+  vty_walk_step_t walk_step;
+  vty_walk_done_t walk_done;
+  void *walk_arg;
+  int walk_ret;
+  struct thread *t_walk;
 };
 
 /* Integrated configuration file. */
@@ -132,6 +146,16 @@ struct vty
 /* Vty read buffer size. */
 #define VTY_READ_BUFSIZ 512
 
+/* Return values of a vty_walk step function. */
+#define VTY_WALK_DONE 0
+#define VTY_WALK_MORE 1
+
+/* Entries a step function should output per call. */
+#define VTY_WALK_SLICE 500
+
+/* No step is taken while more than this is waiting for the client. */
+#define VTY_WALK_BACKLOG (64 * 1024)
+
 /* Directory separator. */
 #ifndef DIRECTORY_SEP
 #define DIRECTORY_SEP '/'
@@ -221,6 +245,17 @@ extern int vty_shell (struct vty *);
 extern int vty_shell_serv (struct vty *);
 extern void vty_hello (struct vty *);
 
+/* Produce a command's output in slices.  step is called from a
+   background thread, writes about VTY_WALK_SLICE entries and returns
+   VTY_WALK_MORE until it is finished; it keeps its own cursor in arg.
+   Steps wait while the client is slow to read, so a large table neither
+   stalls the daemon nor piles up in the output buffer.  done is called
+   exactly once, when the walk ends, is interrupted or the vty closes,
+   and must release arg.  Where output cannot be resumed later (config
+   files) every step is run at once. */
+extern void vty_walk (struct vty *, vty_walk_step_t step,
+		      vty_walk_done_t done, void *arg);
+
 /* Send a fixed-size message to all vty terminal monitors; this should be
    an async-signal-safe function. */
 extern void vty_log_fixed (const char *buf, size_t len);
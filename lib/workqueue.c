@@ -28,12 +28,65 @@
 #include "linklist.h"
 #include "command.h"
 #include "log.h"
+#include "network.h"
+#include "metrics.h"
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 /* master list of work_queues */
 static struct list work_queues;
 
 #define WORK_QUEUE_MIN_GRANULARITY 1
 
+#ifdef HAVE_LIBPTHREAD
+/* Worker threads of a queue.  Only the todo and done lists (and stop)
+ * are shared with the workers, under mtx.  Everything else, including
+ * the item list of the queue itself, stays with the master thread.
+ */
+struct wq_pool
+{
+  struct work_queue *wq;
+  pthread_t *threads;
+  unsigned int count;		/* threads running */
+  unsigned int workers;		/* spec.workers the pool was made for */
+
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+  struct work_queue_item *todo, *todo_tail;
+  struct work_queue_item *done, *done_tail;
+  int stop;
+
+  int fds[2];			/* workers wake the master through this */
+  struct thread *t_read;
+  unsigned int inflight;	/* items handed out, not yet collected */
+};
+
+/* Items in flight per worker.  Keeps requeued and newly added items
+ * from waiting behind the whole queue. */
+#define WQ_POOL_BATCH 64
+#endif /* HAVE_LIBPTHREAD */
+
+static unsigned int
+work_queue_inflight (struct work_queue *wq)
+{
+#ifdef HAVE_LIBPTHREAD
+  if (wq->pool)
+    return wq->pool->inflight;
+#endif /* HAVE_LIBPTHREAD */
+  return 0;
+}
+
+static unsigned long
+wq_usec_since (struct timeval *then, struct timeval *now)
+{
+  long usec = (now->tv_sec - then->tv_sec) * 1000000L
+              + (now->tv_usec - then->tv_usec);
+
+  return (usec > 0) ? usec : 0;
+}
+
 static struct work_queue_item *
 work_queue_item_new (struct work_queue *wq)
 {
@@ -88,12 +141,169 @@ work_queue_new (struct thread_master *m, const char *queue_name)
   return new;
 }
 
+#ifdef HAVE_LIBPTHREAD
+static void
+wq_pool_wake (struct wq_pool *pool)
+{
+  char c = 0;
+
+  while ((write (pool->fds[1], &c, 1) < 0) && (errno == EINTR))
+    ;
+}
+
+static void *
+wq_pool_worker (void *arg)
+{
+  struct wq_pool *pool = arg;
+  struct work_queue *wq = pool->wq;
+  struct work_queue_item *item;
+  wq_item_status ret;
+
+  pthread_mutex_lock (&pool->mtx);
+  for (;;)
+    {
+      while (!pool->stop && !pool->todo)
+        pthread_cond_wait (&pool->cond, &pool->mtx);
+      if (pool->stop)
+        break;
+
+      item = pool->todo;
+      if (!(pool->todo = item->next))
+        pool->todo_tail = NULL;
+      pthread_mutex_unlock (&pool->mtx);
+
+      /* as in work_queue_run */
+      do
+        {
+          ret = wq->spec.workfunc (wq, item->data);
+          item->ran++;
+        }
+      while ((ret == WQ_RETRY_NOW)
+             && (item->ran < wq->spec.max_retries));
+      item->ret = ret;
+      item->next = NULL;
+
+      pthread_mutex_lock (&pool->mtx);
+      /* the master only needs waking for the first item */
+      if (pool->done_tail)
+        pool->done_tail->next = item;
+      else
+        {
+          pool->done = item;
+          wq_pool_wake (pool);
+        }
+      pool->done_tail = item;
+    }
+  pthread_mutex_unlock (&pool->mtx);
+
+  return NULL;
+}
+
+static void
+wq_pool_free_items (struct work_queue_item *item)
+{
+  struct work_queue_item *next;
+
+  for (; item; item = next)
+    {
+      next = item->next;
+      work_queue_item_free (item);
+    }
+}
+
+/* Stop and join the workers, waiting for items they are running. */
+static void
+wq_pool_stop (struct work_queue *wq)
+{
+  struct wq_pool *pool = wq->pool;
+  unsigned int i;
+
+  pthread_mutex_lock (&pool->mtx);
+  pool->stop = 1;
+  pthread_cond_broadcast (&pool->cond);
+  pthread_mutex_unlock (&pool->mtx);
+
+  for (i = 0; i < pool->count; i++)
+    pthread_join (pool->threads[i], NULL);
+
+  wq_pool_free_items (pool->todo);
+  wq_pool_free_items (pool->done);
+
+  THREAD_OFF (pool->t_read);
+  close (pool->fds[0]);
+  close (pool->fds[1]);
+  pthread_cond_destroy (&pool->cond);
+  pthread_mutex_destroy (&pool->mtx);
+
+  XFREE (MTYPE_WORK_QUEUE_POOL, pool->threads);
+  XFREE (MTYPE_WORK_QUEUE_POOL, wq->pool);
+}
+
+static struct wq_pool *
+wq_pool_start (struct work_queue *wq)
+{
+  struct wq_pool *pool;
+  sigset_t all, old;
+  unsigned int i;
+
+  pool = XCALLOC (MTYPE_WORK_QUEUE_POOL, sizeof (struct wq_pool));
+  pool->wq = wq;
+  pool->workers = wq->spec.workers;
+
+  if (pipe (pool->fds) < 0)
+    {
+      zlog_warn ("%s: pipe failed: %s", __func__, safe_strerror (errno));
+      XFREE (MTYPE_WORK_QUEUE_POOL, pool);
+      return NULL;
+    }
+  set_nonblocking (pool->fds[0]);
+  set_nonblocking (pool->fds[1]);
+
+  pthread_mutex_init (&pool->mtx, NULL);
+  pthread_cond_init (&pool->cond, NULL);
+
+  pool->threads = XCALLOC (MTYPE_WORK_QUEUE_POOL,
+                           pool->workers * sizeof (pthread_t));
+
+  /* workfuncs may allocate */
+  memory_threads_enable ();
+
+  /* signals are for the master thread only */
+  sigfillset (&all);
+  pthread_sigmask (SIG_BLOCK, &all, &old);
+  for (i = 0; i < pool->workers; i++)
+    if (pthread_create (&pool->threads[i], NULL, wq_pool_worker, pool))
+      break;
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  pool->count = i;
+
+  wq->pool = pool;
+
+  if (pool->count < pool->workers)
+    zlog_warn ("%s: %s: started only %u of %u worker threads",
+               __func__, wq->name, pool->count, pool->workers);
+  if (pool->count == 0)
+    {
+      wq_pool_stop (wq);
+      return NULL;
+    }
+
+  return pool;
+}
+#endif /* HAVE_LIBPTHREAD */
+
 void
 work_queue_free (struct work_queue *wq)
 {
   if (wq->thread != NULL)
     thread_cancel(wq->thread);
   
+#ifdef HAVE_LIBPTHREAD
+  if (wq->pool)
+    wq_pool_stop (wq);
+#endif /* HAVE_LIBPTHREAD */
+
+
   /* list_delete frees items via callback */
   list_delete (wq->items);
   listnode_delete (&work_queues, wq);
@@ -109,7 +319,12 @@ work_queue_schedule (struct work_queue *wq, unsigned int delay)
   /* if appropriate, schedule work queue thread */
   if ( CHECK_FLAG (wq->flags, WQ_UNPLUGGED)
        && (wq->thread == NULL)
-       && (listcount (wq->items) > 0) )
+       && (listcount (wq->items) > 0) 
+#ifdef HAVE_LIBPTHREAD
+       && !(wq->pool
+            && wq->pool->inflight >= wq->pool->count * WQ_POOL_BATCH)
+#endif /* HAVE_LIBPTHREAD */
+       )
     {
       wq->thread = thread_add_background (wq->master, work_queue_run, 
                                           wq, delay);
@@ -133,6 +348,11 @@ work_queue_add (struct work_queue *wq, void *data)
     }
   
   item->data = data;
+  bane_gettime (BANE_CLK_MONOTONIC, &item->added);
+
+  if (listcount (wq->items) == 0 && !work_queue_inflight (wq))
+    wq->stats.busy_since = item->added;
+
   listnode_add (wq->items, item);
   
   work_queue_schedule (wq, wq->spec.hold);
@@ -141,22 +361,57 @@ work_queue_add (struct work_queue *wq, void *data)
 }
 
 static void
-work_queue_item_remove (struct work_queue *wq, struct listnode *ln)
+work_queue_item_done (struct work_queue *wq, struct work_queue_item *item)
 {
-  struct work_queue_item *item = listgetdata (ln);
-
-  assert (item && item->data);
+  struct timeval now;
+  unsigned long latency;
 
   /* call private data deletion callback if needed */  
   if (wq->spec.del_item_data)
     wq->spec.del_item_data (wq, item->data);
 
-  list_delete_node (wq->items, ln);
+  bane_gettime (BANE_CLK_MONOTONIC, &now);
+  latency = wq_usec_since (&item->added, &now);
+  wq->stats.items++;
+  wq->stats.latency += latency;
+  if (latency > wq->stats.latency_max)
+    wq->stats.latency_max = latency;
+
   work_queue_item_free (item);
+}
+
+static void
+work_queue_item_remove (struct work_queue *wq, struct listnode *ln)
+{
+  struct work_queue_item *item = listgetdata (ln);
+
+  assert (item && item->data);
+
+  list_delete_node (wq->items, ln);
+  work_queue_item_done (wq, item);
   
   return;
 }
 
+/* Schedule the next run if there is more to do, otherwise the queue
+ * is drained: call the completion callback. */
+static void
+work_queue_run_done (struct work_queue *wq, unsigned int delay)
+{
+  struct timeval now;
+
+  if (listcount (wq->items) > 0)
+    work_queue_schedule (wq, delay);
+  else if (!work_queue_inflight (wq))
+    {
+      bane_gettime (BANE_CLK_MONOTONIC, &now);
+      wq->stats.busy += wq_usec_since (&wq->stats.busy_since, &now);
+
+      if (wq->spec.completion_func)
+        wq->spec.completion_func (wq);
+    }
+}
+
 static void
 work_queue_item_requeue (struct work_queue *wq, struct listnode *ln)
 {
@@ -164,6 +419,59 @@ work_queue_item_requeue (struct work_queue *wq, struct listnode *ln)
   LISTNODE_ATTACH (wq->items, ln); /* attach to end of list */
 }
 
+static void
+work_queue_metrics_family (struct metrics *m, const char *name,
+			   enum metrics_type type, const char *help,
+			   unsigned long (*get) (struct work_queue *))
+{
+  struct listnode *node;
+  struct work_queue *wq;
+
+  metrics_family (m, name, type, help);
+  for (ALL_LIST_ELEMENTS_RO ((&work_queues), node, wq))
+    metrics_value (m, (*get) (wq), "queue", wq->name, NULL);
+}
+
+static unsigned long
+wq_get_items (struct work_queue *wq)
+{
+  return listcount (wq->items) + work_queue_inflight (wq);
+}
+
+static unsigned long
+wq_get_runs (struct work_queue *wq)
+{
+  return wq->runs;
+}
+
+static unsigned long
+wq_get_done (struct work_queue *wq)
+{
+  return wq->stats.items;
+}
+
+static unsigned long
+wq_get_latency (struct work_queue *wq)
+{
+  return wq->stats.latency;
+}
+
+void
+work_queue_metrics (struct metrics *m)
+{
+  work_queue_metrics_family (m, "work_queue_items", METRICS_GAUGE,
+			     "Items queued or being processed",
+			     wq_get_items);
+  work_queue_metrics_family (m, "work_queue_runs_total", METRICS_COUNTER,
+			     "Work queue runs", wq_get_runs);
+  work_queue_metrics_family (m, "work_queue_done_total", METRICS_COUNTER,
+			     "Items completed", wq_get_done);
+  work_queue_metrics_family (m, "work_queue_latency_microseconds_total",
+			     METRICS_COUNTER,
+			     "Time from queueing to completion, summed over items",
+			     wq_get_latency);
+}
+
 DEFUN(show_work_queues,
       show_work_queues_cmd,
       "show work-queues",
@@ -172,31 +480,53 @@ DEFUN(show_work_queues,
 {
   struct listnode *node;
   struct work_queue *wq;
+  struct timeval now;
   
+  bane_gettime (BANE_CLK_MONOTONIC, &now);
+
   vty_out (vty, 
-           "%c %8s %5s %8s %21s%s",
+           "%c %8s %5s %8s %21s %8s %13s %8s%s",
            ' ', "List","(ms) ","Q. Runs","Cycle Counts   ",
+           "Items", "Latency (ms)", "Items/s",
            VTY_NEWLINE);
   vty_out (vty,
-           "%c %8s %5s %8s %7s %6s %6s %s%s",
+           "%c %8s %5s %8s %7s %6s %6s %8s %6s %6s %8s %3s %s%s",
            'P',
            "Items",
            "Hold",
            "Total",
            "Best","Gran.","Avg.", 
+           "Done", "Avg.", "Max", "", "Thr",
            "Name", 
            VTY_NEWLINE);
  
   for (ALL_LIST_ELEMENTS_RO ((&work_queues), node, wq))
     {
-      vty_out (vty,"%c %8d %5d %8ld %7d %6d %6u %s%s",
+      unsigned long busy = wq->stats.busy;
+
+      /* count the current busy period too */
+      if (listcount (wq->items) > 0 || work_queue_inflight (wq))
+        busy += wq_usec_since (&wq->stats.busy_since, &now);
+
+      vty_out (vty,"%c %8d %5d %8ld %7d %6d %6u %8lu %6lu %6lu %8lu %3u %s%s",
                (CHECK_FLAG (wq->flags, WQ_UNPLUGGED) ? ' ' : 'P'),
-               listcount (wq->items),
+               listcount (wq->items) + work_queue_inflight (wq),
                wq->spec.hold,
                wq->runs,
                wq->cycles.best, wq->cycles.granularity,
                  (wq->runs) ? 
                    (unsigned int) (wq->cycles.total / wq->runs) : 0,
+               wq->stats.items,
+               (wq->stats.items) ?
+                 wq->stats.latency / wq->stats.items / 1000 : 0,
+               wq->stats.latency_max / 1000,
+               (busy) ?
+                 (unsigned long) (wq->stats.items * 1000000.0 / busy) : 0,
+#ifdef HAVE_LIBPTHREAD
+               (wq->pool) ? wq->pool->count : 0,
+#else
+               0,
+#endif /* HAVE_LIBPTHREAD */
                wq->name,
                VTY_NEWLINE);
     }
@@ -230,6 +560,125 @@ work_queue_unplug (struct work_queue *wq)
   work_queue_schedule (wq, wq->spec.hold);
 }
 
+#ifdef HAVE_LIBPTHREAD
+/* Take back items from the workers and finish them off as
+ * work_queue_run would have.
+ */
+static int
+work_queue_collect (struct thread *thread)
+{
+  struct work_queue *wq = THREAD_ARG (thread);
+  struct wq_pool *pool = wq->pool;
+  struct work_queue_item *item, *next;
+  unsigned int delay = 0;
+  char buf[64];
+
+  pool->t_read = NULL;
+
+  while (read (pool->fds[0], buf, sizeof (buf)) > 0)
+    ;
+
+  pthread_mutex_lock (&pool->mtx);
+  item = pool->done;
+  pool->done = pool->done_tail = NULL;
+  pthread_mutex_unlock (&pool->mtx);
+
+  for (; item; item = next)
+    {
+      next = item->next;
+      pool->inflight--;
+
+      switch (item->ret)
+        {
+        case WQ_QUEUE_BLOCKED:
+          item->ran--;
+        case WQ_RETRY_LATER:
+          /* the rest of the queue is already with the workers, so
+           * just hold off handing out more */
+          delay = wq->spec.hold;
+          listnode_add (wq->items, item);
+          break;
+        case WQ_REQUEUE:
+          item->ran--;
+          listnode_add (wq->items, item);
+          break;
+        case WQ_RETRY_NOW:
+        case WQ_ERROR:
+          if (wq->spec.errorfunc)
+            wq->spec.errorfunc (wq, item);
+          /* fall through */
+        case WQ_SUCCESS:
+        default:
+          work_queue_item_done (wq, item);
+          break;
+        }
+    }
+
+  if (pool->inflight)
+    pool->t_read = thread_add_read (wq->master, work_queue_collect,
+                                    wq, pool->fds[0]);
+
+  work_queue_run_done (wq, delay);
+  return 0;
+}
+
+/* Hand items out to the workers, up to WQ_POOL_BATCH each. */
+static void
+work_queue_dispatch (struct work_queue *wq)
+{
+  struct wq_pool *pool = wq->pool;
+  struct work_queue_item *item, *head = NULL, *tail = NULL;
+  struct listnode *node, *nnode;
+  unsigned int cycles = 0;
+
+  for (ALL_LIST_ELEMENTS (wq->items, node, nnode, item))
+    {
+      if (pool->inflight >= pool->count * WQ_POOL_BATCH)
+        break;
+
+      assert (item && item->data);
+
+      /* dont run items which are past their allowed retries */
+      if (item->ran > wq->spec.max_retries)
+        {
+          if (wq->spec.errorfunc)
+            wq->spec.errorfunc (wq, item->data);
+          work_queue_item_remove (wq, node);
+          continue;
+        }
+
+      list_delete_node (wq->items, node);
+      item->next = NULL;
+      if (tail)
+        tail->next = item;
+      else
+        head = item;
+      tail = item;
+      pool->inflight++;
+      cycles++;
+    }
+
+  if (head)
+    {
+      pthread_mutex_lock (&pool->mtx);
+      if (pool->todo_tail)
+        pool->todo_tail->next = head;
+      else
+        pool->todo = head;
+      pool->todo_tail = tail;
+      pthread_cond_broadcast (&pool->cond);
+      pthread_mutex_unlock (&pool->mtx);
+    }
+
+  if (pool->inflight && !pool->t_read)
+    pool->t_read = thread_add_read (wq->master, work_queue_collect,
+                                    wq, pool->fds[0]);
+
+  wq->runs++;
+  wq->cycles.total += cycles;
+}
+#endif /* HAVE_LIBPTHREAD */
+
 /* timer thread to process a work queue
  * will reschedule itself if required,
  * otherwise work_queue_item_add 
@@ -249,6 +698,26 @@ work_queue_run (struct thread *thread)
 
   assert (wq && wq->items);
 
+#ifdef HAVE_LIBPTHREAD
+  /* (re)start the workers if spec.workers changed, once they are idle */
+  if (wq->pool && wq->pool->workers != wq->spec.workers
+      && !wq->pool->inflight)
+    wq_pool_stop (wq);
+  if (!wq->pool && wq->spec.workers && !wq_pool_start (wq))
+    {
+      zlog_warn ("%s: %s: running items on the master thread",
+                 __func__, wq->name);
+      wq->spec.workers = 0;
+    }
+
+  if (wq->pool)
+    {
+      work_queue_dispatch (wq);
+      work_queue_run_done (wq, 0);
+      return 0;
+    }
+#endif /* HAVE_LIBPTHREAD */
+
   /* calculate cycle granularity:
    * list iteration == 1 cycle
    * granularity == # cycles between checks whether we should yield.
@@ -373,10 +842,7 @@ stats:
 #endif
   
   /* Is the queue done yet? If it is, call the completion callback. */
-  if (listcount (wq->items) > 0)
-    work_queue_schedule (wq, 0);
-  else if (wq->spec.completion_func)
-    wq->spec.completion_func (wq);
+  work_queue_run_done (wq, 0);
   
   return 0;
 }
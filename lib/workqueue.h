@@ -45,6 +45,11 @@ struct work_queue_item
 {
   void *data;                           /* opaque data */
   unsigned short ran;			/* # of times item has been run */
+
+  /* private, for items handed to worker threads */
+  struct work_queue_item *next;		/* worker pool todo / done lists */
+  wq_item_status ret;			/* result from the worker */
+  struct timeval added;			/* time queued, for latency stats */
 };
 
 #define WQ_UNPLUGGED	(1 << 0) /* available for draining */
@@ -84,6 +89,16 @@ struct work_queue
     unsigned int max_retries;	
 
     unsigned int hold;	/* hold time for first run, in ms */
+
+    /* If non-zero, workfunc is run on this many worker pthreads rather
+     * than on the master thread.  Only for a workfunc which is thread
+     * safe: it may touch nothing but its item data and memory it
+     * allocates, and must not log, which is not safe off the master
+     * thread.
+     * The other callbacks are still run on the master thread as items
+     * come back from the workers.
+     */
+    unsigned int workers;
   } spec;
   
   /* remaining fields should be opaque to users */
@@ -95,6 +110,16 @@ struct work_queue
     unsigned int granularity;
     unsigned long total;
   } cycles;	/* cycle counts */
+
+  struct {
+    unsigned long items;	/* items completed */
+    unsigned long latency;	/* total usecs from queued to completed */
+    unsigned long latency_max;
+    unsigned long busy;		/* total usecs the queue was non-empty */
+    struct timeval busy_since;
+  } stats;
+
+  struct wq_pool *pool;		/* worker threads, see spec.workers */
   
   /* private state */
   u_int16_t flags;		/* user set flag */
@@ -122,4 +147,7 @@ extern void work_queue_unplug (struct work_queue *wq);
 /* Helpers, exported for thread.c and command.c */
 extern int work_queue_run (struct thread *);
 extern struct cmd_element show_work_queues_cmd;
+
+struct metrics;
+extern void work_queue_metrics (struct metrics *);
 #endif /* _BANE_WORK_QUEUE_H */
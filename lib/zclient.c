@@ -54,7 +54,9 @@ zclient_new ()
   zclient = XCALLOC (MTYPE_ZCLIENT, sizeof (struct zclient));
 
   zclient->ibuf = stream_new (KROUTE_MAX_PACKET_SIZ);
+  zclient->rbuf = stream_new (KROUTE_READ_BUFSIZ);
   zclient->obuf = stream_new (KROUTE_MAX_PACKET_SIZ);
+  zclient->bulk = stream_new (KROUTE_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
 
   return zclient;
@@ -70,8 +72,12 @@ zclient_free (struct zclient *zclient)
 {
   if (zclient->ibuf)
     stream_free(zclient->ibuf);
+  if (zclient->rbuf)
+    stream_free(zclient->rbuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->bulk)
+    stream_free(zclient->bulk);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -121,10 +127,17 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_bulk);
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
+  stream_reset(zclient->rbuf);
   stream_reset(zclient->obuf);
+  stream_reset(zclient->bulk);
+  zclient->bulk_count = 0;
+
+  /* A new connection has to agree on them again. */
+  zclient->caps = 0;
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
@@ -268,13 +281,11 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+static int
+zclient_send_stream (struct zclient *zclient, struct stream *s)
 {
-  if (zclient->sock < 0)
-    return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(s),
+		       stream_get_endp(s)))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -292,6 +303,45 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+int
+zclient_send_message(struct zclient *zclient)
+{
+  if (zclient->sock < 0)
+    return -1;
+  /* Routes gathered for a bulk message go first, to keep them in order
+     with whatever is sent after them. */
+  if (zclient->bulk_count && zclient_bulk_flush (zclient) < 0)
+    return -1;
+  return zclient_send_stream (zclient, zclient->obuf);
+}
+
+int
+zclient_bulk_flush (struct zclient *zclient)
+{
+  struct stream *s = zclient->bulk;
+  int ret;
+
+  THREAD_OFF (zclient->t_bulk);
+  if (! zclient->bulk_count || zclient->sock < 0)
+    return 0;
+
+  stream_putw_at (s, zclient->bulk_countp, zclient->bulk_count);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  zclient->bulk_count = 0;
+  ret = zclient_send_stream (zclient, s);
+  stream_reset (s);
+  return ret;
+}
+
+static int
+zclient_bulk_send (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_bulk = NULL;
+  return zclient_bulk_flush (zclient);
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command)
 {
@@ -318,23 +368,22 @@ kroute_message_send (struct zclient *zclient, int command)
   return zclient_send_message(zclient);
 }
 
+/* Say which routes we will announce, if any, and offer the protocol
+   extensions we can use.  kroute answers with those it supports; older
+   versions ignore the offer and never answer. */
 static int
 kroute_hello_send (struct zclient *zclient)
 {
   struct stream *s;
 
-  if (zclient->redist_default)
-    {
-      s = zclient->obuf;
-      stream_reset (s);
-
-      zclient_create_header (s, KROUTE_HELLO);
-      stream_putc (s, zclient->redist_default);
-      stream_putw_at (s, 0, stream_get_endp (s));
-      return zclient_send_message(zclient);
-    }
+  s = zclient->obuf;
+  stream_reset (s);
 
-  return 0;
+  zclient_create_header (s, KROUTE_HELLO);
+  stream_putc (s, zclient->redist_default);
+  stream_putc (s, ZAPI_CAP_BULK);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  return zclient_send_message(zclient);
 }
 
 /* Make connection to kroute daemon. */
@@ -458,30 +507,10 @@ zclient_connect (struct thread *t)
   *
   * XXX: No attention paid to alignment.
   */ 
-int
-zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
-                 struct zapi_ipv4 *api)
+static void
+zapi_ipv4_attr_put (struct stream *s, struct zapi_ipv4 *api)
 {
   int i;
-  int psize;
-  struct stream *s;
-
-  /* Reset stream. */
-  s = zclient->obuf;
-  stream_reset (s);
-  
-  zclient_create_header (s, cmd);
-  
-  /* Put type and nexthop. */
-  stream_putc (s, api->type);
-  stream_putc (s, api->flags);
-  stream_putc (s, api->message);
-  stream_putw (s, api->safi);
-
-  /* Put prefix information. */
-  psize = PSIZE (p->prefixlen);
-  stream_putc (s, p->prefixlen);
-  stream_write (s, (u_char *) & p->prefix, psize);
 
   /* Nexthop, ifindex, distance and metric information. */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
@@ -512,6 +541,107 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
     stream_putc (s, api->distance);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
+}
+
+ /*
+  * Once kroute has agreed to ZAPI_CAP_BULK, runs of routes that differ
+  * only in their prefix are gathered into one KROUTE_IPV4_ROUTE_BULK_ADD
+  * or _DELETE message:
+  *
+  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  * |  Type, Flags, Message, SAFI and everything after the prefix   |
+  * |  in a single route message, as described above                |
+  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  * |         Route count           |
+  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  * |  Prefix length, then Prefix, for each route                   |
+  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  *
+  * The message is sent once the current thread is done, when it is
+  * full, or before anything else is sent to kroute.
+  */
+static int
+zapi_ipv4_route_bulk (u_int16_t cmd, struct zclient *zclient,
+		      struct prefix_ipv4 *p, struct zapi_ipv4 *api)
+{
+  struct stream *s = zclient->obuf;
+  struct stream *b = zclient->bulk;
+  size_t attrlen;
+  int psize;
+
+  if (zclient->sock < 0)
+    return -1;
+
+  /* What the route shares with the others in the message. */
+  stream_reset (s);
+  zclient_create_header (s, cmd);
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  zapi_ipv4_attr_put (s, api);
+  attrlen = stream_get_endp (s);
+
+  psize = PSIZE (p->prefixlen);
+  if (zclient->bulk_count
+      && (zclient->bulk_countp != attrlen
+	  || memcmp (STREAM_DATA (b), STREAM_DATA (s), attrlen)
+	  || STREAM_WRITEABLE (b) < (size_t) 1 + psize))
+    if (zclient_bulk_flush (zclient) < 0)
+      return -1;
+
+  if (! zclient->bulk_count)
+    {
+      stream_reset (b);
+      stream_write (b, STREAM_DATA (s), attrlen);
+      zclient->bulk_countp = attrlen;
+      stream_putw (b, 0);
+      if (! zclient->t_bulk)
+	zclient->t_bulk = thread_add_event (master, zclient_bulk_send,
+					    zclient, 0);
+    }
+
+  stream_putc (b, p->prefixlen);
+  stream_write (b, (u_char *) & p->prefix, psize);
+  zclient->bulk_count++;
+  return 0;
+}
+
+int
+zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
+                 struct zapi_ipv4 *api)
+{
+  int psize;
+  struct stream *s;
+
+  if (CHECK_FLAG (zclient->caps, ZAPI_CAP_BULK))
+    {
+      if (cmd == KROUTE_IPV4_ROUTE_ADD)
+	return zapi_ipv4_route_bulk (KROUTE_IPV4_ROUTE_BULK_ADD,
+				     zclient, p, api);
+      if (cmd == KROUTE_IPV4_ROUTE_DELETE)
+	return zapi_ipv4_route_bulk (KROUTE_IPV4_ROUTE_BULK_DELETE,
+				     zclient, p, api);
+    }
+
+  /* Reset stream. */
+  s = zclient->obuf;
+  stream_reset (s);
+  
+  zclient_create_header (s, cmd);
+  
+  /* Put type and nexthop. */
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+
+  /* Put prefix information. */
+  psize = PSIZE (p->prefixlen);
+  stream_putc (s, p->prefixlen);
+  stream_write (s, (u_char *) & p->prefix, psize);
+
+  zapi_ipv4_attr_put (s, api);
 
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
@@ -817,97 +947,11 @@ kroute_interface_address_read (int type, struct stream *s)
 }
 
 
-/* Kroute client message read function. */
-static int
-zclient_read (struct thread *thread)
+/* Hand the message in zclient->ibuf, its header already read, to the
+   daemon. */
+static void
+zclient_dispatch (struct zclient *zclient, uint16_t command, uint16_t length)
 {
-  size_t already;
-  uint16_t length, command;
-  uint8_t marker, version;
-  struct zclient *zclient;
-
-  /* Get socket to kroute. */
-  zclient = THREAD_ARG (thread);
-  zclient->t_read = NULL;
-
-  /* Read kroute header (if we don't have it already). */
-  if ((already = stream_get_endp(zclient->ibuf)) < KROUTE_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     KROUTE_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	   zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(KROUTE_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
-      already = KROUTE_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(zclient->ibuf, 0);
-
-  /* Fetch header values. */
-  length = stream_getw (zclient->ibuf);
-  marker = stream_getc (zclient->ibuf);
-  version = stream_getc (zclient->ibuf);
-  command = stream_getw (zclient->ibuf);
-  
-  if (marker != KROUTE_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zclient->sock, marker, version);
-      return zclient_failed(zclient);
-    }
-  
-  if (length < KROUTE_HEADER_SIZE) 
-    {
-      zlog_err("%s: socket %d message length %u is less than %d ",
-	       __func__, zclient->sock, length, KROUTE_HEADER_SIZE);
-      return zclient_failed(zclient);
-    }
-
-  /* Length check. */
-  if (length > STREAM_SIZE(zclient->ibuf))
-    {
-      struct stream *ns;
-      zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
-	        __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
-      ns = stream_new(length);
-      stream_copy(ns, zclient->ibuf);
-      stream_free (zclient->ibuf);
-      zclient->ibuf = ns;
-    }
-
-  /* Read rest of kroute packet. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	    zlog_debug("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(length-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
-    }
-
-  length -= KROUTE_HEADER_SIZE;
-
   if (zclient_debug)
     zlog_debug("zclient 0x%p command 0x%x \n", zclient, command);
 
@@ -957,17 +1001,109 @@ zclient_read (struct thread *thread)
       if (zclient->ipv6_route_delete)
 	(*zclient->ipv6_route_delete) (command, zclient, length);
       break;
+    case KROUTE_HELLO:
+      if (length >= 1)
+	zclient->caps = stream_getc (zclient->ibuf);
+      break;
     default:
       break;
     }
+}
 
-  if (zclient->sock < 0)
-    /* Connection was closed during packet processing. */
-    return -1;
+/* Kroute client message read function.  Like kroute's own reader, it
+   takes in all that has arrived and handles the complete messages,
+   a bounded number per call, carrying the rest over in zclient->rbuf. */
+static int
+zclient_read (struct thread *thread)
+{
+  struct zclient *zclient;
+  struct stream *rbuf;
+  size_t start;
+  uint16_t length, command;
+  uint8_t marker, version;
+  int count;
 
-  /* Register read thread. */
-  stream_reset(zclient->ibuf);
-  zclient_event (ZCLIENT_READ, zclient);
+  /* Get socket to kroute. */
+  zclient = THREAD_ARG (thread);
+  zclient->t_read = NULL;
+
+  rbuf = zclient->rbuf;
+  if (STREAM_WRITEABLE (rbuf))
+    {
+      ssize_t nbyte;
+      if (((nbyte = stream_read_try(rbuf, zclient->sock,
+				     STREAM_WRITEABLE (rbuf))) == 0) ||
+	  (nbyte == -1))
+	{
+	  if (zclient_debug)
+	   zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
+	  return zclient_failed(zclient);
+	}
+    }
+
+  for (count = 0; count < KROUTE_READ_MSGS; count++)
+    {
+      if (STREAM_READABLE (rbuf) < KROUTE_HEADER_SIZE)
+	break;
+
+      /* Fetch header values. */
+      start = stream_get_getp (rbuf);
+      length = stream_getw (rbuf);
+      marker = stream_getc (rbuf);
+      version = stream_getc (rbuf);
+      command = stream_getw (rbuf);
+
+      if (marker != KROUTE_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+		   __func__, zclient->sock, marker, version);
+	  return zclient_failed(zclient);
+	}
+
+      if (length < KROUTE_HEADER_SIZE) 
+	{
+	  zlog_err("%s: socket %d message length %u is less than %d ",
+		   __func__, zclient->sock, length, KROUTE_HEADER_SIZE);
+	  return zclient_failed(zclient);
+	}
+
+      /* The rest of it is still to come. */
+      if (STREAM_READABLE (rbuf) < (size_t) length - KROUTE_HEADER_SIZE)
+	{
+	  stream_set_getp (rbuf, start);
+	  break;
+	}
+
+      /* Length check. */
+      if (length > STREAM_SIZE(zclient->ibuf))
+	{
+	  zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
+		    __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
+	  stream_free (zclient->ibuf);
+	  zclient->ibuf = stream_new(length);
+	}
+
+      /* The daemon sees the message alone, as if read by itself. */
+      stream_reset (zclient->ibuf);
+      stream_put (zclient->ibuf, STREAM_DATA (rbuf) + start, length);
+      stream_set_getp (zclient->ibuf, KROUTE_HEADER_SIZE);
+      stream_forward_getp (rbuf, length - KROUTE_HEADER_SIZE);
+
+      zclient_dispatch (zclient, command, length - KROUTE_HEADER_SIZE);
+
+      if (zclient->sock < 0)
+	/* Connection was closed during packet processing. */
+	return -1;
+    }
+
+  stream_pulldown (rbuf);
+
+  /* Register read thread, or come straight back if out of turns with
+     messages perhaps still waiting. */
+  if (count == KROUTE_READ_MSGS)
+    zclient->t_read = thread_add_event (master, zclient_read, zclient, 0);
+  else
+    zclient_event (ZCLIENT_READ, zclient);
 
   return 0;
 }
@@ -31,6 +31,13 @@
 /* For input/output buffer to kroute. */
 #define KROUTE_MAX_PACKET_SIZ          4096
 
+/* Buffer messages are read into, room for as many as a wakeup handles
+   and larger than any one message. */
+#define KROUTE_READ_BUFSIZ             65536
+
+/* Most messages handled in one wakeup, before other work gets a turn. */
+#define KROUTE_READ_MSGS               1000
+
 /* Kroute header size. */
 #define KROUTE_HEADER_SIZE             6
 
@@ -50,6 +57,9 @@ struct zclient
   /* Input buffer for kroute message. */
   struct stream *ibuf;
 
+  /* Data read from kroute, messages not yet handled. */
+  struct stream *rbuf;
+
   /* Output buffer for kroute message. */
   struct stream *obuf;
 
@@ -63,6 +73,16 @@ struct zclient
   /* Thread to write buffered data to kroute. */
   struct thread *t_write;
 
+  /* Capabilities kroute has answered our hello with, ZAPI_CAP_*. */
+  u_char caps;
+
+  /* Routes being gathered into a bulk message, see zapi_ipv4_route(),
+     where their count goes in it and the thread that will send it. */
+  struct stream *bulk;
+  size_t bulk_countp;
+  u_int16_t bulk_count;
+  struct thread *t_bulk;
+
   /* Redistribute information. */
   u_char redist_default;
   u_char redist[KROUTE_ROUTE_MAX];
@@ -90,6 +110,9 @@ struct zclient
 #define ZAPI_MESSAGE_DISTANCE 0x04
 #define ZAPI_MESSAGE_METRIC   0x08
 
+/* Capabilities offered and agreed to in KROUTE_HELLO. */
+#define ZAPI_CAP_BULK         0x01	/* KROUTE_IPV4_ROUTE_BULK_* */
+
 /* Zserv protocol message header */
 struct zserv_header
 {
@@ -148,6 +171,9 @@ extern void zclient_redistribute_default (int command, struct zclient *);
    Returns 0 for success or -1 on an I/O error. */
 extern int zclient_send_message(struct zclient *);
 
+/* Send the routes zapi_ipv4_route() has gathered so far, if any. */
+extern int zclient_bulk_flush (struct zclient *);
+
 /* create header for command, length to be filled in by user later */
 extern void zclient_create_header (struct stream *, uint16_t);
 
@@ -272,6 +272,9 @@ main (int argc, char **argv)
   zlog_default = openzlog (progname, ZLOG_OSPF,
 			   LOG_CONS|LOG_NDELAY|LOG_PID, LOG_DAEMON);
 
+  /* Pool LSAs, which are churned by every refresh. */
+  memory_pool_enable (MTYPE_OSPF_LSA, sizeof (struct ospf_lsa));
+
   /* OSPF master init. */
   ospf_master_init ();
 
@@ -1229,11 +1229,13 @@ ospf_spf_calculate_timer (struct thread *thread)
   struct route_table *new_table, *new_rtrs;
   struct ospf_area *area;
   struct listnode *node, *nnode;
+  struct timeval start, end;
 
   if (IS_DEBUG_OSPF_EVENT)
     zlog_debug ("SPF: Timer (SPF calculation expire)");
 
   ospf->t_spf_calc = NULL;
+  bane_gettime (BANE_CLK_MONOTONIC, &start);
 
   /* Allocate new table tree. */
   new_table = route_table_init ();
@@ -1290,6 +1292,14 @@ ospf_spf_calculate_timer (struct thread *thread)
   if (IS_OSPF_ABR (ospf))
     ospf_abr_task (ospf);
 
+  bane_gettime (BANE_CLK_MONOTONIC, &end);
+  ospf->spf_time_last = (end.tv_sec - start.tv_sec) * 1000000L
+			+ (end.tv_usec - start.tv_usec);
+  ospf->spf_time_total += ospf->spf_time_last;
+  if (ospf->spf_time_max < ospf->spf_time_last)
+    ospf->spf_time_max = ospf->spf_time_last;
+  ospf->spf_runs++;
+
   if (IS_DEBUG_OSPF_EVENT)
     zlog_debug ("SPF: calculation complete");
 
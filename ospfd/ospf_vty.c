@@ -3961,9 +3961,90 @@ show_lsa_detail_adv_router (struct vty *vty, struct ospf *ospf, int type,
     }
 }
 
+/* Cursor of the AS scope part of "show ip ospf database", which holds
+   the external routes and so most of the LSAs.  The LSDB goes away with
+   the instance, so rather than keeping a node the walk remembers the
+   key of the last LSA shown and looks it up again. */
+struct ospf_database_walk
+{
+  int self;
+  int type;
+  int started;
+  struct prefix_ls last;
+};
+
+static int
+show_ip_ospf_database_as_step (struct vty *vty, void *arg)
+{
+  struct ospf_database_walk *walk = arg;
+  struct ospf *ospf;
+  struct route_node *rn;
+  struct ospf_lsa *lsa;
+  int count = 0;
+
+  ospf = ospf_lookup ();
+  if (ospf == NULL)
+    return VTY_WALK_DONE;
+
+  for (; walk->type < OSPF_MAX_LSA; walk->type++, walk->started = 0)
+    {
+      switch (walk->type)
+        {
+          case OSPF_AS_EXTERNAL_LSA:
+#ifdef HAVE_OPAQUE_LSA
+          case OSPF_OPAQUE_AS_LSA:
+#endif /* HAVE_OPAQUE_LSA */
+            break;
+          default:
+            continue;
+        }
+
+      if (walk->started)
+	rn = route_next (route_node_get (AS_LSDB (ospf, walk->type),
+					 (struct prefix *) &walk->last));
+      else if (ospf_lsdb_count_self (ospf->lsdb, walk->type) ||
+	       (!walk->self && ospf_lsdb_count (ospf->lsdb, walk->type)))
+	{
+          vty_out (vty, "                %s%s%s",
+	       show_database_desc[walk->type],
+	       VTY_NEWLINE, VTY_NEWLINE);
+          vty_out (vty, "%s%s", show_database_header[walk->type],
+	       VTY_NEWLINE);
+	  walk->started = 1;
+	  rn = route_top (AS_LSDB (ospf, walk->type));
+	}
+      else
+	continue;
+
+      for (; rn; rn = route_next (rn))
+	{
+	  if ((lsa = rn->info))
+	    show_lsa_summary (vty, lsa, walk->self);
+	  if (++count == VTY_WALK_SLICE)
+	    {
+	      prefix_copy ((struct prefix *) &walk->last, &rn->p);
+	      route_unlock_node (rn);
+	      return VTY_WALK_MORE;
+	    }
+	}
+
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+
+  vty_out (vty, "%s", VTY_NEWLINE);
+  return VTY_WALK_DONE;
+}
+
+static void
+show_ip_ospf_database_as_done (struct vty *vty, void *arg)
+{
+  XFREE (MTYPE_VTY_WALK, arg);
+}
+
 static void
 show_ip_ospf_database_summary (struct vty *vty, struct ospf *ospf, int self)
 {
+  struct ospf_database_walk *walk;
   struct ospf_lsa *lsa;
   struct route_node *rn;
   struct ospf_area *area;
@@ -4001,35 +4082,11 @@ show_ip_ospf_database_summary (struct vty *vty, struct ospf *ospf, int self)
 	}
     }
 
-  for (type = OSPF_MIN_LSA; type < OSPF_MAX_LSA; type++)
-    {
-      switch (type)
-        {
-          case OSPF_AS_EXTERNAL_LSA:
-#ifdef HAVE_OPAQUE_LSA
-          case OSPF_OPAQUE_AS_LSA:
-#endif /* HAVE_OPAQUE_LSA */
-            break;
-          default:
-            continue;
-        }
-      if (ospf_lsdb_count_self (ospf->lsdb, type) ||
-         (!self && ospf_lsdb_count (ospf->lsdb, type)))
-        {
-          vty_out (vty, "                %s%s%s",
-	       show_database_desc[type],
-	       VTY_NEWLINE, VTY_NEWLINE);
-          vty_out (vty, "%s%s", show_database_header[type],
-	       VTY_NEWLINE);
-
-	  LSDB_LOOP (AS_LSDB (ospf, type), rn, lsa)
-	    show_lsa_summary (vty, lsa, self);
-
-          vty_out (vty, "%s", VTY_NEWLINE);
-        }
-    }
-
-  vty_out (vty, "%s", VTY_NEWLINE);
+  walk = XCALLOC (MTYPE_VTY_WALK, sizeof (struct ospf_database_walk));
+  walk->self = self;
+  walk->type = OSPF_MIN_LSA;
+  vty_walk (vty, show_ip_ospf_database_as_step,
+	    show_ip_ospf_database_as_done, walk);
 }
 
 static void
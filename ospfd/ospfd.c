@@ -34,6 +34,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "zclient.h"
 #include "plist.h"
 #include "sockopt.h"
+#include "metrics.h"
 
 #include "ospfd/ospfd.h"
 #include "ospfd/ospf_network.h"
@@ -1634,6 +1635,37 @@ ospf_nbr_nbma_poll_interval_unset (struct ospf *ospf, struct in_addr addr)
   return 1;
 }
 
+static void
+ospf_metrics (struct metrics *m)
+{
+  struct listnode *node;
+  struct ospf *ospf;
+
+  metrics_family (m, "ospf_spf_runs_total", METRICS_COUNTER,
+		  "SPF calculations run");
+  for (ALL_LIST_ELEMENTS_RO (om->ospf, node, ospf))
+    metrics_value (m, ospf->spf_runs,
+		   "router_id", inet_ntoa (ospf->router_id), NULL);
+
+  metrics_family (m, "ospf_spf_microseconds_total", METRICS_COUNTER,
+		  "Time spent in SPF calculations");
+  for (ALL_LIST_ELEMENTS_RO (om->ospf, node, ospf))
+    metrics_value (m, ospf->spf_time_total,
+		   "router_id", inet_ntoa (ospf->router_id), NULL);
+
+  metrics_family (m, "ospf_spf_last_microseconds", METRICS_GAUGE,
+		  "Duration of the last SPF calculation");
+  for (ALL_LIST_ELEMENTS_RO (om->ospf, node, ospf))
+    metrics_value (m, ospf->spf_time_last,
+		   "router_id", inet_ntoa (ospf->router_id), NULL);
+
+  metrics_family (m, "ospf_spf_max_microseconds", METRICS_GAUGE,
+		  "Duration of the longest SPF calculation");
+  for (ALL_LIST_ELEMENTS_RO (om->ospf, node, ospf))
+    metrics_value (m, ospf->spf_time_max,
+		   "router_id", inet_ntoa (ospf->router_id), NULL);
+}
+
 void
 ospf_master_init ()
 {
@@ -1643,4 +1675,6 @@ ospf_master_init ()
   om->ospf = list_new ();
   om->master = thread_master_create ();
   om->start_time = bane_time (NULL);
+
+  metrics_register ("ospf", ospf_metrics);
 }
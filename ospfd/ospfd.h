@@ -243,6 +243,12 @@ struct ospf
   /* Time stamps. */
   struct timeval ts_spf;		/* SPF calculation time stamp. */
 
+  /* SPF run statistics, durations in usecs. */
+  unsigned long spf_runs;
+  unsigned long spf_time_total;
+  unsigned long spf_time_last;
+  unsigned long spf_time_max;
+
   struct list *maxage_lsa;              /* List of MaxAge LSA for deletion. */
   int redistribute;                     /* Num of redistributed protocols. */
 
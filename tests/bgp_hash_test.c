@@ -0,0 +1,274 @@
+#include <kroute.h>
+#include <sys/time.h>
+
+#include "vty.h"
+#include "hash.h"
+#include "jhash.h"
+#include "memory.h"
+#include "privs.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_ecommunity.h"
+
+/* need these to link in libbgp */
+struct kroute_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+/* Spread of the bgpd intern table keys over a table's chains, for the
+   keys bgpd had before they were seeded and the ones it has now.  The
+   attributes are made up to look like a full table's: a few upstream
+   paths through the big transits to a long tail of origins, and the
+   tagging transits do with communities. */
+
+#define DEFAULT_ROUTES 300000
+
+static const as_t transit[] =
+{
+  174, 701, 1299, 2914, 3257, 3320, 3356, 3491,
+  5511, 6453, 6461, 6762, 6830, 7018, 12956, 6939,
+};
+#define TRANSITS (sizeof (transit) / sizeof (transit[0]))
+
+/* The keys as they were. */
+static unsigned int
+old_aspath_key (void *p)
+{
+  struct aspath *aspath = p;
+
+  return jhash (aspath->str, strlen (aspath->str), 2334325);
+}
+
+static unsigned int
+old_community_key (void *p)
+{
+  struct community *com = p;
+  unsigned char *pnt = (unsigned char *) com->val;
+  unsigned int key = 0;
+  int c;
+
+  for (c = 0; c < com->size * 4; c++)
+    key += pnt[c];
+  return key;
+}
+
+static unsigned int
+old_ecommunity_key (void *p)
+{
+  struct ecommunity *ecom = p;
+  unsigned int key = 0;
+  int c;
+
+  for (c = 0; c < ecom->size * ECOMMUNITY_SIZE; c++)
+    key += ecom->val[c];
+  return key;
+}
+
+static unsigned int
+community_key (void *p)
+{
+  return community_hash_make (p);
+}
+
+static int
+community_equal (const void *a, const void *b)
+{
+  return community_cmp (a, b);
+}
+
+/* Skewed towards small numbers, as the origins of a table are. */
+static u_int32_t
+skewed (u_int32_t range)
+{
+  u_int64_t r = random () % 65536;
+
+  return (r * r * r >> 32) * range >> 16;
+}
+
+static char *
+random_aspath (char *buf, size_t size)
+{
+  as_t origin = 1 + skewed (64000);
+  int i, n;
+
+  n = snprintf (buf, size, "%u", transit[random () % 3]);
+  if (random () % 4)
+    n += snprintf (buf + n, size - n, " %u", transit[random () % TRANSITS]);
+  for (i = random () % 3; i > 0; i--)
+    n += snprintf (buf + n, size - n, " %u", 1000 + skewed (40000));
+  for (i = (random () % 10) ? 1 : 2 + random () % 3; i > 0; i--)
+    n += snprintf (buf + n, size - n, " %u", origin);
+  return buf;
+}
+
+/* Location and peering tags of the upstream, and sometimes the
+   origin's own. */
+static char *
+random_community (char *buf, size_t size)
+{
+  as_t as = transit[random () % 3];
+  int n;
+
+  n = snprintf (buf, size, "%u:%u %u:%u", as, 1000 + skewed (200),
+		as, 2 + (unsigned) (random () % 3));
+  if (random () % 3 == 0)
+    n += snprintf (buf + n, size - n, " %u:%u", as, 30000 + skewed (100));
+  if (random () % 4 == 0)
+    snprintf (buf + n, size - n, " %u:%u", 1 + skewed (64000),
+	      (unsigned) (random () % 20) * 10);
+  return buf;
+}
+
+/* Communities whose bytes all add up the same, as a peer could send to
+   put them all in one chain of the additive key. */
+static char *
+crafted_community (char *buf, size_t size, int i)
+{
+  unsigned int a = i & 0xff, b = (i >> 8) & 0xff;
+
+  snprintf (buf, size, "%u:%u %u:%u", a << 8 | b, 0xff - a, 0xff - b,
+	    (unsigned) (random () % 256) << 8 | (0xff - (i >> 16 & 0x7f)));
+  return buf;
+}
+
+static char *
+random_ecommunity (char *buf, size_t size)
+{
+  snprintf (buf, size, "%u:%u", transit[random () % TRANSITS],
+	    1 + skewed (20000));
+  return buf;
+}
+
+static void
+collect_key (struct hash_backet *hb, void *arg)
+{
+  unsigned int **next = arg;
+
+  *(*next)++ = hb->key;
+}
+
+static int
+key_order (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Intern everything in a fresh table keyed with key, and report how
+   the distinct objects fall over its chains.  The table may still be
+   part way through a resize, so the keys are gathered with
+   hash_iterate() and spread over the chains the table is growing
+   into. */
+static void
+report (const char *what, const char *keyname, void **objs, int count,
+	unsigned int (*key) (void *), int (*cmp) (const void *, const void *))
+{
+  struct timeval start, now;
+  struct hash *hash;
+  unsigned int *keys, *next, *chains;
+  unsigned long probes = 0, distinct = 0, n, i;
+  unsigned int longest = 0;
+  double secs;
+  int j;
+
+  hash = hash_create (key, cmp);
+
+  gettimeofday (&start, NULL);
+  for (j = 0; j < count; j++)
+    hash_get (hash, objs[j], hash_alloc_intern);
+  gettimeofday (&now, NULL);
+  secs = (now.tv_sec - start.tv_sec)
+	 + (now.tv_usec - start.tv_usec) / 1000000.0;
+
+  keys = next = XCALLOC (MTYPE_TMP, (hash->count + 1) * sizeof (*keys));
+  chains = XCALLOC (MTYPE_TMP, hash->size * sizeof (*chains));
+  hash_iterate (hash, collect_key, &next);
+  n = next - keys;
+
+  for (i = 0; i < n; i++)
+    chains[keys[i] % hash->size]++;
+  for (i = 0; i < hash->size; i++)
+    {
+      /* finding each object costs its place in the chain */
+      probes += (unsigned long) chains[i] * (chains[i] + 1) / 2;
+      if (chains[i] > longest)
+	longest = chains[i];
+    }
+
+  qsort (keys, n, sizeof (*keys), key_order);
+  for (i = 0; i < n; i++)
+    if (i == 0 || keys[i] != keys[i - 1])
+      distinct++;
+
+  printf ("%-12s %-14s %7lu objects %7u chains %7lu keys  "
+	  "longest %5u  probes %6.2f  %5.3f s\n",
+	  what, keyname, n, hash->size, distinct, longest,
+	  n ? (double) probes / n : 0.0, secs);
+
+  XFREE (MTYPE_TMP, chains);
+  XFREE (MTYPE_TMP, keys);
+  hash_free (hash);
+}
+
+int
+main (int argc, char **argv)
+{
+  int routes = DEFAULT_ROUTES;
+  void **objs;
+  char buf[256];
+  int i;
+
+  if (argc > 1)
+    routes = atoi (argv[1]);
+
+  srandom (1);
+  memory_init ();
+  objs = XCALLOC (MTYPE_TMP, routes * sizeof (void *));
+
+  printf ("%d routes, seed %08x\n", routes, jhash_seed ());
+
+  for (i = 0; i < routes; i++)
+    {
+      objs[i] = aspath_str2aspath (random_aspath (buf, sizeof (buf)));
+      aspath_key_make (objs[i]);
+    }
+  report ("aspath", "fixed jhash", objs, routes, old_aspath_key, aspath_cmp);
+  report ("aspath", "seeded jhash", objs, routes, aspath_key_make,
+	  aspath_cmp);
+  for (i = 0; i < routes; i++)
+    aspath_free (objs[i]);
+
+  for (i = 0; i < routes; i++)
+    objs[i] = community_str2com (random_community (buf, sizeof (buf)));
+  report ("community", "byte sum", objs, routes, old_community_key,
+	  community_equal);
+  report ("community", "seeded jhash", objs, routes, community_key,
+	  community_equal);
+
+  for (i = 0; i < routes; i++)
+    {
+      community_free (objs[i]);
+      objs[i] = community_str2com (crafted_community (buf, sizeof (buf), i));
+    }
+  report ("crafted", "byte sum", objs, routes, old_community_key,
+	  community_equal);
+  report ("crafted", "seeded jhash", objs, routes, community_key,
+	  community_equal);
+  for (i = 0; i < routes; i++)
+    community_free (objs[i]);
+
+  for (i = 0; i < routes; i++)
+    objs[i] = ecommunity_str2com (random_ecommunity (buf, sizeof (buf)),
+				  ECOMMUNITY_ROUTE_TARGET, 0);
+  report ("ecommunity", "byte sum", objs, routes, old_ecommunity_key,
+	  ecommunity_cmp);
+  report ("ecommunity", "seeded jhash", objs, routes, ecommunity_hash_make,
+	  ecommunity_cmp);
+  for (i = 0; i < routes; i++)
+    ecommunity_free ((struct ecommunity **) &objs[i]);
+
+  XFREE (MTYPE_TMP, objs);
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include <kroute.h>
 #include <memory.h>
 #include <buffer.h>
+#include <stream.h>
 
 struct thread_master *master;
 
@@ -34,5 +35,34 @@ main(int argc, char **argv)
     }
   buffer_free(b1);
   buffer_free(b2);
+
+  /* A short stream is copied, a long one queued by reference. */
+  {
+    struct stream *small = stream_new (4096);
+    struct stream *large = stream_new (4096);
+    char *str;
+
+    stream_put (small, "short", 5);
+    stream_put (large, NULL, 2048);
+    b1 = buffer_new (0);
+    buffer_put_stream (b1, small);
+    buffer_put_stream (b1, large);
+    if (STREAM_SHARED (small) || ! STREAM_SHARED (large)
+        || buffer_pending (b1) != 5 + 2048)
+      {
+        fprintf (stderr, "stream queued wrongly\n");
+        return 1;
+      }
+    str = buffer_getstr (b1);
+    if (strncmp (str, "short", 5))
+      {
+        fprintf (stderr, "stream copied wrongly\n");
+        return 1;
+      }
+    XFREE (MTYPE_TMP, str);
+    buffer_free (b1);
+    stream_free (small);
+    stream_free (large);
+  }
   return 0;
 }
@@ -1,6 +1,7 @@
 #include <kroute.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "checksum.h"
 
@@ -486,6 +487,90 @@ in_cksum_rfc(void *parg, int count)
 }
 
 
+/* Check every implementation this CPU has against the reference one. */
+static void
+cross_check (u_char *buffer, int len)
+{
+  u_int16_t ref_in, ref_fl, in, fl;
+  int impl;
+
+  checksum_impl_select (CHECKSUM_IMPL_REFERENCE);
+  ref_in = in_cksum (buffer, len);
+  ref_fl = fletcher_checksum (buffer, len + sizeof (u_int16_t), len);
+
+  for (impl = CHECKSUM_IMPL_REFERENCE + 1; impl < CHECKSUM_IMPL_MAX; impl++)
+    {
+      if (checksum_impl_select (impl) < 0)
+	continue;
+      in = in_cksum (buffer, len);
+      fl = fletcher_checksum (buffer, len + sizeof (u_int16_t), len);
+      if (in != ref_in || fl != ref_fl)
+	{
+	  printf ("%s: in_cksum 0x%04x, reference 0x%04x, "
+		  "fletcher 0x%04x, reference 0x%04x, len %d, at %p\n",
+		  checksum_impl_name (impl), in, ref_in, fl, ref_fl, len,
+		  buffer);
+	  exit (1);
+	}
+    }
+
+  checksum_impl_select (CHECKSUM_IMPL_BEST);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Throughput of each implementation, in MB/s, for packet and LSA sizes. */
+static void
+benchmark (void)
+{
+  static const int sizes[] = { 64, 256, 1500, 4096, 65535 };
+#define BENCH_BYTES (256 * 1024 * 1024)
+  u_char *buffer;
+  struct timeval start;
+  volatile unsigned int sink = 0;
+  double in_rate, fl_rate;
+  int impl, i, n, count;
+
+  buffer = malloc (65535 + sizeof (u_int16_t));
+  for (i = 0; i < 65535; i++)
+    buffer[i] = random ();
+
+  printf ("%-10s %6s %12s %12s\n", "", "bytes", "in_cksum", "fletcher");
+  for (impl = 0; impl < CHECKSUM_IMPL_MAX; impl++)
+    {
+      if (checksum_impl_select (impl) < 0)
+	continue;
+
+      for (i = 0; i < (int) (sizeof (sizes) / sizeof (sizes[0])); i++)
+	{
+	  count = BENCH_BYTES / sizes[i];
+
+	  gettimeofday (&start, NULL);
+	  for (n = 0; n < count; n++)
+	    sink += in_cksum (buffer, sizes[i]);
+	  in_rate = BENCH_BYTES / elapsed (&start) / 1000000;
+
+	  gettimeofday (&start, NULL);
+	  for (n = 0; n < count; n++)
+	    sink += fletcher_checksum (buffer, sizes[i], sizes[i] - 2);
+	  fl_rate = BENCH_BYTES / elapsed (&start) / 1000000;
+
+	  printf ("%-10s %6d %12.0f %12.0f\n", checksum_impl_name (impl),
+		  sizes[i], in_rate, fl_rate);
+	}
+    }
+
+  free (buffer);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -494,13 +579,28 @@ main(int argc, char **argv)
 #define BUFSIZE MAXDATALEN + sizeof(u_int16_t)
   u_char buffer[BUFSIZE];
   int exercise = 0;
+  int i;
 #define EXERCISESTEP 257
   
   srandom (time (NULL));
-  
+
+  if (argc > 1 && strcmp (argv[1], "bench") == 0)
+    {
+      benchmark ();
+      return 0;
+    }
+
+  printf ("checksums by %s", checksum_impl_name (checksum_impl_select
+						  (CHECKSUM_IMPL_BEST)));
+  for (i = CHECKSUM_IMPL_REFERENCE + 1; i < CHECKSUM_IMPL_MAX; i++)
+    if (checksum_impl_select (i) >= 0)
+      printf (", cross-checking %s", checksum_impl_name (i));
+  printf ("\n");
+  checksum_impl_select (CHECKSUM_IMPL_BEST);
+
   while (1) {
     u_int16_t ospfd, isisd, lib, in_csum, in_csum_res, in_csum_rfc;
-    int i,j;
+    int j;
 
     exercise += EXERCISESTEP;
     exercise %= MAXDATALEN;
@@ -512,6 +612,11 @@ main(int argc, char **argv)
         buffer[i + (sizeof (long int) - j)] = (rand >> (j * 8)) & 0xff;
     }
     
+    /* and unaligned, for the tails */
+    cross_check (buffer, exercise);
+    if (exercise > 1)
+      cross_check (buffer + 1, exercise - 1);
+
     in_csum = in_cksum(buffer, exercise);
     in_csum_res = in_cksum_optimized(buffer, exercise);
     in_csum_rfc = in_cksum_rfc(buffer, exercise);
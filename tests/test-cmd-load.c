@@ -0,0 +1,118 @@
+#include <kroute.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "thread.h"
+#include "vty.h"
+#include "command.h"
+#include "memory.h"
+#include "prefix.h"
+#include "filter.h"
+#include "plist.h"
+#include "routemap.h"
+#include "keychain.h"
+
+/* Time reading a large configuration through the command parser, as a
+   daemon does at startup, using the commands of the library. */
+
+struct thread_master *master;
+
+#define DEFAULT_LINES 300000
+
+/* Lists and maps the lines are spread over, so the handlers stay cheap
+   next to the matching. */
+#define LISTS 1000
+
+static void
+write_config (FILE *fp, int lines)
+{
+  int n = 0, seq;
+
+  while (n < lines)
+    {
+      seq = 5 * (n / (4 * LISTS) + 1);
+      switch (random () % 4)
+	{
+	case 0:
+	  fprintf (fp, "ip prefix-list PL%ld seq %d permit 10.%d.%d.0/24 le 32\n",
+		   random () % LISTS, seq, (n >> 8) & 0xff, n & 0xff);
+	  n++;
+	  break;
+	case 1:
+	  fprintf (fp, "access-list AL%ld permit 10.%d.%d.0/24\n",
+		   random () % LISTS, (n >> 8) & 0xff, n & 0xff);
+	  n++;
+	  break;
+	case 2:
+	  fprintf (fp, "route-map RM%ld permit %d\n"
+		   " description map %d\n"
+		   " call RM%ld\n"
+		   " on-match next\n"
+		   "!\n",
+		   random () % LISTS, seq, n, random () % LISTS);
+	  n += 5;
+	  break;
+	case 3:
+	  fprintf (fp, "key chain KC%ld\n"
+		   " key %d\n"
+		   "  key-string secret%d\n"
+		   "  send-lifetime 00:00:00 1 jan 2020 infinite\n"
+		   "!\n",
+		   random () % LISTS, n, n);
+	  n += 5;
+	  break;
+	}
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timeval start, now;
+  struct vty *vty;
+  double secs;
+  FILE *fp;
+  int lines = DEFAULT_LINES;
+  int ret;
+
+  if (argc > 1)
+    lines = atoi (argv[1]);
+
+  srandom (1);
+  master = thread_master_create ();
+  cmd_init (1);
+  vty_init (master);
+  memory_init ();
+  access_list_init ();
+  prefix_list_init ();
+  route_map_init ();
+  route_map_init_vty ();
+  keychain_init ();
+
+  fp = tmpfile ();
+  write_config (fp, lines);
+  rewind (fp);
+
+  vty = vty_new ();
+  vty->fd = 1;
+  vty->type = VTY_TERM;
+  vty->node = CONFIG_NODE;
+
+  gettimeofday (&start, NULL);
+  ret = config_from_file (vty, fp);
+  gettimeofday (&now, NULL);
+
+  secs = (now.tv_sec - start.tv_sec)
+	 + (now.tv_usec - start.tv_usec) / 1000000.0;
+
+  if (ret != CMD_SUCCESS && ret != CMD_ERR_NOTHING_TODO)
+    {
+      printf ("configuration failed, error %d at: %s\n", ret, vty->buf);
+      return 1;
+    }
+
+  printf ("%d lines in %.2f s, %.0f lines/s\n", lines, secs, lines / secs);
+
+  fclose (fp);
+  return 0;
+}
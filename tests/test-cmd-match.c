@@ -0,0 +1,277 @@
+#include <kroute.h>
+#include <stdlib.h>
+
+#include "thread.h"
+#include "vty.h"
+#include "command.h"
+#include "memory.h"
+#include "prefix.h"
+#include "filter.h"
+#include "plist.h"
+#include "routemap.h"
+#include "keychain.h"
+#include "if.h"
+#include "if_rmap.h"
+#include "distribute.h"
+
+/* Match lines made from every installed command both down the command
+   trie and by filtering the command vector, and fail if the two ever
+   pick different results.  The lines take each keyword in full or
+   abbreviated, each alternative, values in and out of range and of the
+   right and wrong form, optional words given or left out, none to a
+   few vararg words, and are cut short or run on. */
+
+struct thread_master *master;
+
+/* The library's nodes, indexed by node type. */
+extern vector cmdvec;
+
+#define DEFAULT_SEED 1
+#define VARIANTS 40
+#define LINE_MAX_LEN 1024
+
+/* Commands for a daemon node, so its lists are matched too. */
+static struct cmd_node rip_node =
+{
+  RIP_NODE,
+  "%s(config-router)# ",
+  1
+};
+
+/* Every keyword of every command, to give variables words that look
+   like commands. */
+static vector keywords;
+
+static unsigned long lines;
+static unsigned long failed;
+
+static const char *
+random_keyword (void)
+{
+  return vector_slot (keywords, random () % vector_active (keywords));
+}
+
+static void
+collect_keywords (void)
+{
+  struct cmd_node *cnode;
+  struct cmd_element *cmd;
+  struct desc *desc;
+  vector descvec;
+  unsigned int i, j, k, l;
+
+  keywords = vector_init (VECTOR_MIN_SIZE);
+  for (i = 0; i < vector_active (cmdvec); i++)
+    if ((cnode = vector_slot (cmdvec, i)) != NULL)
+      for (j = 0; j < vector_active (cnode->cmd_vector); j++)
+	if ((cmd = vector_slot (cnode->cmd_vector, j)) != NULL)
+	  for (k = 0; k < vector_active (cmd->strvec); k++)
+	    {
+	      descvec = vector_slot (cmd->strvec, k);
+	      for (l = 0; l < vector_active (descvec); l++)
+		{
+		  desc = vector_slot (descvec, l);
+		  if (desc->cmd && islower ((int) desc->cmd[0]))
+		    vector_set (keywords, desc->cmd);
+		}
+	    }
+}
+
+/* Append one word for the token str to line. */
+static void
+add_word (char *line, const char *str)
+{
+  char word[64];
+  unsigned long min, max;
+
+  /* An empty alternative, as in "(8|)", is given by no word. */
+  if (str[0] == '\0')
+    return;
+
+  word[0] = '\0';
+  if (CMD_RANGE (str) && sscanf (str, "<%lu-%lu>", &min, &max) == 2)
+    {
+      switch (random () % 5)
+	{
+	case 0:
+	  snprintf (word, sizeof (word), "%lu", min);
+	  break;
+	case 1:
+	  snprintf (word, sizeof (word), "%lu", max);
+	  break;
+	case 2:
+	  snprintf (word, sizeof (word), "%lu", max + 1);
+	  break;
+	case 3:
+	  snprintf (word, sizeof (word), "%s", random_keyword ());
+	  break;
+	default:
+	  snprintf (word, sizeof (word), "%lu",
+		    min + random () % (max - min + 1));
+	  break;
+	}
+    }
+  else if (CMD_IPV4 (str) || CMD_IPV4_PREFIX (str))
+    {
+      static const char *forms[] =
+	{ "10.1.2.3", "10.1.", "300.1.1.1", "10.0.0.0/8", "10.0.0.0/",
+	  "10.0.0.0/33", "192.168.1.0/24", "2001:db8::1" };
+      snprintf (word, sizeof (word), "%s", forms[random () % 8]);
+    }
+  else if (CMD_IPV6 (str) || CMD_IPV6_PREFIX (str))
+    {
+      static const char *forms[] =
+	{ "2001:db8::1", "2001:", "2001:db8::/32", "2001:db8::/",
+	  "::/0", "fe80::1/129", "10.1.2.3", "::" };
+      snprintf (word, sizeof (word), "%s", forms[random () % 8]);
+    }
+  else if (CMD_VARIABLE (str) || CMD_OPTION (str) || CMD_VARARG (str))
+    {
+      switch (random () % 3)
+	{
+	case 0:
+	  snprintf (word, sizeof (word), "%s", random_keyword ());
+	  break;
+	case 1:
+	  snprintf (word, sizeof (word), "%ld", random () % 100000);
+	  break;
+	default:
+	  snprintf (word, sizeof (word), "w%ld", random () % 1000);
+	  break;
+	}
+    }
+  else
+    {
+      switch (random () % 4)
+	{
+	case 0:
+	  /* Abbreviated. */
+	  snprintf (word, sizeof (word), "%.*s",
+		    (int) (1 + random () % strlen (str)), str);
+	  break;
+	case 1:
+	  /* Run past the keyword. */
+	  snprintf (word, sizeof (word), "%sx", str);
+	  break;
+	default:
+	  snprintf (word, sizeof (word), "%s", str);
+	  break;
+	}
+    }
+
+  if (line[0])
+    strcat (line, " ");
+  strncat (line, word, LINE_MAX_LEN - strlen (line) - 1);
+}
+
+static void
+check_line (enum node_type node, const char *line, struct cmd_element *cmd)
+{
+  vector vline;
+  int strict;
+
+  vline = cmd_make_strvec (line);
+  if (vline == NULL)
+    return;
+
+  for (strict = 0; strict <= 1; strict++)
+    {
+      lines++;
+      if (cmd_match_check (vline, node, strict) != 0)
+	{
+	  if (failed++ < 20)
+	    printf ("node %d%s: \"%s\" (from \"%s\") matches differently\n",
+		    node, strict ? " strict" : "", line, cmd->string);
+	}
+    }
+  cmd_free_strvec (vline);
+}
+
+static void
+check_command (enum node_type node, struct cmd_element *cmd)
+{
+  char line[LINE_MAX_LEN];
+  vector descvec;
+  struct desc *desc;
+  unsigned int i, n, len;
+  int variant;
+
+  for (variant = 0; variant < VARIANTS; variant++)
+    {
+      line[0] = '\0';
+
+      /* Mostly whole lines, else cut short. */
+      len = vector_active (cmd->strvec);
+      if (random () % 4 == 0)
+	len = random () % (len + 1);
+
+      for (i = 0; i < len; i++)
+	{
+	  descvec = vector_slot (cmd->strvec, i);
+	  desc = vector_slot (descvec, random () % vector_active (descvec));
+
+	  if (CMD_OPTION (desc->cmd) && random () % 2)
+	    break;
+	  if (CMD_VARARG (desc->cmd))
+	    {
+	      for (n = random () % 4; n > 0; n--)
+		add_word (line, desc->cmd);
+	      continue;
+	    }
+	  add_word (line, desc->cmd);
+	}
+
+      if (random () % 8 == 0)
+	add_word (line, random_keyword ());
+
+      check_line (node, line, cmd);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  struct cmd_node *cnode;
+  struct cmd_element *cmd;
+  unsigned int i, j;
+  unsigned long commands = 0;
+  int seed = DEFAULT_SEED;
+
+  if (argc > 1)
+    seed = atoi (argv[1]);
+
+  master = thread_master_create ();
+  cmd_init (1);
+  vty_init (master);
+  memory_init ();
+  access_list_init ();
+  prefix_list_init ();
+  route_map_init ();
+  route_map_init_vty ();
+  keychain_init ();
+  if_init ();
+  install_node (&rip_node, NULL);
+  distribute_list_init (RIP_NODE);
+  if_rmap_init (RIP_NODE);
+
+  collect_keywords ();
+
+  /* After cmd_init(), which seeds from the time. */
+  srandom (seed);
+
+  for (i = 0; i < vector_active (cmdvec); i++)
+    if ((cnode = vector_slot (cmdvec, i)) != NULL)
+      for (j = 0; j < vector_active (cnode->cmd_vector); j++)
+	if ((cmd = vector_slot (cnode->cmd_vector, j)) != NULL)
+	  {
+	    commands++;
+	    check_command (i, cmd);
+	  }
+
+  printf ("seed %d: %lu commands, %lu lines, %lu differ\n",
+	  seed, commands, lines, failed);
+
+  if (commands == 0 || failed)
+    exit (1);
+  return 0;
+}
@@ -30,7 +30,7 @@ print_stream (struct stream *s)
 int
 main (void)
 {
-  struct stream *s;
+  struct stream *s, *c;
   
   s = stream_new (1024);
   
@@ -50,5 +50,14 @@ main (void)
   printf ("l: 0x%x\n", stream_getl (s));
   printf ("q: 0x%lx\n", stream_getq (s));
   
+  /* a clone keeps the shared data alive after the original is freed */
+  c = stream_clone (s);
+  stream_free (s);
+  stream_set_getp (c, 0);
+  
+  print_stream (c);
+  
+  stream_free (c);
+  
   return 0;
 }
@@ -0,0 +1,264 @@
+#include <kroute.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "privs.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+
+/* need these to link in libbgp */
+struct kroute_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+/* A full table: IPv4 prefixes, and an eighth as many IPv6 ones. */
+#define DEFAULT_PREFIXES 600000
+
+/* A node as it was with a whole struct prefix embedded, at the pool's
+   former 16 byte granularity. */
+#define FULL_SIZE(S) ((sizeof (S) + 15) & ~15)
+
+static int
+random_prefixlen (void)
+{
+  long r = random () % 100;
+
+  if (r < 55)
+    return 24;
+  if (r < 60)
+    return 25 + random () % 8;
+  return 8 + random () % 16;
+}
+
+static void
+random_prefix (struct prefix *p, int family)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = family;
+  if (family == AF_INET)
+    {
+      p->prefixlen = random_prefixlen ();
+      p->u.prefix4.s_addr = htonl ((u_int32_t) random () << 1 ^ random ());
+    }
+  else
+    {
+      /* 2000::/3, mostly /48 */
+      p->prefixlen = (random () % 4) ? 48 : 32 + random () % 33;
+      p->u.prefix6.s6_addr[0] = 0x20 | (random () & 0x1f);
+      p->u.prefix6.s6_addr[1] = random ();
+      p->u.prefix6.s6_addr[2] = random ();
+      p->u.prefix6.s6_addr[3] = random ();
+      p->u.prefix6.s6_addr[4] = random ();
+      p->u.prefix6.s6_addr[5] = random ();
+    }
+  apply_mask (p);
+}
+
+/* Marks the nodes for prefixes put in, as a daemon's info would. */
+static int inserted;
+
+static int failed;
+
+static void
+insert (struct route_table *rt, struct bgp_table *bt, struct prefix *p,
+	unsigned long *distinct)
+{
+  struct route_node *rn;
+  struct bgp_node *bn;
+
+  rn = route_node_get (rt, p);
+  if (rn->info == NULL)
+    {
+      rn->info = &inserted;
+      (*distinct)++;
+    }
+  bn = bgp_node_get (bt, p);
+  bn->info = &inserted;
+}
+
+/* Every prefix put in must be found again, whole, in both tables. */
+static void
+check_lookup (struct route_table *rt, struct bgp_table *bt, struct prefix *p)
+{
+  struct route_node *rn;
+  struct bgp_node *bn;
+  char buf[BUFSIZ];
+
+  rn = route_node_lookup (rt, p);
+  if (rn == NULL || ! prefix_same (&rn->p, p))
+    {
+      prefix2str (p, buf, sizeof (buf));
+      if (failed++ < 10)
+	printf ("route table lost %s\n", buf);
+    }
+  if (rn)
+    route_unlock_node (rn);
+
+  bn = bgp_node_lookup (bt, p);
+  if (bn == NULL || ! prefix_same (&bn->p, p))
+    {
+      prefix2str (p, buf, sizeof (buf));
+      if (failed++ < 10)
+	printf ("BGP table lost %s\n", buf);
+    }
+  if (bn)
+    bgp_unlock_node (bn);
+}
+
+/* Nodes in a table, and how many of them hold a prefix put in. */
+static unsigned long
+route_nodes_count (struct route_table *rt, unsigned long *marked)
+{
+  struct route_node *rn;
+  unsigned long nodes = 0;
+
+  *marked = 0;
+  for (rn = route_top (rt); rn; rn = route_next (rn))
+    {
+      nodes++;
+      if (rn->info)
+	(*marked)++;
+    }
+  return nodes;
+}
+
+static unsigned long
+bgp_nodes_count (struct bgp_table *bt, unsigned long *marked)
+{
+  struct bgp_node *bn;
+  unsigned long nodes = 0;
+
+  *marked = 0;
+  for (bn = bgp_table_top (bt); bn; bn = bgp_route_next (bn))
+    {
+      nodes++;
+      if (bn->info)
+	(*marked)++;
+    }
+  return nodes;
+}
+
+/* Check the nodes of type are allocated at size, that there are as many
+   as the table holds and that those put in are all there, then print
+   what they take against a whole struct prefix each. */
+static unsigned long
+report (const char *what, int type, size_t size, size_t full,
+	unsigned long nodes, unsigned long marked, unsigned long distinct)
+{
+  unsigned long count = mtype_stats_alloc (type);
+  size_t pooled = mtype_stats_size (type);
+
+  printf ("%-16s %8lu nodes x %3zu bytes = %8.1f MB  (full prefix: %3zu "
+	  "bytes, %8.1f MB)\n", what, count, pooled,
+	  count * pooled / 1048576.0, full, count * full / 1048576.0);
+
+  if (pooled != size)
+    {
+      printf ("%s: allocated at %zu bytes, not %zu\n", what, pooled, size);
+      failed++;
+    }
+  if (count != nodes)
+    {
+      printf ("%s: %lu allocated, %lu in the table\n", what, count, nodes);
+      failed++;
+    }
+  if (marked != distinct)
+    {
+      printf ("%s: %lu prefixes put in, %lu in the table\n",
+	      what, distinct, marked);
+      failed++;
+    }
+  return count * (full - pooled);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct route_table *rt4, *rt6;
+  struct bgp_table *bt4, *bt6;
+  unsigned long saved = 0;
+  unsigned long distinct4 = 0, distinct6 = 0, nodes, marked;
+  struct prefix p;
+  int count = DEFAULT_PREFIXES;
+  unsigned int seed;
+  int i;
+
+  if (argc > 1)
+    count = atoi (argv[1]);
+  seed = (argc > 2) ? (unsigned int) atoi (argv[2]) : time (NULL);
+
+  /* as bgpd does */
+  memory_pool_enable (MTYPE_BGP_NODE, BGP_NODE_SIZE (AF_INET));
+  memory_pool_enable (MTYPE_BGP_NODE_IPV6, BGP_NODE_SIZE (AF_INET6));
+
+  rt4 = route_table_init ();
+  rt6 = route_table_init ();
+  bt4 = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  bt6 = bgp_table_init (AFI_IP6, SAFI_UNICAST);
+
+  srandom (seed);
+  for (i = 0; i < count; i++)
+    {
+      random_prefix (&p, AF_INET);
+      insert (rt4, bt4, &p, &distinct4);
+      if (i % 8 == 0)
+	{
+	  random_prefix (&p, AF_INET6);
+	  insert (rt6, bt6, &p, &distinct6);
+	}
+    }
+
+  /* The same prefixes again. */
+  srandom (seed);
+  for (i = 0; i < count; i++)
+    {
+      random_prefix (&p, AF_INET);
+      check_lookup (rt4, bt4, &p);
+      if (i % 8 == 0)
+	{
+	  random_prefix (&p, AF_INET6);
+	  check_lookup (rt6, bt6, &p);
+	}
+    }
+
+  printf ("%d IPv4 and %d IPv6 prefixes in a route and a BGP table each, "
+	  "seed %u\n", count, (count + 7) / 8, seed);
+  nodes = route_nodes_count (rt4, &marked);
+  saved += report ("route node", MTYPE_ROUTE_NODE,
+		   ROUTE_NODE_SIZE (AF_INET), FULL_SIZE (struct route_node),
+		   nodes, marked, distinct4);
+  nodes = route_nodes_count (rt6, &marked);
+  saved += report ("route node IPv6", MTYPE_ROUTE_NODE_IPV6,
+		   ROUTE_NODE_SIZE (AF_INET6), FULL_SIZE (struct route_node),
+		   nodes, marked, distinct6);
+  nodes = bgp_nodes_count (bt4, &marked);
+  saved += report ("BGP node", MTYPE_BGP_NODE,
+		   BGP_NODE_SIZE (AF_INET), FULL_SIZE (struct bgp_node),
+		   nodes, marked, distinct4);
+  nodes = bgp_nodes_count (bt6, &marked);
+  saved += report ("BGP node IPv6", MTYPE_BGP_NODE_IPV6,
+		   BGP_NODE_SIZE (AF_INET6), FULL_SIZE (struct bgp_node),
+		   nodes, marked, distinct6);
+  printf ("saved %.1f MB\n", saved / 1048576.0);
+
+  /* IPv6 nodes keep the whole prefix. */
+  if (ROUTE_NODE_SIZE (AF_INET6)
+      != offsetof (struct route_node, p) + sizeof (struct prefix)
+      || BGP_NODE_SIZE (AF_INET6)
+	 != offsetof (struct bgp_node, p) + sizeof (struct prefix))
+    {
+      printf ("IPv6 nodes not allocated with a whole prefix\n");
+      failed++;
+    }
+
+  if (failed)
+    {
+      printf ("%d failures\n", failed);
+      exit (1);
+    }
+  return 0;
+}
@@ -0,0 +1,430 @@
+#include <kroute.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "thread.h"
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+#define DEFAULT_PREFIXES 500000
+#define LOOKUPS 2000000
+
+/* Prefix length mix roughly like a full Internet table: mostly /24,
+   with the rest spread over /8 - /23. */
+static int
+random_prefixlen (void)
+{
+  long r = random () % 100;
+
+  if (r < 55)
+    return 24;
+  if (r < 60)
+    return 25 + random () % 8;
+  return 8 + random () % 16;
+}
+
+static void
+random_prefix (struct prefix_ipv4 *p)
+{
+  p->family = AF_INET;
+  p->prefixlen = random_prefixlen ();
+  p->prefix.s_addr = htonl ((u_int32_t) random () << 1 ^ random ());
+  apply_mask_ipv4 (p);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Look the same addresses up in both tables and fail on any
+   difference. */
+static void
+verify (struct route_table *plain, struct route_table *indexed,
+	struct prefix_ipv4 *addrs, int count, const char *what)
+{
+  struct route_node *a, *b;
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      a = route_node_match (plain, (struct prefix *) &addrs[i]);
+      b = route_node_match (indexed, (struct prefix *) &addrs[i]);
+
+      if ((a == NULL) != (b == NULL)
+	  || (a && prefix_same (&a->p, &b->p) == 0))
+	{
+	  char buf[BUFSIZ], abuf[BUFSIZ] = "none", bbuf[BUFSIZ] = "none";
+
+	  prefix2str ((struct prefix *) &addrs[i], buf, sizeof (buf));
+	  if (a)
+	    prefix2str (&a->p, abuf, sizeof (abuf));
+	  if (b)
+	    prefix2str (&b->p, bbuf, sizeof (bbuf));
+	  printf ("%s: mismatch for %s: %s vs %s\n", what, buf, abuf, bbuf);
+	  exit (1);
+	}
+      if (a)
+	route_unlock_node (a);
+      if (b)
+	route_unlock_node (b);
+    }
+}
+
+static double
+benchmark (struct route_table *table, struct prefix_ipv4 *addrs, int count)
+{
+  struct route_node *rn;
+  struct timeval start;
+  int i;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < count; i++)
+    if ((rn = route_node_match (table, (struct prefix *) &addrs[i])))
+      route_unlock_node (rn);
+  return count / elapsed (&start);
+}
+
+static void set_route (struct route_table *, struct prefix_ipv4 *, int);
+static void route_counted (struct route_table *, int);
+
+#ifdef HAVE_LIBPTHREAD
+/* Reader threads walk and match in a table while the master thread
+   withdraws and re-adds routes under them.  A node freed too early
+   shows up as a node of the wrong table or family, or a match that
+   does not cover the address.  Every walk must end up consistent,
+   from the live table or, failing that, a snapshot.  The default
+   route's info carries the number of other routes, so a snapshot
+   can be checked against it. */
+#define READERS 2
+#define READ_TRIES 3
+
+struct reader_arg
+{
+  pthread_t thread;
+  struct route_table *table;
+  struct prefix_ipv4 *addrs;
+  int stop;
+  unsigned long walks, stable, snapshots, nodes, matches, bad;
+};
+
+/* Kept in the info of the default route while readers run. */
+static struct route_node *route_count;
+static unsigned long routes;
+static int readers_running;
+
+/* Walk table, counting the routes other than the default. */
+static unsigned long
+reader_walk (struct reader_arg *ra, struct route_table *table,
+	     unsigned long *count)
+{
+  struct route_node *rn;
+  unsigned long found = 0;
+
+  *count = 0;
+  for (rn = route_read_top (table); rn; rn = route_read_next (rn))
+    {
+      if (rn->table != table || rn->p.family != AF_INET
+	  || rn->p.prefixlen > IPV4_MAX_BITLEN)
+	ra->bad++;
+      else if (rn->p.prefixlen == 0 && rn->info)
+	*count = (uintptr_t) rn->info - 1;
+      else if (rn->info)
+	found++;
+      ra->nodes++;
+    }
+  return found;
+}
+
+static void *
+reader_run (void *arg)
+{
+  struct reader_arg *ra = arg;
+  struct route_reader *reader = route_reader_get ();
+  struct route_table *snap;
+  struct route_node *rn;
+  unsigned long version, count;
+  int i = 0, n, tries;
+
+  while (! __atomic_load_n (&ra->stop, __ATOMIC_ACQUIRE))
+    {
+      route_read_lock (reader);
+      for (tries = 0; tries < READ_TRIES; tries++)
+	{
+	  version = route_read_version (ra->table);
+	  reader_walk (ra, ra->table, &count);
+	  if (! (version & 1) && version == route_read_version (ra->table))
+	    break;
+	}
+      if (tries < READ_TRIES)
+	ra->stable++;
+      else
+	{
+	  snap = route_read_snapshot (reader, ra->table);
+	  if (reader_walk (ra, snap, &count) != count)
+	    ra->bad++;
+	  route_read_snapshot_done (reader);
+	  ra->snapshots++;
+	}
+
+      for (n = 0; n < 10000; n++, i = (i + 1) % LOOKUPS)
+	if ((rn = route_read_match (ra->table,
+				    (struct prefix *) &ra->addrs[i])))
+	  {
+	    if (rn->table != ra->table
+		|| ! prefix_match (&rn->p, (struct prefix *) &ra->addrs[i]))
+	      ra->bad++;
+	    ra->matches++;
+	  }
+      route_read_unlock (reader);
+      ra->walks++;
+    }
+
+  route_reader_put (reader);
+  __atomic_sub_fetch (&readers_running, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/* Keep the event loop turning while readers may still ask for
+   snapshots. */
+static int
+readers_poll (struct thread *thread)
+{
+  if (__atomic_load_n (&readers_running, __ATOMIC_ACQUIRE))
+    thread_add_timer_msec (master, readers_poll, NULL, 10);
+  return 0;
+}
+
+static void
+test_readers (struct route_table *table, struct prefix_ipv4 *prefixes,
+	      int count, struct prefix_ipv4 *addrs)
+{
+  struct reader_arg ra[READERS];
+  struct prefix_ipv4 deflt;
+  struct route_node *rn;
+  struct thread t;
+  struct timeval start;
+  unsigned long bad = 0;
+  int r, i, pass;
+
+  routes = 0;
+  for (rn = route_top (table); rn; rn = route_next (rn))
+    if (rn->info)
+      routes++;
+  memset (&deflt, 0, sizeof (deflt));
+  deflt.family = AF_INET;
+  route_count = route_node_get (table, (struct prefix *) &deflt);
+  route_count->info = (void *) (uintptr_t) (routes + 1);
+
+  memset (ra, 0, sizeof (ra));
+  readers_running = READERS;
+  for (r = 0; r < READERS; r++)
+    {
+      ra[r].table = table;
+      ra[r].addrs = addrs;
+      pthread_create (&ra[r].thread, NULL, reader_run, &ra[r]);
+    }
+
+  /* Add the even prefixes, withdraw the odd ones, put them back and
+     withdraw the even ones again. */
+  gettimeofday (&start, NULL);
+  for (pass = 0; pass < 4; pass++)
+    for (i = (pass == 1 || pass == 2); i < count; i += 2)
+      set_route (table, &prefixes[i], ! (pass & 1));
+  printf ("readers:  %12.0f updates/sec under %d readers\n",
+	  4 * (count / 2) / elapsed (&start), READERS);
+
+  for (r = 0; r < READERS; r++)
+    __atomic_store_n (&ra[r].stop, 1, __ATOMIC_RELEASE);
+  readers_poll (NULL);
+  while (__atomic_load_n (&readers_running, __ATOMIC_ACQUIRE)
+	 && thread_fetch (master, &t))
+    thread_call (&t);
+
+  for (r = 0; r < READERS; r++)
+    {
+      pthread_join (ra[r].thread, NULL);
+      printf ("reader %d: %lu walks, %lu unchanged, %lu from snapshots, "
+	      "%lu nodes, %lu matches\n", r, ra[r].walks, ra[r].stable,
+	      ra[r].snapshots, ra[r].nodes, ra[r].matches);
+      bad += ra[r].bad;
+      if (ra[r].walks == 0 || ra[r].stable + ra[r].snapshots != ra[r].walks)
+	{
+	  printf ("reader %d: %lu of %lu walks consistent\n", r,
+		  ra[r].stable + ra[r].snapshots, ra[r].walks);
+	  exit (1);
+	}
+    }
+
+  route_count->info = NULL;
+  route_unlock_node (route_count);
+  route_count = NULL;
+
+  /* What the readers held, snapshots included, is freed from the
+     event loop. */
+  while ((mtype_stats_alloc (MTYPE_ROUTE_DEFER)
+	  || mtype_stats_alloc (MTYPE_ROUTE_TABLE) > 2)
+	 && thread_fetch (master, &t))
+    thread_call (&t);
+  if (bad || mtype_stats_alloc (MTYPE_ROUTE_DEFER))
+    {
+      printf ("readers: %lu bad nodes, %lu deferred frees left\n",
+	      bad, mtype_stats_alloc (MTYPE_ROUTE_DEFER));
+      exit (1);
+    }
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* Keep the count in the default route up to date. */
+static void
+route_counted (struct route_table *table, int change)
+{
+#ifdef HAVE_LIBPTHREAD
+  if (route_count && route_count->table == table)
+    {
+      routes += change;
+      route_count->info = (void *) (uintptr_t) (routes + 1);
+    }
+#endif /* HAVE_LIBPTHREAD */
+}
+
+static void
+set_route (struct route_table *table, struct prefix_ipv4 *p, int add)
+{
+  struct route_node *rn;
+
+  if (add)
+    {
+      rn = route_node_get (table, (struct prefix *) p);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	{
+	  rn->info = table;
+	  route_counted (table, 1);
+	}
+      return;
+    }
+
+  rn = route_node_lookup (table, (struct prefix *) p);
+  if (rn && rn->info)
+    {
+      rn->info = NULL;
+      route_counted (table, -1);
+      route_unlock_node (rn);
+      route_unlock_node (rn);
+    }
+  else if (rn)
+    route_unlock_node (rn);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct route_table *plain, *indexed;
+  struct prefix_ipv4 *prefixes, *addrs;
+  int count = DEFAULT_PREFIXES;
+  unsigned int seed = time (NULL);
+  int i;
+
+  /* usage: testtable [prefixes [seed]] */
+  if (argc > 1)
+    count = atoi (argv[1]);
+  if (argc > 2)
+    seed = strtoul (argv[2], NULL, 10);
+
+  /* A failure can be replayed with the seed it printed. */
+  printf ("seed %u\n", seed);
+  srandom (seed);
+
+  master = thread_master_create ();
+  route_read_init (master);
+
+  plain = route_table_init ();
+  indexed = route_table_init ();
+  route_table_index_enable (indexed);
+
+  prefixes = malloc (sizeof (struct prefix_ipv4) * count);
+  addrs = malloc (sizeof (struct prefix_ipv4) * LOOKUPS);
+
+  for (i = 0; i < count; i++)
+    {
+      random_prefix (&prefixes[i]);
+      set_route (plain, &prefixes[i], 1);
+      set_route (indexed, &prefixes[i], 1);
+    }
+
+  /* Half the lookups hit inside a known prefix, half are random. */
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      addrs[i].family = AF_INET;
+      addrs[i].prefixlen = IPV4_MAX_BITLEN;
+      addrs[i].prefix.s_addr = htonl ((u_int32_t) random () << 1 ^ random ());
+      if (i & 1)
+	{
+	  struct prefix_ipv4 *p = &prefixes[random () % count];
+	  u_int32_t host = ntohl (addrs[i].prefix.s_addr);
+
+	  host &= p->prefixlen ? ~0U >> p->prefixlen : ~0U;
+	  addrs[i].prefix.s_addr = htonl (ntohl (p->prefix.s_addr) | host);
+	}
+      /* Some matches for a prefix rather than an address. */
+      if (i % 4 == 2)
+	{
+	  addrs[i].prefixlen = random_prefixlen ();
+	  apply_mask_ipv4 (&addrs[i]);
+	}
+    }
+
+  verify (plain, indexed, addrs, LOOKUPS, "insert");
+
+  printf ("%d prefixes, %d lookups\n", count, LOOKUPS);
+  printf ("patricia: %12.0f lookups/sec\n", benchmark (plain, addrs, LOOKUPS));
+  printf ("indexed:  %12.0f lookups/sec\n", benchmark (indexed, addrs, LOOKUPS));
+
+  /* Withdraw every other prefix and check the index follows. */
+  for (i = 0; i < count; i += 2)
+    {
+      set_route (plain, &prefixes[i], 0);
+      set_route (indexed, &prefixes[i], 0);
+    }
+  verify (plain, indexed, addrs, LOOKUPS, "delete");
+
+#ifdef HAVE_LIBPTHREAD
+  /* Churn the indexed table under readers, ending with the same routes
+     as the plain one. */
+  test_readers (indexed, prefixes, count, addrs);
+  verify (plain, indexed, addrs, LOOKUPS, "readers");
+#endif /* HAVE_LIBPTHREAD */
+
+  /* And a default route, which covers every slot. */
+  {
+    struct prefix_ipv4 def;
+
+    memset (&def, 0, sizeof (def));
+    def.family = AF_INET;
+    set_route (plain, &def, 1);
+    set_route (indexed, &def, 1);
+    verify (plain, indexed, addrs, LOOKUPS, "default");
+  }
+
+  route_table_finish (plain);
+  route_table_finish (indexed);
+  free (prefixes);
+  free (addrs);
+
+  printf ("OK\n");
+  return 0;
+}
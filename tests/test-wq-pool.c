@@ -0,0 +1,292 @@
+#include <kroute.h>
+#include <stdlib.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "thread.h"
+#include "memory.h"
+#include "workqueue.h"
+
+/* Run work queues on worker threads and check what comes back to the
+   master thread: every item is finished exactly once, one worker
+   finishes them in the order they were added, retries and requeues
+   come out as they do on the master thread, the pool is restarted when
+   spec.workers changes, and a queue freed with items in flight takes
+   its items and threads with it. */
+
+struct thread_master *master;
+
+#define ITEMS		10000
+#define MAX_RETRIES	3
+
+struct test_item
+{
+  int id;
+  int want_tries;		/* RETRY_NOW until tried this often */
+  int want_requeues;		/* REQUEUE this often first */
+  int tries;
+  int requeues;
+  int finished;
+  int errors;
+  int on_master;
+};
+
+static struct test_item items[ITEMS];
+static int order[ITEMS];
+static int nfinished, nerrors, drained, finished_at_drain;
+static unsigned int slow;	/* usec each run takes */
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_t master_thread;
+
+static wq_item_status
+item_run (struct work_queue *wq, void *data)
+{
+  struct test_item *it = data;
+
+  it->on_master = pthread_equal (pthread_self (), master_thread);
+  if (slow)
+    usleep (slow);
+
+  if (it->requeues < it->want_requeues)
+    {
+      it->requeues++;
+      return WQ_REQUEUE;
+    }
+  if (++it->tries < it->want_tries)
+    return WQ_RETRY_NOW;
+  return WQ_SUCCESS;
+}
+
+static void
+item_error (struct work_queue *wq, struct work_queue_item *item)
+{
+  struct test_item *it = item->data;
+
+  it->errors++;
+  nerrors++;
+}
+
+static void
+item_finished (struct work_queue *wq, void *data)
+{
+  struct test_item *it = data;
+
+  it->finished++;
+  order[nfinished++] = it->id;
+}
+
+static void
+queue_drained (struct work_queue *wq)
+{
+  drained = 1;
+  finished_at_drain = nfinished;
+}
+
+static void
+fail (const char *what, const char *fmt, int a, int b)
+{
+  printf ("%s: FAILED: ", what);
+  printf (fmt, a, b);
+  printf ("\n");
+  exit (1);
+}
+
+static struct work_queue *
+queue_new (unsigned int workers)
+{
+  struct work_queue *wq = work_queue_new (master, "test");
+
+  wq->spec.workfunc = item_run;
+  wq->spec.errorfunc = item_error;
+  wq->spec.del_item_data = item_finished;
+  wq->spec.completion_func = queue_drained;
+  wq->spec.max_retries = MAX_RETRIES;
+  wq->spec.hold = 1;
+  wq->spec.workers = workers;
+  return wq;
+}
+
+/* Queue count items, every requeues'th requeued twice, every retries'th
+   retried once and every fails'th retried past MAX_RETRIES. */
+static void
+queue_items (struct work_queue *wq, int count, int requeues, int retries,
+	     int fails)
+{
+  int i;
+
+  memset (items, 0, sizeof (items));
+  nfinished = nerrors = drained = finished_at_drain = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      items[i].id = i;
+      items[i].want_tries = 1;
+      if (requeues && i % requeues == 0)
+	items[i].want_requeues = 2;
+      if (retries && i % retries == 0)
+	items[i].want_tries = 2;
+      if (fails && i % fails == 0)
+	items[i].want_tries = MAX_RETRIES + 2;
+      work_queue_add (wq, &items[i]);
+    }
+}
+
+static void
+run_until (int *done, int count)
+{
+  struct thread t;
+
+  while (*done < count && thread_fetch (master, &t))
+    thread_call (&t);
+}
+
+/* Every item finished once, after its retries and requeues, and the
+   queue reported drained only after the last one. */
+static void
+check_items (const char *what, int count, int on_master)
+{
+  int i, errors = 0;
+
+  if (nfinished != count || finished_at_drain != count)
+    fail (what, "%d items finished, %d when drained", nfinished,
+	  finished_at_drain);
+
+  for (i = 0; i < count; i++)
+    {
+      struct test_item *it = &items[i];
+      int tries = it->want_tries;
+
+      if (tries > MAX_RETRIES)
+	{
+	  tries = MAX_RETRIES;
+	  errors++;
+	}
+      if (it->finished != 1)
+	fail (what, "item %d finished %d times", i, it->finished);
+      if (it->tries != tries || it->requeues != it->want_requeues)
+	fail (what, "item %d tried %d times", i, it->tries);
+      if (it->errors != (it->want_tries > MAX_RETRIES))
+	fail (what, "item %d had %d errors", i, it->errors);
+      if (it->on_master != on_master)
+	fail (what, "item %d on master thread: %d", i, it->on_master);
+    }
+  if (nerrors != errors)
+    fail (what, "%d errors, wanted %d", nerrors, errors);
+
+  printf ("%s: %d items ok, %d failed\n", what, count, errors);
+}
+
+static void
+test_order (void)
+{
+  struct work_queue *wq = queue_new (1);
+  int i;
+
+  queue_items (wq, ITEMS, 0, 0, 0);
+  run_until (&drained, 1);
+  check_items ("order", ITEMS, 0);
+
+  for (i = 0; i < ITEMS; i++)
+    if (order[i] != i)
+      fail ("order", "item %d finished as %d", i, order[i]);
+  printf ("order: one worker finishes items in order\n");
+
+  work_queue_free (wq);
+}
+
+static void
+test_status (unsigned int workers)
+{
+  struct work_queue *wq = queue_new (workers);
+  char what[32];
+
+  snprintf (what, sizeof (what), "status/%u", workers);
+  queue_items (wq, ITEMS, 7, 5, 11);
+  run_until (&drained, 1);
+  check_items (what, ITEMS, workers == 0);
+
+  work_queue_free (wq);
+}
+
+/* Change spec.workers between runs of the same queue. */
+static void
+test_restart (void)
+{
+  struct work_queue *wq = queue_new (2);
+  unsigned int workers[] = { 0, 3, 1 };
+  unsigned int i;
+
+  slow = 100;
+  queue_items (wq, 500, 0, 0, 0);
+  run_until (&drained, 1);
+  check_items ("restart/2", 500, 0);
+
+  for (i = 0; i < sizeof (workers) / sizeof (workers[0]); i++)
+    {
+      char what[32];
+
+      wq->spec.workers = workers[i];
+      snprintf (what, sizeof (what), "restart/%u", workers[i]);
+      queue_items (wq, 500, 0, 0, 0);
+      run_until (&drained, 1);
+      check_items (what, 500, workers[i] == 0);
+
+      if ((mtype_stats_alloc (MTYPE_WORK_QUEUE_POOL) != 0)
+	  != (workers[i] != 0))
+	fail (what, "%d pool allocations with %d workers",
+	      (int) mtype_stats_alloc (MTYPE_WORK_QUEUE_POOL), workers[i]);
+    }
+  slow = 0;
+
+  work_queue_free (wq);
+}
+
+/* Free a queue while its workers are busy. */
+static void
+test_free (void)
+{
+  struct work_queue *wq = queue_new (4);
+
+  slow = 2000;
+  queue_items (wq, 1000, 0, 0, 0);
+  run_until (&nfinished, 20);
+  printf ("free: freeing the queue with %d of 1000 items finished\n",
+	  nfinished);
+  work_queue_free (wq);
+  slow = 0;
+
+  if (mtype_stats_alloc (MTYPE_WORK_QUEUE_ITEM)
+      || mtype_stats_alloc (MTYPE_WORK_QUEUE_POOL)
+      || mtype_stats_alloc (MTYPE_WORK_QUEUE))
+    fail ("free", "%d items, %d pools left",
+	  (int) mtype_stats_alloc (MTYPE_WORK_QUEUE_ITEM),
+	  (int) mtype_stats_alloc (MTYPE_WORK_QUEUE_POOL));
+  printf ("free: no items, pools or queues left\n");
+}
+#endif /* HAVE_LIBPTHREAD */
+
+int
+main (int argc, char **argv)
+{
+#ifdef HAVE_LIBPTHREAD
+  master = thread_master_create ();
+  master_thread = pthread_self ();
+
+  /* A lost wakeup would otherwise hang the test. */
+  alarm (120);
+
+  test_order ();
+  test_status (0);
+  test_status (1);
+  test_status (4);
+  test_restart ();
+  test_free ();
+
+  printf ("OK\n");
+#else
+  printf ("no pthreads, nothing to test\n");
+#endif /* HAVE_LIBPTHREAD */
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <kroute.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "prefix.h"
+#include "stream.h"
+#include "zclient.h"
+#include "log.h"
+
+/* Replay a full table from a synthetic protocol daemon into a running
+   kroute, then withdraw it, timing each until kroute has redistributed
+   every change back.  The routes are blackholes of type BGP, so run it
+   against a kroute in a scratch network namespace.
+
+   usage: testzapibulk [-s] [-n routes] [zserv path]
+
+   -s sends every route in a message of its own, as clients did before
+   bulk messages. */
+
+struct thread_master *master;
+
+#define DEFAULT_ROUTES 100000
+
+/* Seconds before giving up on a kroute that stopped answering. */
+#define TIMEOUT 600
+
+/* Routes sent per pass, as a daemon's work queue would. */
+#define BATCH 1000
+
+static struct zclient *zclient;
+static int routes = DEFAULT_ROUTES;
+static int single;
+static int adding = 1;
+static int sent, seen;
+static struct timeval start;
+
+static void
+route_prefix (int i, struct prefix_ipv4 *p)
+{
+  p->family = AF_INET;
+  p->prefixlen = 24;
+  p->prefix.s_addr = htonl (((20 + (i >> 16)) << 24) | ((i & 0xffff) << 8));
+}
+
+static double
+elapsed (void)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start.tv_sec)
+	 + (now.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static int
+send_routes (struct thread *thread)
+{
+  struct zapi_ipv4 api;
+  struct prefix_ipv4 p;
+  int n;
+
+  memset (&api, 0, sizeof (api));
+  api.type = KROUTE_ROUTE_BGP;
+  api.flags = KROUTE_FLAG_BLACKHOLE;
+  api.safi = SAFI_UNICAST;
+  SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
+
+  for (n = 0; n < BATCH && sent < routes; n++, sent++)
+    {
+      route_prefix (sent, &p);
+      zapi_ipv4_route (adding ? KROUTE_IPV4_ROUTE_ADD
+		       : KROUTE_IPV4_ROUTE_DELETE, zclient, &p, &api);
+      if (single)
+	zclient_bulk_flush (zclient);
+    }
+
+  if (sent < routes)
+    thread_add_background (master, send_routes, NULL, 0);
+  return 0;
+}
+
+static void
+start_pass (void)
+{
+  sent = seen = 0;
+  gettimeofday (&start, NULL);
+  thread_add_background (master, send_routes, NULL, 0);
+}
+
+/* kroute has answered our hello, so the capabilities are known. */
+static int
+router_id_update (int command, struct zclient *zclient, uint16_t length)
+{
+  static int started;
+
+  if (started++)
+    return 0;
+
+  printf ("kroute %s bulk messages%s\n",
+	  CHECK_FLAG (zclient->caps, ZAPI_CAP_BULK) ? "accepts" : "refuses",
+	  single ? ", not using them" : "");
+  kroute_redistribute_send (KROUTE_REDISTRIBUTE_ADD, zclient,
+			    KROUTE_ROUTE_BGP);
+  start_pass ();
+  return 0;
+}
+
+static int
+route_update (int command, struct zclient *zclient, uint16_t length)
+{
+  if (++seen < routes)
+    return 0;
+
+  printf ("%d routes %s in %.2f s\n", routes, adding ? "added" : "deleted",
+	  elapsed ());
+  if (! adding)
+    exit (0);
+  adding = 0;
+  start_pass ();
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct thread t;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "sn:")) != -1)
+    switch (opt)
+      {
+      case 's':
+	single = 1;
+	break;
+      case 'n':
+	routes = atoi (optarg);
+	break;
+      default:
+	fprintf (stderr, "usage: %s [-s] [-n routes] [zserv path]\n",
+		 argv[0]);
+	return 1;
+      }
+  if (optind < argc)
+    zclient_serv_path_set (argv[optind]);
+
+  master = thread_master_create ();
+  zlog_default = openzlog ("testzapibulk", ZLOG_NONE,
+			   LOG_CONS|LOG_NDELAY|LOG_PID, LOG_DAEMON);
+  zlog_set_level (NULL, ZLOG_DEST_SYSLOG, ZLOG_DISABLED);
+  zlog_set_level (NULL, ZLOG_DEST_STDOUT, LOG_WARNING);
+
+  zclient = zclient_new ();
+  zclient_init (zclient, KROUTE_ROUTE_BGP);
+  zclient->router_id_update = router_id_update;
+  zclient->ipv4_route_add = route_update;
+  zclient->ipv4_route_delete = route_update;
+
+  alarm (TIMEOUT);
+
+  /* zclient would go on retrying a kroute it could not reach or lost. */
+  while (thread_fetch (master, &t))
+    {
+      thread_call (&t);
+      if (zclient->fail)
+	{
+	  fprintf (stderr, "%s: lost or can't reach kroute\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  return 1;
+}
@@ -1628,6 +1628,35 @@ DEFUNSH (VTYSH_ALL,
   return CMD_SUCCESS;
 }
 
+DEFUNSH (VTYSH_ALL,
+	 vtysh_log_async,
+	 vtysh_log_async_cmd,
+	 "log async",
+	 "Logging control\n"
+	 "Write syslog, file and stdout logs from a separate thread\n")
+{
+  return CMD_SUCCESS;
+}
+
+ALIAS_SH (VTYSH_ALL,
+	  vtysh_log_async,
+	  vtysh_log_async_size_cmd,
+	  "log async <16-65536>",
+	  "Logging control\n"
+	  "Write syslog, file and stdout logs from a separate thread\n"
+	  "Number of log messages which may be queued\n")
+
+DEFUNSH (VTYSH_ALL,
+	 no_vtysh_log_async,
+	 no_vtysh_log_async_cmd,
+	 "no log async",
+	 NO_STR
+	 "Logging control\n"
+	 "Write logs synchronously\n")
+{
+  return CMD_SUCCESS;
+}
+
 DEFUNSH (VTYSH_ALL,
 	 vtysh_service_password_encrypt,
 	 vtysh_service_password_encrypt_cmd,
@@ -2474,6 +2503,9 @@ vtysh_init_vty (void)
   install_element (CONFIG_NODE, &no_vtysh_log_record_priority_cmd);
   install_element (CONFIG_NODE, &vtysh_log_timestamp_precision_cmd);
   install_element (CONFIG_NODE, &no_vtysh_log_timestamp_precision_cmd);
+  install_element (CONFIG_NODE, &vtysh_log_async_cmd);
+  install_element (CONFIG_NODE, &vtysh_log_async_size_cmd);
+  install_element (CONFIG_NODE, &no_vtysh_log_async_cmd);
 
   install_element (CONFIG_NODE, &vtysh_service_password_encrypt_cmd);
   install_element (CONFIG_NODE, &no_vtysh_service_password_encrypt_cmd);